@@ -32,6 +32,9 @@ epicsShareFunc void epicsShareAPI printChannelAccessAddressList
 epicsShareFunc void epicsShareAPI removeDuplicateAddresses
     ( struct ELLLIST *pDestList, ELLLIST *pSrcList, int silent);
 
+epicsShareFunc int epicsShareAPI getChannelAccessMulticastGroup
+    ( struct in_addr *pGroup );
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,403 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*
+ *  Compression of large DBR payloads, see caCompress.h
+ *
+ *  The codec writes the LZ4 block format: a sequence of tokens, each
+ *  giving a run of literal bytes followed by a match of at least four
+ *  bytes within the previous 64k.  The last five bytes are always
+ *  literals, as the format requires.
+ */
+
+#include <string.h>
+
+#include "epicsTypes.h"
+
+#define epicsExportSharedSymbols
+#include "db_access.h"
+#include "caCompress.h"
+
+static const unsigned lzHashBits = 12u;
+static const unsigned lzMinMatch = 4u;
+static const unsigned lzLastLiterals = 5u;
+static const unsigned lzMatchStartLimit = 12u;
+static const unsigned lzMaxOffset = 0xffffu;
+static const unsigned hdrSize = 12u; /* on the wire */
+
+static inline epicsUInt32 lzRead32 ( const epicsUInt8 * p )
+{
+    epicsUInt32 v;
+    memcpy ( &v, p, sizeof ( v ) );
+    return v;
+}
+
+static inline unsigned lzHash ( epicsUInt32 seq )
+{
+    return ( seq * 2654435761u ) >> ( 32u - lzHashBits );
+}
+
+static inline epicsUInt8 * lzPutLength ( epicsUInt8 * op, size_t len )
+{
+    while ( len >= 255u ) {
+        *op++ = 255u;
+        len -= 255u;
+    }
+    *op++ = static_cast < epicsUInt8 > ( len );
+    return op;
+}
+
+/*
+ * returns the compressed size, or 0 if it would exceed dstCapacity
+ */
+static unsigned lzCompress ( const epicsUInt8 * pSrc, unsigned srcSize,
+    epicsUInt8 * pDst, unsigned dstCapacity, epicsUInt32 * pTable )
+{
+    const epicsUInt8 * ip = pSrc;
+    const epicsUInt8 * anchor = pSrc;
+    const epicsUInt8 * const iend = pSrc + srcSize;
+    epicsUInt8 * op = pDst;
+    epicsUInt8 * const oend = pDst + dstCapacity;
+    epicsUInt8 * token;
+    size_t litLen;
+
+    if ( srcSize > lzMatchStartLimit ) {
+        const epicsUInt8 * const mflimit = iend - lzMatchStartLimit;
+        const epicsUInt8 * const matchlimit = iend - lzLastLiterals;
+
+        memset ( pTable, 0, sizeof ( *pTable ) << lzHashBits );
+        ip++;
+        while ( ip < mflimit ) {
+            const epicsUInt32 seq = lzRead32 ( ip );
+            const unsigned h = lzHash ( seq );
+            const epicsUInt8 * ref = pSrc + pTable[h];
+            size_t matchLen = lzMinMatch;
+            size_t offset;
+
+            pTable[h] = static_cast < epicsUInt32 > ( ip - pSrc );
+            if ( ref >= ip || static_cast < size_t > ( ip - ref ) > lzMaxOffset ||
+                    lzRead32 ( ref ) != seq ) {
+                /* skip faster through incompressible data */
+                ip += 1u + ( ( ip - anchor ) >> 6u );
+                continue;
+            }
+            while ( ip > anchor && ref > pSrc && ip[-1] == ref[-1] ) {
+                ip--;
+                ref--;
+            }
+            while ( ip + matchLen < matchlimit && ip[matchLen] == ref[matchLen] ) {
+                matchLen++;
+            }
+
+            litLen = ip - anchor;
+            if ( static_cast < size_t > ( oend - op ) <
+                    litLen + litLen / 255u + matchLen / 255u + 5u ) {
+                return 0u;
+            }
+            token = op++;
+            if ( litLen >= 15u ) {
+                *token = 15u << 4u;
+                op = lzPutLength ( op, litLen - 15u );
+            }
+            else {
+                *token = static_cast < epicsUInt8 > ( litLen << 4u );
+            }
+            memcpy ( op, anchor, litLen );
+            op += litLen;
+
+            offset = ip - ref;
+            *op++ = static_cast < epicsUInt8 > ( offset );
+            *op++ = static_cast < epicsUInt8 > ( offset >> 8u );
+            matchLen -= lzMinMatch;
+            if ( matchLen >= 15u ) {
+                *token |= 15u;
+                op = lzPutLength ( op, matchLen - 15u );
+            }
+            else {
+                *token |= static_cast < epicsUInt8 > ( matchLen );
+            }
+
+            ip += matchLen + lzMinMatch;
+            anchor = ip;
+        }
+    }
+
+    litLen = iend - anchor;
+    if ( static_cast < size_t > ( oend - op ) < litLen + litLen / 255u + 2u ) {
+        return 0u;
+    }
+    token = op++;
+    if ( litLen >= 15u ) {
+        *token = 15u << 4u;
+        op = lzPutLength ( op, litLen - 15u );
+    }
+    else {
+        *token = static_cast < epicsUInt8 > ( litLen << 4u );
+    }
+    memcpy ( op, anchor, litLen );
+    op += litLen;
+
+    return static_cast < unsigned > ( op - pDst );
+}
+
+static inline bool lzGetLength ( const epicsUInt8 * & ip,
+    const epicsUInt8 * iend, size_t & len )
+{
+    unsigned s;
+    do {
+        if ( ip >= iend ) {
+            return false;
+        }
+        s = *ip++;
+        len += s;
+    } while ( s == 255u );
+    return true;
+}
+
+/*
+ * returns 0, or -1 if the data are corrupt or do
+ * not expand to exactly dstSize bytes
+ */
+static int lzDecompress ( const epicsUInt8 * ip, unsigned srcSize,
+    epicsUInt8 * pDst, unsigned dstSize )
+{
+    const epicsUInt8 * const iend = ip + srcSize;
+    epicsUInt8 * op = pDst;
+    epicsUInt8 * const oend = pDst + dstSize;
+
+    while ( ip < iend ) {
+        const unsigned token = *ip++;
+        const epicsUInt8 * ref;
+        size_t len = token >> 4u;
+        size_t offset;
+
+        if ( len == 15u && ! lzGetLength ( ip, iend, len ) ) {
+            return -1;
+        }
+        if ( len > static_cast < size_t > ( iend - ip ) ||
+                len > static_cast < size_t > ( oend - op ) ) {
+            return -1;
+        }
+        memcpy ( op, ip, len );
+        ip += len;
+        op += len;
+        if ( ip == iend ) {
+            break;
+        }
+
+        if ( iend - ip < 2 ) {
+            return -1;
+        }
+        offset = ip[0] | ( ip[1] << 8u );
+        ip += 2;
+        if ( offset == 0u || offset > static_cast < size_t > ( op - pDst ) ) {
+            return -1;
+        }
+        len = token & 15u;
+        if ( len == 15u && ! lzGetLength ( ip, iend, len ) ) {
+            return -1;
+        }
+        len += lzMinMatch;
+        if ( len > static_cast < size_t > ( oend - op ) ) {
+            return -1;
+        }
+        ref = op - offset;
+        if ( offset >= len ) {
+            memcpy ( op, ref, len );
+            op += len;
+        }
+        else {
+            while ( len-- ) {
+                *op++ = *ref++;
+            }
+        }
+    }
+    return op == oend ? 0 : -1;
+}
+
+/*
+ * Transpose count big endian elements into elemSize byte planes,
+ * optionally storing the difference to the previous element instead
+ * of each element.
+ */
+static void filterValues ( const epicsUInt8 * pSrc, epicsUInt8 * pDst,
+    unsigned count, unsigned elemSize, bool delta )
+{
+    epicsUInt64 prev = 0u;
+
+    for ( unsigned i = 0u; i < count; i++ ) {
+        epicsUInt64 v = 0u;
+        epicsUInt64 d;
+
+        for ( unsigned b = 0u; b < elemSize; b++ ) {
+            v = ( v << 8u ) | *pSrc++;
+        }
+        d = delta ? v - prev : v;
+        prev = v;
+        for ( unsigned b = elemSize; b-- > 0u; ) {
+            pDst[b * count + i] = static_cast < epicsUInt8 > ( d );
+            d >>= 8u;
+        }
+    }
+}
+
+static void unfilterValues ( const epicsUInt8 * pSrc, epicsUInt8 * pDst,
+    unsigned count, unsigned elemSize, bool delta )
+{
+    epicsUInt64 prev = 0u;
+
+    for ( unsigned i = 0u; i < count; i++ ) {
+        epicsUInt64 v = 0u;
+
+        for ( unsigned b = 0u; b < elemSize; b++ ) {
+            v = ( v << 8u ) | pSrc[b * count + i];
+        }
+        if ( delta ) {
+            v += prev;
+        }
+        prev = v;
+        for ( unsigned b = elemSize; b-- > 0u; ) {
+            pDst[b] = static_cast < epicsUInt8 > ( v );
+            v >>= 8u;
+        }
+        pDst += elemSize;
+    }
+}
+
+static void filterPayload ( const epicsUInt8 * pSrc, epicsUInt8 * pDst,
+    unsigned size, unsigned offset, unsigned elemSize, unsigned filter,
+    bool forward )
+{
+    unsigned count = ( size - offset ) / elemSize;
+    unsigned tail = offset + count * elemSize;
+
+    if ( filter == caCompressFilterNone ) {
+        memcpy ( pDst, pSrc, size );
+        return;
+    }
+    memcpy ( pDst, pSrc, offset );
+    if ( forward ) {
+        filterValues ( pSrc + offset, pDst + offset, count, elemSize,
+            filter == caCompressFilterDeltaShuffle );
+    }
+    else {
+        unfilterValues ( pSrc + offset, pDst + offset, count, elemSize,
+            filter == caCompressFilterDeltaShuffle );
+    }
+    memcpy ( pDst + tail, pSrc + tail, size - tail );
+}
+
+static inline epicsUInt32 getUInt32 ( const epicsUInt8 * p )
+{
+    return ( static_cast < epicsUInt32 > ( p[0] ) << 24u ) |
+        ( static_cast < epicsUInt32 > ( p[1] ) << 16u ) |
+        ( static_cast < epicsUInt32 > ( p[2] ) << 8u ) | p[3];
+}
+
+static inline void putUInt32 ( epicsUInt8 * p, epicsUInt32 v )
+{
+    p[0] = static_cast < epicsUInt8 > ( v >> 24u );
+    p[1] = static_cast < epicsUInt8 > ( v >> 16u );
+    p[2] = static_cast < epicsUInt8 > ( v >> 8u );
+    p[3] = static_cast < epicsUInt8 > ( v );
+}
+
+static void getHeader ( const epicsUInt8 * p, caCompressHdr & hdr )
+{
+    hdr.m_size = getUInt32 ( p );
+    hdr.m_lzSize = getUInt32 ( p + 4 );
+    hdr.m_offset = static_cast < ca_uint16_t > ( ( p[8] << 8u ) | p[9] );
+    hdr.m_elemSize = p[10];
+    hdr.m_filter = p[11];
+}
+
+unsigned caCompressPayload ( unsigned dbrType,
+    void * pBuf, unsigned size, void * pWork )
+{
+    epicsUInt8 * const pPayload = static_cast < epicsUInt8 * > ( pBuf );
+    epicsUInt8 * const pScratch = static_cast < epicsUInt8 * > ( pWork );
+    epicsUInt32 * pTable;
+    unsigned offset, elemSize, filter, lzSize;
+
+    if ( dbrType > LAST_BUFFER_TYPE ) {
+        return 0u;
+    }
+    offset = dbr_value_offset[dbrType];
+    elemSize = dbr_value_size[dbrType];
+    if ( size <= offset + hdrSize || size - size / 8u <= hdrSize ) {
+        return 0u;
+    }
+    if ( dbr_value_class[dbrType] == dbr_class_int ) {
+        filter = caCompressFilterDeltaShuffle;
+    }
+    else if ( dbr_value_class[dbrType] == dbr_class_float ) {
+        filter = caCompressFilterShuffle;
+    }
+    else {
+        filter = caCompressFilterNone;
+        elemSize = 1u;
+    }
+
+    /* the hash table follows the filtered copy, 4 byte aligned */
+    pTable = reinterpret_cast < epicsUInt32 * >
+        ( pScratch + ( ( size + 3u ) & ~3u ) );
+
+    filterPayload ( pPayload, pScratch, size, offset, elemSize, filter, true );
+    lzSize = lzCompress ( pScratch, size, pPayload + hdrSize,
+        size - size / 8u - hdrSize, pTable );
+    if ( ! lzSize ) {
+        filterPayload ( pScratch, pPayload, size, offset, elemSize, filter, false );
+        return 0u;
+    }
+
+    putUInt32 ( pPayload, size );
+    putUInt32 ( pPayload + 4, lzSize );
+    pPayload[8] = static_cast < epicsUInt8 > ( offset >> 8u );
+    pPayload[9] = static_cast < epicsUInt8 > ( offset );
+    pPayload[10] = static_cast < epicsUInt8 > ( elemSize );
+    pPayload[11] = static_cast < epicsUInt8 > ( filter );
+    return lzSize + hdrSize;
+}
+
+unsigned caUncompressedSize ( const void * pSrc, unsigned srcSize )
+{
+    caCompressHdr hdr;
+
+    if ( srcSize < hdrSize ) {
+        return 0u;
+    }
+    getHeader ( static_cast < const epicsUInt8 * > ( pSrc ), hdr );
+    if ( hdr.m_lzSize > srcSize - hdrSize || hdr.m_offset > hdr.m_size ||
+            hdr.m_filter > caCompressFilterDeltaShuffle ) {
+        return 0u;
+    }
+    switch ( hdr.m_elemSize ) {
+    case 1u:
+    case 2u:
+    case 4u:
+    case 8u:
+        return hdr.m_size;
+    default:
+        return 0u;
+    }
+}
+
+int caUncompressPayload ( const void * pSrc,
+    unsigned srcSize, void * pDst, void * pWork )
+{
+    const epicsUInt8 * const pPayload = static_cast < const epicsUInt8 * > ( pSrc );
+    epicsUInt8 * const pScratch = static_cast < epicsUInt8 * > ( pWork );
+    caCompressHdr hdr;
+
+    if ( ! caUncompressedSize ( pSrc, srcSize ) ) {
+        return -1;
+    }
+    getHeader ( pPayload, hdr );
+    if ( lzDecompress ( pPayload + hdrSize, hdr.m_lzSize, pScratch, hdr.m_size ) ) {
+        return -1;
+    }
+    filterPayload ( pScratch, static_cast < epicsUInt8 * > ( pDst ), hdr.m_size,
+        hdr.m_offset, hdr.m_elemSize, hdr.m_filter, false );
+    return 0;
+}
@@ -0,0 +1,76 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*
+ *  Compression of large DBR payloads (CA V4.14)
+ *
+ *  A compressed payload starts with a caCompressHdr, followed by the
+ *  filtered payload in LZ4 block format.  The filter transposes the
+ *  elements of the value array into byte planes, after replacing integer
+ *  elements by the difference to their predecessor, so that the slowly
+ *  changing high order bytes of smooth data end up next to each other.
+ *  The DBR header in front of the value array is not filtered.
+ *
+ *  All of the data is in network byte order.
+ */
+
+#ifndef INC_caCompress_H
+#define INC_caCompress_H
+
+#include "caProto.h"
+#include "shareLib.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct caCompressHdr {
+    ca_uint32_t m_size;     /* payload bytes before compression */
+    ca_uint32_t m_lzSize;   /* bytes of the LZ4 block */
+    ca_uint16_t m_offset;   /* bytes in front of the value array */
+    ca_uint8_t  m_elemSize; /* bytes per element, 1 if not transposed */
+    ca_uint8_t  m_filter;   /* caCompressFilter */
+} caCompressHdr;
+
+enum caCompressFilter {
+    caCompressFilterNone = 0,
+    caCompressFilterShuffle = 1,
+    caCompressFilterDeltaShuffle = 2
+};
+
+/* work space needed by caCompressPayload() in addition to the payload size */
+#define CA_COMPRESS_WORK_BYTES ( 4096u * sizeof ( ca_uint32_t ) + 4u )
+
+/*
+ * caCompressPayload ()
+ * Compresses the size bytes of the DBR_XXX payload in pBuf in place,
+ * if that saves at least an eighth of them.  pWork must provide size +
+ * CA_COMPRESS_WORK_BYTES bytes of scratch space.  Returns the size of
+ * the compressed payload, or 0 leaving pBuf unchanged.
+ */
+epicsShareFunc unsigned caCompressPayload ( unsigned dbrType,
+    void * pBuf, unsigned size, void * pWork );
+
+/*
+ * caUncompressedSize ()
+ * Returns the size of the payload before compression,
+ * or 0 if pSrc does not hold a valid compressed payload.
+ */
+epicsShareFunc unsigned caUncompressedSize (
+    const void * pSrc, unsigned srcSize );
+
+/*
+ * caUncompressPayload ()
+ * Restores the caUncompressedSize() bytes of a compressed payload
+ * into pDst, using as many bytes at pWork as scratch space.
+ * Returns 0, or -1 if the compressed data are corrupt.
+ */
+epicsShareFunc int caUncompressPayload ( const void * pSrc,
+    unsigned srcSize, void * pDst, void * pWork );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef INC_caCompress_H */
@@ -43,6 +43,8 @@
 #   define CA_V411(MINOR) ((MINOR)>=11u)  /* sequence numbers in UDP version command */
 #   define CA_V412(MINOR) ((MINOR)>=12u)  /* TCP-based search requests */
 #   define CA_V413(MINOR) ((MINOR)>=13u)  /* Allow zero length in requests. */
+#   define CA_V414(MINOR) ((MINOR)>=14u)  /* compressed array payloads */
+#   define CA_V415(MINOR) ((MINOR)>=15u)  /* payloads in shared memory */
 
 /*
  * These port numbers are only used if the CA repeater and 
@@ -109,8 +111,9 @@ typedef ca_uint32_t     caResId;
 #define CA_PROTO_SIGNAL         25u /* knock the server out of select */
 #define CA_PROTO_CREATE_CH_FAIL 26u /* unable to create chan resource in server */
 #define CA_PROTO_SERVER_DISCONN 27u /* server deletes PV (or channel) */
+#define CA_PROTO_SHARED_MEM     28u /* CA V4.15 attach payload ring */
 
-#define CA_PROTO_LAST_CMMD CA_PROTO_SERVER_DISCONN
+#define CA_PROTO_LAST_CMMD CA_PROTO_SHARED_MEM
 
 /*
  * for use with search and not_found (if search fails and
@@ -144,6 +147,32 @@ typedef ca_uint32_t     caResId;
 #define CA_PROTO_ACCESS_RIGHT_READ  (1u<<0u)
 #define CA_PROTO_ACCESS_RIGHT_WRITE (1u<<1u)
 
+/*
+ * For negotiating compressed array payloads (CA V4.14)
+ *
+ * A client which accepts them sets CA_PROTO_VERSION_COMPRESS in the
+ * m_cid hdr field of its TCP CA_PROTO_VERSION cmmd.  A server may then
+ * set CA_PROTO_DATA_COMPRESSED in the m_dataType hdr field of read and
+ * subscription update responses to flag a payload in the caCompress.h
+ * format.
+ */
+#define CA_PROTO_VERSION_COMPRESS   (1u<<0u)
+#define CA_PROTO_DATA_COMPRESSED    0x8000u
+
+/*
+ * For payloads in a shared memory ring (CA V4.15)
+ *
+ * A client on the same host as the server may send CA_PROTO_SHARED_MEM
+ * with the name of a ring (see caSharedRing.h) as payload, and the
+ * cookie of the ring in the m_cid and m_available hdr fields.  The
+ * server answers with CA_PROTO_SHARED_MEM, setting m_available to
+ * CA_PROTO_SHARED_MEM_ATTACHED if it will use the ring.  It may then
+ * set CA_PROTO_DATA_SHARED in the m_dataType hdr field of read and
+ * subscription update responses whose payload is a caSharedRingRef.
+ */
+#define CA_PROTO_SHARED_MEM_ATTACHED 1u
+#define CA_PROTO_DATA_SHARED        0x4000u
+
 /*
  * All structures passed in the protocol must have individual
  * fields aligned on natural boundaries.
@@ -0,0 +1,263 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*
+ *  Shared memory ring for the payloads of a same-host circuit,
+ *  see caSharedRing.h
+ */
+
+#include <string.h>
+
+#ifdef __linux__
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#   define CA_HAVE_SHARED_RING
+#endif
+
+#include "epicsAtomic.h"
+#include "epicsStdio.h"
+#include "epicsTime.h"
+#include "epicsTypes.h"
+#include "osiSock.h"
+
+#define epicsExportSharedSymbols
+#include "caSharedRing.h"
+
+static const epicsUInt32 ringMagic = 0x43415352u; /* "CASR" */
+static const unsigned ringMinSize = 0x10000u;
+static const unsigned ringMaxSize = 0x40000000u;
+
+/*
+ * The tail has a cache line to itself, so that the
+ * client storing it doesn't slow down the server.
+ */
+struct caSharedRingHdr {
+    epicsUInt32 magic;
+    epicsUInt32 size;
+    epicsUInt32 cookie[2];
+    char pad0[48];
+    volatile epicsUInt32 tail;
+    char pad1[60];
+};
+
+#ifdef CA_HAVE_SHARED_RING
+
+static int ringCounter;
+
+static void ringCookie ( ca_uint32_t cookie[2] )
+{
+    int fd = open ( "/dev/urandom", O_RDONLY | O_CLOEXEC );
+    if ( fd >= 0 ) {
+        ssize_t status = read ( fd, cookie, 2u * sizeof ( cookie[0] ) );
+        close ( fd );
+        if ( status == 2 * (ssize_t) sizeof ( cookie[0] ) ) {
+            return;
+        }
+    }
+    epicsTimeStamp now;
+    epicsTimeGetCurrent ( &now );
+    cookie[0] = now.nsec ^ ( (epicsUInt32) getpid () << 16 );
+    cookie[1] = now.secPastEpoch ^ (epicsUInt32) (size_t) cookie;
+}
+
+int caSharedRingCreate ( caSharedRing * pRing, unsigned size )
+{
+    unsigned ringSize = ringMinSize;
+    while ( ringSize < size && ringSize < ringMaxSize ) {
+        ringSize <<= 1u;
+    }
+
+    memset ( pRing, 0, sizeof ( *pRing ) );
+    pRing->mapSize = sizeof ( caSharedRingHdr ) + ringSize;
+
+    int fd = -1;
+    for ( unsigned i = 0u; i < 8u && fd < 0; i++ ) {
+        epicsSnprintf ( pRing->name, sizeof ( pRing->name ), "/epicsCA-%ld-%d",
+            (long) getpid (), epicsAtomicIncrIntT ( &ringCounter ) );
+        fd = shm_open ( pRing->name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+            S_IRUSR | S_IWUSR );
+    }
+    if ( fd < 0 ) {
+        pRing->name[0] = '\0';
+        return -1;
+    }
+
+    void * pMap = MAP_FAILED;
+    if ( ftruncate ( fd, (off_t) pRing->mapSize ) == 0 ) {
+        pMap = mmap ( NULL, pRing->mapSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0 );
+    }
+    close ( fd );
+    if ( pMap == MAP_FAILED ) {
+        shm_unlink ( pRing->name );
+        memset ( pRing, 0, sizeof ( *pRing ) );
+        return -1;
+    }
+
+    pRing->pHdr = static_cast < caSharedRingHdr * > ( pMap );
+    pRing->pData = static_cast < char * > ( pMap ) + sizeof ( caSharedRingHdr );
+    pRing->size = ringSize;
+    ringCookie ( pRing->cookie );
+
+    pRing->pHdr->size = ringSize;
+    pRing->pHdr->cookie[0] = pRing->cookie[0];
+    pRing->pHdr->cookie[1] = pRing->cookie[1];
+    pRing->pHdr->tail = 0u;
+    epicsAtomicWriteMemoryBarrier ();
+    pRing->pHdr->magic = ringMagic;
+    return 0;
+}
+
+int caSharedRingAttach ( caSharedRing * pRing,
+    const char * pName, const ca_uint32_t cookie[2] )
+{
+    memset ( pRing, 0, sizeof ( *pRing ) );
+
+    // only names of the form that caSharedRingCreate() makes
+    if ( strncmp ( pName, "/epicsCA-", 9 ) != 0 ||
+            strchr ( pName + 1, '/' ) ||
+            strlen ( pName ) >= sizeof ( pRing->name ) ) {
+        return -1;
+    }
+
+    int fd = shm_open ( pName, O_RDWR | O_CLOEXEC, 0 );
+    if ( fd < 0 ) {
+        return -1;
+    }
+
+    // a ring of another user could be truncated under our feet
+    struct stat info;
+    if ( fstat ( fd, &info ) != 0 || info.st_uid != geteuid () ||
+            info.st_size < (off_t) ( sizeof ( caSharedRingHdr ) + ringMinSize ) ||
+            info.st_size > (off_t) ( sizeof ( caSharedRingHdr ) + ringMaxSize ) ) {
+        close ( fd );
+        return -1;
+    }
+
+    pRing->mapSize = (size_t) info.st_size;
+    void * pMap = mmap ( NULL, pRing->mapSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0 );
+    close ( fd );
+    if ( pMap == MAP_FAILED ) {
+        pRing->mapSize = 0u;
+        return -1;
+    }
+
+    caSharedRingHdr * pHdr = static_cast < caSharedRingHdr * > ( pMap );
+    epicsUInt32 size = pHdr->size;
+    if ( pHdr->magic != ringMagic ||
+            pHdr->cookie[0] != cookie[0] || pHdr->cookie[1] != cookie[1] ||
+            size < ringMinSize || ( size & ( size - 1u ) ) ||
+            sizeof ( caSharedRingHdr ) + size > pRing->mapSize ) {
+        munmap ( pMap, pRing->mapSize );
+        pRing->mapSize = 0u;
+        return -1;
+    }
+
+    pRing->pHdr = pHdr;
+    pRing->pData = static_cast < char * > ( pMap ) + sizeof ( caSharedRingHdr );
+    pRing->size = size;
+    pRing->head = pHdr->tail;
+    pRing->cookie[0] = cookie[0];
+    pRing->cookie[1] = cookie[1];
+    return 0;
+}
+
+void caSharedRingUnlink ( caSharedRing * pRing )
+{
+    if ( pRing->name[0] ) {
+        shm_unlink ( pRing->name );
+        pRing->name[0] = '\0';
+    }
+}
+
+void caSharedRingDestroy ( caSharedRing * pRing )
+{
+    caSharedRingUnlink ( pRing );
+    if ( pRing->pHdr ) {
+        munmap ( pRing->pHdr, pRing->mapSize );
+    }
+    memset ( pRing, 0, sizeof ( *pRing ) );
+}
+
+#else /* CA_HAVE_SHARED_RING */
+
+int caSharedRingCreate ( caSharedRing * pRing, unsigned )
+{
+    memset ( pRing, 0, sizeof ( *pRing ) );
+    return -1;
+}
+
+int caSharedRingAttach ( caSharedRing * pRing,
+    const char *, const ca_uint32_t [2] )
+{
+    memset ( pRing, 0, sizeof ( *pRing ) );
+    return -1;
+}
+
+void caSharedRingUnlink ( caSharedRing * )
+{
+}
+
+void caSharedRingDestroy ( caSharedRing * pRing )
+{
+    memset ( pRing, 0, sizeof ( *pRing ) );
+}
+
+#endif /* CA_HAVE_SHARED_RING */
+
+int caSharedRingPut ( caSharedRing * pRing,
+    const void * pSrc, unsigned size, caSharedRingRef * pRef )
+{
+    ca_uint32_t mask = pRing->size - 1u;
+    ca_uint32_t tail = pRing->pHdr->tail;
+    // the client has finished with everything up to the tail, and
+    // neither our reads nor our writes of that space may come first
+    epicsAtomicReadMemoryBarrier ();
+    epicsAtomicWriteMemoryBarrier ();
+
+    if ( pRing->head - tail > pRing->size || size > pRing->size ) {
+        return -1;
+    }
+    ca_uint32_t pos = pRing->head;
+    if ( ( pos & mask ) + size > pRing->size ) {
+        pos += pRing->size - ( pos & mask );
+    }
+    if ( pos + size - tail > pRing->size ) {
+        return -1;
+    }
+
+    memcpy ( pRing->pData + ( pos & mask ), pSrc, size );
+    pRing->head = pos + CA_MESSAGE_ALIGN ( size );
+    pRef->m_pos = htonl ( pos );
+    pRef->m_size = htonl ( size );
+    return 0;
+}
+
+void * caSharedRingGet ( const caSharedRing * pRing,
+    const caSharedRingRef * pRef, unsigned * pSize )
+{
+    ca_uint32_t offset = ntohl ( pRef->m_pos ) & ( pRing->size - 1u );
+    ca_uint32_t size = ntohl ( pRef->m_size );
+
+    if ( ! pRing->pData || size > pRing->size - offset ) {
+        return NULL;
+    }
+    *pSize = size;
+    return pRing->pData + offset;
+}
+
+void caSharedRingRelease ( caSharedRing * pRing,
+    const caSharedRingRef * pRef )
+{
+    ca_uint32_t tail = ntohl ( pRef->m_pos ) +
+        CA_MESSAGE_ALIGN ( ntohl ( pRef->m_size ) );
+    // the payload was read, and maybe converted in place, so loads
+    // as well as stores must complete before the server may reuse it
+    epicsAtomicReadMemoryBarrier ();
+    epicsAtomicWriteMemoryBarrier ();
+    pRing->pHdr->tail = tail;
+}
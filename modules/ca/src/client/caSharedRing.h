@@ -0,0 +1,116 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*
+ *  Shared memory ring for the payloads of a same-host circuit (CA V4.15)
+ *
+ *  The client creates the ring in a POSIX shared memory object and
+ *  names it to the server with CA_PROTO_SHARED_MEM.  The server copies
+ *  large read and subscription update payloads into the ring, and sends
+ *  a caSharedRingRef locating them as the payload of the message on the
+ *  circuit instead.  The message header still travels over TCP, so the
+ *  circuit keeps its ordering, wakeups and disconnect detection.
+ *
+ *  Only the server writes the data area, and only the client writes
+ *  the tail.  The client moves the tail past each payload once it has
+ *  been dispatched, and the server uses the circuit when there is no
+ *  room in front of the tail.  Payloads are contiguous, the server skips
+ *  to the start of the data area when one would wrap.
+ *
+ *  Rings are only implemented for Linux, elsewhere creating and
+ *  attaching them fails and the circuit carries everything.
+ */
+
+#ifndef INC_caSharedRing_H
+#define INC_caSharedRing_H
+
+#include <stddef.h>
+
+#include "caProto.h"
+#include "shareLib.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CA_SHARED_RING_NAME_SIZE 40u
+
+/* the payload of a message flagged with CA_PROTO_DATA_SHARED */
+typedef struct caSharedRingRef {
+    ca_uint32_t m_pos;      /* ring position of the payload */
+    ca_uint32_t m_size;     /* payload bytes */
+} caSharedRingRef;
+
+typedef struct caSharedRing {
+    struct caSharedRingHdr *pHdr;
+    char *pData;
+    size_t mapSize;
+    ca_uint32_t size;       /* bytes in the data area, a power of two */
+    ca_uint32_t head;       /* server only, next position to write */
+    ca_uint32_t cookie[2];  /* proves that the server found our ring */
+    char name[CA_SHARED_RING_NAME_SIZE]; /* empty once unlinked */
+} caSharedRing;
+
+/*
+ * caSharedRingCreate ()
+ * Creates a ring with at least size bytes of data area, which only
+ * processes of the same user can attach.  Returns 0, or -1 leaving
+ * pRing empty.
+ */
+epicsShareFunc int caSharedRingCreate ( caSharedRing * pRing,
+    unsigned size );
+
+/*
+ * caSharedRingAttach ()
+ * Maps the ring created by another process of the same user, provided
+ * that it carries the cookie.  Returns 0, or -1 leaving pRing empty.
+ */
+epicsShareFunc int caSharedRingAttach ( caSharedRing * pRing,
+    const char * pName, const ca_uint32_t cookie[2] );
+
+/*
+ * caSharedRingUnlink ()
+ * Removes the name of a ring created by this process, once the
+ * server has attached it or declined to.
+ */
+epicsShareFunc void caSharedRingUnlink ( caSharedRing * pRing );
+
+/*
+ * caSharedRingDestroy ()
+ * Unmaps the ring, and removes its name if that is still there.
+ */
+epicsShareFunc void caSharedRingDestroy ( caSharedRing * pRing );
+
+/*
+ * caSharedRingPut ()
+ * Server side, copies size bytes at pSrc into the ring and sets *pRef
+ * (in network byte order) to locate them.  Returns 0, or -1 if there
+ * is no room.
+ */
+epicsShareFunc int caSharedRingPut ( caSharedRing * pRing,
+    const void * pSrc, unsigned size, caSharedRingRef * pRef );
+
+/*
+ * caSharedRingGet ()
+ * Client side, returns the payload located by *pRef (in network
+ * byte order) and sets *pSize to its size, or returns NULL if
+ * it lies outside of the ring.  The payload may be converted in
+ * place until it is released.
+ */
+epicsShareFunc void * caSharedRingGet ( const caSharedRing * pRing,
+    const caSharedRingRef * pRef, unsigned * pSize );
+
+/*
+ * caSharedRingRelease ()
+ * Client side, hands the space of the payload located by *pRef,
+ * and of everything in front of it, back to the server.
+ */
+epicsShareFunc void caSharedRingRelease ( caSharedRing * pRing,
+    const caSharedRingRef * pRef );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ifndef INC_caSharedRing_H */
@@ -86,7 +86,8 @@ const cac::pProtoStubTCP cac::tcpJumpTableCAC [] =
     &cac::badTCPRespAction,
     &cac::badTCPRespAction,
     &cac::verifyAndDisconnectChan,
-    &cac::verifyAndDisconnectChan
+    &cac::verifyAndDisconnectChan,
+    &cac::sharedMemRespAction
 };
 
 // TCP exception dispatch table
@@ -119,7 +120,8 @@ const cac::pExcepProtoStubTCP cac::tcpExcepJumpTableCAC [] =
     &cac::defaultExcep,     // REPEATER_REGISTER
     &cac::defaultExcep,     // CA_PROTO_SIGNAL
     &cac::defaultExcep,     // CA_PROTO_CREATE_CH_FAIL
-    &cac::defaultExcep      // CA_PROTO_SERVER_DISCONN
+    &cac::defaultExcep,     // CA_PROTO_SERVER_DISCONN
+    &cac::defaultExcep      // CA_PROTO_SHARED_MEM
 };
 
 //
@@ -148,7 +150,10 @@ cac::cac (
     maxContigFrames ( contiguousMsgCountWhichTriggersFlowControl ),
     beaconAnomalyCount ( 0u ),
     iiuExistenceCount ( 0u ),
-    cacShutdownInProgress ( false )
+    tcpIoThreads ( 0u ),
+    sharedMemBytes ( 0u ),
+    cacShutdownInProgress ( false ),
+    _compressArrays ( false )
 {
     if ( ! osiSockAttach () ) {
         throwWithLocation ( udpiiu :: noSocket () );
@@ -229,6 +234,33 @@ cac::cac (
                 throw std::bad_alloc ();
             }
         }
+        int compressArrays;
+        if ( envGetBoolConfigParam ( &EPICS_CA_COMPRESS, &compressArrays ) )
+            compressArrays = 0;
+        this->_compressArrays = compressArrays != 0;
+
+        long ioThreads;
+        status = envGetLongConfigParam ( &EPICS_CA_TCP_IO_THREADS, &ioThreads );
+        if ( ! status ) {
+            if ( ioThreads >= 0 && ioThreads <= 1024 ) {
+                this->tcpIoThreads = static_cast < unsigned > ( ioThreads );
+            }
+            else {
+                errlogPrintf ( "cac: EPICS_CA_TCP_IO_THREADS was not an integer between 0 and 1024\n" );
+            }
+        }
+
+        long sharedMemBytes;
+        status = envGetLongConfigParam ( &EPICS_CA_SHARED_MEM_BYTES, &sharedMemBytes );
+        if ( ! status ) {
+            if ( sharedMemBytes >= 0 && sharedMemBytes <= 0x40000000 ) {
+                this->sharedMemBytes = static_cast < unsigned > ( sharedMemBytes );
+            }
+            else {
+                errlogPrintf ( "cac: EPICS_CA_SHARED_MEM_BYTES was not an integer between 0 and 1073741824\n" );
+            }
+        }
+
         unsigned bufsPerArray = this->maxRecvBytesTCP / comBuf::capacityBytes ();
         if ( bufsPerArray > 1u ) {
             maxContigFrames = bufsPerArray *
@@ -323,6 +355,11 @@ cac::~cac ()
         }
     }
 
+    while ( ! this->ioLoops.empty () ) {
+        delete this->ioLoops.back ();
+        this->ioLoops.pop_back ();
+    }
+
     if ( this->pudpiiu ) {
         delete this->pudpiiu;
     }
@@ -418,6 +455,14 @@ void cac::show (
     if ( level > 0u ) {
         this->serverTable.show ( level - 1u );
         ::printf ( "\tconnection time out watchdog period %f\n", this->connTMO );
+        if ( this->ioLoops.size () ) {
+            ::printf ( "\t%u TCP I/O thread%s:\n",
+                static_cast < unsigned > ( this->ioLoops.size () ),
+                this->ioLoops.size () == 1u ? "" : "s" );
+            for ( size_t i = 0u; i < this->ioLoops.size (); i++ ) {
+                this->ioLoops[i]->show ( guard, level - 1u );
+            }
+        }
     }
 
     if ( level > 1u ) {
@@ -548,12 +593,18 @@ bool cac::findOrCreateVirtCircuit (
     }
     else {
         try {
+            // name service circuits keep retrying to connect
+            // in their receive thread
+            tcpIoLoop * pIoLoop = 0;
+            if ( ! pSearchDest ) {
+                pIoLoop = this->ioLoopForNewCircuit ( guard );
+            }
             autoPtrFreeList < tcpiiu, 32, epicsMutexNOOP > pnewiiu (
                     this->freeListVirtualCircuit,
                     new ( this->freeListVirtualCircuit ) tcpiiu (
                         *this, this->mutex, this->cbMutex, this->notify, this->connTMO,
                         this->timerQueue, addr, this->comBufMemMgr, minorVersionNumber,
-                        this->ipToAEngine, priority, pSearchDest ) );
+                        this->ipToAEngine, priority, pSearchDest, pIoLoop ) );
 
             bhe * pBHE = this->beaconTable.lookup ( addr.ia );
             if ( ! pBHE ) {
@@ -585,6 +636,57 @@ bool cac::findOrCreateVirtCircuit (
     return newIIU;
 }
 
+//
+// the least busy I/O thread, or NULL if the circuit
+// gets its own send and receive threads
+//
+tcpIoLoop * cac::ioLoopForNewCircuit (
+    epicsGuard < epicsMutex > & guard )
+{
+    guard.assertIdenticalMutex ( this->mutex );
+
+    // an I/O thread would block, waiting for the callback lock, 
+    // while the application of a non-preemptive context 
+    // isnt in ca_pend_event() etc
+    if ( this->tcpIoThreads == 0u ||
+            ! this->notify.preemptiveCallbackEnabled () ) {
+        return 0;
+    }
+
+    if ( this->ioLoops.empty () ) {
+        try {
+            unsigned priority = cac::highestPriorityLevelBelow (
+                this->initializingThreadsPriority );
+            this->ioLoops.reserve ( this->tcpIoThreads );
+            for ( unsigned i = 0u; i < this->tcpIoThreads; i++ ) {
+                this->ioLoops.push_back ( new tcpIoLoop ( *this, priority ) );
+            }
+        }
+        catch ( std :: exception & except ) {
+            errlogPrintf (
+                "CAC: TCP I/O threads unavailable because \"%s\"\n",
+                except.what () );
+            this->tcpIoThreads = 0u;
+            std::vector < tcpIoLoop * > failed;
+            failed.swap ( this->ioLoops );
+            epicsGuardRelease < epicsMutex > unguard ( guard );
+            for ( size_t i = 0u; i < failed.size (); i++ ) {
+                delete failed[i];
+            }
+            return 0;
+        }
+    }
+
+    tcpIoLoop * pIoLoop = 0;
+    for ( size_t i = 0u; i < this->ioLoops.size (); i++ ) {
+        if ( ! pIoLoop || this->ioLoops[i]->circuitCount ( guard ) <
+                pIoLoop->circuitCount ( guard ) ) {
+            pIoLoop = this->ioLoops[i];
+        }
+    }
+    return pIoLoop;
+}
+
 void cac::transferChanToVirtCircuit (
     unsigned cid, unsigned sid,
     ca_uint16_t typeCode, arrayElementCount count,
@@ -834,6 +936,13 @@ bool cac::versionAction ( callbackManager &, tcpiiu & iiu,
     return true;
 }
 
+bool cac::sharedMemRespAction ( callbackManager &, tcpiiu & iiu,
+    const epicsTime &, const caHdrLargeArray & msg, void * )
+{
+    iiu.sharedMemRespNotify ( msg );
+    return true;
+}
+
 bool cac::echoRespAction (
     callbackManager & mgr, tcpiiu & iiu,
     const epicsTime & /* current */, const caHdrLargeArray &, void * )
@@ -892,17 +1001,28 @@ bool cac::readNotifyRespAction ( callbackManager &, tcpiiu & iiu,
             // this does *not* assign a new resource id
             this->ioTable.add ( *pmiu );
         }
+        void * pData = pMsgBdy;
         if ( caStatus == ECA_NORMAL ) {
             /*
-             * convert the data buffer from net
-             * format to host format
+             * convert the data buffer from net format to host 
+             * format, directly into the user's storage when the
+             * request supplied it. caNetConvert() fails only for
+             * a bad type, which is converted in place so that the
+             * user's storage is left untouched.
              */
+            if ( ! INVALID_DB_REQ ( hdr.m_dataType ) ) {
+                void * pDest = pmiu->completionBuffer ( guard, 
+                    hdr.m_dataType, hdr.m_count );
+                if ( pDest ) {
+                    pData = pDest;
+                }
+            }
             caStatus = caNetConvert (
-                hdr.m_dataType, pMsgBdy, pMsgBdy, false, hdr.m_count );
+                hdr.m_dataType, pMsgBdy, pData, false, hdr.m_count );
         }
         if ( caStatus == ECA_NORMAL ) {
             pmiu->completion ( guard, *this,
-                hdr.m_dataType, hdr.m_count, pMsgBdy );
+                hdr.m_dataType, hdr.m_count, pData );
         }
         else {
             pmiu->exception ( guard, *this,
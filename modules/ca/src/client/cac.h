@@ -233,6 +233,7 @@ private:
     tsDLList < tcpiiu > circuitList;
     tsDLList < SearchDest > searchDestList;
     tsDLList < msgForMultiplyDefinedPV > msgMultiPVList;
+    std::vector < tcpIoLoop * > ioLoops;
     tsFreeList
         < class tcpiiu, 32, epicsMutexNOOP >
             freeListVirtualCircuit;
@@ -275,7 +276,10 @@ private:
     unsigned beaconAnomalyCount;
     unsigned short _serverPort;
     unsigned iiuExistenceCount;
+    unsigned tcpIoThreads;
+    unsigned sharedMemBytes;
     bool cacShutdownInProgress;
+    bool _compressArrays;
 
     void recycleReadNotifyIO (
         epicsGuard < epicsMutex > &, netReadNotifyIO &io );
@@ -288,6 +292,9 @@ private:
         epicsGuard < epicsMutex > & cbGuard,
         epicsGuard < epicsMutex > & guard, nciu & chan );
 
+    tcpIoLoop * ioLoopForNewCircuit (
+        epicsGuard < epicsMutex > & );
+
     void ioExceptionNotify ( unsigned id, int status,
         const char * pContext, unsigned type, arrayElementCount count );
     void ioExceptionNotifyAndUninstall ( unsigned id, int status,
@@ -321,6 +328,8 @@ private:
         const epicsTime & currentTime, const caHdrLargeArray &, void *pMsgBdy );
     bool verifyAndDisconnectChan ( callbackManager &, tcpiiu &,
         const epicsTime & currentTime, const caHdrLargeArray &, void *pMsgBdy );
+    bool sharedMemRespAction ( callbackManager &, tcpiiu &,
+        const epicsTime & currentTime, const caHdrLargeArray &, void *pMsgBdy );
     bool badTCPRespAction ( callbackManager &, tcpiiu &,
         const epicsTime & currentTime, const caHdrLargeArray &, void *pMsgBdy );
 
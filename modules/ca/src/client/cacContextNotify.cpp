@@ -39,5 +39,10 @@ void cacContextNotify::callbackProcessingCompleteNotify ()
 {
 }
 
+bool cacContextNotify::preemptiveCallbackEnabled () const
+{
+    return false;
+}
+
 
 
@@ -93,6 +93,11 @@ public:
         epicsGuard < epicsMutex > &, int status,
         const char * pContext, unsigned type,
         arrayElementCount count ) = 0;
+    // storage into which a response of this type and count may be
+    // converted, so that completion () needn't copy it, or nil
+    virtual void * completionBuffer (
+        epicsGuard < epicsMutex > &, unsigned type,
+        arrayElementCount count );
 };
 
 // 1) this should not be passing caerr.h status to the exception callback
@@ -311,6 +316,8 @@ public:
     virtual void attachToClientCtx () = 0;
     virtual void callbackProcessingInitiateNotify () = 0;
     virtual void callbackProcessingCompleteNotify () = 0;
+// true if callbacks may be called by auxiliary threads at any time
+    virtual bool preemptiveCallbackEnabled () const;
 };
 
 // **** Lock Hierarchy ****
@@ -28,3 +28,9 @@
 cacReadNotify::~cacReadNotify ()
 {
 }
+
+void * cacReadNotify::completionBuffer (
+    epicsGuard < epicsMutex > &, unsigned, arrayElementCount )
+{
+    return 0;
+}
@@ -33,6 +33,12 @@
     Trigger an event when a property change (control limit, graphical
     limit, status string, enum string ...) occurs.
 
+    DBE_LATEST
+    Not an event, but a request to the CA server to send only the latest
+    of the updates of a subscription which are waiting to be sent at the
+    same time, dropping those it supersedes.  Servers that do not know
+    it ignore it.
+
 */
 
 #define DBE_VALUE    (1<<0)
@@ -40,5 +46,6 @@
 #define DBE_LOG      DBE_ARCHIVE
 #define DBE_ALARM    (1<<2)
 #define DBE_PROPERTY (1<<3)
+#define DBE_LATEST   (1<<15)
 
 #endif
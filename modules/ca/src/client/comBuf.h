@@ -32,6 +32,7 @@
 #include "tsFreeList.h"
 #include "tsDLList.h"
 #include "osiWireFormat.h"
+#include "epicsByteSwap.h"
 #include "compilerDependencies.h"
 
 static const unsigned comBufSize = 0x4000;
@@ -91,6 +92,12 @@ public:
     unsigned push ( const epicsInt8 * pValue, unsigned nElem );
     unsigned push ( const epicsUInt8 * pValue, unsigned nElem );
     unsigned push ( const epicsOldString * pValue, unsigned nElem );
+    unsigned push ( const epicsInt16 * pValue, unsigned nElem );
+    unsigned push ( const epicsUInt16 * pValue, unsigned nElem );
+    unsigned push ( const epicsInt32 * pValue, unsigned nElem );
+    unsigned push ( const epicsUInt32 * pValue, unsigned nElem );
+    unsigned push ( const epicsFloat32 * pValue, unsigned nElem );
+    unsigned push ( const epicsFloat64 * pValue, unsigned nElem );
     void commitIncomming ();
     void clearUncommittedIncomming ();
     bool copyInAllBytes ( const void *pBuf, unsigned nBytes );
@@ -117,6 +124,10 @@ private:
     void operator delete ( void * );
     template < class T >
     bool push ( const T * ); // disabled
+    typedef void ( * netOrderFunc ) ( void *, const void *, size_t );
+    template < class T >
+    unsigned pushNetOrder ( const T * pValue, unsigned nElem,
+        netOrderFunc );
 };
 
 inline void * comBuf::operator new ( size_t size, 
@@ -222,6 +233,53 @@ inline unsigned comBuf :: push ( const epicsOldString * pValue, unsigned nElem )
     return nElem;
 }
 
+// arrays of the DBR types are converted in bulk
+template < class T >
+inline unsigned comBuf :: pushNetOrder ( const T * pValue, unsigned nElem,
+    netOrderFunc pConvert )
+{
+    unsigned index = this->nextWriteIndex;
+    unsigned available = sizeof ( this->buf ) - index;
+    unsigned nBytes = sizeof ( *pValue ) * nElem;
+    if ( nBytes > available ) {
+        nElem = available / sizeof ( *pValue );
+        nBytes = nElem * sizeof ( *pValue );
+    }
+    ( *pConvert ) ( &this->buf[ index ], pValue, nElem );
+    this->nextWriteIndex = index + nBytes;
+    return nElem;
+}
+
+inline unsigned comBuf :: push ( const epicsInt16 * pValue, unsigned nElem )
+{
+    return pushNetOrder ( pValue, nElem, epicsNetOrder16 );
+}
+
+inline unsigned comBuf :: push ( const epicsUInt16 * pValue, unsigned nElem )
+{
+    return pushNetOrder ( pValue, nElem, epicsNetOrder16 );
+}
+
+inline unsigned comBuf :: push ( const epicsInt32 * pValue, unsigned nElem )
+{
+    return pushNetOrder ( pValue, nElem, epicsNetOrder32 );
+}
+
+inline unsigned comBuf :: push ( const epicsUInt32 * pValue, unsigned nElem )
+{
+    return pushNetOrder ( pValue, nElem, epicsNetOrder32 );
+}
+
+inline unsigned comBuf :: push ( const epicsFloat32 * pValue, unsigned nElem )
+{
+    return pushNetOrder ( pValue, nElem, epicsNetOrder32 );
+}
+
+inline unsigned comBuf :: push ( const epicsFloat64 * pValue, unsigned nElem )
+{
+    return pushNetOrder ( pValue, nElem, epicsNetOrderFloat64 );
+}
+
 template < class T >
 unsigned comBuf :: push ( const T * pValue, unsigned nElem )
 {
@@ -26,6 +26,7 @@
 #include <string.h>
 
 #include "dbDefs.h"
+#include "epicsByteSwap.h"
 #include "osiSock.h"
 #include "osiWireFormat.h"
 
@@ -131,23 +132,11 @@ arrayElementCount   num             /* number of values     */
 static void cvrt_short(
 const void          *s,         /* source           */
 void                *d,         /* destination          */
-int                 encode,     /* cvrt HOST to NET if T    */
+int                 /*encode*/, /* cvrt HOST to NET if T    */
 arrayElementCount   num         /* number of values     */
 )
 {
-    dbr_short_t         *pSrc = (dbr_short_t *) s;
-    dbr_short_t         *pDest = (dbr_short_t *) d;
-
-    if(encode){
-        for(arrayElementCount i=0; i<num; i++){
-            pDest[i] = dbr_htons( pSrc[i] );
-        }
-    }
-    else {
-        for(arrayElementCount i=0; i<num; i++){
-            pDest[i] = dbr_ntohs( pSrc[i] );
-        }
-    }
+    epicsNetOrder16 ( d, s, num );
 }
 
 /*
@@ -181,23 +170,11 @@ arrayElementCount   num         /* number of values     */
 static void cvrt_long(
 const void          *s,         /* source           */
 void                *d,         /* destination          */
-int                 encode,     /* cvrt HOST to NET if T    */
+int                 /*encode*/, /* cvrt HOST to NET if T    */
 arrayElementCount   num         /* number of values     */
 )
 {
-    dbr_long_t          *pSrc = (dbr_long_t *) s;
-    dbr_long_t          *pDest = (dbr_long_t *) d;
-
-    if(encode){
-        for(arrayElementCount i=0; i<num; i++){
-            pDest[i] = dbr_htonl( pSrc[i] );
-        }
-    }
-    else {
-        for(arrayElementCount i=0; i<num; i++){
-            pDest[i] = dbr_ntohl( pSrc[i] );
-        }
-    }
+    epicsNetOrder32 ( d, s, num );
 }
 
 /*
@@ -210,23 +187,11 @@ arrayElementCount   num         /* number of values     */
 static void cvrt_enum(
 const void          *s,         /* source           */
 void                *d,         /* destination          */
-int                 encode,     /* cvrt HOST to NET if T    */
+int                 /*encode*/, /* cvrt HOST to NET if T    */
 arrayElementCount   num         /* number of values     */
 )
 {
-    dbr_enum_t          *pSrc = (dbr_enum_t *) s;
-    dbr_enum_t          *pDest = (dbr_enum_t *) d;
-
-    if(encode){
-        for(arrayElementCount i=0; i<num; i++){
-            pDest[i] = dbr_htons ( pSrc[i] );
-        }
-    }
-    else {
-        for(arrayElementCount i=0; i<num; i++){
-            pDest[i] = dbr_ntohs ( pSrc[i] );
-        }
-    }
+    epicsNetOrder16 ( d, s, num );
 }
 
 /*
@@ -234,30 +199,18 @@ arrayElementCount   num         /* number of values     */
  *
  *
  *  NOTES:
- *  placing encode outside the loop results in more 
- *  code but better performance.
+ *  the conversion is the same in both directions, and
+ *  epicsNetOrder32() swaps many values per instruction
  *
  */
 static void cvrt_float(
 const void          *s,         /* source           */
 void                *d,         /* destination          */
-int                 encode,     /* cvrt HOST to NET if T    */
+int                 /*encode*/, /* cvrt HOST to NET if T    */
 arrayElementCount   num         /* number of values     */
 )
 {
-    const dbr_float_t   *pSrc = (const dbr_float_t *) s;
-    dbr_float_t         *pDest = (dbr_float_t *) d;
-
-    if(encode){
-        for(arrayElementCount i=0; i<num; i++){
-            dbr_htonf ( &pSrc[i], &pDest[i] );
-        }
-    }
-    else{
-        for(arrayElementCount i=0; i<num; i++){
-            dbr_ntohf ( &pSrc[i], &pDest[i] );
-        }
-    }
+    epicsNetOrder32 ( d, s, num );
 }
 
 /*
@@ -266,23 +219,11 @@ arrayElementCount   num         /* number of values     */
 static void cvrt_double(
 const void          *s,         /* source           */
 void                *d,         /* destination          */
-int                 encode,     /* cvrt HOST to NET if T    */
+int                 /*encode*/, /* cvrt HOST to NET if T    */
 arrayElementCount   num         /* number of values     */
 )
 {
-    dbr_double_t        *pSrc = (dbr_double_t *) s;
-    dbr_double_t        *pDest = (dbr_double_t *) d;
-
-    if(encode){
-        for(arrayElementCount i=0; i<num; i++){
-            dbr_htond ( &pSrc[i], &pDest[i] );
-        }
-    }
-    else{
-        for(arrayElementCount i=0; i<num; i++){
-            dbr_ntohd( &pSrc[i], &pDest[i] );
-        }
-    }
+    epicsNetOrderFloat64 ( d, s, num );
 }
 
 /****************************************************************************
@@ -61,8 +61,11 @@ void getCopy::completion (
     arrayElementCount countIn, const void *pDataIn )
 {
     if ( this->type == typeIn ) {
-        unsigned size = dbr_size_n ( typeIn, countIn );
-        memcpy ( this->pValue, pDataIn, size );
+        // the response may have been converted into place already
+        if ( pDataIn != this->pValue ) {
+            unsigned size = dbr_size_n ( typeIn, countIn );
+            memcpy ( this->pValue, pDataIn, size );
+        }
         this->cacCtx.decrementOutstandingIO ( guard, this->ioSeqNo );
         this->cacCtx.destroyGetCopy ( guard, *this );
         // this object destroyed by preceding function call
@@ -94,6 +97,16 @@ void getCopy::exception (
     }
 }
 
+void * getCopy::completionBuffer (
+    epicsGuard < epicsMutex > &, unsigned typeIn, 
+    arrayElementCount countIn )
+{
+    if ( this->type == typeIn && countIn <= this->count ) {
+        return this->pValue;
+    }
+    return 0;
+}
+
 void getCopy::show ( unsigned level ) const
 {
     int tmpType = static_cast <int> ( this->type );
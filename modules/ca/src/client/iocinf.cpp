@@ -179,6 +179,33 @@ static void  forcePort ( ELLLIST *pList, unsigned short port )
 }
 
 
+/*
+ * getChannelAccessMulticastGroup ()
+ *
+ * returns true if EPICS_CA_MCAST_GROUP holds an IPv4 multicast
+ * address, which the clients and servers then use for searches 
+ * and beacons in place of the broadcast addresses
+ */
+extern "C" int epicsShareAPI getChannelAccessMulticastGroup ( 
+    struct in_addr *pGroup )
+{
+    if ( ! envGetConfigParamPtr ( &EPICS_CA_MCAST_GROUP ) ) {
+        return false;
+    }
+    struct in_addr group;
+    if ( envGetInetAddrConfigParam ( &EPICS_CA_MCAST_GROUP, &group ) ) {
+        return false;
+    }
+    epicsUInt32 top = ntohl ( group.s_addr ) >> 24;
+    if ( top < 224 || top > 239 ) {
+        errlogPrintf ( "%s is not an IPv4 multicast address, ignored\n", 
+            EPICS_CA_MCAST_GROUP.name );
+        return false;
+    }
+    *pGroup = group;
+    return true;
+}
+
 /*
  * configureChannelAccessAddressList ()
  */
@@ -215,7 +242,21 @@ extern "C" void epicsShareAPI configureChannelAccessAddressList
      * LOCK is for piiu->destAddr list
      * (lock outside because this is used by the server also)
      */
-    if (yes) {
+    struct in_addr group;
+    if ( yes && getChannelAccessMulticastGroup ( &group ) ) {
+        osiSockAddrNode *pNewNode;
+        pNewNode = (osiSockAddrNode *) calloc ( 1, sizeof (*pNewNode) );
+        if ( pNewNode ) {
+            pNewNode->addr.ia.sin_family = AF_INET;
+            pNewNode->addr.ia.sin_addr = group;
+            pNewNode->addr.ia.sin_port = htons ( port );
+            ellAdd ( &tmpList, &pNewNode->node );
+        }
+        else {
+            errlogPrintf ( "configureChannelAccessAddressList(): no memory available for configuration\n" );
+        }
+    }
+    else if (yes) {
 		ELLLIST bcastList;
         osiSockAddr addr;
 		ellInit ( &bcastList );
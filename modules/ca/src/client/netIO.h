@@ -63,6 +63,9 @@ public:
     virtual void forceSubscriptionUpdate (
         epicsGuard < epicsMutex > & guard, nciu & chan ) = 0;
     virtual class netSubscription * isSubscription () = 0;
+    virtual void * completionBuffer (
+        epicsGuard < epicsMutex > &, unsigned type,
+        arrayElementCount count ) = 0;
     virtual void show ( 
         unsigned level ) const = 0;
     virtual void show ( 
@@ -106,6 +109,9 @@ private:
     const unsigned mask;
     bool subscribed;
     class netSubscription * isSubscription ();
+    void * completionBuffer (
+        epicsGuard < epicsMutex > &, unsigned type,
+        arrayElementCount count );
     void operator delete ( void * );
     void * operator new ( size_t, 
         tsFreeList < class netSubscription, 1024, epicsMutexNOOP > & );
@@ -167,6 +173,9 @@ private:
         int status, const char * pContext, 
         unsigned type, arrayElementCount count );
     class netSubscription * isSubscription ();
+    void * completionBuffer (
+        epicsGuard < epicsMutex > &, unsigned type,
+        arrayElementCount count );
     void forceSubscriptionUpdate (
         epicsGuard < epicsMutex > & guard, nciu & chan );
     netReadNotifyIO ( const netReadNotifyIO & );
@@ -194,6 +203,9 @@ private:
     epicsPlacementDeleteOperator (( void *,
         tsFreeList < class netWriteNotifyIO, 1024, epicsMutexNOOP > & ))
     class netSubscription * isSubscription ();
+    void * completionBuffer (
+        epicsGuard < epicsMutex > &, unsigned type,
+        arrayElementCount count );
     void destroy ( 
         epicsGuard < epicsMutex > &, class cacRecycle & );
     void completion (
@@ -114,6 +114,13 @@ class netSubscription * netReadNotifyIO::isSubscription ()
     return 0;
 }
 
+void * netReadNotifyIO::completionBuffer (
+    epicsGuard < epicsMutex > & guard, 
+    unsigned type, arrayElementCount count )
+{
+    return this->notify.completionBuffer ( guard, type, count );
+}
+
 void netReadNotifyIO::forceSubscriptionUpdate (
     epicsGuard < epicsMutex > &, nciu & )
 {
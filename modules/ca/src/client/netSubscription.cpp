@@ -64,6 +64,12 @@ class netSubscription * netSubscription::isSubscription ()
     return this;
 }
 
+void * netSubscription::completionBuffer (
+    epicsGuard < epicsMutex > &, unsigned, arrayElementCount )
+{
+    return 0;
+}
+
 void netSubscription::show ( unsigned /* level */ ) const
 {
     ::printf ( "event subscription IO at %p, type %s, element count %lu, mask %u\n", 
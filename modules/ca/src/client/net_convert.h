@@ -25,6 +25,11 @@ extern "C" {
 
 typedef unsigned long arrayElementCount;
 
+/*
+ * Converts count elements of a DBR type between network and host byte
+ * order.  Returns ECA_BADTYPE, without writing to pDest, if the type is
+ * unknown, otherwise ECA_NORMAL.
+ */
 epicsShareFunc int caNetConvert ( 
     unsigned type, const void *pSrc, void *pDest, 
     int hton, arrayElementCount count );
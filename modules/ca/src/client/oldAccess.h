@@ -195,6 +195,9 @@ private:
     void exception (
         epicsGuard < epicsMutex > &, int status,
         const char *pContext, unsigned type, arrayElementCount count );
+    void * completionBuffer (
+        epicsGuard < epicsMutex > &, unsigned type,
+        arrayElementCount count );
 	getCopy ( const getCopy & );
 	getCopy & operator = ( const getCopy & );
     void operator delete ( void * );
@@ -421,6 +424,7 @@ private:
     void attachToClientCtx ();
     void callbackProcessingInitiateNotify ();
     void callbackProcessingCompleteNotify ();
+    bool preemptiveCallbackEnabled () const;
     cacContext & createNetworkContext (
         epicsMutex & mutualExclusion, epicsMutex & callbackControl );
     void _sendWakeupMsg ();
@@ -570,6 +574,11 @@ inline bool ca_client_context::preemptiveCallbakIsEnabled () const
     return this->pCallbackGuard.get () == 0;
 }
 
+inline bool ca_client_context::preemptiveCallbackEnabled () const
+{
+    return this->preemptiveCallbakIsEnabled ();
+}
+
 inline bool ca_client_context::ioComplete () const
 {
     return ( this->pndRecvCnt == 0u );
@@ -556,6 +556,10 @@ int epicsShareAPI ca_create_subscription (
         return ECA_BADMASK;
     }
 
+    if ( mask == DBE_LATEST ) {
+        return ECA_BADMASK;
+    }
+
     try {
         epicsGuard < epicsMutex > guard ( pChan->cacCtx.mutexRef () );
         try {
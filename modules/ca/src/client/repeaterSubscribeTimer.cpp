@@ -78,6 +78,8 @@ epicsTimerNotify::expireStatus repeaterSubscribeTimer::
     "Silence this message by starting a CA repeater daemon\n") ;
         this->iiu.printFormated ( mgr.cbGuard,
     "or by calling ca_pend_event() and or ca_poll() more often.\n" );
+        this->iiu.printFormated ( mgr.cbGuard,
+    "If other CA clients on this host set EPICS_CA_MCAST_GROUP, set it here too.\n" );
         this->once = true;
     }
 
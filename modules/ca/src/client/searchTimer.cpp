@@ -44,6 +44,7 @@ searchTimer::searchTimer (
         epicsMutex & mutexIn,
         bool boostPossibleIn ) :
     timeAtLastSend ( epicsTime::getCurrent () ),
+    timeAtRoundBegin ( timeAtLastSend ),
     timer ( queueIn.createTimer () ),
     iiu ( iiuIn ),
     mutex ( mutexIn ),
@@ -52,11 +53,16 @@ searchTimer::searchTimer (
     retry ( 0 ),
     searchAttempts ( 0u ),
     searchResponses ( 0u ),
+    framesThisRound ( 0u ),
+    pacedSends ( 0u ),
+    totalSearchAttempts ( 0.0 ),
+    totalSearchResponses ( 0.0 ),
     index ( indexIn ),
     dgSeqNoAtTimerExpireBegin ( 0u ),
     dgSeqNoAtTimerExpireEnd ( 0u ),
     boostPossible ( boostPossibleIn ),
-    stopped ( false )
+    stopped ( false ),
+    roundContinues ( false )
 {
 }
 
@@ -105,6 +111,17 @@ void searchTimer::installChannel (
     chan.channelNode::setReqPendingState ( guard, this->index );
 }
 
+//
+// recently disconnected channels are searched for ahead 
+// of those that were never found
+//
+void searchTimer::installPriorityChannel ( 
+    epicsGuard < epicsMutex > & guard, nciu & chan )
+{
+    this->chanListReqPending.push ( chan );
+    chan.channelNode::setReqPendingState ( guard, this->index );
+}
+
 void searchTimer::moveChannels ( 
     epicsGuard < epicsMutex > & guard, searchTimer & dest )
 {
@@ -127,6 +144,14 @@ epicsTimerNotify::expireStatus searchTimer::expire (
 {
     epicsGuard < epicsMutex > guard ( this->mutex );
 
+    // a round postponed by the bandwidth budget carries on 
+    // sending without declaring the channels already searched 
+    // for as unanswered
+    if ( this->roundContinues ) {
+        this->roundContinues = false;
+        return this->sendSearchRequests ( guard, currentTime );
+    }
+
     while ( nciu * pChan = this->chanListRespPending.get () ) {
         pChan->channelNode::listMember = 
             channelNode::cs_none;
@@ -134,7 +159,7 @@ epicsTimerNotify::expireStatus searchTimer::expire (
             guard, *pChan, this->index );
     }
     
-    this->timeAtLastSend = currentTime;
+    this->timeAtRoundBegin = currentTime;
 
     // boost search period for channels not recently
     // searched for if there was some success
@@ -232,9 +257,19 @@ epicsTimerNotify::expireStatus searchTimer::expire (
 
     this->searchAttempts = 0;
     this->searchResponses = 0;
+    this->framesThisRound = 0u;
+
+    return this->sendSearchRequests ( guard, currentTime );
+}
+
+epicsTimerNotify::expireStatus searchTimer::sendSearchRequests ( 
+    epicsGuard < epicsMutex > & guard, const epicsTime & currentTime )
+{
+    this->timeAtLastSend = currentTime;
 
-    unsigned nFrameSent = 0u;
-    while ( true ) {
+    double pacingDelay = 
+        this->iiu.searchPacingDelay ( guard, currentTime );
+    while ( pacingDelay <= 0.0 ) {
         nciu * pChan = this->chanListReqPending.get ();
         if ( ! pChan ) {
             break;
@@ -246,9 +281,13 @@ epicsTimerNotify::expireStatus searchTimer::expire (
         bool success = pChan->searchMsg ( guard );
         if ( ! success ) {
             if ( this->iiu.datagramFlush ( guard, currentTime ) ) {
-                nFrameSent++;
-                if ( nFrameSent < this->framesPerTry ) {
-                    success = pChan->searchMsg ( guard );
+                this->framesThisRound++;
+                if ( this->framesThisRound < this->framesPerTry ) {
+                    pacingDelay = this->iiu.searchPacingDelay ( 
+                        guard, currentTime );
+                    if ( pacingDelay <= 0.0 ) {
+                        success = pChan->searchMsg ( guard );
+                    }
                 }
             }
             if ( ! success ) {
@@ -266,11 +305,12 @@ epicsTimerNotify::expireStatus searchTimer::expire (
         if ( this->searchAttempts < UINT_MAX ) {
             this->searchAttempts++;
         }
+        this->totalSearchAttempts++;
     }
 
     // flush out the search request buffer
     if ( this->iiu.datagramFlush ( guard, currentTime ) ) {
-        nFrameSent++;
+        this->framesThisRound++;
     }
 
     this->dgSeqNoAtTimerExpireEnd = 
@@ -281,11 +321,24 @@ epicsTimerNotify::expireStatus searchTimer::expire (
             char buf[64];
             currentTime.strftime ( buf, sizeof(buf), "%M:%S.%09f");
             debugPrintf ( ("sent %u delay sec=%f Rts=%s\n", 
-                nFrameSent, this->period(), buf ) );
+                this->framesThisRound, this->period(), buf ) );
         }
 #   endif
 
-    return expireStatus ( restart, this->period ( guard ) );
+    double delay = this->period ( guard ) - 
+        ( currentTime - this->timeAtRoundBegin );
+    if ( delay < 0.0 ) {
+        delay = 0.0;
+    }
+    if ( pacingDelay > 0.0 && this->chanListReqPending.count () ) {
+        this->pacedSends++;
+        if ( pacingDelay < delay && 
+                this->framesThisRound < this->framesPerTry ) {
+            this->roundContinues = true;
+            delay = pacingDelay;
+        }
+    }
+    return expireStatus ( restart, delay );
 }
 
 void searchTimer :: show ( unsigned level ) const
@@ -293,6 +346,24 @@ void searchTimer :: show ( unsigned level ) const
     epicsGuard < epicsMutex > guard ( this->mutex );
     ::printf ( "searchTimer with period %f\n", this->period ( guard ) );
     if ( level > 0 ) {
+        ::printf ( "UDP frames per try %g", this->framesPerTry );
+        if ( this->framesPerTryCongestThresh < DBL_MAX ) {
+            ::printf ( ", congestion threshold %g", 
+                this->framesPerTryCongestThresh );
+        }
+        ::printf ( "\n" );
+        ::printf ( "last round %u frames, %u searches, %u responses\n", 
+            this->framesThisRound, this->searchAttempts, 
+            this->searchResponses );
+        double lossPercent = 0.0;
+        if ( this->totalSearchAttempts > 0.0 ) {
+            lossPercent = 100.0 * ( 1.0 - this->totalSearchResponses / 
+                this->totalSearchAttempts );
+        }
+        ::printf ( "%.0f searches, %.0f responses (%.1f%% unanswered), "
+            "%u sends postponed by the bandwidth budget\n", 
+            this->totalSearchAttempts, this->totalSearchResponses, 
+            lossPercent, this->pacedSends );
         ::printf ( "channels with search request pending = %u\n", 
             this->chanListReqPending.count () );
         if ( level > 1u ) {
@@ -343,8 +414,13 @@ void searchTimer::uninstallChanDueToSuccessfulSearchResponse (
     // if we receive a successful response then reset to a
     // reasonable timer period
     if ( validResponse ) {
-        double measured = currentTime - this->timeAtLastSend;
+        epicsTime sendTime = this->timeAtLastSend;
+        if ( seqNumberIsValid ) {
+            this->iiu.datagramSendTime ( guard, respDatagramSeqNo, sendTime );
+        }
+        double measured = currentTime - sendTime;
         this->iiu.updateRTTE ( guard, measured );
+        this->totalSearchResponses++;
 
         if ( this->searchResponses < UINT_MAX ) {
             this->searchResponses++;
@@ -57,6 +57,11 @@ public:
         const epicsTime & currentTime ) = 0;
     virtual ca_uint32_t datagramSeqNumber (
         epicsGuard < epicsMutex > & ) const = 0;
+    virtual bool datagramSendTime ( epicsGuard < epicsMutex > &,
+        ca_uint32_t seqNumber, epicsTime & sendTime ) const = 0;
+    // seconds until the search bandwidth budget allows another frame
+    virtual double searchPacingDelay ( 
+        epicsGuard < epicsMutex > &, const epicsTime & currentTime ) = 0;
 };
 
 class searchTimer : private epicsTimerNotify {
@@ -74,6 +79,8 @@ public:
         epicsGuard < epicsMutex > &, searchTimer & dest );
     void installChannel ( 
         epicsGuard < epicsMutex > &, nciu & );
+    void installPriorityChannel ( 
+        epicsGuard < epicsMutex > &, nciu & );
     void uninstallChan ( 
         epicsGuard < epicsMutex > &, nciu & );
     void uninstallChanDueToSuccessfulSearchResponse ( 
@@ -85,6 +92,7 @@ private:
     tsDLList < nciu > chanListReqPending;
     tsDLList < nciu > chanListRespPending;
     epicsTime timeAtLastSend;
+    epicsTime timeAtRoundBegin;
     epicsTimer & timer;
     searchTimerNotify & iiu;
     epicsMutex & mutex;
@@ -93,13 +101,20 @@ private:
     unsigned retry;
     unsigned searchAttempts; /* num search tries after last timer experation */
     unsigned searchResponses; /* num search resp after last timer experation */
+    unsigned framesThisRound; /* UDP frames sent since the round began */
+    unsigned pacedSends; /* expirations postponed by the bandwidth budget */
+    double totalSearchAttempts;
+    double totalSearchResponses;
     const unsigned index;
     ca_uint32_t dgSeqNoAtTimerExpireBegin; 
     ca_uint32_t dgSeqNoAtTimerExpireEnd;
     const bool boostPossible;
     bool stopped;
+    bool roundContinues; /* next expire continues a paced round */
 
     expireStatus expire ( const epicsTime & currentTime );
+    expireStatus sendSearchRequests ( 
+        epicsGuard < epicsMutex > &, const epicsTime & currentTime );
     double period ( epicsGuard < epicsMutex > & ) const;
 	searchTimer ( const searchTimer & ); // not implemented
 	searchTimer & operator = ( const searchTimer & ); // not implemented
@@ -0,0 +1,481 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*
+ *  Virtual circuits serviced by a few epoll driven I/O threads
+ *  (EPICS_CA_TCP_IO_THREADS), see tcpIoLoop in virtualCircuit.h
+ *
+ *  The sockets of these circuits are nonblocking.  The I/O thread
+ *  keeps waiting for a socket to become readable, and also for it to
+ *  become writable while there are requests to send.  Where the send
+ *  thread would block in send() the rest of the buffer is kept by
+ *  the circuit, and the send watchdog keeps running until the socket
+ *  takes it.  A clean shutdown waits for the server to close the
+ *  circuit for at most 30 seconds, as the send thread does.
+ */
+
+#ifdef _MSC_VER
+#   pragma warning(disable:4355)
+#endif
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include <string.h>
+
+#ifdef __linux__
+#   include <sys/epoll.h>
+#   include <sys/eventfd.h>
+#   include <unistd.h>
+#   define CAC_HAVE_EPOLL
+#endif
+
+#include "epicsAtomic.h"
+#include "errlog.h"
+
+#define epicsExportSharedSymbols
+#include "iocinf.h"
+#include "virtualCircuit.h"
+#include "cac.h"
+
+static const double cleanShutdownDelay = 30.0; // sec
+static const int ioEventsMax = 64;
+
+tcpIoLoop::tcpIoLoop ( cac & cacIn, unsigned priority ) :
+    thread ( *this, "CAC-TCP-io",
+        epicsThreadGetStackSize ( epicsThreadStackBig ), priority ),
+    cacRef ( cacIn ), nWakeups ( 0u ), nEvents ( 0u ), nCircuits ( 0u ),
+    epfd ( -1 ), wakeupFd ( -1 ), exitRequested ( 0 )
+{
+#ifdef CAC_HAVE_EPOLL
+    this->epfd = epoll_create1 ( EPOLL_CLOEXEC );
+    if ( this->epfd >= 0 ) {
+        this->wakeupFd = eventfd ( 0, EFD_CLOEXEC | EFD_NONBLOCK );
+    }
+    int status = -1;
+    if ( this->wakeupFd >= 0 ) {
+        struct epoll_event event;
+        memset ( & event, 0, sizeof ( event ) );
+        event.events = EPOLLIN;
+        event.data.ptr = 0;
+        status = epoll_ctl ( this->epfd, EPOLL_CTL_ADD,
+            this->wakeupFd, & event );
+    }
+    if ( status < 0 ) {
+        char sockErrBuf[64];
+        epicsSocketConvertErrnoToString (
+            sockErrBuf, sizeof ( sockErrBuf ) );
+        if ( this->wakeupFd >= 0 ) {
+            ::close ( this->wakeupFd );
+        }
+        if ( this->epfd >= 0 ) {
+            ::close ( this->epfd );
+        }
+        std :: string reason = "epoll setup failed because \"";
+        reason += sockErrBuf;
+        reason += "\"";
+        throw std :: runtime_error ( reason );
+    }
+    this->thread.start ();
+#else
+    throw std :: runtime_error ( "epoll isnt available on this target" );
+#endif
+}
+
+tcpIoLoop::~tcpIoLoop ()
+{
+#ifdef CAC_HAVE_EPOLL
+    // the cac destroys us after all of our circuits are gone
+    epicsAtomicSetIntT ( & this->exitRequested, true );
+    epicsUInt64 one = 1u;
+    if ( ::write ( this->wakeupFd, & one, sizeof ( one ) ) < 0 ) {
+        errlogPrintf ( "CAC: TCP I/O thread wakeup failed\n" );
+    }
+    this->thread.exitWait ();
+    ::close ( this->wakeupFd );
+    ::close ( this->epfd );
+#endif
+}
+
+// the circuit is connected by the I/O thread
+void tcpIoLoop::install (
+    epicsGuard < epicsMutex > & guard, tcpiiu & iiu )
+{
+    guard.assertIdenticalMutex ( this->cacRef.mutexRef () );
+    this->installReq.push_back ( & iiu );
+    this->nCircuits++;
+#ifdef CAC_HAVE_EPOLL
+    epicsUInt64 one = 1u;
+    if ( ::write ( this->wakeupFd, & one, sizeof ( one ) ) < 0 ) {
+        errlogPrintf ( "CAC: TCP I/O thread wakeup failed\n" );
+    }
+#endif
+}
+
+void tcpIoLoop::sendWakeup (
+    epicsGuard < epicsMutex > & guard, tcpiiu & iiu )
+{
+    guard.assertIdenticalMutex ( this->cacRef.mutexRef () );
+    this->watch ( iiu, true );
+}
+
+unsigned tcpIoLoop::circuitCount (
+    epicsGuard < epicsMutex > & guard ) const
+{
+    guard.assertIdenticalMutex ( this->cacRef.mutexRef () );
+    return this->nCircuits;
+}
+
+void tcpIoLoop::show (
+    epicsGuard < epicsMutex > & guard, unsigned level ) const
+{
+    guard.assertIdenticalMutex ( this->cacRef.mutexRef () );
+    ::printf ( "\t%u circuit%s", this->nCircuits,
+        this->nCircuits == 1u ? "" : "s" );
+    if ( level > 1u && this->nWakeups ) {
+        ::printf ( ", %.1f ready per wakeup",
+            static_cast < double > ( this->nEvents ) / this->nWakeups );
+    }
+    ::printf ( "\n" );
+}
+
+#ifdef CAC_HAVE_EPOLL
+
+void tcpIoLoop::run ()
+{
+    // callbacks are called by this thread, and it must not block
+    // when they flush
+    epicsThreadPrivateSet ( caClientCallbackThreadId, this );
+    this->cacRef.attachToClientCtx ();
+
+    struct epoll_event events[ioEventsMax];
+    while ( true ) {
+        int timeout = this->closing.size () ? 1000 : -1;
+        int n = epoll_wait ( this->epfd, events, ioEventsMax, timeout );
+        if ( n < 0 ) {
+            if ( SOCKERRNO != SOCK_EINTR ) {
+                char sockErrBuf[64];
+                epicsSocketConvertErrnoToString (
+                    sockErrBuf, sizeof ( sockErrBuf ) );
+                errlogPrintf ( "CAC: epoll_wait error: %s\n", sockErrBuf );
+                epicsThreadSleep ( 1.0 );
+            }
+            continue;
+        }
+        this->nWakeups++;
+        this->nEvents += n;
+
+        for ( int i = 0; i < n; i++ ) {
+            tcpiiu * piiu = static_cast < tcpiiu * > ( events[i].data.ptr );
+            if ( piiu ) {
+                unsigned ev = events[i].events;
+                this->service ( *piiu,
+                    ( ev & ( EPOLLIN | EPOLLHUP | EPOLLERR ) ) != 0,
+                    ( ev & ( EPOLLOUT | EPOLLHUP | EPOLLERR ) ) != 0 );
+                continue;
+            }
+
+            epicsUInt64 count;
+            if ( ::read ( this->wakeupFd, & count, sizeof ( count ) ) < 0 ) {
+                count = 0u;
+            }
+            if ( epicsAtomicGetIntT ( & this->exitRequested ) ) {
+                return;
+            }
+            std::vector < tcpiiu * > req;
+            {
+                epicsGuard < epicsMutex > guard ( this->cacRef.mutexRef () );
+                req.swap ( this->installReq );
+            }
+            for ( size_t j = 0u; j < req.size (); j++ ) {
+                if ( ! this->connect ( *req[j] ) ) {
+                    this->finish ( *req[j] );
+                }
+            }
+        }
+
+        if ( this->closing.size () ) {
+            this->abortUnclosed ();
+        }
+    }
+}
+
+void tcpIoLoop::service ( tcpiiu & iiu, bool recvReady, bool sendReady )
+{
+    bool done = false;
+    try {
+        if ( iiu.connectPending ) {
+            done = ! this->connectComplete ( iiu );
+            // the version, user, and host name messages are queued
+            sendReady = true;
+        }
+        if ( ! done && recvReady ) {
+            done = ! this->recvLabor ( iiu );
+        }
+        if ( ! done && sendReady ) {
+            this->sendLabor ( iiu );
+        }
+    }
+    catch ( std::exception & except ) {
+        errlogPrintf (
+            "CA client library tcp I/O thread "
+            "disconnecting due to C++ exception \"%s\"\n",
+            except.what () );
+        epicsGuard < epicsMutex > guard ( iiu.mutex );
+        iiu.initiateAbortShutdown ( guard );
+        done = true;
+    }
+    catch ( ... ) {
+        errlogPrintf (
+            "CA client library tcp I/O thread "
+            "disconnecting due to a non-standard C++ exception\n" );
+        epicsGuard < epicsMutex > guard ( iiu.mutex );
+        iiu.initiateAbortShutdown ( guard );
+        done = true;
+    }
+    if ( done ) {
+        this->finish ( iiu );
+    }
+}
+
+// the I/O thread counterpart of tcpRecvThread::connect (),
+// returns false if the circuit has to be destroyed
+bool tcpIoLoop::connect ( tcpiiu & iiu )
+{
+    {
+        epicsGuard < epicsMutex > guard ( iiu.mutex );
+        if ( iiu.state != tcpiiu::iiucs_connecting ) {
+            return false;
+        }
+    }
+
+    osiSockIoctl_t yes = true;
+    int status = socket_ioctl ( iiu.sock, FIONBIO, & yes );
+    if ( status >= 0 ) {
+        osiSockAddr tmp = iiu.address ();
+        status = ::connect ( iiu.sock, & tmp.sa, sizeof ( tmp.sa ) );
+        if ( status < 0 ) {
+            int errnoCpy = SOCKERRNO;
+            if ( errnoCpy == SOCK_EINPROGRESS || errnoCpy == SOCK_EINTR ) {
+                status = 0;
+            }
+        }
+    }
+    if ( status >= 0 ) {
+        // connect completion is signaled by the socket becoming writable
+        struct epoll_event event;
+        memset ( & event, 0, sizeof ( event ) );
+        event.events = EPOLLIN | EPOLLOUT;
+        event.data.ptr = & iiu;
+        status = epoll_ctl ( this->epfd, EPOLL_CTL_ADD, iiu.sock, & event );
+    }
+    if ( status < 0 ) {
+        char sockErrBuf[64];
+        epicsSocketConvertErrnoToString (
+            sockErrBuf, sizeof ( sockErrBuf ) );
+        errlogPrintf ( "CAC: Unable to connect because \"%s\"\n",
+            sockErrBuf );
+        epicsGuard < epicsMutex > guard ( iiu.mutex );
+        iiu.disconnectNotify ( guard );
+        return false;
+    }
+    iiu.connectPending = true;
+    return true;
+}
+
+bool tcpIoLoop::connectComplete ( tcpiiu & iiu )
+{
+    int error = 0;
+    osiSocklen_t errorSize = sizeof ( error );
+    if ( getsockopt ( iiu.sock, SOL_SOCKET, SO_ERROR,
+            reinterpret_cast < char * > ( & error ), & errorSize ) < 0 ) {
+        error = SOCKERRNO;
+    }
+
+    epicsGuard < epicsMutex > guard ( iiu.mutex );
+    iiu.connectPending = false;
+    if ( iiu.state != tcpiiu::iiucs_connecting ) {
+        return false;
+    }
+    if ( error ) {
+        char sockErrBuf[64];
+        epicsSocketConvertErrorToString (
+            sockErrBuf, sizeof ( sockErrBuf ), error );
+        errlogPrintf ( "CAC: Unable to connect because \"%s\"\n",
+            sockErrBuf );
+        iiu.disconnectNotify ( guard );
+        return false;
+    }
+    // put the iiu into the connected state
+    iiu.state = tcpiiu::iiucs_connected;
+    iiu.recvDog.connectNotify ( guard );
+    return true;
+}
+
+// returns false once the circuit has shut down
+bool tcpIoLoop::recvLabor ( tcpiiu & iiu )
+{
+    if ( iiu.recvBodyInPlace ) {
+        comBuf * pNoBuf = 0;
+        statusWireIO stat;
+        iiu.recvBody ( stat );
+        return iiu.recvLabor ( pNoBuf, stat );
+    }
+    comBuf * pComBuf = new ( iiu.comBufMemMgr ) comBuf;
+    statusWireIO stat;
+    pComBuf->fillFromWire ( iiu, stat );
+    bool alive = iiu.recvLabor ( pComBuf, stat );
+    if ( pComBuf ) {
+        pComBuf->~comBuf ();
+        iiu.comBufMemMgr.release ( pComBuf );
+    }
+    return alive;
+}
+
+// the I/O thread counterpart of tcpSendThread::run ()
+bool tcpIoLoop::sendLabor ( tcpiiu & iiu )
+{
+    epicsGuard < epicsMutex > guard ( iiu.mutex );
+
+    if ( iiu.sendShutdown ) {
+        return false;
+    }
+
+    if ( iiu.state == tcpiiu::iiucs_connected ) {
+        bool laborPending = false;
+        // the rest of a buffer goes out before more requests are queued
+        if ( ! iiu.pSendBuf ) {
+            laborPending = iiu.sendLabor ( guard );
+        }
+        if ( iiu.sendThreadFlush ( guard ) ) {
+            // other threads may have queued more labor, or
+            // changed the state, while the lock was released
+            // for sending
+            laborPending = laborPending || iiu.pSendBuf ||
+                iiu.state != tcpiiu::iiucs_connected ||
+                iiu.echoRequestPending ||
+                iiu.busyStateDetected != iiu.flowControlActive ||
+                iiu.createReqPend.count () ||
+                iiu.subscripReqPend.count () ||
+                iiu.subscripUpdateReqPend.count () ||
+                iiu.sendQue.occupiedBytes () > 0u;
+            // the send thread would wait for a wakeup if
+            // there is no labor pending
+            if ( laborPending != iiu.sendArmed ) {
+                iiu.sendArmed = laborPending;
+                this->watch ( iiu, laborPending );
+            }
+            return true;
+        }
+    }
+
+    if ( iiu.state == tcpiiu::iiucs_clean_shutdown ) {
+        iiu.sendThreadFlush ( guard );
+        if ( iiu.pSendBuf ) {
+            if ( ! iiu.sendArmed ) {
+                iiu.sendArmed = true;
+                this->watch ( iiu, true );
+            }
+            return true;
+        }
+        // this should cause the server to disconnect from
+        // the client
+        int status = ::shutdown ( iiu.sock, SHUT_WR );
+        if ( status ) {
+            char sockErrBuf[64];
+            epicsSocketConvertErrnoToString (
+                sockErrBuf, sizeof ( sockErrBuf ) );
+            errlogPrintf ("CAC TCP clean socket shutdown error was %s\n",
+                sockErrBuf );
+        }
+    }
+
+    // only the receive side is still serviced, sendArmed stays
+    // set so that other threads dont wait for the socket to
+    // become writable again
+    iiu.sendShutdown = true;
+    iiu.sendShutdownTime = epicsTime::getCurrent ();
+    this->closing.push_back ( & iiu );
+    this->watch ( iiu, false );
+    return false;
+}
+
+void tcpIoLoop::watch ( tcpiiu & iiu, bool send )
+{
+    struct epoll_event event;
+    memset ( & event, 0, sizeof ( event ) );
+    event.events = send ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    event.data.ptr = & iiu;
+    if ( epoll_ctl ( this->epfd, EPOLL_CTL_MOD, iiu.sock, & event ) ) {
+        char sockErrBuf[64];
+        epicsSocketConvertErrnoToString (
+            sockErrBuf, sizeof ( sockErrBuf ) );
+        errlogPrintf ( "CAC: epoll_ctl error: %s\n", sockErrBuf );
+    }
+}
+
+// see the shutdown timeout in tcpSendThread::run ()
+void tcpIoLoop::abortUnclosed ()
+{
+    epicsTime current = epicsTime::getCurrent ();
+    epicsGuard < epicsMutex > guard ( this->cacRef.mutexRef () );
+    for ( size_t i = 0u; i < this->closing.size (); i++ ) {
+        tcpiiu & iiu = * this->closing[i];
+        if ( current - iiu.sendShutdownTime >= cleanShutdownDelay ) {
+            iiu.initiateAbortShutdown ( guard );
+        }
+    }
+}
+
+void tcpIoLoop::finish ( tcpiiu & iiu )
+{
+    {
+        epicsGuard < epicsMutex > guard ( iiu.mutex );
+        // other threads no longer modify the epoll set
+        iiu.sendArmed = true;
+        this->nCircuits--;
+    }
+
+    // the circuit might never have been added
+    struct epoll_event event;
+    epoll_ctl ( this->epfd, EPOLL_CTL_DEL, iiu.sock, & event );
+
+    std::vector < tcpiiu * > :: iterator pos =
+        std::find ( this->closing.begin (), this->closing.end (), & iiu );
+    if ( pos != this->closing.end () ) {
+        this->closing.erase ( pos );
+    }
+
+    iiu.sendDog.cancel ();
+    iiu.recvDog.shutdown ();
+
+    // user threads blocking for send backlog to be reduced
+    // will abort their attempt to get space if
+    // the state of the tcpiiu changes from connected to a
+    // disconnecting state. Nevertheless, we need to wait
+    // for them to finish prior to destroying the IIU.
+    {
+        epicsGuard < epicsMutex > guard ( iiu.mutex );
+        while ( iiu.blockingForFlush ) {
+            epicsGuardRelease < epicsMutex > unguard ( guard );
+            epicsThreadSleep ( 0.1 );
+        }
+    }
+    this->cacRef.destroyIIU ( iiu );
+}
+
+#else /* CAC_HAVE_EPOLL */
+
+void tcpIoLoop::run () {}
+void tcpIoLoop::service ( tcpiiu &, bool, bool ) {}
+bool tcpIoLoop::connect ( tcpiiu & ) { return false; }
+bool tcpIoLoop::connectComplete ( tcpiiu & ) { return false; }
+bool tcpIoLoop::recvLabor ( tcpiiu & ) { return false; }
+bool tcpIoLoop::sendLabor ( tcpiiu & ) { return false; }
+void tcpIoLoop::watch ( tcpiiu &, bool ) {}
+void tcpIoLoop::abortUnclosed () {}
+void tcpIoLoop::finish ( tcpiiu & ) {}
+
+#endif /* CAC_HAVE_EPOLL */
@@ -40,6 +40,8 @@
 #include "netiiu.h"
 #include "hostNameCache.h"
 #include "net_convert.h"
+#include "caCompress.h"
+#include "caSharedRing.h"
 #include "bhe.h"
 #include "epicsSignal.h"
 #include "caerr.h"
@@ -91,79 +93,7 @@ void tcpSendThread::run ()
                 break;
             }
 
-            laborPending = false;
-            bool flowControlLaborNeeded = 
-                this->iiu.busyStateDetected != this->iiu.flowControlActive;
-            bool echoLaborNeeded = this->iiu.echoRequestPending;
-            this->iiu.echoRequestPending = false;
-
-            if ( flowControlLaborNeeded ) {
-                if ( this->iiu.flowControlActive ) {
-                    this->iiu.disableFlowControlRequest ( guard );
-                    this->iiu.flowControlActive = false;
-                    debugPrintf ( ( "fc off\n" ) );
-                }
-                else {
-                    this->iiu.enableFlowControlRequest ( guard );
-                    this->iiu.flowControlActive = true;
-                    debugPrintf ( ( "fc on\n" ) );
-                }
-            }
-
-            if ( echoLaborNeeded ) {
-                this->iiu.echoRequest ( guard );
-            }
-
-            while ( nciu * pChan = this->iiu.createReqPend.get () ) {
-                this->iiu.createChannelRequest ( *pChan, guard );
-
-                if ( CA_V42 ( this->iiu.minorProtocolVersion ) ) {
-                    this->iiu.createRespPend.add ( *pChan );
-                    pChan->channelNode::listMember = 
-                        channelNode::cs_createRespPend;
-                }
-                else {
-                    // This wakes up the resp thread so that it can call
-                    // the connect callback. This isnt maximally efficent
-                    // but it has the excellent side effect of not requiring
-                    // that the UDP thread take the callback lock. There are
-                    // almost no V42 servers left at this point.
-                    this->iiu.v42ConnCallbackPend.add ( *pChan );
-                    pChan->channelNode::listMember = 
-                        channelNode::cs_v42ConnCallbackPend;
-                    this->iiu.echoRequestPending = true;
-                    laborPending = true;
-                }
-                
-                if ( this->iiu.sendQue.flushBlockThreshold () ) {
-                    laborPending = true;
-                    break;
-                }
-            }
-
-            while ( nciu * pChan = this->iiu.subscripReqPend.get () ) {
-                // this installs any subscriptions as needed
-                pChan->resubscribe ( guard );
-                this->iiu.connectedList.add ( *pChan );
-                pChan->channelNode::listMember = 
-                    channelNode::cs_connected;
-                if ( this->iiu.sendQue.flushBlockThreshold () ) {
-                    laborPending = true;
-                    break;
-                }
-            }
-
-            while ( nciu * pChan = this->iiu.subscripUpdateReqPend.get () ) {
-                // this updates any subscriptions as needed
-                pChan->sendSubscriptionUpdateRequests ( guard );
-                this->iiu.connectedList.add ( *pChan );
-                pChan->channelNode::listMember = 
-                    channelNode::cs_connected;
-                if ( this->iiu.sendQue.flushBlockThreshold () ) {
-                    laborPending = true;
-                    break;
-                }
-            }
+            laborPending = this->iiu.sendLabor ( guard );
 
             if ( ! this->iiu.sendThreadFlush ( guard ) ) {
                 break;
@@ -202,7 +132,7 @@ void tcpSendThread::run ()
     this->iiu.sendDog.cancel ();
     this->iiu.recvDog.shutdown ();
 
-    while ( ! this->iiu.recvThread.exitWait ( 30.0 ) ) {
+    while ( ! this->iiu.pRecvThread->exitWait ( 30.0 ) ) {
         // it is possible to get stuck here if the user calls 
         // ca_context_destroy() when a circuit isnt known to
         // be unresponsive, but is. That situation is probably
@@ -229,6 +159,91 @@ void tcpSendThread::run ()
     this->iiu.cacRef.destroyIIU ( this->iiu );
 }
 
+// requests which the send thread queues on behalf of other threads,
+// returns true if it has to be called again after the send queue
+// has been flushed
+bool tcpiiu::sendLabor ( epicsGuard < epicsMutex > & guard )
+{
+    guard.assertIdenticalMutex ( this->mutex );
+
+    bool laborPending = false;
+
+    bool flowControlLaborNeeded = 
+        this->busyStateDetected != this->flowControlActive;
+    bool echoLaborNeeded = this->echoRequestPending;
+    this->echoRequestPending = false;
+
+    if ( flowControlLaborNeeded ) {
+        if ( this->flowControlActive ) {
+            this->disableFlowControlRequest ( guard );
+            this->flowControlActive = false;
+            debugPrintf ( ( "fc off\n" ) );
+        }
+        else {
+            this->enableFlowControlRequest ( guard );
+            this->flowControlActive = true;
+            debugPrintf ( ( "fc on\n" ) );
+        }
+    }
+
+    if ( echoLaborNeeded ) {
+        this->echoRequest ( guard );
+    }
+
+    while ( nciu * pChan = this->createReqPend.get () ) {
+        this->createChannelRequest ( *pChan, guard );
+
+        if ( CA_V42 ( this->minorProtocolVersion ) ) {
+            this->createRespPend.add ( *pChan );
+            pChan->channelNode::listMember = 
+                channelNode::cs_createRespPend;
+        }
+        else {
+            // This wakes up the resp thread so that it can call
+            // the connect callback. This isnt maximally efficent
+            // but it has the excellent side effect of not requiring
+            // that the UDP thread take the callback lock. There are
+            // almost no V42 servers left at this point.
+            this->v42ConnCallbackPend.add ( *pChan );
+            pChan->channelNode::listMember = 
+                channelNode::cs_v42ConnCallbackPend;
+            this->echoRequestPending = true;
+            laborPending = true;
+        }
+        
+        if ( this->sendQue.flushBlockThreshold () ) {
+            laborPending = true;
+            break;
+        }
+    }
+
+    while ( nciu * pChan = this->subscripReqPend.get () ) {
+        // this installs any subscriptions as needed
+        pChan->resubscribe ( guard );
+        this->connectedList.add ( *pChan );
+        pChan->channelNode::listMember = 
+            channelNode::cs_connected;
+        if ( this->sendQue.flushBlockThreshold () ) {
+            laborPending = true;
+            break;
+        }
+    }
+
+    while ( nciu * pChan = this->subscripUpdateReqPend.get () ) {
+        // this updates any subscriptions as needed
+        pChan->sendSubscriptionUpdateRequests ( guard );
+        this->connectedList.add ( *pChan );
+        pChan->channelNode::listMember = 
+            channelNode::cs_connected;
+        if ( this->sendQue.flushBlockThreshold () ) {
+            laborPending = true;
+            break;
+        }
+    }
+
+    return laborPending;
+}
+
 unsigned tcpiiu::sendBytes ( const void *pBuf, 
     unsigned nBytesInBuf, const epicsTime & currentTime )
 {
@@ -263,6 +278,14 @@ unsigned tcpiiu::sendBytes ( const void *pBuf,
                 continue;
             }
 
+            // only the nonblocking sockets of I/O thread circuits get
+            // here, the send watchdog keeps running until the rest 
+            // of the bytes can be sent
+            if ( localError == SOCK_EWOULDBLOCK ) {
+                this->sendWouldBlock = true;
+                return 0u;
+            }
+
             if ( localError == SOCK_ENOBUFS ) {
                 errlogPrintf ( 
                     "CAC: system low on network buffers "
@@ -297,6 +320,24 @@ unsigned tcpiiu::sendBytes ( const void *pBuf,
     return nBytes;
 }
 
+//
+// receive the rest of the current message body straight into the
+// message body cache, which the response handlers lease to the
+// callbacks, instead of through the comBufs of the receive queue
+//
+void tcpiiu::recvBody ( statusWireIO & stat )
+{
+    arrayElementCount nBytes = this->curMsg.m_postsize - this->curDataBytes;
+    if ( nBytes > INT_MAX ) {
+        nBytes = INT_MAX;
+    }
+    this->recvBytes ( & this->pCurData[this->curDataBytes], 
+        static_cast < unsigned > ( nBytes ), stat );
+    if ( stat.circuitState == swioConnected ) {
+        this->curDataBytes += stat.bytesCopied;
+    }
+}
+
 void tcpiiu::recvBytes ( 
         void * pBuf, unsigned nBytesInBuf, statusWireIO & stat )
 {
@@ -343,6 +384,13 @@ void tcpiiu::recvBytes (
                 continue;
             }
 
+            // only the nonblocking sockets of I/O thread circuits get here
+            if ( localErrno == SOCK_EWOULDBLOCK ) {
+                stat.bytesCopied = 0u;
+                stat.circuitState = swioConnected;
+                return;
+            }
+
             if ( localErrno == SOCK_ENOBUFS ) {
                 errlogPrintf ( 
                     "CAC: system low on network buffers "
@@ -377,12 +425,10 @@ void tcpiiu::recvBytes (
 }
 
 tcpRecvThread::tcpRecvThread ( 
-    class tcpiiu & iiuIn, class epicsMutex & cbMutexIn,
-    cacContextNotify & ctxNotifyIn, const char * pName, 
+    class tcpiiu & iiuIn, const char * pName, 
     unsigned int stackSize, unsigned int priority  ) :
     thread ( *this, pName, stackSize, priority ),
-        iiu ( iiuIn ), cbMutex ( cbMutexIn ), 
-        ctxNotify ( ctxNotifyIn ) {}
+        iiu ( iiuIn ) {}
 
 tcpRecvThread::~tcpRecvThread ()
 {
@@ -407,11 +453,11 @@ void tcpRecvThread::exitWait ()
     this->thread.exitWait ();
 }
 
-bool tcpRecvThread::validFillStatus ( 
+bool tcpiiu::validFillStatus ( 
     epicsGuard < epicsMutex > & guard, const statusWireIO & stat )
 {
-    if ( this->iiu.state != tcpiiu::iiucs_connected &&
-        this->iiu.state != tcpiiu::iiucs_clean_shutdown ) {
+    if ( this->state != iiucs_connected &&
+        this->state != iiucs_clean_shutdown ) {
         return false;
     }
     if ( stat.circuitState == swioConnected ) {
@@ -419,17 +465,17 @@ bool tcpRecvThread::validFillStatus (
     }
     if ( stat.circuitState == swioPeerHangup ||
         stat.circuitState == swioPeerAbort ) {
-        this->iiu.disconnectNotify ( guard );
+        this->disconnectNotify ( guard );
     }
     else if ( stat.circuitState == swioLinkFailure ) {
-        this->iiu.initiateAbortShutdown ( guard );
+        this->initiateAbortShutdown ( guard );
     }
     else if ( stat.circuitState == swioLocalAbort ) {
         // state change already occurred
     }
     else {
         errlogMessage ( "cac: invalid fill status - disconnecting" );
-        this->iiu.disconnectNotify ( guard );
+        this->disconnectNotify ( guard );
     }
     return false;
 }
@@ -455,7 +501,7 @@ void tcpRecvThread::run ()
             }
         }
 
-        this->iiu.sendThread.start ();
+        this->iiu.pSendThread->start ();
         epicsThreadPrivateSet ( caClientCallbackThreadId, &this->iiu );
         this->iiu.cacRef.attachToClientCtx ();
 
@@ -474,101 +520,18 @@ void tcpRecvThread::run ()
             }
 
             statusWireIO stat;
-            pComBuf->fillFromWire ( this->iiu, stat );
-
-            epicsTime currentTime = epicsTime::getCurrent ();
-
-            {
-                epicsGuard < epicsMutex > guard ( this->iiu.mutex );
-                
-                if ( ! this->validFillStatus ( guard, stat ) ) {
+            if ( this->iiu.recvBodyInPlace ) {
+                comBuf * pNoBuf = 0;
+                this->iiu.recvBody ( stat );
+                if ( ! this->iiu.recvLabor ( pNoBuf, stat ) ) {
                     break;
                 }
-                if ( stat.bytesCopied == 0u ) {
-                    continue;
-                }
-
-                this->iiu.recvQue.pushLastComBufReceived ( *pComBuf );
-                pComBuf = 0;
-
-                this->iiu._receiveThreadIsBusy = true;
-            }
-
-            bool sendWakeupNeeded = false;
-            {
-                // only one recv thread at a time may call callbacks
-                // - pendEvent() blocks until threads waiting for
-                // this lock get a chance to run
-                callbackManager mgr ( this->ctxNotify, this->cbMutex );
-
-                epicsGuard < epicsMutex > guard ( this->iiu.mutex );
-                
-                // route legacy V42 channel connect through the recv thread -
-                // the only thread that should be taking the callback lock
-                while ( nciu * pChan = this->iiu.v42ConnCallbackPend.first () ) {
-                    this->iiu.connectNotify ( guard, *pChan );
-                    pChan->connect ( mgr.cbGuard, guard );
-                }
-
-                this->iiu.unacknowledgedSendBytes = 0u;
-
-                bool protocolOK = false;
-                {
-                    epicsGuardRelease < epicsMutex > unguard ( guard );
-                    // execute receive labor
-                    protocolOK = this->iiu.processIncoming ( currentTime, mgr );
-                }
-
-                if ( ! protocolOK ) {
-                    this->iiu.initiateAbortShutdown ( guard );
-                    break;
-                }
-                this->iiu._receiveThreadIsBusy = false;
-                // reschedule connection activity watchdog
-                this->iiu.recvDog.messageArrivalNotify ( guard ); 
-                //
-                // if this thread has connected channels with subscriptions
-                // that need to be sent then wakeup the send thread
-                if ( this->iiu.subscripReqPend.count() ) {
-                    sendWakeupNeeded = true;
-                }
-            }
-            
-            //
-            // we dont feel comfortable calling this with a lock applied
-            // (it might block for longer than we like)
-            //
-            // we would prefer to improve efficency by trying, first, a 
-            // recv with the new MSG_DONTWAIT flag set, but there isnt 
-            // universal support
-            //
-            bool bytesArePending = this->iiu.bytesArePendingInOS ();
-            {
-                epicsGuard < epicsMutex > guard ( this->iiu.mutex );
-                if ( bytesArePending ) {
-                    if ( ! this->iiu.busyStateDetected ) {
-                        this->iiu.contigRecvMsgCount++;
-                        if ( this->iiu.contigRecvMsgCount >= 
-                            this->iiu.cacRef.maxContiguousFrames ( guard ) ) {
-                            this->iiu.busyStateDetected = true;
-                            sendWakeupNeeded = true;
-                        }
-                    }
-                }
-                else {
-                    // if no bytes are pending then we must immediately
-                    // switch off flow control w/o waiting for more
-                    // data to arrive
-                    this->iiu.contigRecvMsgCount = 0u;
-                    if ( this->iiu.busyStateDetected ) {
-                        sendWakeupNeeded = true;
-                        this->iiu.busyStateDetected = false;
-                    }
-                }
+                continue;
             }
+            pComBuf->fillFromWire ( this->iiu, stat );
 
-            if ( sendWakeupNeeded ) {
-                this->iiu.sendThreadFlushEvent.signal ();
+            if ( ! this->iiu.recvLabor ( pComBuf, stat ) ) {
+                break;
             }
         }
 
@@ -602,6 +565,113 @@ void tcpRecvThread::run ()
     }
 }
 
+//
+// process the bytes which were received into the buffer, which
+// is consumed unless no bytes were received, returns false when
+// the circuit is shutting down, a nil buffer means that the bytes
+// were received in place by recvBody ()
+//
+bool tcpiiu::recvLabor ( comBuf * & pComBuf, const statusWireIO & stat )
+{
+    epicsTime currentTime = epicsTime::getCurrent ();
+
+    {
+        epicsGuard < epicsMutex > guard ( this->mutex );
+        
+        if ( ! this->validFillStatus ( guard, stat ) ) {
+            return false;
+        }
+        if ( stat.bytesCopied == 0u ) {
+            return true;
+        }
+
+        if ( pComBuf ) {
+            this->recvQue.pushLastComBufReceived ( *pComBuf );
+            pComBuf = 0;
+        }
+
+        this->_receiveThreadIsBusy = true;
+    }
+
+    bool sendWakeupNeeded = false;
+    {
+        // only one recv thread at a time may call callbacks
+        // - pendEvent() blocks until threads waiting for
+        // this lock get a chance to run
+        callbackManager mgr ( this->ctxNotify, this->cbMutex );
+
+        epicsGuard < epicsMutex > guard ( this->mutex );
+        
+        // route legacy V42 channel connect through the recv thread -
+        // the only thread that should be taking the callback lock
+        while ( nciu * pChan = this->v42ConnCallbackPend.first () ) {
+            this->connectNotify ( guard, *pChan );
+            pChan->connect ( mgr.cbGuard, guard );
+        }
+
+        this->unacknowledgedSendBytes = 0u;
+
+        bool protocolOK = false;
+        {
+            epicsGuardRelease < epicsMutex > unguard ( guard );
+            // execute receive labor
+            protocolOK = this->processIncoming ( currentTime, mgr );
+        }
+
+        if ( ! protocolOK ) {
+            this->initiateAbortShutdown ( guard );
+            return false;
+        }
+        this->_receiveThreadIsBusy = false;
+        // reschedule connection activity watchdog
+        this->recvDog.messageArrivalNotify ( guard ); 
+        //
+        // if this thread has connected channels with subscriptions
+        // that need to be sent then wakeup the send thread
+        if ( this->subscripReqPend.count() ) {
+            sendWakeupNeeded = true;
+        }
+    }
+    
+    //
+    // we dont feel comfortable calling this with a lock applied
+    // (it might block for longer than we like)
+    //
+    // we would prefer to improve efficency by trying, first, a 
+    // recv with the new MSG_DONTWAIT flag set, but there isnt 
+    // universal support
+    //
+    bool bytesArePending = this->bytesArePendingInOS ();
+    {
+        epicsGuard < epicsMutex > guard ( this->mutex );
+        if ( bytesArePending ) {
+            if ( ! this->busyStateDetected ) {
+                this->contigRecvMsgCount++;
+                if ( this->contigRecvMsgCount >= 
+                    this->cacRef.maxContiguousFrames ( guard ) ) {
+                    this->busyStateDetected = true;
+                    sendWakeupNeeded = true;
+                }
+            }
+        }
+        else {
+            // if no bytes are pending then we must immediately
+            // switch off flow control w/o waiting for more
+            // data to arrive
+            this->contigRecvMsgCount = 0u;
+            if ( this->busyStateDetected ) {
+                sendWakeupNeeded = true;
+                this->busyStateDetected = false;
+            }
+        }
+        if ( sendWakeupNeeded ) {
+            this->sendWakeup ( guard );
+        }
+    }
+
+    return true;
+}
+
 /*
  * tcpRecvThread::connect ()
  */
@@ -660,6 +730,35 @@ void tcpRecvThread::connect (
     return;
 }
 
+//
+// true if the server is on this host, where a UDP socket
+// connected to the server address picks that address as
+// its own (this doesn't send anything)
+//
+static bool sameHost ( const osiSockAddr & addr )
+{
+    if ( addr.sa.sa_family != AF_INET ) {
+        return false;
+    }
+    if ( ( ntohl ( addr.ia.sin_addr.s_addr ) >> 24u ) == 127u ) {
+        return true;
+    }
+    SOCKET sock = epicsSocketCreate ( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+    if ( sock == INVALID_SOCKET ) {
+        return false;
+    }
+    bool local = false;
+    if ( ::connect ( sock, & addr.sa, sizeof ( addr.ia ) ) == 0 ) {
+        osiSockAddr self;
+        osiSocklen_t size = sizeof ( self );
+        if ( getsockname ( sock, & self.sa, & size ) == 0 ) {
+            local = self.ia.sin_addr.s_addr == addr.ia.sin_addr.s_addr;
+        }
+    }
+    epicsSocketDestroy ( sock );
+    return local;
+}
+
 //
 // tcpiiu::tcpiiu ()
 //
@@ -670,16 +769,11 @@ tcpiiu::tcpiiu (
         comBufMemoryManager & comBufMemMgrIn,
         unsigned minorVersion, ipAddrToAsciiEngine & engineIn, 
         const cacChannel::priLev & priorityIn,
-        SearchDestTCP * pSearchDestIn ) :
+        SearchDestTCP * pSearchDestIn, tcpIoLoop * pIoLoopIn ) :
     caServerID ( addrIn.ia, priorityIn ),
     hostNameCacheInstance ( addrIn, engineIn ),
-    recvThread ( *this, cbMutexIn, ctxNotifyIn, "CAC-TCP-recv", 
-        epicsThreadGetStackSize ( epicsThreadStackBig ),
-        cac::highestPriorityLevelBelow ( cac.getInitializingThreadsPriority() ) ),
-    sendThread ( *this, "CAC-TCP-send",
-        epicsThreadGetStackSize ( epicsThreadStackMedium ),
-        cac::lowestPriorityLevelAbove (
-            cac.getInitializingThreadsPriority() ) ),
+    pRecvThread ( 0 ),
+    pSendThread ( 0 ),
     recvDog ( cbMutexIn, ctxNotifyIn, mutexIn, 
         *this, connectionTimeout, timerQueue ),
     sendDog ( cbMutexIn, ctxNotifyIn, mutexIn,
@@ -688,10 +782,16 @@ tcpiiu::tcpiiu (
     recvQue ( comBufMemMgrIn ),
     curDataMax ( MAX_TCP ),
     curDataBytes ( 0ul ),
+    unzipDataMax ( 0ul ),
     comBufMemMgr ( comBufMemMgrIn ),
     cacRef ( cac ),
     pCurData ( (char*) freeListMalloc(this->cacRef.tcpSmallRecvBufFreeList) ),
+    pUnzipData ( 0 ),
+    sharedRing (),
     pSearchDest ( pSearchDestIn ),
+    pIoLoop ( pIoLoopIn ),
+    pSendBuf ( 0 ),
+    ctxNotify ( ctxNotifyIn ),
     mutex ( mutexIn ),
     cbMutex ( cbMutexIn ),
     minorProtocolVersion ( minorVersion ),
@@ -712,14 +812,46 @@ tcpiiu::tcpiiu (
     recvProcessPostponedFlush ( false ),
     discardingPendingData ( false ),
     socketHasBeenClosed ( false ),
-    unresponsiveCircuit ( false )
+    unresponsiveCircuit ( false ),
+    recvBodyInPlace ( false ),
+    connectPending ( false ),
+    sendArmed ( true ), // until the I/O thread has connected
+    sendWouldBlock ( false ),
+    sendShutdown ( false )
 {
     if(!pCurData)
         throw std::bad_alloc();
 
+    if ( ! this->pIoLoop ) {
+        try {
+            this->pRecvThread = new tcpRecvThread ( *this, "CAC-TCP-recv", 
+                epicsThreadGetStackSize ( epicsThreadStackBig ),
+                cac::highestPriorityLevelBelow ( 
+                    cac.getInitializingThreadsPriority() ) );
+            this->pSendThread = new tcpSendThread ( *this, "CAC-TCP-send",
+                epicsThreadGetStackSize ( epicsThreadStackMedium ),
+                cac::lowestPriorityLevelAbove (
+                    cac.getInitializingThreadsPriority() ) );
+        }
+        catch ( ... ) {
+            if ( this->pRecvThread ) {
+                this->pRecvThread->exitWait ();
+                delete this->pRecvThread;
+            }
+            freeListFree(this->cacRef.tcpSmallRecvBufFreeList, this->pCurData);
+            throw;
+        }
+    }
+
     this->sock = epicsSocketCreate ( AF_INET, SOCK_STREAM, IPPROTO_TCP );
     if ( this->sock == INVALID_SOCKET ) {
         freeListFree(this->cacRef.tcpSmallRecvBufFreeList, this->pCurData);
+        if ( this->pSendThread ) {
+            this->pSendThread->exitWait ();
+            delete this->pSendThread;
+            this->pRecvThread->exitWait ();
+            delete this->pRecvThread;
+        }
         char sockErrBuf[64];
         epicsSocketConvertErrnoToString ( 
             sockErrBuf, sizeof ( sockErrBuf ) );
@@ -755,10 +887,15 @@ tcpiiu::tcpiiu (
     // load message queue with messages informing server 
     // of version, user, and host name of client
     {
+        bool local = this->cacRef.sharedMemBytes > 0u && 
+            CA_V415 ( this->minorProtocolVersion ) && sameHost ( addrIn );
         epicsGuard < epicsMutex > guard ( this->mutex );
         this->versionMessage ( guard, this->priority() );
         this->userNameSetRequest ( guard );
         this->hostNameSetRequest ( guard );
+        if ( local ) {
+            this->sharedMemRequest ( guard );
+        }
     }
 
 #   if 0
@@ -821,7 +958,29 @@ void tcpiiu::start (
     epicsGuard < epicsMutex > & guard )
 {
     guard.assertIdenticalMutex ( this->mutex );
-    this->recvThread.start ();
+    if ( this->pIoLoop ) {
+        this->pIoLoop->install ( guard, *this );
+    }
+    else {
+        this->pRecvThread->start ();
+    }
+}
+
+// wake up the send thread, or have the I/O thread
+// call back when the socket is ready for sending
+void tcpiiu::sendWakeup ( 
+    epicsGuard < epicsMutex > & guard )
+{
+    guard.assertIdenticalMutex ( this->mutex );
+    if ( this->pIoLoop ) {
+        if ( ! this->sendArmed ) {
+            this->sendArmed = true;
+            this->pIoLoop->sendWakeup ( guard, *this );
+        }
+    }
+    else {
+        this->sendThreadFlushEvent.signal ();
+    }
 }
 
 void tcpiiu::initiateCleanShutdown ( 
@@ -835,7 +994,7 @@ void tcpiiu::initiateCleanShutdown (
         }
         else {
             this->state = iiucs_clean_shutdown;
-            this->sendThreadFlushEvent.signal ();
+            this->sendWakeup ( guard );
             this->flushBlockEvent.signal ();
         }
     }
@@ -854,7 +1013,7 @@ void tcpiiu::disconnectNotify (
 {
     guard.assertIdenticalMutex ( this->mutex );
     this->state = iiucs_disconnected;
-    this->sendThreadFlushEvent.signal ();
+    this->sendWakeup ( guard );
     this->flushBlockEvent.signal ();
 }
 
@@ -872,7 +1031,7 @@ void tcpiiu::responsiveCircuitNotify (
                 channelNode::cs_subscripUpdateReqPend;
             pChan->connect ( cbGuard, guard );
         }
-        this->sendThreadFlushEvent.signal ();
+        this->sendWakeup ( guard );
     }
 }
 
@@ -906,7 +1065,7 @@ void tcpiiu::unresponsiveCircuitNotify (
     if ( ! this->unresponsiveCircuit ) {
         this->unresponsiveCircuit = true;
         this->echoRequestPending = true;
-        this->sendThreadFlushEvent.signal ();
+        this->sendWakeup ( guard );
         this->flushBlockEvent.signal ();
 
         // must not hold lock when canceling timer
@@ -994,8 +1153,10 @@ void tcpiiu::initiateAbortShutdown (
             }
             break;
         case esscimqi_socketSigAlarmRequired:
-            this->recvThread.interruptSocketRecv ();
-            this->sendThread.interruptSocketSend ();
+            if ( this->pRecvThread ) {
+                this->pRecvThread->interruptSocketRecv ();
+                this->pSendThread->interruptSocketSend ();
+            }
             break;
         default:
             break;
@@ -1004,7 +1165,7 @@ void tcpiiu::initiateAbortShutdown (
         // 
         // wake up the send thread if it isnt blocking in send()
         //
-        this->sendThreadFlushEvent.signal ();
+        this->sendWakeup ( guard );
         this->flushBlockEvent.signal ();
     }
 }
@@ -1018,8 +1179,12 @@ tcpiiu :: ~tcpiiu ()
         this->pSearchDest->disable ();
     }
 
-    this->sendThread.exitWait ();
-    this->recvThread.exitWait ();
+    if ( this->pSendThread ) {
+        this->pSendThread->exitWait ();
+        this->pRecvThread->exitWait ();
+        delete this->pSendThread;
+        delete this->pRecvThread;
+    }
     this->sendDog.cancel ();
     this->recvDog.shutdown ();
 
@@ -1039,6 +1204,13 @@ tcpiiu :: ~tcpiiu ()
             free ( this->pCurData );
         }
     }
+    free ( this->pUnzipData );
+    caSharedRingDestroy ( & this->sharedRing );
+
+    if ( this->pSendBuf ) {
+        this->pSendBuf->~comBuf ();
+        this->comBufMemMgr.release ( this->pSendBuf );
+    }
 }
 
 void tcpiiu::show ( unsigned level ) const
@@ -1052,6 +1224,15 @@ void tcpiiu::show ( unsigned level ) const
     if ( level > 1u ) {
         ::printf ( "\tcurrent data cache pointer = %p current data cache size = %lu\n",
             static_cast < void * > ( this->pCurData ), this->curDataMax );
+        if ( this->pUnzipData ) {
+            ::printf ( "\tuncompressed data cache size = %lu\n",
+                this->unzipDataMax );
+        }
+        if ( this->sharedRing.pData ) {
+            ::printf ( "\tshared memory payload ring of %u bytes, %s\n",
+                this->sharedRing.size, this->sharedRing.name[0] ?
+                    "waiting for the server to attach" : "attached" );
+        }
         ::printf ( "\tcontiguous receive message count=%u, busy detect bool=%u, flow control bool=%u\n", 
             this->contigRecvMsgCount, this->busyStateDetected, this->flowControlActive );
         ::printf ( "\receive thread is busy=%u\n", 
@@ -1059,12 +1240,18 @@ void tcpiiu::show ( unsigned level ) const
     }
     if ( level > 2u ) {
         ::printf ( "\tvirtual circuit socket identifier %d\n", this->sock );
-        ::printf ( "\tsend thread flush signal:\n" );
-        this->sendThreadFlushEvent.show ( level-2u );
-        ::printf ( "\tsend thread:\n" );
-        this->sendThread.show ( level-2u );
-        ::printf ( "\trecv thread:\n" );
-        this->recvThread.show ( level-2u );
+        if ( this->pIoLoop ) {
+            ::printf ( "\tserviced by an I/O thread, send %s\n",
+                this->sendArmed ? "pending" : "idle" );
+        }
+        else {
+            ::printf ( "\tsend thread flush signal:\n" );
+            this->sendThreadFlushEvent.show ( level-2u );
+            ::printf ( "\tsend thread:\n" );
+            this->pSendThread->show ( level-2u );
+            ::printf ( "\trecv thread:\n" );
+            this->pRecvThread->show ( level-2u );
+        }
         ::printf ("\techo pending bool = %u\n", this->echoRequestPending );
         ::printf ( "IO identifier hash table:\n" );
 
@@ -1124,7 +1311,7 @@ bool tcpiiu::setEchoRequestPending ( epicsGuard < epicsMutex > & guard )
     guard.assertIdenticalMutex ( this->mutex );
 
     this->echoRequestPending = true;
-    this->sendThreadFlushEvent.signal ();
+    this->sendWakeup ( guard );
     if ( CA_V43 ( this->minorProtocolVersion ) ) {
         // we send an echo
         return true;
@@ -1255,16 +1442,45 @@ bool tcpiiu::processIncoming (
                             &this->pCurData[this->curDataBytes], 
                             this->curMsg.m_postsize - this->curDataBytes );
                 if ( this->curDataBytes < this->curMsg.m_postsize ) {
+                    // the receive queue is empty, so the rest of a large
+                    // body can skip the comBufs and go straight into place
+                    this->recvBodyInPlace = 
+                        this->curMsg.m_postsize - this->curDataBytes >= 
+                            comBuf::capacityBytes ();
                     epicsGuard < epicsMutex > guard ( this->mutex );
                     this->flushIfRecvProcessRequested ( guard );
                     return true;
                 }
+                this->recvBodyInPlace = false;
+            }
+            caHdrLargeArray msg = this->curMsg;
+            char * pBody = this->pCurData;
+            bool dbrPayload = 
+                    msg.m_cmmd == CA_PROTO_READ_NOTIFY ||
+                    msg.m_cmmd == CA_PROTO_EVENT_ADD ||
+                    msg.m_cmmd == CA_PROTO_READ;
+            bool sharedPayload = dbrPayload &&
+                ( msg.m_dataType & CA_PROTO_DATA_SHARED );
+            caSharedRingRef ringRef;
+            if ( sharedPayload ) {
+                if ( ! this->locateSharedPayload ( mgr, msg, pBody, ringRef ) ) {
+                    return false;
+                }
+            }
+            if ( dbrPayload && 
+                    ( msg.m_dataType & CA_PROTO_DATA_COMPRESSED ) ) {
+                if ( ! this->uncompressPayload ( mgr, msg, pBody ) ) {
+                    return false;
+                }
             }
             bool msgOK = this->cacRef.executeResponse ( mgr, *this, 
-                                currentTime, this->curMsg, this->pCurData );
+                                currentTime, msg, pBody );
             if ( ! msgOK ) {
                 return false;
             }
+            if ( sharedPayload ) {
+                caSharedRingRelease ( & this->sharedRing, & ringRef );
+            }
         }
         else {
             static bool once = false;
@@ -1289,6 +1505,72 @@ bool tcpiiu::processIncoming (
     }
 }
 
+//
+// restore a payload compressed by the server (CA V4.14)
+//
+bool tcpiiu::uncompressPayload ( callbackManager & mgr, 
+    caHdrLargeArray & msg, char * & pBody )
+{
+    unsigned size = caUncompressedSize ( pBody, msg.m_postsize );
+    if ( ! size || size > this->cacRef.maxRecvBytesTCP ) {
+        this->printFormated ( mgr.cbGuard,
+            "CAC: server sent invalid compressed payload\n" );
+        return false;
+    }
+
+    // the payload, followed by scratch space of the same size
+    arrayElementCount alignedSize = CA_MESSAGE_ALIGN ( size );
+    if ( 2u * alignedSize > this->unzipDataMax ) {
+        char * newbuf = static_cast < char * > ( malloc ( 2u * alignedSize ) );
+        if ( ! newbuf ) {
+            this->printFormated ( mgr.cbGuard,
+                "CAC: not enough memory to uncompress a response message\n" );
+            return false;
+        }
+        free ( this->pUnzipData );
+        this->pUnzipData = newbuf;
+        this->unzipDataMax = 2u * alignedSize;
+    }
+
+    if ( caUncompressPayload ( pBody, msg.m_postsize,
+            this->pUnzipData, this->pUnzipData + alignedSize ) ) {
+        this->printFormated ( mgr.cbGuard,
+            "CAC: server sent corrupt compressed payload\n" );
+        return false;
+    }
+    memset ( this->pUnzipData + size, '\0', alignedSize - size );
+
+    msg.m_dataType &= ~CA_PROTO_DATA_COMPRESSED;
+    msg.m_postsize = alignedSize;
+    pBody = this->pUnzipData;
+    return true;
+}
+
+//
+// the payload is dispatched straight from the ring
+// of a server on this host (CA V4.15)
+//
+bool tcpiiu::locateSharedPayload ( callbackManager & mgr, 
+    caHdrLargeArray & msg, char * & pBody, caSharedRingRef & ref )
+{
+    unsigned size = 0u;
+    void * pPayload = 0;
+    if ( msg.m_postsize >= sizeof ( ref ) ) {
+        memcpy ( & ref, pBody, sizeof ( ref ) );
+        pPayload = caSharedRingGet ( & this->sharedRing, & ref, & size );
+    }
+    if ( ! pPayload ) {
+        this->printFormated ( mgr.cbGuard,
+            "CAC: server sent invalid shared memory payload reference\n" );
+        return false;
+    }
+
+    msg.m_dataType &= ~CA_PROTO_DATA_SHARED;
+    msg.m_postsize = size;
+    pBody = static_cast < char * > ( pPayload );
+    return true;
+}
+
 void tcpiiu::hostNameSetRequest ( epicsGuard < epicsMutex > & guard )
 {
     guard.assertIdenticalMutex ( this->mutex );
@@ -1316,6 +1598,37 @@ void tcpiiu::hostNameSetRequest ( epicsGuard < epicsMutex > & guard )
     minder.commit ();
 }
 
+/*
+ * tcpiiu::sharedMemRequest ()
+ *
+ * offer a ring for the payloads to a server on this host (CA V4.15)
+ */
+void tcpiiu::sharedMemRequest ( epicsGuard < epicsMutex > & guard )
+{
+    guard.assertIdenticalMutex ( this->mutex );
+
+    if ( caSharedRingCreate ( & this->sharedRing, 
+            this->cacRef.sharedMemBytes ) ) {
+        return;
+    }
+
+    unsigned size = strlen ( this->sharedRing.name ) + 1u;
+    unsigned postSize = CA_MESSAGE_ALIGN ( size );
+
+    if ( this->sendQue.flushEarlyThreshold ( postSize + 16u ) ) {
+        this->flushRequest ( guard );
+    }
+
+    comQueSendMsgMinder minder ( this->sendQue, guard );
+    this->sendQue.insertRequestHeader ( 
+        CA_PROTO_SHARED_MEM, postSize, 
+        0u, 0u, this->sharedRing.cookie[0], this->sharedRing.cookie[1], 
+        CA_V49 ( this->minorProtocolVersion ) );
+    this->sendQue.pushString ( this->sharedRing.name, size );
+    this->sendQue.pushString ( cacNillBytes, postSize - size );
+    minder.commit ();
+}
+
 /*
  * tcpiiu::userNameSetRequest ()
  */
@@ -1393,7 +1706,8 @@ void tcpiiu::versionMessage ( epicsGuard < epicsMutex > & guard,
     this->sendQue.insertRequestHeader ( 
         CA_PROTO_VERSION, 0u, 
         static_cast < ca_uint16_t > ( priority ), 
-        CA_MINOR_PROTOCOL_REVISION, 0u, 0u, 
+        CA_MINOR_PROTOCOL_REVISION, 
+        this->cacRef._compressArrays ? CA_PROTO_VERSION_COMPRESS : 0u, 0u, 
         CA_V49 ( this->minorProtocolVersion ) );
     minder.commit ();
 }
@@ -1667,35 +1981,61 @@ bool tcpiiu::sendThreadFlush ( epicsGuard < epicsMutex > & guard )
 {
     guard.assertIdenticalMutex ( this->mutex );
 
-    if ( this->sendQue.occupiedBytes() > 0 ) {
-        while ( comBuf * pBuf = this->sendQue.popNextComBufToSend () ) {
-            epicsTime current = epicsTime::getCurrent ();
+    while ( true ) {
+        // the rest of a buffer which the socket would not 
+        // take before goes out first
+        comBuf * pBuf = this->pSendBuf;
+        if ( pBuf ) {
+            this->pSendBuf = 0;
+        }
+        else {
+            pBuf = this->sendQue.popNextComBufToSend ();
+            if ( ! pBuf ) {
+                break;
+            }
+        }
+
+        epicsTime current = epicsTime::getCurrent ();
 
-            unsigned bytesToBeSent = pBuf->occupiedBytes ();
-            bool success = false;
-            {
-                // no lock while blocking to send
-                epicsGuardRelease < epicsMutex > unguard ( guard );
-                success = pBuf->flushToWire ( *this, current );
+        unsigned bytesToBeSent = pBuf->occupiedBytes ();
+        bool success = false;
+        bool wouldBlock = false;
+        {
+            // no lock while blocking to send
+            epicsGuardRelease < epicsMutex > unguard ( guard );
+            this->sendWouldBlock = false;
+            success = pBuf->flushToWire ( *this, current );
+            wouldBlock = ! success && this->sendWouldBlock;
+            if ( wouldBlock ) {
+                bytesToBeSent -= pBuf->occupiedBytes ();
+            }
+            else {
                 pBuf->~comBuf ();
                 this->comBufMemMgr.release ( pBuf );
             }
+        }
 
-            if ( ! success ) {
-                while ( ( pBuf = this->sendQue.popNextComBufToSend () ) ) {
-                    pBuf->~comBuf ();
-                    this->comBufMemMgr.release ( pBuf );
-                }
-                return false;
-            }
-
-            // set it here with this odd order because we must have 
-            // the lock and we must have already sent the bytes
+        if ( wouldBlock ) {
+            // an I/O thread tries again when the socket is ready
+            this->pSendBuf = pBuf;
             this->unacknowledgedSendBytes += bytesToBeSent;
-            if ( this->unacknowledgedSendBytes > 
-                this->socketLibrarySendBufferSize ) {
-                this->recvDog.sendBacklogProgressNotify ( guard );
+            return true;
+        }
+
+        if ( ! success ) {
+            while ( ( pBuf = this->sendQue.popNextComBufToSend () ) ) {
+                pBuf->~comBuf ();
+                this->comBufMemMgr.release ( pBuf );
             }
+            return false;
+        }
+
+        // set it here with this odd order because we must have 
+        // the lock and we must have already sent the bytes
+        this->unacknowledgedSendBytes += bytesToBeSent;
+        if ( this->unacknowledgedSendBytes > 
+            this->socketLibrarySendBufferSize ) {
+            this->recvDog.sendBacklogProgressNotify ( guard );
         }
     }
 
@@ -1750,7 +2090,7 @@ unsigned tcpiiu::requestMessageBytesPending (
 #if 0
     if ( ! this->earlyFlush && this->sendQue.flushEarlyThreshold(0u) ) {
         this->earlyFlush = true;
-        this->sendThreadFlushEvent.signal ();
+        this->sendWakeup ( guard );
     }
 #endif
     return sendQue.occupiedBytes ();
@@ -1953,7 +2293,7 @@ void tcpiiu::installChannel (
     chan.searchReplySetUp ( *this, sidIn, typeIn, countIn, guard );
     // The tcp send thread runs at apriority below the udp thread 
     // so that this will not send small packets
-    this->sendThreadFlushEvent.signal ();
+    this->sendWakeup ( guard );
 }
 
 bool tcpiiu :: connectNotify ( 
@@ -2036,10 +2376,10 @@ int tcpiiu :: printFormated (
     return status;
 }
 
-void tcpiiu::flushRequest ( epicsGuard < epicsMutex > & )
+void tcpiiu::flushRequest ( epicsGuard < epicsMutex > & guard )
 {
     if ( this->sendQue.occupiedBytes () > 0 ) {
-        this->sendThreadFlushEvent.signal ();
+        this->sendWakeup ( guard );
     }
 }
 
@@ -2191,6 +2531,15 @@ void tcpiiu :: versionRespNotify ( const caHdrLargeArray & msg )
     this->minorProtocolVersion = msg.m_count;
 }
 
+void tcpiiu :: sharedMemRespNotify ( const caHdrLargeArray & msg )
+{
+    // the server has mapped the ring or never will
+    caSharedRingUnlink ( & this->sharedRing );
+    if ( ! ( msg.m_available & CA_PROTO_SHARED_MEM_ATTACHED ) ) {
+        caSharedRingDestroy ( & this->sharedRing );
+    }
+}
+
 void tcpiiu :: searchRespNotify (
     const epicsTime & currentTime, const caHdrLargeArray & msg )
 {    
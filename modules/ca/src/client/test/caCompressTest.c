@@ -0,0 +1,237 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*
+ * Tests of the compressed payload format of caCompress.h
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "caCompress.h"
+#include "db_access.h"
+#include "epicsUnitTest.h"
+#include "testMain.h"
+
+#define SMALL_COUNT 4u
+#define LARGE_COUNT 20000u
+#define GUARD 16u
+#define GUARD_BYTE 0xa5
+
+/* bytes of the caCompressHdr on the wire */
+#define HDR_SIZE 12u
+
+/*
+ * Fill a DBR_XXX payload of count elements with smoothly changing big
+ * endian values, as the filters expect, after an arbitrary DBR header.
+ */
+static void fillPayload ( unsigned type, unsigned count,
+    unsigned char *pBuf, unsigned size )
+{
+    unsigned offset = dbr_value_offset[type];
+    unsigned elemSize = dbr_value_size[type];
+    unsigned i, b;
+
+    for ( i = 0u; i < offset; i++ )
+        pBuf[i] = (unsigned char) ( i * 7u + type );
+    if ( dbr_value_class[type] == dbr_class_string ) {
+        for ( i = offset; i < size; i++ )
+            pBuf[i] = (unsigned char) ( 'a' + ( i / elemSize ) % 26u );
+        return;
+    }
+    for ( i = 0u; i < count; i++ ) {
+        unsigned long v = 1000u + 3u * i;
+
+        for ( b = elemSize; b-- > 0u; ) {
+            pBuf[offset + i * elemSize + b] = (unsigned char) v;
+            v >>= 8u;
+        }
+    }
+    for ( i = offset + count * elemSize; i < size; i++ )
+        pBuf[i] = 0u;
+}
+
+static int guardOK ( const unsigned char *p )
+{
+    unsigned i;
+
+    for ( i = 0u; i < GUARD; i++ ) {
+        if ( p[i] != GUARD_BYTE )
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * Compress a payload and restore it.  Returns the compressed size,
+ * 0 if it was left uncompressed, or -1 if anything went wrong.
+ */
+static int roundTrip ( unsigned type, const unsigned char *pOrig,
+    unsigned size )
+{
+    unsigned char *pBuf = malloc ( size );
+    unsigned char *pWork = malloc ( size + CA_COMPRESS_WORK_BYTES );
+    unsigned char *pDst = malloc ( size + GUARD );
+    unsigned csize;
+    int result = -1;
+
+    if ( ! pBuf || ! pWork || ! pDst )
+        testAbort ( "Out of memory" );
+
+    memcpy ( pBuf, pOrig, size );
+    csize = caCompressPayload ( type, pBuf, size, pWork );
+    if ( csize == 0u ) {
+        if ( memcmp ( pBuf, pOrig, size ) == 0 )
+            result = 0;
+    }
+    else if ( csize <= size - size / 8u &&
+            caUncompressedSize ( pBuf, csize ) == size ) {
+        memset ( pDst, GUARD_BYTE, size + GUARD );
+        if ( caUncompressPayload ( pBuf, csize, pDst, pWork ) == 0 &&
+                memcmp ( pDst, pOrig, size ) == 0 &&
+                guardOK ( pDst + size ) )
+            result = (int) csize;
+    }
+    free ( pBuf );
+    free ( pWork );
+    free ( pDst );
+    return result;
+}
+
+static void testRoundTrip ( void )
+{
+    unsigned type;
+
+    testDiag ( "Round trip of every DBR type" );
+
+    for ( type = 0u; type <= LAST_BUFFER_TYPE; type++ ) {
+        unsigned size = dbr_size_n ( type, SMALL_COUNT );
+        unsigned char *pOrig = malloc ( dbr_size_n ( type, LARGE_COUNT ) );
+        int status;
+
+        if ( ! pOrig )
+            testAbort ( "Out of memory" );
+
+        fillPayload ( type, SMALL_COUNT, pOrig, size );
+        status = roundTrip ( type, pOrig, size );
+        testOk ( status >= 0, "%s[%u] round trip (%d bytes compressed)",
+            dbr_type_to_text ( type ), SMALL_COUNT, status );
+
+        size = dbr_size_n ( type, LARGE_COUNT );
+        fillPayload ( type, LARGE_COUNT, pOrig, size );
+        status = roundTrip ( type, pOrig, size );
+        testOk ( status > 0, "%s[%u] compressed from %u to %d bytes",
+            dbr_type_to_text ( type ), LARGE_COUNT, size, status );
+
+        free ( pOrig );
+    }
+}
+
+/*
+ * Decoding truncated or corrupt data must fail, or at least never
+ * write beyond the uncompressed size.
+ */
+static void testCorrupt ( void )
+{
+    const unsigned type = DBR_TIME_DOUBLE;
+    unsigned size = dbr_size_n ( type, LARGE_COUNT );
+    unsigned char *pOrig = malloc ( size );
+    unsigned char *pBuf = malloc ( size );
+    unsigned char *pWork = malloc ( size + CA_COMPRESS_WORK_BYTES + GUARD );
+    unsigned char *pDst = malloc ( size + GUARD );
+    unsigned csize, len, i, nOK;
+
+    testDiag ( "Truncated and corrupt input" );
+
+    if ( ! pOrig || ! pBuf || ! pWork || ! pDst )
+        testAbort ( "Out of memory" );
+
+    fillPayload ( type, LARGE_COUNT, pOrig, size );
+    memcpy ( pBuf, pOrig, size );
+    csize = caCompressPayload ( type, pBuf, size, pWork );
+    if ( csize <= HDR_SIZE + 16u )
+        testAbort ( "%s[%u] didn't compress", dbr_type_to_text ( type ),
+            LARGE_COUNT );
+    memcpy ( pOrig, pBuf, csize );
+
+    /* whole messages cut short */
+    for ( len = 0u, nOK = 0u; len < csize; len++ ) {
+        if ( caUncompressedSize ( pOrig, len ) == 0u &&
+                caUncompressPayload ( pOrig, len, pDst, pWork ) == -1 )
+            nOK++;
+    }
+    testOk ( nOK == csize, "All %u truncated messages rejected", csize );
+
+    /* LZ4 blocks cut short, with the header adjusted to match */
+    for ( len = 0u, nOK = 0u; len < csize - HDR_SIZE; len++ ) {
+        memcpy ( pBuf, pOrig, csize );
+        pBuf[4] = (unsigned char) ( len >> 24u );
+        pBuf[5] = (unsigned char) ( len >> 16u );
+        pBuf[6] = (unsigned char) ( len >> 8u );
+        pBuf[7] = (unsigned char) len;
+        memset ( pDst, GUARD_BYTE, size + GUARD );
+        if ( caUncompressPayload ( pBuf, HDR_SIZE + len, pDst, pWork ) == -1 &&
+                guardOK ( pDst + size ) )
+            nOK++;
+    }
+    testOk ( nOK == csize - HDR_SIZE, "All %u truncated blocks rejected",
+        csize - HDR_SIZE );
+
+    memcpy ( pBuf, pOrig, csize );
+    pBuf[11] = caCompressFilterDeltaShuffle + 1u;
+    testOk ( caUncompressPayload ( pBuf, csize, pDst, pWork ) == -1,
+        "Unknown filter rejected" );
+
+    memcpy ( pBuf, pOrig, csize );
+    pBuf[10] = 3u;
+    testOk ( caUncompressPayload ( pBuf, csize, pDst, pWork ) == -1,
+        "Bad element size rejected" );
+
+    memcpy ( pBuf, pOrig, csize );
+    pBuf[0] = pBuf[1] = pBuf[2] = 0u;
+    pBuf[3] = (unsigned char) ( dbr_value_offset[type] - 1u );
+    testOk ( caUncompressPayload ( pBuf, csize, pDst, pWork ) == -1,
+        "Offset beyond the payload rejected" );
+
+    memcpy ( pBuf, pOrig, csize );
+    pBuf[0] = pBuf[1] = 0u;
+    pBuf[2] = 0u;
+    pBuf[3] = 16u;
+    memset ( pWork, GUARD_BYTE, 16u + GUARD );
+    testOk ( caUncompressPayload ( pBuf, csize, pDst, pWork ) == -1 &&
+        guardOK ( pWork + 16u ),
+        "Block expanding beyond the stated size rejected" );
+
+    /* random damage to the LZ4 block must stay within the buffers */
+    srand ( 1 );
+    for ( i = 0u, nOK = 0u; i < 1000u; i++ ) {
+        unsigned j;
+
+        memcpy ( pBuf, pOrig, csize );
+        for ( j = 0u; j < 1u + i % 8u; j++ ) {
+            pBuf[HDR_SIZE + (unsigned) rand () % ( csize - HDR_SIZE )] =
+                (unsigned char) rand ();
+        }
+        memset ( pDst, GUARD_BYTE, size + GUARD );
+        memset ( pWork + size, GUARD_BYTE, GUARD );
+        caUncompressPayload ( pBuf, csize, pDst, pWork );
+        if ( guardOK ( pDst + size ) && guardOK ( pWork + size ) )
+            nOK++;
+    }
+    testOk ( nOK == 1000u, "%u of 1000 damaged blocks decoded within bounds",
+        nOK );
+
+    free ( pOrig );
+    free ( pBuf );
+    free ( pWork );
+    free ( pDst );
+}
+
+MAIN(caCompressTest)
+{
+    testPlan ( 2 * ( LAST_BUFFER_TYPE + 1 ) + 7 );
+    testRoundTrip ();
+    testCorrupt ();
+    return testDone ();
+}
@@ -0,0 +1,191 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*
+ * Test of CA client searches and beacons through a multicast group,
+ * looped back on this host
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cadef.h"
+#include "caProto.h"
+#include "envDefs.h"
+#include "epicsThread.h"
+#include "errlog.h"
+#include "osiSock.h"
+#include "epicsUnitTest.h"
+#include "testMain.h"
+
+#define GROUP "239.255.76.23"
+#define SERVER_PORT 15080
+#define REPEATER_PORT 15081
+#define CHANNEL "caMcastTest:chan"
+#define MINOR_REVISION 10u      /* beacons carry a sequence number */
+
+static unsigned nMismatch;
+
+static void errlogCount ( void *pPrivate, const char *message )
+{
+    if ( strstr ( message, "expects a CA repeater" ) )
+        nMismatch++;
+}
+
+static SOCKET udpSocket ( unsigned short port )
+{
+    SOCKET sock = epicsSocketCreate ( AF_INET, SOCK_DGRAM, 0 );
+    osiSockAddr addr;
+
+    if ( sock == INVALID_SOCKET )
+        testAbort ( "Can't create a UDP socket" );
+    memset ( &addr, 0, sizeof ( addr ) );
+    addr.ia.sin_family = AF_INET;
+    addr.ia.sin_addr.s_addr = htonl ( INADDR_ANY );
+    addr.ia.sin_port = htons ( port );
+    epicsSocketEnableAddressUseForDatagramFanout ( sock );
+    if ( bind ( sock, &addr.sa, sizeof ( addr ) ) )
+        testAbort ( "Can't bind UDP port %u", port );
+    return sock;
+}
+
+/*
+ * Wait for a search for name, return true if one arrived
+ */
+static int searchWait ( SOCKET sock, const char *name, double timeout )
+{
+    char buf[ETHERNET_MAX_UDP];
+    struct timeval tv;
+    fd_set fds;
+    int n;
+
+    tv.tv_sec = (long) timeout;
+    tv.tv_usec = (long) ( ( timeout - tv.tv_sec ) * 1e6 );
+    while ( 1 ) {
+        const char *pMsg = buf;
+
+        FD_ZERO ( &fds );
+        FD_SET ( sock, &fds );
+        if ( select ( sock + 1, &fds, NULL, NULL, &tv ) <= 0 )
+            return 0;
+        n = recv ( sock, buf, sizeof ( buf ), 0 );
+        while ( n >= (int) sizeof ( caHdr ) ) {
+            caHdr hdr;
+            int size;
+
+            memcpy ( &hdr, pMsg, sizeof ( hdr ) );
+            size = sizeof ( hdr ) + ntohs ( hdr.m_postsize );
+            if ( size > n )
+                break;
+            if ( ntohs ( hdr.m_cmmd ) == CA_PROTO_SEARCH &&
+                    strncmp ( pMsg + sizeof ( hdr ), name,
+                        size - sizeof ( hdr ) ) == 0 )
+                return 1;
+            pMsg += size;
+            n -= size;
+        }
+    }
+}
+
+static void sendMsg ( SOCKET sock, const char *dest, unsigned short port,
+    unsigned cmmd, unsigned seqNo )
+{
+    osiSockAddr addr;
+    caHdr hdr;
+
+    memset ( &addr, 0, sizeof ( addr ) );
+    addr.ia.sin_family = AF_INET;
+    addr.ia.sin_addr.s_addr = inet_addr ( dest );
+    addr.ia.sin_port = htons ( port );
+    memset ( &hdr, 0, sizeof ( hdr ) );
+    hdr.m_cmmd = htons ( cmmd );
+    hdr.m_dataType = htons ( MINOR_REVISION );
+    hdr.m_count = htons ( SERVER_PORT );
+    hdr.m_cid = htonl ( seqNo );
+    sendto ( sock, (char *) &hdr, sizeof ( hdr ), 0,
+        &addr.sa, sizeof ( addr ) );
+}
+
+MAIN(caMcastTest)
+{
+    struct ip_mreq mreq;
+    osiSockOptMcastLoop_t loop = 1;
+    SOCKET server, sender;
+    unsigned anomalies, i;
+    chid chan;
+
+    testPlan(7);
+
+    if ( ! osiSockAttach () )
+        testAbort ( "osiSockAttach failed" );
+
+    epicsEnvSet ( "EPICS_CA_MCAST_GROUP", GROUP );
+    epicsEnvSet ( "EPICS_CA_AUTO_ADDR_LIST", "YES" );
+    epicsEnvSet ( "EPICS_CA_ADDR_LIST", "" );
+    epicsEnvSet ( "EPICS_CA_NAME_SERVERS", "" );
+    epicsEnvSet ( "EPICS_CA_SERVER_PORT", "15080" );
+    epicsEnvSet ( "EPICS_CA_REPEATER_PORT", "15081" );
+
+    /* a fake server in the group, which receives the searches */
+    server = udpSocket ( SERVER_PORT );
+    memset ( &mreq, 0, sizeof ( mreq ) );
+    mreq.imr_multiaddr.s_addr = inet_addr ( GROUP );
+    mreq.imr_interface.s_addr = htonl ( INADDR_ANY );
+    if ( setsockopt ( server, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+            (char *) &mreq, sizeof ( mreq ) ) ) {
+        testSkip ( 7, "This host can't join a multicast group" );
+        epicsSocketDestroy ( server );
+        osiSockRelease ();
+        return testDone();
+    }
+    sender = udpSocket ( 0 );
+    setsockopt ( sender, IPPROTO_IP, IP_MULTICAST_LOOP,
+        (char *) &loop, sizeof ( loop ) );
+
+    errlogAddListener ( errlogCount, NULL );
+
+    testOk1 ( ca_context_create ( ca_enable_preemptive_callback )
+        == ECA_NORMAL );
+    ca_create_channel ( CHANNEL, NULL, NULL, 0, &chan );
+    ca_flush_io ();
+    testOk ( epicsThreadGetId ( "CAC-UDP-beacon" ) != 0,
+        "Client joined the group instead of using a repeater" );
+    testOk ( searchWait ( server, CHANNEL, 5.0 ),
+        "Search arrived through the group" );
+
+    /*
+     * A new server's second beacon, if it comes sooner than the
+     * client has been running, is an anomaly.
+     */
+    anomalies = ca_beacon_anomaly_count ();
+    epicsThreadSleep ( 0.5 );
+    sendMsg ( sender, GROUP, REPEATER_PORT, CA_PROTO_RSRV_IS_UP, 1u );
+    epicsThreadSleep ( 0.1 );
+    sendMsg ( sender, GROUP, REPEATER_PORT, CA_PROTO_RSRV_IS_UP, 2u );
+    for ( i = 0u; i < 500u; i++ ) {
+        if ( ca_beacon_anomaly_count () > anomalies )
+            break;
+        epicsThreadSleep ( 0.01 );
+    }
+    testOk ( ca_beacon_anomaly_count () > anomalies,
+        "Beacons arrived through the group" );
+
+    /* a client without the group registers with a repeater */
+    testOk1 ( nMismatch == 0u );
+    sendMsg ( sender, "127.0.0.1", REPEATER_PORT, REPEATER_REGISTER, 0u );
+    sendMsg ( sender, "127.0.0.1", REPEATER_PORT, REPEATER_REGISTER, 0u );
+    epicsThreadSleep ( 0.5 );
+    errlogFlush ();
+    testOk ( nMismatch > 0u, "Client without the group reported" );
+    testOk ( nMismatch == 1u, "Reported once" );
+
+    ca_clear_channel ( chan );
+    ca_context_destroy ();
+    errlogRemoveListeners ( errlogCount, NULL );
+    epicsSocketDestroy ( sender );
+    epicsSocketDestroy ( server );
+    osiSockRelease ();
+
+    return testDone();
+}
@@ -0,0 +1,117 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*
+ * Test that CA client searches keep to EPICS_CA_SEARCH_BANDWIDTH
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cadef.h"
+#include "caProto.h"
+#include "envDefs.h"
+#include "epicsTime.h"
+#include "osiSock.h"
+#include "epicsUnitTest.h"
+#include "testMain.h"
+
+#define NCHANNELS 3000
+#define BANDWIDTH 20000.0       /* bytes per second */
+#define BURST 0.1               /* seconds of budget the client may save */
+#define WINDOW 2.0              /* seconds */
+
+/*
+ * Wait for a datagram for up to timeout seconds and return its
+ * size, or 0 if none arrived.
+ */
+static int recvWait ( SOCKET sock, double timeout )
+{
+    char buf[ETHERNET_MAX_UDP];
+    struct timeval tv;
+    fd_set fds;
+    int n;
+
+    FD_ZERO ( &fds );
+    FD_SET ( sock, &fds );
+    tv.tv_sec = (long) timeout;
+    tv.tv_usec = (long) ( ( timeout - tv.tv_sec ) * 1e6 );
+    if ( select ( sock + 1, &fds, NULL, NULL, &tv ) <= 0 )
+        return 0;
+    n = recv ( sock, buf, sizeof ( buf ), 0 );
+    return n > 0 ? n : 0;
+}
+
+MAIN(caSearchPaceTest)
+{
+    static chid chans[NCHANNELS];
+    char name[64];
+    osiSockAddr addr;
+    osiSocklen_t len = sizeof ( addr );
+    epicsTimeStamp start, now;
+    double elapsed = 0.0, limit;
+    unsigned long bytes = 0ul;
+    unsigned frames = 0u;
+    SOCKET sock;
+    int i, n;
+
+    testPlan(4);
+
+    if ( ! osiSockAttach () )
+        testAbort ( "osiSockAttach failed" );
+
+    /* a fake server, which receives the searches but never replies */
+    sock = epicsSocketCreate ( AF_INET, SOCK_DGRAM, 0 );
+    memset ( &addr, 0, sizeof ( addr ) );
+    addr.ia.sin_family = AF_INET;
+    addr.ia.sin_addr.s_addr = htonl ( INADDR_LOOPBACK );
+    addr.ia.sin_port = 0;
+    if ( sock == INVALID_SOCKET || bind ( sock, &addr.sa, sizeof ( addr ) ) ||
+            getsockname ( sock, &addr.sa, &len ) )
+        testAbort ( "Can't bind a loopback UDP socket" );
+
+    sprintf ( name, "127.0.0.1:%u", ntohs ( addr.ia.sin_port ) );
+    epicsEnvSet ( "EPICS_CA_AUTO_ADDR_LIST", "NO" );
+    epicsEnvSet ( "EPICS_CA_ADDR_LIST", name );
+    epicsEnvSet ( "EPICS_CA_NAME_SERVERS", "" );
+    sprintf ( name, "%g", BANDWIDTH / 1000.0 );
+    epicsEnvSet ( "EPICS_CA_SEARCH_BANDWIDTH", name );
+
+    testOk1 ( ca_context_create ( ca_enable_preemptive_callback )
+        == ECA_NORMAL );
+    for ( i = 0; i < NCHANNELS; i++ ) {
+        sprintf ( name, "caSearchPaceTest:no:such:channel:%d", i );
+        ca_create_channel ( name, NULL, NULL, 0, &chans[i] );
+    }
+    ca_flush_io ();
+
+    /* start timing at the first search, the budget is full then */
+    n = recvWait ( sock, 5.0 );
+    testOk ( n > 0, "Searches arrive" );
+    epicsTimeGetCurrent ( &start );
+    bytes = (unsigned long) n;
+    frames = 1u;
+
+    while ( elapsed < WINDOW ) {
+        n = recvWait ( sock, WINDOW - elapsed );
+        epicsTimeGetCurrent ( &now );
+        elapsed = epicsTimeDiffInSeconds ( &now, &start );
+        if ( n > 0 && elapsed < WINDOW ) {
+            bytes += (unsigned long) n;
+            frames++;
+        }
+    }
+
+    limit = BANDWIDTH * ( WINDOW + BURST ) + ETHERNET_MAX_UDP;
+    testOk ( bytes <= limit, "%lu bytes in %u frames sent in %g s, "
+        "at most %.0f allowed", bytes, frames, WINDOW, limit );
+    testOk ( bytes >= BANDWIDTH * WINDOW / 2.0,
+        "Searches keep going at more than half the budget" );
+
+    ca_context_destroy ();
+    epicsSocketDestroy ( sock );
+    osiSockRelease ();
+
+    return testDone();
+}
@@ -0,0 +1,213 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*
+ * Test of the shared memory ring for same-host CA circuits, with the
+ * client and the server side mapping the ring in one process
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+#include "caSharedRing.h"
+#include "osiSock.h"
+#include "epicsUnitTest.h"
+#include "testMain.h"
+
+#define NPAYLOADS 2000u
+#define MAXPAYLOAD 0x5000u
+#define NQUEUE 64u
+
+static unsigned char src[MAXPAYLOAD];
+
+static unsigned payloadSize ( unsigned i )
+{
+    return 1u + ( i * 2731u ) % MAXPAYLOAD;
+}
+
+static void payloadFill ( unsigned i )
+{
+    unsigned j, size = payloadSize ( i );
+
+    for ( j = 0u; j < size; j++ )
+        src[j] = (unsigned char) ( i + j * 7u );
+}
+
+static int payloadCheck ( unsigned i, const unsigned char *p, unsigned size )
+{
+    unsigned j;
+
+    if ( ! p || size != payloadSize ( i ) )
+        return 0;
+    for ( j = 0u; j < size; j++ )
+        if ( p[j] != (unsigned char) ( i + j * 7u ) )
+            return 0;
+    return 1;
+}
+
+/*
+ * The server puts payloads of many sizes until the ring is full,
+ * then the client takes the oldest ones, so positions wrap many times
+ */
+static void testWrap ( caSharedRing *pClient, caSharedRing *pServer )
+{
+    caSharedRingRef refs[NQUEUE];
+    unsigned first = 0u, next = 0u, nFull = 0u, nBad = 0u;
+    ca_uint32_t lastPos = 0u;
+
+    testDiag ( "Put, get and release %u payloads", NPAYLOADS );
+
+    while ( first < NPAYLOADS ) {
+        if ( next < NPAYLOADS && next - first < NQUEUE ) {
+            payloadFill ( next );
+            if ( caSharedRingPut ( pServer, src, payloadSize ( next ),
+                    &refs[next % NQUEUE] ) == 0 ) {
+                lastPos = ntohl ( refs[next % NQUEUE].m_pos );
+                next++;
+                continue;
+            }
+            if ( next == first )
+                break;
+            nFull++;
+        }
+        {
+            caSharedRingRef *pRef = &refs[first % NQUEUE];
+            unsigned size = 0u;
+            void *p = caSharedRingGet ( pClient, pRef, &size );
+
+            if ( ! payloadCheck ( first, p, size ) )
+                nBad++;
+            caSharedRingRelease ( pClient, pRef );
+            first++;
+        }
+    }
+
+    testOk ( first == NPAYLOADS, "%u payloads passed through", first );
+    testOk ( nBad == 0u, "%u payloads damaged", nBad );
+    testOk ( nFull > 0u, "Put rejected %u times while the ring was full",
+        nFull );
+    testOk ( lastPos / pClient->size > 10u, "Ring wrapped %u times",
+        (unsigned) ( lastPos / pClient->size ) );
+}
+
+static void testLimits ( void )
+{
+    caSharedRing client, server;
+    caSharedRingRef refs[4], ref;
+    unsigned quarter, size, n;
+    void *p;
+
+    testDiag ( "Full ring and bad references" );
+
+    if ( caSharedRingCreate ( &client, 0u ) != 0 )
+        testAbort ( "Can't create a second ring" );
+    testOk1 ( caSharedRingAttach ( &server, client.name, client.cookie ) == 0 );
+    quarter = client.size / 4u;
+
+    for ( n = 0u; n < 4u; n++ ) {
+        memset ( src, n, quarter );
+        if ( caSharedRingPut ( &server, src, quarter, &refs[n] ) != 0 )
+            break;
+    }
+    testOk ( n == 4u, "%u quarters fill the ring", n );
+    testOk ( caSharedRingPut ( &server, src, 8u, &ref ) != 0,
+        "Put into a full ring rejected" );
+
+    caSharedRingRelease ( &client, &refs[0] );
+    memset ( src, 4, quarter );
+    size = 0u;
+    p = caSharedRingPut ( &server, src, quarter, &ref ) == 0 ?
+        caSharedRingGet ( &client, &ref, &size ) : NULL;
+    testOk ( p && size == quarter && ntohl ( ref.m_pos ) == client.size &&
+        memcmp ( p, src, quarter ) == 0,
+        "Put wraps to the start once the first quarter is released" );
+
+    testOk ( caSharedRingPut ( &server, src, client.size + 1u, &ref ) != 0,
+        "Payload larger than the ring rejected" );
+
+    ref.m_pos = refs[3].m_pos;
+    ref.m_size = htonl ( 2u * quarter );
+    testOk ( caSharedRingGet ( &client, &ref, &size ) == NULL,
+        "Reference past the end of the ring rejected" );
+
+    caSharedRingDestroy ( &server );
+    caSharedRingDestroy ( &client );
+}
+
+static void testAttach ( caSharedRing *pRing )
+{
+    caSharedRing other, small;
+    ca_uint32_t cookie[2];
+    char name[CA_SHARED_RING_NAME_SIZE];
+
+    testDiag ( "Attach with bad names, cookies and sizes" );
+
+    cookie[0] = pRing->cookie[0] ^ 1u;
+    cookie[1] = pRing->cookie[1];
+    testOk ( caSharedRingAttach ( &other, pRing->name, cookie ) != 0,
+        "Wrong cookie rejected" );
+    testOk ( caSharedRingAttach ( &other, pRing->name + 1, pRing->cookie ) != 0,
+        "Name without the prefix rejected" );
+    testOk ( caSharedRingAttach ( &other, "/epicsCA-none", pRing->cookie ) != 0,
+        "Missing ring rejected" );
+
+#ifdef __linux__
+    {
+        int fd;
+
+        /* an object too small to hold a ring */
+        sprintf ( name, "/epicsCA-%ld-test", (long) getpid () );
+        fd = shm_open ( name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR );
+        if ( fd < 0 || ftruncate ( fd, 64 ) != 0 )
+            testAbort ( "Can't create shared memory %s", name );
+        close ( fd );
+        testOk ( caSharedRingAttach ( &other, name, pRing->cookie ) != 0,
+            "Object too small for a ring rejected" );
+        shm_unlink ( name );
+
+        /* a ring whose object is smaller than its header says */
+        if ( caSharedRingCreate ( &small, 0u ) != 0 )
+            testAbort ( "Can't create a second ring" );
+        fd = shm_open ( pRing->name, O_RDWR, 0 );
+        if ( fd < 0 || ftruncate ( fd, (off_t) small.mapSize ) != 0 )
+            testAbort ( "Can't truncate ring %s", pRing->name );
+        close ( fd );
+        testOk ( caSharedRingAttach ( &other, pRing->name, pRing->cookie ) != 0,
+            "Ring truncated below its size rejected" );
+        caSharedRingDestroy ( &small );
+    }
+#else
+    testSkip ( 2, "Shared memory objects are Linux only" );
+#endif
+}
+
+MAIN(caSharedRingTest)
+{
+    caSharedRing client, server;
+
+    testPlan(17);
+
+    if ( caSharedRingCreate ( &client, 0x20000u ) != 0 ) {
+        testSkip ( 17, "Shared rings aren't available on this target" );
+        return testDone();
+    }
+    testOk1 ( caSharedRingAttach ( &server, client.name, client.cookie ) == 0 );
+    testOk1 ( server.size == client.size );
+
+    testWrap ( &client, &server );
+    testLimits ();
+
+    caSharedRingDestroy ( &server );
+    testAttach ( &client );
+    caSharedRingDestroy ( &client );
+
+    return testDone();
+}
@@ -62,6 +62,13 @@ const udpiiu::pProtoStubUDP udpiiu::udpJumpTableCAC [] =
     &udpiiu::badUDPRespAction,
     &udpiiu::badUDPRespAction,
     &udpiiu::repeaterAckAction,
+    &udpiiu::badUDPRespAction,
+    &udpiiu::badUDPRespAction,
+    &udpiiu::badUDPRespAction,
+    &udpiiu::badUDPRespAction,
+    &udpiiu::badUDPRespAction,
+    &udpiiu::badUDPRespAction,
+    &udpiiu::repeaterRegisterAction,
 };
 
 
@@ -93,6 +100,26 @@ double getMaxPeriod()
     return maxPeriod;
 }
 
+static
+double getSearchBandwidth()
+{
+    double kBytesPerSec = 0.0;
+
+    if ( envGetConfigParamPtr ( & EPICS_CA_SEARCH_BANDWIDTH ) ) {
+        long longStatus = envGetDoubleConfigParam (
+            & EPICS_CA_SEARCH_BANDWIDTH, & kBytesPerSec );
+        if ( longStatus || kBytesPerSec < 0.0 ) {
+            epicsPrintf ( "EPICS \"%s\" wasnt a positive real number\n",
+                            EPICS_CA_SEARCH_BANDWIDTH.name );
+            epicsPrintf ( "Setting \"%s\" = 0 (unlimited)\n",
+                EPICS_CA_SEARCH_BANDWIDTH.name );
+            kBytesPerSec = 0.0;
+        }
+    }
+
+    return 1000.0 * kBytesPerSec;
+}
+
 static
 unsigned getNTimers(double maxPeriod)
 {
@@ -131,7 +158,11 @@ udpiiu::udpiiu (
     repeaterSubscribeTmr (
         m_repeaterTimerNotify, timerQueue, cbMutexIn, ctxNotifyIn ),
     govTmr ( *this, timerQueue, cacMutexIn ),
+    searchBudgetTime ( epicsTime::getCurrent () ),
     maxPeriod ( getMaxPeriod() ),
+    searchBandwidth ( getSearchBandwidth () ),
+    searchBudget ( searchBandwidth * searchBurstPeriod ),
+    searchBytesSent ( 0.0 ),
     rtteMean ( minRoundTripEstimate ),
     rtteMeanDev ( 0 ),
     cacRef ( cac ),
@@ -144,11 +175,13 @@ udpiiu::udpiiu (
     sequenceNumber ( 0 ),
     lastReceivedSeqNo ( 0 ),
     sock ( 0 ),
+    beaconSock ( INVALID_SOCKET ),
     repeaterPort ( 0 ),
     serverPort ( port ),
     localPort ( 0 ),
     shutdownCmd ( false ),
-    lastReceivedSeqNoIsValid ( false )
+    lastReceivedSeqNoIsValid ( false ),
+    repeaterMismatchWarned ( false )
 {
     cacGuard.assertIdenticalMutex ( cacMutex );
 
@@ -289,13 +322,34 @@ udpiiu::udpiiu (
         SearchDestUDP & searchDest = * 
             new SearchDestUDP ( pNode->addr, *this );
         _searchDestList.add ( searchDest );
+        osiSockDatagram dg;
+        dg.pBuf = this->xmitBuf;
+        dg.bufSize = 0u;
+        dg.nBytes = 0u;
+        dg.truncated = 0;
+        dg.addr = pNode->addr;
+        _searchDatagrams.push_back ( dg );
         free ( pNode );
     }
 
     /* add list of tcp name service addresses */
     _searchDestList.add ( searchDestListIn );
     
-    caStartRepeaterIfNotInstalled ( this->repeaterPort );
+    // beacons sent to a multicast group reach every client on 
+    // the host directly, so the repeater isnt needed
+    struct in_addr group;
+    if ( getChannelAccessMulticastGroup ( &group ) &&
+            this->joinBeaconGroup ( group ) ) {
+        this->pBeaconRecvThread.reset ( new udpRecvThread ( 
+            *this, ctxNotifyIn, cbMutexIn, "CAC-UDP-beacon", 
+            epicsThreadGetStackSize ( epicsThreadStackMedium ),
+            cac::lowestPriorityLevelAbove (
+                cac::lowestPriorityLevelAbove (
+                    cac.getInitializingThreadsPriority () ) ) ) );
+    }
+    else {
+        caStartRepeaterIfNotInstalled ( this->repeaterPort );
+    }
 
     this->pushVersionMsg ();
 
@@ -304,8 +358,76 @@ udpiiu::udpiiu (
         this->ppSearchTmr[j]->start ( cacGuard ); 
     }
     this->govTmr.start ();
-    this->repeaterSubscribeTmr.start ();
-    this->recvThread.start ();
+    if ( this->pBeaconRecvThread.get () ) {
+        this->pBeaconRecvThread->start ( this->beaconSock );
+    }
+    else {
+        this->repeaterSubscribeTmr.start ();
+    }
+    this->recvThread.start ( this->sock );
+}
+
+//
+// Many clients on one host bind the same port to receive the 
+// beacons, like the repeater would if it used multicast.
+//
+bool udpiiu::joinBeaconGroup ( const struct in_addr & group )
+{
+#ifdef IP_ADD_MEMBERSHIP
+    SOCKET bsock = epicsSocketCreate ( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+    if ( bsock == INVALID_SOCKET ) {
+        char sockErrBuf[64];
+        epicsSocketConvertErrnoToString ( 
+            sockErrBuf, sizeof ( sockErrBuf ) );
+        errlogPrintf ("CAC: unable to create beacon socket because = \"%s\"\n",
+            sockErrBuf );
+        return false;
+    }
+
+    epicsSocketEnableAddressUseForDatagramFanout ( bsock );
+
+    osiSockAddr addr;
+    memset ( (char *)&addr, 0 , sizeof (addr) );
+    addr.ia.sin_family = AF_INET;
+    addr.ia.sin_addr.s_addr = htonl ( INADDR_ANY ); 
+    addr.ia.sin_port = htons ( this->repeaterPort );
+    int status = bind ( bsock, &addr.sa, sizeof (addr) );
+    if ( status < 0 ) {
+        char sockErrBuf[64];
+        epicsSocketConvertErrnoToString ( 
+            sockErrBuf, sizeof ( sockErrBuf ) );
+        errlogPrintf ( "CAC: unable to bind beacon port %u because = \"%s\", "
+            "using the CA repeater\n", this->repeaterPort, sockErrBuf );
+        epicsSocketDestroy ( bsock );
+        return false;
+    }
+
+    struct ip_mreq mreq;
+    memset ( &mreq, 0, sizeof ( mreq ) );
+    mreq.imr_multiaddr = group;
+    mreq.imr_interface.s_addr = htonl ( INADDR_ANY );
+    status = setsockopt ( bsock, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+        (char *) &mreq, sizeof ( mreq ) );
+    if ( status < 0 ) {
+        char sockErrBuf[64];
+        epicsSocketConvertErrnoToString ( 
+            sockErrBuf, sizeof ( sockErrBuf ) );
+        addr.ia.sin_addr = group;
+        char buf[64];
+        ipAddrToDottedIP ( &addr.ia, buf, sizeof ( buf ) );
+        errlogPrintf ( "CAC: unable to join multicast group %s because = \"%s\", "
+            "using the CA repeater\n", buf, sockErrBuf );
+        epicsSocketDestroy ( bsock );
+        return false;
+    }
+
+    this->beaconSock = bsock;
+    return true;
+#else
+    errlogPrintf ( "CAC: IPv4 multicast not supported by this target, "
+        "using the CA repeater\n" );
+    return false;
+#endif
 }
 
 /*
@@ -328,6 +450,9 @@ udpiiu::~udpiiu ()
     }
     
     epicsSocketDestroy ( this->sock );
+    if ( this->beaconSock != INVALID_SOCKET ) {
+        epicsSocketDestroy ( this->beaconSock );
+    }
 }
 
 void udpiiu::shutdown ( 
@@ -364,22 +489,57 @@ void udpiiu::shutdown (
                     }
                 }
             }
+
+            if ( this->pBeaconRecvThread.get () ) {
+                this->interruptBeaconRecv ();
+                while ( ! this->pBeaconRecvThread->exitWait ( 1.0 ) ) {
+                    this->interruptBeaconRecv ();
+                }
+            }
         }
     }
 }
 
+//
+// other clients share the beacon port, so a wakeup message
+// sent to it might not reach this client's thread
+//
+void udpiiu::interruptBeaconRecv ()
+{
+    if ( this->beaconSock == INVALID_SOCKET ) {
+        return;
+    }
+    epicsSocketSystemCallInterruptMechanismQueryInfo info  =
+        epicsSocketSystemCallInterruptMechanismQuery ();
+    switch ( info ) {
+    case esscimqi_socketCloseRequired:
+        epicsSocketDestroy ( this->beaconSock );
+        this->beaconSock = INVALID_SOCKET;
+        break;
+    case esscimqi_socketBothShutdownRequired:
+        // fails with ENOTCONN on an unconnected UDP socket,
+        // but wakes up the receiving thread nevertheless
+        ::shutdown ( this->beaconSock, SHUT_RDWR );
+        break;
+    default:
+        break;
+    }
+}
+
 udpRecvThread::udpRecvThread ( 
     udpiiu & iiuIn, cacContextNotify & ctxNotifyIn, epicsMutex & cbMutexIn,
     const char * pName, unsigned stackSize, unsigned priority ) :
         iiu ( iiuIn ), cbMutex ( cbMutexIn ), ctxNotify ( ctxNotifyIn ), 
-        thread ( *this, pName, stackSize, priority ) {}
+        thread ( *this, pName, stackSize, priority ), 
+        sock ( INVALID_SOCKET ) {}
 
 udpRecvThread::~udpRecvThread () 
 {
 }
 
-void udpRecvThread::start ()
+void udpRecvThread::start ( SOCKET sockIn )
 {
+    this->sock = sockIn;
     this->thread.start ();
 }
 
@@ -396,19 +556,23 @@ void udpRecvThread::run ()
 {
     epicsThreadPrivateSet ( caClientCallbackThreadId, &this->iiu );
     
-    if ( this->iiu._searchDestList.count () == 0 ) { 
+    if ( this->sock == this->iiu.sock && 
+            this->iiu._searchDestList.count () == 0 ) { 
         callbackManager mgr ( this->ctxNotify, this->cbMutex );
         epicsGuard < epicsMutex > guard ( this->iiu.cacMutex );
         genLocalExcep ( mgr.cbGuard, guard, 
             this->iiu.cacRef, ECA_NOSEARCHADDR, NULL );
     }
 
+    osiSockDatagram dg [ recvBatchMax ];
+    for ( unsigned i = 0u; i < recvBatchMax; i++ ) {
+        dg[i].pBuf = this->recvBuf[i];
+        dg[i].bufSize = sizeof ( this->recvBuf[i] );
+    }
+
     do {
-        osiSockAddr src;
-        osiSocklen_t src_size = sizeof ( src );
-        int status = recvfrom ( this->iiu.sock, 
-            this->iiu.recvBuf, sizeof ( this->iiu.recvBuf ), 0,
-            & src.sa, & src_size );
+        int status = epicsSocketRecvDatagrams ( this->sock, 
+            dg, recvBatchMax );
 
         if ( status <= 0 ) {
 
@@ -433,9 +597,15 @@ void udpRecvThread::run ()
                 }
             }
         }
-        else if ( status > 0 ) {
-            this->iiu.postMsg ( src, this->iiu.recvBuf, 
-                (arrayElementCount) status, epicsTime::getCurrent() );
+        else {
+            epicsTime currentTime = epicsTime::getCurrent ();
+            for ( int i = 0; i < status; i++ ) {
+                if ( dg[i].nBytes > 0u && ! dg[i].truncated ) {
+                    this->iiu.postMsg ( dg[i].addr, 
+                        static_cast < char * > ( dg[i].pBuf ), 
+                        (arrayElementCount) dg[i].nBytes, currentTime );
+                }
+            }
         }
 
     } while ( ! this->iiu.shutdownCmd );
@@ -683,6 +853,8 @@ bool udpiiu :: searchRespAction (
         return true;
     }
 
+    this->searchResponseNotify ( addr, currentTime );
+
     /*
      * Starting with CA V4.1 the minor version number
      * is appended to the end of each UDP search reply.
@@ -770,6 +942,14 @@ bool udpiiu::beaconAction (
      */
     ina.sin_family = AF_INET;
     ina.sin_addr.s_addr = htonl ( msg.m_available );
+    if ( ina.sin_addr.s_addr == htonl ( INADDR_ANY ) ) {
+        /*
+         * beacons received directly from the multicast
+         * group have not passed through a repeater which
+         * would have filled in the source address
+         */
+        ina.sin_addr = net_addr.ia.sin_addr;
+    }
     if ( msg.m_count != 0 ) {
         ina.sin_port = htons ( msg.m_count );
     }
@@ -797,6 +977,32 @@ bool udpiiu::repeaterAckAction (
     return true;
 }
 
+//
+// Only the beacon socket of a client in a multicast group receives 
+// these. A client on this host without the group found the repeater 
+// port taken, assumed a repeater, and will never receive beacons.
+//
+bool udpiiu::repeaterRegisterAction ( 
+    const caHdr & msg, 
+    const osiSockAddr & net_addr, const epicsTime & currentTime )
+{
+    if ( this->beaconSock == INVALID_SOCKET ) {
+        return this->badUDPRespAction ( msg, net_addr, currentTime );
+    }
+    if ( ! this->repeaterMismatchWarned ) {
+        char buf[64];
+        sockAddrToDottedIP ( &net_addr.sa, buf, sizeof ( buf ) );
+        errlogPrintf ( "CAC: CA client at %s expects a CA repeater on port %u, "
+            "where clients in multicast group %s receive beacons instead. "
+            "It will see no beacons unless it also sets %s\n", 
+            buf, this->repeaterPort, 
+            envGetConfigParamPtr ( &EPICS_CA_MCAST_GROUP ),
+            EPICS_CA_MCAST_GROUP.name );
+        this->repeaterMismatchWarned = true;
+    }
+    return true;
+}
+
 bool udpiiu::notHereRespAction ( 
     const caHdr &,  
         const osiSockAddr &, const epicsTime & )
@@ -961,7 +1167,9 @@ bool udpiiu::pushDatagramMsg ( epicsGuard < epicsMutex > & guard,
 
 udpiiu :: SearchDestUDP :: SearchDestUDP ( 
     const osiSockAddr & destAddr, udpiiu & udpiiuIn ) :
-    _lastError (0u), _destAddr ( destAddr ), _udpiiu ( udpiiuIn )
+    _lastError (0u), _destAddr ( destAddr ), _udpiiu ( udpiiuIn ),
+    _frames ( 0.0 ), _bytes ( 0.0 ), _sendFailures ( 0.0 ), 
+    _responses ( 0.0 ), _rttMean ( 0.0 ), _rttMeanDev ( 0.0 )
 {
 }
 
@@ -976,13 +1184,7 @@ void udpiiu :: SearchDestUDP :: searchRequest (
         int status = sendto ( _udpiiu.sock, const_cast<char *>(pBuf), bufSizeAsInt, 0, 
                 & _destAddr.sa, sizeof ( _destAddr.sa ) );
         if ( status == bufSizeAsInt ) {
-            if ( _lastError ) {
-                char buf[64];
-                sockAddrToDottedIP ( &_destAddr.sa, buf, sizeof ( buf ) );
-                errlogPrintf (
-                    "CAC: ok sending UDP msg to %s\n", buf);
-            }
-            _lastError = 0;
+            this->searchRequestSent ();
             break;
         }
         if ( status >= 0 ) {
@@ -1010,8 +1212,10 @@ void udpiiu :: SearchDestUDP :: searchRequest (
                 break;
             }
             else if ( localErrno == _lastError) {
+                _sendFailures++;
                 break;
             } else {
+                _sendFailures++;
                 char sockErrBuf[64];
                 epicsSocketConvertErrnoToString ( 
                     sockErrBuf, sizeof ( sockErrBuf ) );
@@ -1027,6 +1231,44 @@ void udpiiu :: SearchDestUDP :: searchRequest (
         }
     }
 }
+
+void udpiiu :: SearchDestUDP :: searchRequestSent ()
+{
+    if ( _lastError ) {
+        char buf[64];
+        sockAddrToDottedIP ( &_destAddr.sa, buf, sizeof ( buf ) );
+        errlogPrintf (
+            "CAC: ok sending UDP msg to %s\n", buf);
+    }
+    _lastError = 0;
+    _frames++;
+    _bytes += _udpiiu.nBytesInXmitBuf;
+}
+
+//
+// Servers reply from their own address, so only replies to 
+// unicast destinations can be attributed to one of them.
+//
+bool udpiiu :: SearchDestUDP :: searchResponse ( 
+    const osiSockAddr & addr, double roundTrip )
+{
+    if ( addr.ia.sin_addr.s_addr != _destAddr.ia.sin_addr.s_addr ) {
+        return false;
+    }
+    _responses++;
+    if ( roundTrip >= 0.0 ) {
+        if ( _responses <= 1.0 ) {
+            _rttMean = roundTrip;
+        }
+        double error = roundTrip - _rttMean;
+        _rttMean += 0.125 * error;
+        if ( error < 0.0 ) {
+            error = - error;
+        }
+        _rttMeanDev += 0.25 * ( error - _rttMeanDev );
+    }
+    return true;
+}
             
 void udpiiu :: SearchDestUDP :: show ( 
     epicsGuard < epicsMutex > & guard, unsigned level ) const
@@ -1035,6 +1277,14 @@ void udpiiu :: SearchDestUDP :: show (
     char buf[64];
     sockAddrToDottedIP ( &_destAddr.sa, buf, sizeof ( buf ) );
     :: printf ( "UDP Search destination \"%s\"\n", buf );
+    if ( level > 0u ) {
+        :: printf ( "\t%.0f frames, %.0f bytes, %.0f send failures\n", 
+            _frames, _bytes, _sendFailures );
+        if ( _responses > 0.0 ) {
+            :: printf ( "\t%.0f responses, round trip %f sec +/- %f\n", 
+                _responses, _rttMean, _rttMeanDev );
+        }
+    }
 }
 
 udpiiu :: SearchRespCallback :: SearchRespCallback ( udpiiu & udpiiuIn ) : 
@@ -1128,12 +1378,42 @@ bool udpiiu :: datagramFlush (
     }
 
     tsDLIter < SearchDest > iter ( _searchDestList.firstIter () );
+
+    // the UDP destinations share one system call where the OS allows it
+    const unsigned nUDP = static_cast < unsigned > ( _searchDatagrams.size () );
+    for ( unsigned j = 0u; j < nUDP; j++ ) {
+        _searchDatagrams[j].bufSize = this->nBytesInXmitBuf;
+    }
+    unsigned i = 0u;
+    while ( i < nUDP ) {
+        int status = epicsSocketSendDatagrams ( this->sock, 
+            & _searchDatagrams[i], nUDP - i );
+        if ( status < 0 ) {
+            // resend by itself to report or recover from the error
+            iter->searchRequest ( guard, this->xmitBuf, this->nBytesInXmitBuf );
+            iter++;
+            i++;
+            continue;
+        }
+        for ( unsigned nSent = i + status; i < nSent; i++ ) {
+            static_cast < SearchDestUDP & > ( *iter ).searchRequestSent ();
+            iter++;
+        }
+    }
+
+    // remaining destinations are TCP name servers
     while ( iter.valid () )
     {
         iter->searchRequest ( guard, this->xmitBuf, this->nBytesInXmitBuf );
         iter++;
     }
 
+    double nBytes = static_cast < double > ( this->nBytesInXmitBuf ) * 
+        _searchDestList.count ();
+    this->searchBudget -= nBytes;
+    this->searchBytesSent += nBytes;
+    this->searchSendTime[this->sequenceNumber % sendTimeRingSize] = 
+        currentTime;
     this->nBytesInXmitBuf = 0u;
 
     this->pushVersionMsg ();
@@ -1146,8 +1426,26 @@ void udpiiu :: show ( unsigned level ) const
     epicsGuard < epicsMutex > guard ( this->cacMutex );
 
     ::printf ( "Datagram IO circuit (and disconnected channel repository)\n");
+    if ( level > 0u ) {
+        ::printf ( "\tsearch round trip estimate %f sec +/- %f\n", 
+            this->rtteMean, this->rtteMeanDev );
+        ::printf ( "\t%.0f search bytes sent", this->searchBytesSent );
+        if ( this->searchBandwidth > 0.0 ) {
+            ::printf ( ", bandwidth budget %g kB/sec, %.0f bytes available\n", 
+                this->searchBandwidth / 1000.0, this->searchBudget );
+        }
+        else {
+            ::printf ( ", bandwidth unlimited\n" );
+        }
+    }
     if ( level > 1u ) {
-        ::printf ("\trepeater port %u\n", this->repeaterPort );
+        if ( this->pBeaconRecvThread.get () ) {
+            ::printf ("\tbeacons received from the multicast group on port %u\n", 
+                this->repeaterPort );
+        }
+        else {
+            ::printf ("\trepeater port %u\n", this->repeaterPort );
+        }
         ::printf ("\tdefault server port %u\n", this->serverPort );
         ::printf ( "Search Destination List with %u items\n", 
             _searchDestList.count () );
@@ -1293,7 +1591,7 @@ void udpiiu::boostChannel (
 void udpiiu::govExpireNotify ( 
     epicsGuard < epicsMutex > & guard, nciu & chan )
 {
-    this->ppSearchTmr[0]->installChannel ( guard, chan );
+    this->ppSearchTmr[0]->installPriorityChannel ( guard, chan );
 }
 
 int udpiiu :: M_repeaterTimerNotify :: printFormated ( 
@@ -1448,6 +1746,71 @@ double udpiiu::receiveWatchdogDelay (
     return netiiu::receiveWatchdogDelay ( guard );
 }
 
+bool udpiiu::datagramSendTime ( epicsGuard < epicsMutex > & guard,
+    ca_uint32_t seqNumber, epicsTime & sendTime ) const
+{
+    guard.assertIdenticalMutex ( this->cacMutex );
+    // the frame with the current sequence number hasnt been sent
+    ca_uint32_t age = this->sequenceNumber - seqNumber;
+    if ( age == 0u || age > sendTimeRingSize ) {
+        return false;
+    }
+    sendTime = this->searchSendTime[seqNumber % sendTimeRingSize];
+    return true;
+}
+
+//
+// A token bucket holding at most searchBurstPeriod worth of the 
+// budget. A frame may be sent whenever the bucket isnt empty, and 
+// the bytes sent to all destinations are then charged against it.
+// Once it is empty, sending resumes when it is half full again, so 
+// that the timer queue isnt asked for delays below its quantum.
+//
+double udpiiu::searchPacingDelay ( 
+    epicsGuard < epicsMutex > & guard, const epicsTime & currentTime )
+{
+    guard.assertIdenticalMutex ( this->cacMutex );
+    if ( this->searchBandwidth <= 0.0 ) {
+        return 0.0;
+    }
+    double elapsed = currentTime - this->searchBudgetTime;
+    if ( elapsed > 0.0 ) {
+        this->searchBudget += elapsed * this->searchBandwidth;
+        double burst = this->searchBandwidth * searchBurstPeriod;
+        if ( this->searchBudget > burst ) {
+            this->searchBudget = burst;
+        }
+        this->searchBudgetTime = currentTime;
+    }
+    if ( this->searchBudget >= 0.0 ) {
+        return 0.0;
+    }
+    return searchBurstPeriod / 2.0 - 
+        this->searchBudget / this->searchBandwidth;
+}
+
+void udpiiu::searchResponseNotify ( 
+    const osiSockAddr & addr, const epicsTime & currentTime )
+{
+    epicsGuard < epicsMutex > guard ( this->cacMutex );
+
+    double roundTrip = -1.0;
+    epicsTime sendTime;
+    if ( this->lastReceivedSeqNoIsValid &&
+            this->datagramSendTime ( guard, this->lastReceivedSeqNo, sendTime ) ) {
+        roundTrip = currentTime - sendTime;
+    }
+
+    tsDLIter < SearchDest > iter ( _searchDestList.firstIter () );
+    for ( size_t i = 0u; i < _searchDatagrams.size (); i++ ) {
+        if ( static_cast < SearchDestUDP & > ( *iter ).searchResponse ( 
+                addr, roundTrip ) ) {
+            break;
+        }
+        iter++;
+    }
+}
+
 ca_uint32_t udpiiu::datagramSeqNumber (
     epicsGuard < epicsMutex > & ) const
 {
@@ -26,6 +26,7 @@
 #define udpiiuh
 
 #include <memory>
+#include <vector>
 
 #ifdef epicsExportSharedSymbols
 #   define udpiiuh_accessh_epicsExportSharedSymbols
@@ -68,14 +69,18 @@ public:
         class udpiiu & iiuIn, cacContextNotify &, epicsMutex &,
         const char * pName, unsigned stackSize, unsigned priority );
     virtual ~udpRecvThread ();
-    void start ();
+    void start ( SOCKET );
     bool exitWait ( double delay );
     void show ( unsigned level ) const;
+    enum { recvBatchMax = 4u }; // datagrams per receive system call
 private:
+    // any of them may be larger than an ethernet frame
+    char recvBuf [recvBatchMax][MAX_UDP_RECV];
     class udpiiu & iiu;
     epicsMutex & cbMutex;
     cacContextNotify & ctxNotify;
     epicsThread thread;
+    SOCKET sock;
     void run();
 };
 
@@ -84,6 +89,7 @@ static const double maxRoundTripEstimate = 30; // seconds
 static const double maxSearchPeriodDefault = 5.0 * 60.0; // seconds
 static const double maxSearchPeriodLowerLimit = 60.0; // seconds
 static const double beaconAnomalySearchPeriod = 5.0; // seconds
+static const double searchBurstPeriod = 0.1; // seconds of bandwidth budget
 
 class udpiiu : 
     private netiiu, 
@@ -120,12 +126,20 @@ private:
         SearchDestUDP ( const osiSockAddr &, udpiiu & );
         void searchRequest ( 
             epicsGuard < epicsMutex > &, const char * pBuf, size_t bufLen );
+        void searchRequestSent ();
+        bool searchResponse ( const osiSockAddr &, double roundTrip );
         void show ( 
             epicsGuard < epicsMutex > &, unsigned level ) const;
     private:
         int _lastError;
         osiSockAddr _destAddr;
         udpiiu & _udpiiu;
+        double _frames;
+        double _bytes;
+        double _sendFailures;
+        double _responses;
+        double _rttMean;
+        double _rttMeanDev;
     };
     class SearchRespCallback : 
         public SearchDest :: Callback {
@@ -154,14 +168,24 @@ private:
     private:
         udpiiu & m_udpiiu;
     };
+    enum { sendTimeRingSize = 256u }; // must be a power of two
     char xmitBuf [MAX_UDP_SEND];   
-    char recvBuf [MAX_UDP_RECV];
     udpRecvThread recvThread;
+    // receives beacons sent to the multicast group, if there is one
+    std::auto_ptr < udpRecvThread > pBeaconRecvThread;
     M_repeaterTimerNotify m_repeaterTimerNotify;
     repeaterSubscribeTimer repeaterSubscribeTmr;
     disconnectGovernorTimer govTmr;
     tsDLList < SearchDest > _searchDestList;
+    // one entry for each SearchDestUDP, which come first in _searchDestList
+    std::vector < osiSockDatagram > _searchDatagrams;
+    // send time of recent search frames, by sequence number
+    epicsTime searchSendTime [sendTimeRingSize];
+    epicsTime searchBudgetTime;
     const double maxPeriod;
+    const double searchBandwidth; // bytes per second, zero if unlimited
+    double searchBudget; // bytes, negative when in debt
+    double searchBytesSent;
     double rtteMean;
     double rtteMeanDev;
     cac & cacRef;
@@ -183,13 +207,17 @@ private:
     ca_uint32_t sequenceNumber;
     ca_uint32_t lastReceivedSeqNo;
     SOCKET sock;
+    SOCKET beaconSock;
     ca_uint16_t repeaterPort;
     ca_uint16_t serverPort;
     ca_uint16_t localPort;
     bool shutdownCmd;
     bool lastReceivedSeqNoIsValid;
+    bool repeaterMismatchWarned;
 
     bool wakeupMsg ();
+    bool joinBeaconGroup ( const struct in_addr & group );
+    void interruptBeaconRecv ();
 
     void postMsg ( 
             const osiSockAddr & net_addr, 
@@ -229,6 +257,9 @@ private:
     bool repeaterAckAction ( 
         const caHdr &msg, 
         const osiSockAddr &net_addr, const epicsTime & );
+    bool repeaterRegisterAction ( 
+        const caHdr &msg, 
+        const osiSockAddr &net_addr, const epicsTime & );
 
     // netiiu stubs
     unsigned getHostName ( 
@@ -298,6 +329,12 @@ private:
         epicsGuard < epicsMutex > &, const epicsTime & currentTime );
     ca_uint32_t datagramSeqNumber ( 
         epicsGuard < epicsMutex > & ) const;
+    bool datagramSendTime ( epicsGuard < epicsMutex > &,
+        ca_uint32_t seqNumber, epicsTime & sendTime ) const;
+    double searchPacingDelay ( 
+        epicsGuard < epicsMutex > &, const epicsTime & currentTime );
+    void searchResponseNotify ( 
+        const osiSockAddr &, const epicsTime & currentTime );
 
     // disconnectGovernorNotify
     void govExpireNotify ( 
@@ -25,10 +25,13 @@
 #ifndef virtualCircuith  
 #define virtualCircuith
 
+#include <vector>
+
 #include "tsDLList.h"
 
 #include "comBuf.h"
 #include "caServerID.h"
+#include "caSharedRing.h"
 #include "netiiu.h"
 #include "comQueSend.h"
 #include "comQueRecv.h"
@@ -55,8 +58,8 @@ class ipAddrToAsciiEngine;
 class tcpRecvThread : private epicsThreadRunable {
 public:
     tcpRecvThread ( 
-        class tcpiiu & iiuIn, epicsMutex & cbMutexIn, cacContextNotify &,
-        const char * pName, unsigned int stackSize, unsigned int priority );
+        class tcpiiu & iiuIn, const char * pName, 
+        unsigned int stackSize, unsigned int priority );
     virtual ~tcpRecvThread ();
     void start ();
     void exitWait ();
@@ -66,14 +69,9 @@ public:
 private:
     epicsThread thread;
     class tcpiiu & iiu;
-    epicsMutex & cbMutex;
-    cacContextNotify & ctxNotify;
     void run ();
     void connect (
         epicsGuard < epicsMutex > & guard );
-    bool validFillStatus ( 
-        epicsGuard < epicsMutex > & guard, 
-        const statusWireIO & stat );
 };
 
 class tcpSendThread : private epicsThreadRunable {
@@ -92,6 +90,50 @@ private:
     void run ();
 };
 
+//
+// When EPICS_CA_TCP_IO_THREADS is set the circuits of a client
+// context are serviced by a few of these instead of a send and
+// a receive thread per circuit. Each waits with epoll for its
+// share of the circuit sockets to become ready, and then does
+// the labor which the send and receive threads would do.
+//
+class tcpIoLoop : private epicsThreadRunable {
+public:
+    tcpIoLoop ( cac &, unsigned priority );
+    virtual ~tcpIoLoop ();
+    void install ( 
+        epicsGuard < epicsMutex > &, class tcpiiu & );
+    void sendWakeup ( 
+        epicsGuard < epicsMutex > &, class tcpiiu & );
+    unsigned circuitCount ( 
+        epicsGuard < epicsMutex > & ) const;
+    void show ( 
+        epicsGuard < epicsMutex > &, unsigned level ) const;
+private:
+    std::vector < class tcpiiu * > installReq; // protected by the cac mutex
+    std::vector < class tcpiiu * > closing; // only used by the I/O thread
+    epicsThread thread;
+    cac & cacRef;
+    size_t nWakeups;
+    size_t nEvents;
+    unsigned nCircuits;
+    int epfd;
+    int wakeupFd;
+    int exitRequested;
+    void run ();
+    void service (
+        class tcpiiu &, bool recvReady, bool sendReady );
+    bool connect ( class tcpiiu & );
+    bool connectComplete ( class tcpiiu & );
+    bool recvLabor ( class tcpiiu & );
+    bool sendLabor ( class tcpiiu & );
+    void watch ( class tcpiiu &, bool send );
+    void abortUnclosed ();
+    void finish ( class tcpiiu & );
+	tcpIoLoop ( const tcpIoLoop & );
+	tcpIoLoop & operator = ( const tcpIoLoop & );
+};
+
 class SearchDestTCP : public SearchDest {
 public:
     SearchDestTCP ( cac &, const osiSockAddr & );
@@ -119,7 +161,7 @@ public:
         cacContextNotify &, double connectionTimeout, epicsTimerQueue & timerQueue, 
         const osiSockAddr & addrIn, comBufMemoryManager &, unsigned minorVersion, 
         ipAddrToAsciiEngine & engineIn, const cacChannel::priLev & priorityIn,
-        SearchDestTCP * pSearchDestIn = NULL);
+        SearchDestTCP * pSearchDestIn = NULL, tcpIoLoop * pIoLoopIn = NULL );
     ~tcpiiu ();
     void start (
         epicsGuard < epicsMutex > & );
@@ -197,6 +239,7 @@ public:
     void searchRespNotify ( 
         const epicsTime &, const caHdrLargeArray & );
     void versionRespNotify ( const caHdrLargeArray & );
+    void sharedMemRespNotify ( const caHdrLargeArray & );
 
     void * operator new ( size_t size, 
         tsFreeList < class tcpiiu, 32, epicsMutexNOOP >  & );
@@ -205,8 +248,8 @@ public:
 
 private:
     hostNameCache hostNameCacheInstance;
-    tcpRecvThread recvThread;
-    tcpSendThread sendThread;
+    tcpRecvThread * pRecvThread; // NULL when serviced by an I/O thread
+    tcpSendThread * pSendThread; // NULL when serviced by an I/O thread
     tcpRecvWatchdog recvDog;
     tcpSendWatchdog sendDog;
     comQueSend sendQue;
@@ -223,10 +266,16 @@ private:
     caHdrLargeArray curMsg;
     arrayElementCount curDataMax;
     arrayElementCount curDataBytes;
+    arrayElementCount unzipDataMax;
     comBufMemoryManager & comBufMemMgr;
     cac & cacRef;
     char * pCurData;
+    char * pUnzipData; // compressed payloads are restored here
+    caSharedRing sharedRing; // payloads from a server on this host
     SearchDestTCP * pSearchDest;
+    tcpIoLoop * pIoLoop;
+    comBuf * pSendBuf; // partly sent when the socket would block
+    cacContextNotify & ctxNotify;
     epicsMutex & mutex;
     epicsMutex & cbMutex;
     unsigned minorProtocolVersion;
@@ -240,6 +289,7 @@ private:
     epicsEvent sendThreadFlushEvent;
     epicsEvent flushBlockEvent;
     SOCKET sock;
+    epicsTime sendShutdownTime;
     unsigned contigRecvMsgCount;
     unsigned blockingForFlush;
     unsigned socketLibrarySendBufferSize;
@@ -256,13 +306,34 @@ private:
     bool discardingPendingData;
     bool socketHasBeenClosed;
     bool unresponsiveCircuit;
+    bool recvBodyInPlace; // only used by the receiving thread
+    // the following are only used when serviced by an I/O thread
+    bool connectPending;
+    bool sendArmed; // protected by the mutex
+    bool sendWouldBlock;
+    bool sendShutdown;
 
     bool processIncoming ( 
         const epicsTime & currentTime, callbackManager & );
+    bool uncompressPayload ( 
+        callbackManager &, caHdrLargeArray &, char * & pBody );
+    bool locateSharedPayload ( 
+        callbackManager &, caHdrLargeArray &, char * & pBody,
+        caSharedRingRef & );
     unsigned sendBytes ( const void *pBuf, 
         unsigned nBytesInBuf, const epicsTime & currentTime );
     void recvBytes ( 
         void * pBuf, unsigned nBytesInBuf, statusWireIO & );
+    void recvBody ( statusWireIO & );
+    bool validFillStatus ( 
+        epicsGuard < epicsMutex > & guard, 
+        const statusWireIO & stat );
+    bool recvLabor ( 
+        comBuf * & pComBuf, const statusWireIO & stat );
+    bool sendLabor ( 
+        epicsGuard < epicsMutex > & );
+    void sendWakeup ( 
+        epicsGuard < epicsMutex > & );
     const char * pHostName (
         epicsGuard < epicsMutex > & ) const throw ();
     double receiveWatchdogDelay (
@@ -294,6 +365,8 @@ private:
         epicsGuard < epicsMutex > & );
     void userNameSetRequest ( 
         epicsGuard < epicsMutex > & );
+    void sharedMemRequest ( 
+        epicsGuard < epicsMutex > & );
     void createChannelRequest ( 
         nciu &, epicsGuard < epicsMutex > & );
     void writeRequest ( 
@@ -330,6 +403,7 @@ private:
 
     friend class tcpRecvThread;
     friend class tcpSendThread;
+    friend class tcpIoLoop;
 
 	tcpiiu ( const tcpiiu & );
 	tcpiiu & operator = ( const tcpiiu & );
@@ -50,7 +50,8 @@ void usage (void)
     "Channel Access options:\n"
     "  -w <sec>: Wait time, specifies CA timeout, default is %f second(s)\n"
     "  -m <msk>: Specify CA event mask to use.  <msk> is any combination of\n"
-    "            'v' (value), 'a' (alarm), 'l' (log/archive), 'p' (property).\n"
+    "            'v' (value), 'a' (alarm), 'l' (log/archive), 'p' (property),\n"
+    "            and 'c' (coalesce: only the latest of the queued updates).\n"
     "            Default event mask is 'va'\n"
     "  -p <pri>: CA priority (0-%u, default 0=lowest)\n"
     "Timestamps:\n"
@@ -278,6 +279,7 @@ int main (int argc, char *argv[])
                     case 'a': eventMask |= DBE_ALARM; break;
                     case 'l': eventMask |= DBE_LOG; break;
                     case 'p': eventMask |= DBE_PROPERTY; break;
+                    case 'c': eventMask |= DBE_LATEST; break;
                         default :
                             fprintf(stderr, "Invalid argument '%s' "
                                     "for option '-m' - ignored.\n", optarg);
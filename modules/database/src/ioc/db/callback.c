@@ -25,9 +25,10 @@
 #include "epicsAtomic.h"
 #include "epicsEvent.h"
 #include "epicsInterrupt.h"
-#include "epicsRingPointer.h"
+#include "epicsSpin.h"
 #include "epicsString.h"
 #include "epicsThread.h"
+#include "epicsTime.h"
 #include "epicsTimer.h"
 #include "errlog.h"
 #include "errMdef.h"
@@ -49,10 +50,61 @@
 
 
 static int callbackQueueSize = 2000;
+static int callbackQueueMax = 0;
+
+/* Each callback thread has its own queue.  Requests are shared out
+ * between the queues of their priority, and a thread that finds its own
+ * queue empty takes the oldest request from one of its peers instead.
+ * The queues are protected by spin locks as callbackRequest() may be
+ * called from interrupt context.
+ */
+typedef struct cbEntry {
+    epicsCallback *pcallback;
+    epicsUInt64 queued;         /* monotonic time, 0 if not known */
+} cbEntry;
+
+typedef struct cbWorker {
+    struct cbQueueSet *set;
+    epicsSpinId lock;
+    cbEntry *ring;
+    int size;
+    int head;                   /* oldest entry */
+    int count;
+    int maxUsed;
+    unsigned long nRun;
+    unsigned long nStolen;      /* taken from a peer's queue */
+    unsigned long nLatency;     /* run with a queued time */
+    epicsUInt64 latencySum;
+    epicsUInt64 latencyMax;
+} cbWorker;
+
+/* Requests which don't fit in the thread queues go to an overflow queue
+ * which is grown on demand, up to callbackQueueMax entries in total.
+ * It can only grow outside interrupt context, and is freed again when
+ * it has been emptied.  While it holds requests new ones are added to
+ * it as well, so they are still run in order.  Requests made from
+ * interrupt context are the exception: they still go to a thread queue
+ * if there is room, as the overflow queue can't grow for them.
+ */
+typedef struct cbSpill {
+    epicsSpinId lock;
+    cbEntry *ring;
+    int size;
+    int head;
+    int count;
+    int maxUsed;
+    int nGrow;
+    unsigned long nSpilled;
+} cbSpill;
 
 typedef struct cbQueueSet {
     epicsEventId semWakeUp;
-    epicsRingPointerId queue;
+    cbWorker *workers;
+    cbSpill spill;
+    int nWorkers;
+    int nextWorker;
+    int queued;                 /* in all worker queues */
+    int maxUsed;
     int queueOverflow;
     int queueOverflows;
     int shutdown;
@@ -91,7 +143,6 @@ static unsigned int threadPriority[NUM_CALLBACK_PRIORITIES] = {
     epicsThreadPriorityScanLow + 4,
     epicsThreadPriorityScanHigh + 1
 };
-static int priorityValue[NUM_CALLBACK_PRIORITIES] = {0, 1, 2};
 
 
 int callbackSetQueueSize(int size)
@@ -104,6 +155,16 @@ int callbackSetQueueSize(int size)
     return 0;
 }
 
+int callbackSetQueueMax(int size)
+{
+    if (callbackIsInit) {
+        fprintf(stderr, "Callback system already initialized\n");
+        return -1;
+    }
+    callbackQueueMax = size;
+    return 0;
+}
+
 int callbackQueueStatus(const int reset, callbackQueueStats *result)
 {
     int ret;
@@ -112,9 +173,10 @@ int callbackQueueStatus(const int reset, callbackQueueStats *result)
         int prio;
         result->size = callbackQueueSize;
         for(prio = 0; prio < NUM_CALLBACK_PRIORITIES; prio++) {
-            epicsRingPointerId qId = callbackQueue[prio].queue;
-            result->numUsed[prio] = epicsRingPointerGetUsed(qId);
-            result->maxUsed[prio] = epicsRingPointerGetHighWaterMark(qId);
+            int used = epicsAtomicGetIntT(&callbackQueue[prio].queued);
+
+            result->numUsed[prio] = used > 0 ? used : 0;
+            result->maxUsed[prio] = callbackQueue[prio].maxUsed;
             result->numOverflow[prio] = epicsAtomicGetIntT(&callbackQueue[prio].queueOverflows);
         }
         ret = 0;
@@ -124,7 +186,24 @@ int callbackQueueStatus(const int reset, callbackQueueStats *result)
     if (reset) {
         int prio;
         for(prio = 0; prio < NUM_CALLBACK_PRIORITIES; prio++) {
-            epicsRingPointerResetHighWaterMark(callbackQueue[prio].queue);
+            cbQueueSet *mySet = &callbackQueue[prio];
+            int i;
+
+            mySet->maxUsed = epicsAtomicGetIntT(&mySet->queued);
+            epicsSpinLock(mySet->spill.lock);
+            mySet->spill.maxUsed = mySet->spill.count;
+            epicsSpinUnlock(mySet->spill.lock);
+            mySet->spill.nSpilled = 0;
+            mySet->spill.nGrow = 0;
+            for (i = 0; i < mySet->nWorkers; i++) {
+                cbWorker *pw = &mySet->workers[i];
+
+                epicsSpinLock(pw->lock);
+                pw->maxUsed = pw->count;
+                epicsSpinUnlock(pw->lock);
+                pw->nRun = pw->nStolen = pw->nLatency = 0;
+                pw->latencySum = pw->latencyMax = 0;
+            }
         }
     }
     return ret;
@@ -146,6 +225,39 @@ void callbackQueueShow(const int reset)
                    stats.numUsed[prio], stats.size, qusage,
                    stats.numOverflow[prio]);
         }
+        printf("\nTHREAD      HIGH-WATER MARK  ITEMS IN Q  Q SIZE"
+               "        RUN     STOLEN  LATENCY us (MAX)\n");
+        for (prio = 0; prio < NUM_CALLBACK_PRIORITIES; prio++) {
+            cbQueueSet *mySet = &callbackQueue[prio];
+            int i;
+
+            for (i = 0; i < mySet->nWorkers; i++) {
+                cbWorker *pw = &mySet->workers[i];
+                char name[32];
+
+                if (mySet->nWorkers > 1)
+                    sprintf(name, "%s-%d", threadNamePrefix[prio], i);
+                else
+                    strcpy(name, threadNamePrefix[prio]);
+                printf("%-10s  %15d  %10d  %6d  %9lu  %9lu  %7.1f (%.1f)\n",
+                       name, pw->maxUsed, pw->count, pw->size,
+                       pw->nRun, pw->nStolen,
+                       pw->nLatency ? pw->latencySum * 1e-3 / pw->nLatency : 0.0,
+                       pw->latencyMax * 1e-3);
+            }
+        }
+        if (callbackQueueMax > stats.size) {
+            printf("\nOVERFLOW    HIGH-WATER MARK  ITEMS IN Q  Q SIZE"
+                "    MAX SIZE      ITEMS  GROWN\n");
+            for (prio = 0; prio < NUM_CALLBACK_PRIORITIES; prio++) {
+                cbSpill *pspill = &callbackQueue[prio].spill;
+
+                printf("%-10s  %15d  %10d  %6d  %10d  %9lu  %5d\n",
+                       threadNamePrefix[prio], pspill->maxUsed, pspill->count,
+                       pspill->size, callbackQueueMax - stats.size,
+                       pspill->nSpilled, pspill->nGrow);
+            }
+        }
     }
 }
 
@@ -199,26 +311,166 @@ found:
     return 0;
 }
 
+static int cbPush(cbWorker *pw, epicsCallback *pcallback, epicsUInt64 now)
+{
+    int pushOK = 0;
+
+    epicsSpinLock(pw->lock);
+    if (pw->count < pw->size) {
+        cbEntry *pentry = &pw->ring[(pw->head + pw->count) % pw->size];
+
+        pentry->pcallback = pcallback;
+        pentry->queued = now;
+        if (++pw->count > pw->maxUsed)
+            pw->maxUsed = pw->count;
+        pushOK = 1;
+    }
+    epicsSpinUnlock(pw->lock);
+    return pushOK;
+}
+
+static int cbPop(cbWorker *pw, cbEntry *pentry)
+{
+    int popOK = 0;
+
+    epicsSpinLock(pw->lock);
+    if (pw->count > 0) {
+        *pentry = pw->ring[pw->head];
+        pw->head = (pw->head + 1) % pw->size;
+        pw->count--;
+        popOK = 1;
+    }
+    epicsSpinUnlock(pw->lock);
+    return popOK;
+}
+
+/* Must not be called from interrupt context if canGrow is set */
+static int cbSpillPush(cbQueueSet *mySet, epicsCallback *pcallback,
+    epicsUInt64 now, int canGrow)
+{
+    cbSpill *pspill = &mySet->spill;
+    const int maxSize = callbackQueueMax - mySet->nWorkers * mySet->workers[0].size;
+    int pushOK = 0;
+
+    for (;;) {
+        cbEntry *newRing;
+        int oldSize, newSize;
+
+        epicsSpinLock(pspill->lock);
+        if (pspill->count < pspill->size) {
+            cbEntry *pentry =
+                &pspill->ring[(pspill->head + pspill->count) % pspill->size];
+
+            pentry->pcallback = pcallback;
+            pentry->queued = now;
+            if (++pspill->count > pspill->maxUsed)
+                pspill->maxUsed = pspill->count;
+            pspill->nSpilled++;
+            pushOK = 1;
+        }
+        oldSize = pspill->size;
+        epicsSpinUnlock(pspill->lock);
+
+        if (pushOK || !canGrow || oldSize >= maxSize)
+            return pushOK;
+
+        /* Grow, allocating outside the spin lock */
+        newSize = oldSize ? 2 * oldSize : mySet->workers[0].size;
+        if (newSize > maxSize)
+            newSize = maxSize;
+        newRing = malloc(newSize * sizeof(cbEntry));
+        if (!newRing)
+            return 0;
+
+        epicsSpinLock(pspill->lock);
+        if (pspill->size == oldSize) {
+            int i;
+
+            for (i = 0; i < pspill->count; i++)
+                newRing[i] = pspill->ring[(pspill->head + i) % pspill->size];
+            pspill->head = 0;
+            pspill->size = newSize;
+            pspill->nGrow++;
+            /* swap, so the old ring is freed below */
+            {
+                cbEntry *oldRing = pspill->ring;
+                pspill->ring = newRing;
+                newRing = oldRing;
+            }
+        }
+        epicsSpinUnlock(pspill->lock);
+        free(newRing);
+    }
+}
+
+static int cbSpillPop(cbSpill *pspill, cbEntry *pentry)
+{
+    cbEntry *emptied = NULL;
+    int popOK = 0;
+
+    epicsSpinLock(pspill->lock);
+    if (pspill->count > 0) {
+        *pentry = pspill->ring[pspill->head];
+        pspill->head = (pspill->head + 1) % pspill->size;
+        if (--pspill->count == 0) {
+            emptied = pspill->ring;
+            pspill->ring = NULL;
+            pspill->size = pspill->head = 0;
+        }
+        popOK = 1;
+    }
+    epicsSpinUnlock(pspill->lock);
+    free(emptied);
+    return popOK;
+}
+
 static void callbackTask(void *arg)
 {
-    int prio = *(int*)arg;
-    cbQueueSet *mySet = &callbackQueue[prio];
+    cbWorker *pw = (cbWorker *)arg;
+    cbQueueSet *mySet = pw->set;
+    const int self = pw - mySet->workers;
 
     taskwdInsert(0, NULL, NULL);
     epicsEventSignal(startStopEvent);
 
     while(!mySet->shutdown) {
-        void *ptr;
-        if (epicsRingPointerIsEmpty(mySet->queue))
-            epicsEventMustWait(mySet->semWakeUp);
-
-        while ((ptr = epicsRingPointerPop(mySet->queue))) {
-            CALLBACK *pcallback = (CALLBACK *)ptr;
-            if(!epicsRingPointerIsEmpty(mySet->queue))
-                epicsEventMustTrigger(mySet->semWakeUp);
-            mySet->queueOverflow = FALSE;
-            (*pcallback->callback)(pcallback);
+        cbEntry entry;
+        int stolen = 0;
+
+        if (!cbPop(pw, &entry)) {
+            int i;
+
+            for (i = 1; i < mySet->nWorkers; i++) {
+                cbWorker *peer = &mySet->workers[(self + i) % mySet->nWorkers];
+
+                if (peer->count > 0 && cbPop(peer, &entry))
+                    break;
+            }
+            if (i < mySet->nWorkers)
+                stolen = 1;
+            else if (mySet->spill.count == 0 ||
+                     !cbSpillPop(&mySet->spill, &entry)) {
+                epicsEventMustWait(mySet->semWakeUp);
+                continue;
+            }
+        }
+
+        if (epicsAtomicDecrIntT(&mySet->queued) > 0)
+            epicsEventMustTrigger(mySet->semWakeUp);
+        mySet->queueOverflow = FALSE;
+
+        pw->nRun++;
+        if (stolen)
+            pw->nStolen++;
+        if (entry.queued) {
+            epicsUInt64 latency = epicsMonotonicGet() - entry.queued;
+
+            pw->nLatency++;
+            pw->latencySum += latency;
+            if (latency > pw->latencyMax)
+                pw->latencyMax = latency;
         }
+        (*entry.pcallback->callback)(entry.pcallback);
     }
 
     if(!epicsAtomicDecrIntT(&mySet->threadsRunning))
@@ -250,14 +502,20 @@ void callbackStop(void)
 
 void callbackCleanup(void)
 {
-    int i;
+    int i, j;
 
     for (i = 0; i < NUM_CALLBACK_PRIORITIES; i++) {
         cbQueueSet *mySet = &callbackQueue[i];
 
         assert(epicsAtomicGetIntT(&mySet->threadsRunning)==0);
         epicsEventDestroy(mySet->semWakeUp);
-        epicsRingPointerDelete(mySet->queue);
+        for (j = 0; j < mySet->nWorkers; j++) {
+            epicsSpinDestroy(mySet->workers[j].lock);
+            free(mySet->workers[j].ring);
+        }
+        free(mySet->workers);
+        epicsSpinDestroy(mySet->spill.lock);
+        free(mySet->spill.ring);
     }
 
     epicsTimerQueueRelease(timerQueue);
@@ -283,25 +541,38 @@ void callbackInit(void)
     timerQueue = epicsTimerQueueAllocate(0, epicsThreadPriorityScanHigh);
 
     for (i = 0; i < NUM_CALLBACK_PRIORITIES; i++) {
+        cbQueueSet *mySet = &callbackQueue[i];
         epicsThreadId tid;
+        int size;
+
+        mySet->semWakeUp = epicsEventMustCreate(epicsEventEmpty);
+        mySet->queueOverflow = FALSE;
+        if (mySet->threadsConfigured == 0)
+            mySet->threadsConfigured = callbackThreadsDefault;
+
+        /* The queue size is shared between the threads */
+        mySet->nWorkers = mySet->threadsConfigured;
+        size = (callbackQueueSize + mySet->nWorkers - 1) / mySet->nWorkers;
+        mySet->workers = callocMustSucceed(mySet->nWorkers, sizeof(cbWorker),
+            "callbackInit");
+        for (j = 0; j < mySet->nWorkers; j++) {
+            cbWorker *pw = &mySet->workers[j];
+
+            pw->set = mySet;
+            pw->size = size;
+            pw->ring = callocMustSucceed(size, sizeof(cbEntry), "callbackInit");
+            pw->lock = epicsSpinMustCreate();
+        }
+        mySet->spill.lock = epicsSpinMustCreate();
 
-        callbackQueue[i].semWakeUp = epicsEventMustCreate(epicsEventEmpty);
-        callbackQueue[i].queue = epicsRingPointerLockedCreate(callbackQueueSize);
-        if (callbackQueue[i].queue == 0)
-            cantProceed("epicsRingPointerLockedCreate failed for %s\n",
-                threadNamePrefix[i]);
-        callbackQueue[i].queueOverflow = FALSE;
-        if (callbackQueue[i].threadsConfigured == 0)
-            callbackQueue[i].threadsConfigured = callbackThreadsDefault;
-
-        for (j = 0; j < callbackQueue[i].threadsConfigured; j++) {
-            if (callbackQueue[i].threadsConfigured > 1 )
+        for (j = 0; j < mySet->nWorkers; j++) {
+            if (mySet->nWorkers > 1 )
                 sprintf(threadName, "%s-%d", threadNamePrefix[i], j);
             else
                 strcpy(threadName, threadNamePrefix[i]);
             tid = epicsThreadCreate(threadName, threadPriority[i],
                 epicsThreadGetStackSize(epicsThreadStackBig),
-                (EPICSTHREADFUNC)callbackTask, &priorityValue[i]);
+                (EPICSTHREADFUNC)callbackTask, &mySet->workers[j]);
             if (tid == 0) {
                 cantProceed("Failed to spawn callback thread %s\n", threadName);
             } else {
@@ -316,7 +587,9 @@ void callbackInit(void)
 int callbackRequest(CALLBACK *pcallback)
 {
     int priority;
-    int pushOK;
+    int i, first, queued;
+    int pushOK = 0;
+    epicsUInt64 now;
     cbQueueSet *mySet;
 
     if (!pcallback) {
@@ -331,7 +604,18 @@ int callbackRequest(CALLBACK *pcallback)
     mySet = &callbackQueue[priority];
     if (mySet->queueOverflow) return S_db_bufFull;
 
-    pushOK = epicsRingPointerPush(mySet->queue, pcallback);
+    now = epicsInterruptIsInterruptContext() ? 0 : epicsMonotonicGet();
+
+    /* Take turns between the threads, skipping those with full queues */
+    if (mySet->spill.count == 0 || epicsInterruptIsInterruptContext()) {
+        first = (unsigned) epicsAtomicIncrIntT(&mySet->nextWorker) % mySet->nWorkers;
+        for (i = 0; i < mySet->nWorkers && !pushOK; i++)
+            pushOK = cbPush(&mySet->workers[(first + i) % mySet->nWorkers],
+                pcallback, now);
+    }
+    if (!pushOK && callbackQueueMax > callbackQueueSize)
+        pushOK = cbSpillPush(mySet, pcallback, now,
+            !epicsInterruptIsInterruptContext());
 
     if (!pushOK) {
         epicsInterruptContextMessage(fullMessage[priority]);
@@ -339,6 +623,9 @@ int callbackRequest(CALLBACK *pcallback)
         epicsAtomicIncrIntT(&mySet->queueOverflows);
         return S_db_bufFull;
     }
+    queued = epicsAtomicIncrIntT(&mySet->queued);
+    if (queued > mySet->maxUsed)
+        mySet->maxUsed = queued;
     epicsEventSignal(mySet->semWakeUp);
     return 0;
 }
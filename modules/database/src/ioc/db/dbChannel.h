@@ -40,10 +40,13 @@ typedef struct evSubscrip {
     struct event_que        *ev_que;
     db_field_log            **pLastLog;
     unsigned long           npend;  /* n times this event is on the queue */
+    unsigned long           npendmax;  /* high water mark of npend */
     unsigned long           nreplace;  /* n times replacing event on the queue */
+    unsigned                nentries;  /* n queue entries reserved for this event */
     unsigned char           select;
     char                    useValque;
-    char                    callBackInProgress;
+    unsigned char           callBackInProgress;  /* n updates being delivered */
+    char                    canceledInCallBack;
     char                    enabled;
 } evSubscrip;
 
@@ -27,6 +27,7 @@
 #include "cantProceed.h"
 #include "dbDefs.h"
 #include "epicsAssert.h"
+#include "epicsAtomic.h"
 #include "epicsEvent.h"
 #include "epicsMutex.h"
 #include "epicsThread.h"
@@ -46,30 +47,84 @@
 #include "db_field_log.h"
 #include "dbFldTypes.h"
 #include "dbLock.h"
+#include "epicsExport.h"
 #include "link.h"
 #include "special.h"
 
 #define EVENTSPERQUE    32
-#define EVENTENTRIES    4      /* the number of que entries for each event */
+#define EVENTENTRIES    4      /* default number of que entries for each event */
 #define EVENTQUESIZE    (EVENTENTRIES  * EVENTSPERQUE)
+#define EVENTQUEMAX     65536u /* upper bound on the size of one ring buffer */
 #define EVENTQEMPTY     ((struct evSubscrip *)NULL)
+#define EVENTBATCHMAX   64     /* max updates taken off a que at once */
+#define EVENTQUIETREADS 16     /* drains at half use before a que shrinks */
+#define EVENTINTAKESIZE 128u   /* entries in a que's intake ring, a power of two */
+
+/*
+ * Default per-subscription queue depth and the size limit up to which
+ * an event queue may grow under load (0 means never grow). Copied into
+ * each event_user by db_init_events(), see db_event_queue_size().
+ */
+int dbEventQueueDepth = EVENTENTRIES;
+epicsExportAddress(int, dbEventQueueDepth);
+int dbEventQueueMax = 0;
+epicsExportAddress(int, dbEventQueueMax);
+
+/*
+ * Posting threads hand updates to the event task through a lock-free
+ * intake ring when this is set (the default), otherwise they take the
+ * event que lock for each update. Copied into each event_user by
+ * db_init_events().
+ */
+int dbEventQueueLockFree = 1;
+epicsExportAddress(int, dbEventQueueLockFree);
+
+epicsShareDef void (*db_event_intake_hook)(void);
+
+/*
+ * An entry of the intake ring, which is free for the poster claiming
+ * position n when its seq is n, and holds that poster's update once
+ * its seq is n + 1 (a bounded MPSC ring after D. Vyukov).
+ */
+typedef struct evIntakeEntry {
+    size_t                  seq;
+    struct evSubscrip       *pevent;
+    db_field_log            *pLog;
+} evIntakeEntry;
 
 /*
  * really a ring buffer
+ *
+ * Posting threads push updates onto the intake ring without locking.
+ * Whoever holds the writelock (normally the event task) moves them on
+ * to the ring proper, where they are squashed, grown into or canceled
+ * exactly as before. A poster only takes the writelock itself when the
+ * intake ring is full, or when dbEventQueueLockFree is off.
  */
 struct event_que {
     /* lock writers to the ring buffer only */
     /* readers must never slow up writers */
     epicsMutexId            writelock;
-    db_field_log            *valque[EVENTQUESIZE];
-    struct evSubscrip       *evque[EVENTQUESIZE];
+    db_field_log            **valque;       /* quesize entries */
+    struct evSubscrip       **evque;        /* quesize entries */
     struct event_que        *nextque;       /* in case que quota exceeded */
     struct event_user       *evUser;        /* event user parent struct */
-    unsigned short          putix;
-    unsigned short          getix;
-    unsigned short          quota;          /* the number of assigned entries*/
-    unsigned short          nDuplicates;    /* N events duplicated on this q */
-    unsigned short          nCanceled;      /* the number of canceled entries */
+    unsigned                quesize;        /* current size of the ring */
+    unsigned                basesize;       /* size when not grown by load */
+    unsigned                putix;
+    unsigned                getix;
+    unsigned                quota;          /* the number of assigned entries*/
+    unsigned                nSubscr;        /* N events assigned to this q */
+    unsigned                nDuplicates;    /* N events duplicated on this q */
+    unsigned                nCanceled;      /* the number of canceled entries */
+    unsigned                hwm;            /* max entries ever in use */
+    unsigned                recentMax;      /* max entries in use since the last drain */
+    unsigned                nQuiet;         /* drains in a row at half use or less */
+    unsigned                nGrow;          /* N times the ring was enlarged */
+    size_t                  intakePut;      /* next intake position to claim */
+    size_t                  intakeGet;      /* next intake position to move */
+    int                     wakeArmed;      /* event task waits for a post */
+    evIntakeEntry           intake[EVENTINTAKESIZE];
 };
 
 struct event_user {
@@ -83,8 +138,13 @@ struct event_user {
     EXTRALABORFUNC      *extralabor_sub;/* off load to event task */
     void                *extralabor_arg;/* parameter to above */
 
+    EVENTBATCHFUNC      *batch_sub;     /* deliver updates in batches */
+    void                *batch_arg;     /* parameter to above */
+
     epicsThreadId       taskid;         /* event handler task id */
-    struct evSubscrip   *pSuicideEvent; /* event that is deleteing itself */
+    unsigned            queDepth;       /* default que entries per event */
+    unsigned            queMax;         /* ques may grow up to this size */
+    int                 lockFree;       /* post through the intake rings */
     unsigned            queovr;         /* event que overflow count */
     unsigned char       pendexit;       /* exit pend task */
     unsigned char       extra_labor;    /* if set call extra labor func */
@@ -92,6 +152,10 @@ struct event_user {
     unsigned char       extraLaborBusy;
     void                (*init_func)();
     epicsThreadId       init_func_arg;
+
+    /* updates being delivered by the event task */
+    dbEventBatchEntry   batch[EVENTBATCHMAX];
+    struct evSubscrip   *batchEvents[EVENTBATCHMAX];
 };
 
 /*
@@ -100,8 +164,8 @@ struct event_user {
  * into only 10 or 20 total steps part of the time.
  */
 
-#define RNGINC(OLD)\
-( (unsigned short) ( (OLD) >= (EVENTQUESIZE-1) ? 0 : (OLD)+1 ) )
+#define RNGINC(EV_QUE, OLD)\
+( (OLD) >= ((EV_QUE)->quesize-1) ? 0u : (OLD)+1u )
 
 #define LOCKEVQUE(EV_QUE)   epicsMutexMustLock((EV_QUE)->writelock)
 #define UNLOCKEVQUE(EV_QUE) epicsMutexUnlock((EV_QUE)->writelock)
@@ -119,19 +183,200 @@ static struct evSubscrip canceledEvent;
 
 static epicsMutexId stopSync;
 
-static unsigned short ringSpace ( const struct event_que *pevq )
+static int intake_drain ( struct event_que *ev_que );
+static int intake_flush ( struct event_que *ev_que );
+
+static unsigned ringSpace ( const struct event_que *pevq )
 {
     if ( pevq->evque[pevq->putix] == EVENTQEMPTY ) {
         if ( pevq->getix > pevq->putix ) {
-            return ( unsigned short ) ( pevq->getix - pevq->putix );
+            return pevq->getix - pevq->putix;
         }
         else {
-            return ( unsigned short ) ( ( EVENTQUESIZE + pevq->getix ) - pevq->putix );
+            return ( pevq->quesize + pevq->getix ) - pevq->putix;
         }
     }
     return 0;
 }
 
+/*
+ * The number of entries which must stay free so that every event
+ * assigned to this que can always queue at least one update
+ */
+static unsigned ringReserve ( const struct event_que *pevq )
+{
+    return pevq->nSubscr > EVENTSPERQUE ? pevq->nSubscr : EVENTSPERQUE;
+}
+
+/*
+ * ev_que_alloc_ring()
+ * allocate empty ring buffer storage of the requested size
+ */
+static int ev_que_alloc_ring ( struct event_que *ev_que, unsigned size )
+{
+    db_field_log **valque = calloc ( size, sizeof ( *valque ) );
+    struct evSubscrip **evque = calloc ( size, sizeof ( *evque ) );
+
+    if ( ! valque || ! evque ) {
+        free ( valque );
+        free ( evque );
+        return FALSE;
+    }
+    free ( ev_que->valque );
+    free ( ev_que->evque );
+    ev_que->valque = valque;
+    ev_que->evque = evque;
+    ev_que->quesize = size;
+    ev_que->putix = 0u;
+    ev_que->getix = 0u;
+    return TRUE;
+}
+
+/*
+ * ev_que_grow()
+ * event queue lock _must_ be applied
+ *
+ * Enlarge a full ring so that bursts are queued instead of squashed.
+ * Entries are moved to the start of the new ring, and the pLastLog
+ * back pointers of their events are updated.
+ */
+static int ev_que_grow ( struct event_que *ev_que )
+{
+    unsigned newsize = ev_que->quesize * 2u;
+    unsigned nused, i, ix;
+    db_field_log **valque;
+    struct evSubscrip **evque;
+
+    if ( newsize > ev_que->evUser->queMax ) {
+        newsize = ev_que->evUser->queMax;
+    }
+    if ( newsize > EVENTQUEMAX ) {
+        newsize = EVENTQUEMAX;
+    }
+    if ( newsize <= ev_que->quesize ) {
+        return FALSE;
+    }
+    valque = calloc ( newsize, sizeof ( *valque ) );
+    evque = calloc ( newsize, sizeof ( *evque ) );
+    if ( ! valque || ! evque ) {
+        free ( valque );
+        free ( evque );
+        return FALSE;
+    }
+
+    nused = ev_que->quesize - ringSpace ( ev_que );
+    for ( i = 0u, ix = ev_que->getix; i < nused;
+            i++, ix = RNGINC ( ev_que, ix ) ) {
+        struct evSubscrip * const pevent = ev_que->evque[ix];
+
+        evque[i] = pevent;
+        valque[i] = ev_que->valque[ix];
+        if ( pevent != &canceledEvent &&
+                pevent->pLastLog == &ev_que->valque[ix] ) {
+            pevent->pLastLog = &valque[i];
+        }
+    }
+
+    free ( ev_que->valque );
+    free ( ev_que->evque );
+    ev_que->valque = valque;
+    ev_que->evque = evque;
+    ev_que->quesize = newsize;
+    ev_que->getix = 0u;
+    ev_que->putix = nused;
+    ev_que->nGrow++;
+    return TRUE;
+}
+
+/*
+ * intake_init()
+ */
+static void intake_init ( struct event_que *ev_que )
+{
+    size_t i;
+
+    for ( i = 0u; i < EVENTINTAKESIZE; i++ ) {
+        ev_que->intake[i].seq = i;
+    }
+    ev_que->intakePut = 0u;
+    ev_que->intakeGet = 0u;
+    ev_que->wakeArmed = TRUE;
+}
+
+/*
+ * intake_put()
+ * called by posting threads without any lock
+ *
+ * Returns FALSE if the intake ring is full.
+ */
+static int intake_put ( struct event_que *ev_que,
+    struct evSubscrip *pevent, db_field_log *pLog )
+{
+    size_t pos = epicsAtomicGetSizeT ( &ev_que->intakePut );
+    evIntakeEntry *pEntry;
+
+    while ( TRUE ) {
+        size_t seq;
+
+        pEntry = &ev_que->intake[pos & ( EVENTINTAKESIZE - 1u )];
+        seq = epicsAtomicGetSizeT ( &pEntry->seq );
+        epicsAtomicReadMemoryBarrier ();
+        if ( seq == pos ) {
+            size_t prev = epicsAtomicCmpAndSwapSizeT (
+                &ev_que->intakePut, pos, pos + 1u );
+            if ( prev == pos ) {
+                break;
+            }
+            pos = prev;
+        }
+        else if ( (long) ( seq - pos ) < 0 ) {
+            return FALSE;
+        }
+        else {
+            pos = epicsAtomicGetSizeT ( &ev_que->intakePut );
+        }
+    }
+    if ( db_event_intake_hook ) {
+        ( *db_event_intake_hook ) ();
+    }
+    pEntry->pevent = pevent;
+    pEntry->pLog = pLog;
+    epicsAtomicWriteMemoryBarrier ();
+    epicsAtomicSetSizeT ( &pEntry->seq, pos + 1u );
+    return TRUE;
+}
+
+/*
+ * intake_take()
+ * event queue lock _must_ be applied
+ *
+ * Returns FALSE if the intake ring is empty, or if the oldest
+ * position has been claimed by a poster which hasn't filled it yet
+ * (that poster wakes the event task when it's done).
+ */
+static int intake_take ( struct event_que *ev_que,
+    struct evSubscrip **ppevent, db_field_log **ppLog )
+{
+    const size_t pos = ev_que->intakeGet;
+    evIntakeEntry * const pEntry =
+        &ev_que->intake[pos & ( EVENTINTAKESIZE - 1u )];
+
+    if ( epicsAtomicGetSizeT ( &pEntry->seq ) != pos + 1u ) {
+        return FALSE;
+    }
+    epicsAtomicReadMemoryBarrier ();
+    *ppevent = pEntry->pevent;
+    *ppLog = pEntry->pLog;
+    /*
+     * a full barrier, so that the reads above are done before
+     * a poster may see the entry free and refill it
+     */
+    epicsAtomicCmpAndSwapSizeT ( &pEntry->seq, pos + 1u,
+        pos + EVENTINTAKESIZE );
+    ev_que->intakeGet = pos + 1u;
+    return TRUE;
+}
+
 /*
  *  db_event_list ()
  */
@@ -188,17 +433,20 @@ int dbel ( const char *pname, unsigned level )
             }
 
             if ( level > 1 ) {
-                unsigned nEntriesFree;
+                unsigned nEntriesFree, queSize, hwm, nGrow;
                 const void * taskId;
                 LOCKEVQUE(pevent->ev_que);
                 nEntriesFree = ringSpace ( pevent->ev_que );
+                queSize = pevent->ev_que->quesize;
+                hwm = pevent->ev_que->hwm;
+                nGrow = pevent->ev_que->nGrow;
                 taskId = ( void * ) pevent->ev_que->evUser->taskid;
                 UNLOCKEVQUE(pevent->ev_que);
                 if ( nEntriesFree == 0u ) {
                     printf ( ", thread=%p, queue full",
                         (void *) taskId );
                 }
-                else if ( nEntriesFree == EVENTQUESIZE ) {
+                else if ( nEntriesFree == queSize ) {
                     printf ( ", thread=%p, queue empty",
                         (void *) taskId );
                 }
@@ -206,6 +454,13 @@ int dbel ( const char *pname, unsigned level )
                     printf ( ", thread=%p, unused entries=%u",
                         (void *) taskId, nEntriesFree );
                 }
+                printf ( ", depth=%u, max undelivered=%lu",
+                    pevent->nentries, pevent->npendmax );
+                printf ( ", queue size=%u, high water mark=%u",
+                    queSize, hwm );
+                if ( nGrow ) {
+                    printf ( ", grown %u times", nGrow );
+                }
             }
 
             if ( level > 2 ) {
@@ -290,7 +545,16 @@ dbEventCtx db_init_events (void)
     /* Flag will be cleared when event task starts */
     evUser->pendexit = TRUE;
 
+    evUser->queDepth = dbEventQueueDepth > EVENTENTRIES ?
+        (unsigned) dbEventQueueDepth : EVENTENTRIES;
+    evUser->queMax = dbEventQueueMax > 0 ? (unsigned) dbEventQueueMax : 0u;
+    evUser->lockFree = dbEventQueueLockFree != 0;
+
     evUser->firstque.evUser = evUser;
+    intake_init(&evUser->firstque);
+    evUser->firstque.basesize = EVENTQUESIZE;
+    if (!ev_que_alloc_ring(&evUser->firstque, EVENTQUESIZE))
+        goto fail;
     evUser->firstque.writelock = epicsMutexCreate();
     if (!evUser->firstque.writelock)
         goto fail;
@@ -310,7 +574,6 @@ dbEventCtx db_init_events (void)
 
     evUser->flowCtrlMode = FALSE;
     evUser->extraLaborBusy = FALSE;
-    evUser->pSuicideEvent = NULL;
     return (dbEventCtx) evUser;
 fail:
     if(evUser->lock)
@@ -323,6 +586,8 @@ fail:
         epicsEventDestroy (evUser->pflush_sem);
     if(evUser->pexitsem)
         epicsEventDestroy (evUser->pexitsem);
+    free(evUser->firstque.valque);
+    free(evUser->firstque.evque);
     freeListFree(dbevEventUserFreeList,evUser);
     return NULL;
 }
@@ -391,22 +656,59 @@ void db_close_events (dbEventCtx ctx)
     freeListFree(dbevEventUserFreeList, evUser);
 }
 
+/*
+ * db_event_queue_size()
+ *
+ * Set the default number of queue entries reserved for each event
+ * subsequently added to this context, and the size up to which its
+ * event queues may grow when a burst would otherwise squash updates.
+ * Zero leaves the respective setting unchanged.
+ */
+void db_event_queue_size ( dbEventCtx ctx, unsigned depth,
+                                    unsigned maxQueueSize )
+{
+    struct event_user * const evUser = (struct event_user *) ctx;
+
+    epicsMutexMustLock ( evUser->lock );
+    if ( depth ) {
+        evUser->queDepth = depth > EVENTENTRIES ? depth : EVENTENTRIES;
+    }
+    if ( maxQueueSize ) {
+        evUser->queMax = maxQueueSize;
+    }
+    epicsMutexUnlock ( evUser->lock );
+}
+
 /*
  * create_ev_que()
  */
-static struct event_que * create_ev_que ( struct event_user * const evUser )
+static struct event_que * create_ev_que ( struct event_user * const evUser,
+                                            unsigned depth )
 {
+    unsigned size = EVENTQUESIZE;
     struct event_que * const ev_que = (struct event_que *) 
         freeListCalloc ( dbevEventQueueFreeList );
     if ( ! ev_que ) {
         return NULL;
     }
+    /* a deep event must fit with room to spare for the reserve */
+    while ( size < depth + 2u * EVENTSPERQUE ) {
+        size *= 2u;
+    }
+    ev_que->basesize = size;
+    if ( ! ev_que_alloc_ring ( ev_que, size ) ) {
+        freeListFree ( dbevEventQueueFreeList, ev_que );
+        return NULL;
+    }
     ev_que->writelock = epicsMutexCreate();
     if ( ! ev_que->writelock ) {
+        free ( ev_que->valque );
+        free ( ev_que->evque );
         freeListFree ( dbevEventQueueFreeList, ev_que );
         return NULL;
     }
     ev_que->evUser = evUser;
+    intake_init ( ev_que );
     return ev_que;
 }
 
@@ -416,6 +718,19 @@ static struct event_que * create_ev_que ( struct event_user * const evUser )
 dbEventSubscription db_add_event (
     dbEventCtx ctx, struct dbChannel *chan,
     EVENTFUNC *user_sub, void *user_arg, unsigned select)
+{
+    return db_add_event_depth ( ctx, chan, user_sub, user_arg, select, 0u );
+}
+
+/*
+ * DB_ADD_EVENT_DEPTH()
+ *
+ * As db_add_event(), reserving depth event queue entries for this
+ * subscription (0 selects the context default).
+ */
+dbEventSubscription db_add_event_depth (
+    dbEventCtx ctx, struct dbChannel *chan,
+    EVENTFUNC *user_sub, void *user_arg, unsigned select, unsigned depth)
 {
     struct event_user * const evUser = (struct event_user *) ctx;
     struct event_que * ev_que;
@@ -436,21 +751,31 @@ dbEventSubscription db_add_event (
     /* find an event que block with enough quota */
     /* otherwise add a new one to the list */
     epicsMutexMustLock ( evUser->lock );
+    if ( ! depth ) {
+        depth = evUser->queDepth;
+    }
+    else if ( depth < EVENTENTRIES ) {
+        depth = EVENTENTRIES;
+    }
+    if ( depth > EVENTQUEMAX / 2u ) {
+        depth = EVENTQUEMAX / 2u;
+    }
     ev_que = & evUser->firstque;
     while ( TRUE ) {
         int success = 0;
         LOCKEVQUE ( ev_que );
-        success = ( ev_que->quota + ev_que->nCanceled < 
-                                EVENTQUESIZE - EVENTENTRIES );
+        success = ( ev_que->quota + ev_que->nCanceled + depth <
+                                ev_que->basesize );
         if ( success ) {
-            ev_que->quota += EVENTENTRIES;
+            ev_que->quota += depth;
+            ev_que->nSubscr++;
         }
         UNLOCKEVQUE ( ev_que );
         if ( success ) {
             break;
         }
         if ( ! ev_que->nextque ) {
-            ev_que->nextque = create_ev_que ( evUser );
+            ev_que->nextque = create_ev_que ( evUser, depth );
             if ( ! ev_que->nextque ) {
                 ev_que = NULL;
                 break;
@@ -466,13 +791,16 @@ dbEventSubscription db_add_event (
     }
 
     pevent->npend =     0ul;
+    pevent->npendmax =  0ul;
     pevent->nreplace =  0ul;
+    pevent->nentries =  depth;
     pevent->user_sub =  user_sub;
     pevent->user_arg =  user_arg;
     pevent->chan =      chan;
     pevent->select =    (unsigned char) select;
     pevent->pLastLog =  NULL; /* not yet in the queue */
-    pevent->callBackInProgress = FALSE;
+    pevent->callBackInProgress = 0u;
+    pevent->canceledInCallBack = FALSE;
     pevent->enabled =   FALSE;
     pevent->ev_que =    ev_que;
 
@@ -531,7 +859,7 @@ void db_event_disable (dbEventSubscription event)
  * this nulls the entry in the queue, but doesn't delete the db_field_log chunk
  */
 static void event_remove ( struct event_que *ev_que,
-    unsigned short index, struct evSubscrip *placeHolder )
+    unsigned index, struct evSubscrip *placeHolder )
 {
     struct evSubscrip * const pevent = ev_que->evque[index];
 
@@ -548,17 +876,35 @@ static void event_remove ( struct event_que *ev_que,
     pevent->npend--;
 }
 
+/*
+ * db_event_replaced()
+ *
+ * number of updates to the subscription which replaced an earlier one
+ * still waiting on the event queue
+ */
+unsigned long db_event_replaced (dbEventSubscription event)
+{
+    struct evSubscrip * const pevent = (struct evSubscrip *) event;
+
+    return pevent->nreplace;
+}
+
 /*
  * DB_CANCEL_EVENT()
  *
  * This routine does not prevent two threads from deleting
  * the same block at the same time.
  *
+ * Called from a thread other than the event task while a batch holding
+ * updates of this event is being delivered, it waits for the whole
+ * batch, up to EVENTBATCHMAX updates, to be delivered.
  */
 void db_cancel_event (dbEventSubscription event)
 {
     struct evSubscrip * const pevent = (struct evSubscrip *) event;
-    unsigned short getix;
+    unsigned getix;
+    int freeIt = TRUE;
+    int firstEventFlag;
 
     db_event_disable ( event );
 
@@ -572,6 +918,13 @@ void db_cancel_event (dbEventSubscription event)
 
     pevent->user_sub = NULL;
 
+    /*
+     * updates posted before the event was disabled may still be
+     * on the intake ring, some behind entries which other posters
+     * haven't filled yet, and must all be purged below
+     */
+    firstEventFlag = intake_flush ( pevent->ev_que );
+
     /*
      * purge this event from the queue
      *
@@ -585,11 +938,11 @@ void db_cancel_event (dbEventSubscription event)
     for (   getix = pevent->ev_que->getix;
             pevent->ev_que->evque[getix] != EVENTQEMPTY; ) {
         if ( pevent->ev_que->evque[getix] == pevent ) {
-            assert ( pevent->ev_que->nCanceled < USHRT_MAX );
+            assert ( pevent->ev_que->nCanceled < UINT_MAX );
             pevent->ev_que->nCanceled++;
             event_remove ( pevent->ev_que, getix, &canceledEvent );
         }
-        getix = RNGINC ( getix );
+        getix = RNGINC ( pevent->ev_que, getix );
         if ( getix == pevent->ev_que->getix ) {
             break;
         }
@@ -597,7 +950,14 @@ void db_cancel_event (dbEventSubscription event)
     assert ( pevent->npend == 0u );
 
     if ( pevent->ev_que->evUser->taskid == epicsThreadGetIdSelf() ) {
-        pevent->ev_que->evUser->pSuicideEvent = pevent;
+        /*
+         * canceled by a callback, the event task frees this event
+         * once the batch containing its updates is finished
+         */
+        if ( pevent->callBackInProgress ) {
+            pevent->canceledInCallBack = TRUE;
+            freeIt = FALSE;
+        }
     }
     else {
         while ( pevent->callBackInProgress ) {
@@ -607,11 +967,18 @@ void db_cancel_event (dbEventSubscription event)
         }
     }
 
-    pevent->ev_que->quota -= EVENTENTRIES;
+    pevent->ev_que->quota -= pevent->nentries;
+    pevent->ev_que->nSubscr--;
 
     UNLOCKEVQUE (pevent->ev_que);
 
-    freeListFree ( dbevEventSubscriptionFreeList, pevent );
+    if ( firstEventFlag ) {
+        epicsEventSignal ( pevent->ev_que->evUser->ppendsem );
+    }
+
+    if ( freeIt ) {
+        freeListFree ( dbevEventSubscriptionFreeList, pevent );
+    }
 
     return;
 }
@@ -654,6 +1021,30 @@ int db_add_extra_labor_event (
     return DB_EVENT_OK;
 }
 
+/*
+ * DB_ADD_EVENT_BATCH_HANDLER()
+ *
+ * Specify a routine which the event task calls with
+ * all updates taken from an event que at once, instead
+ * of calling each subscription's routine for each update
+ */
+int db_add_event_batch_handler (
+    dbEventCtx ctx, EVENTBATCHFUNC *func, void *arg)
+{
+    struct event_user * const evUser = (struct event_user *) ctx;
+
+    epicsMutexMustLock ( evUser->lock );
+    if ( evUser->taskid ) {
+        epicsMutexUnlock ( evUser->lock );
+        return DB_EVENT_ERROR;
+    }
+    evUser->batch_sub = func;
+    evUser->batch_arg = arg;
+    epicsMutexUnlock ( evUser->lock );
+
+    return DB_EVENT_OK;
+}
+
 /*
  *  DB_POST_EXTRA_LABOR()
  */
@@ -731,23 +1122,20 @@ db_field_log* db_create_read_log (struct dbChannel *chan)
 }
 
 /*
- *  DB_QUEUE_EVENT_LOG()
+ * ev_que_insert()
+ * event queue lock _must_ be applied
  *
+ * Put an update on the ring, or squash it into the last update of its
+ * event which is still waiting there. Returns TRUE if the ring was
+ * empty, and sets *ppDiscard to a field log which the caller must
+ * delete once the lock has been released.
  */
-static void db_queue_event_log (evSubscrip *pevent, db_field_log *pLog)
+static int ev_que_insert ( struct event_que *ev_que, evSubscrip *pevent,
+    db_field_log *pLog, db_field_log **ppDiscard )
 {
-    struct event_que    *ev_que;
     int firstEventFlag;
     unsigned rngSpace;
 
-    ev_que = pevent->ev_que;
-    /*
-     * evUser ring buffer must be locked for the multiple
-     * threads writing/reading it
-     */
-
-    LOCKEVQUE (ev_que);
-
     /*
      * if we have an event on the queue and both the last
      * event on the queue and the current event are emtpy
@@ -757,10 +1145,10 @@ static void db_queue_event_log (evSubscrip *pevent, db_field_log *pLog)
     if (pevent->npend > 0u &&
         (*pevent->pLastLog)->type == dbfl_type_rec &&
         pLog->type == dbfl_type_rec) {
-        db_delete_field_log(pLog);
-        UNLOCKEVQUE (ev_que);
-        return;
+        *ppDiscard = pLog;
+        return FALSE;
     }
+    *ppDiscard = NULL;
 
     /*
      * add to task local event que
@@ -772,13 +1160,22 @@ static void db_queue_event_log (evSubscrip *pevent, db_field_log *pLog)
      * then replace the last event on the queue (for this monitor)
      */
     rngSpace = ringSpace ( ev_que );
+
+    /*
+     * rather than replace, enlarge the queue if this is permitted
+     */
+    if ( pevent->npend>0u && ! ev_que->evUser->flowCtrlMode &&
+            rngSpace<=ringReserve(ev_que) && ev_que_grow(ev_que) ) {
+        rngSpace = ringSpace ( ev_que );
+    }
+
     if ( pevent->npend>0u &&
-        (ev_que->evUser->flowCtrlMode || rngSpace<=EVENTSPERQUE) ) {
+        (ev_que->evUser->flowCtrlMode || rngSpace<=ringReserve(ev_que)) ) {
         /*
          * replace last event if no space is left
          */
         if (*pevent->pLastLog) {
-            db_delete_field_log(*pevent->pLastLog);
+            *ppDiscard = *pevent->pLastLog;
             *pevent->pLastLog = pLog;
         }
         pevent->nreplace++;
@@ -801,21 +1198,141 @@ static void db_queue_event_log (evSubscrip *pevent, db_field_log *pLog)
             ev_que->nDuplicates++;
         }
         pevent->npend++;
+        if (pevent->npend > pevent->npendmax) {
+            pevent->npendmax = pevent->npend;
+        }
+        if (ev_que->quesize - rngSpace + 1u > ev_que->recentMax) {
+            ev_que->recentMax = ev_que->quesize - rngSpace + 1u;
+            if (ev_que->recentMax > ev_que->hwm) {
+                ev_que->hwm = ev_que->recentMax;
+            }
+        }
         /*
          * if the ring buffer was empty before
          * adding this event
          */
-        if (rngSpace==EVENTQUESIZE) {
+        if (rngSpace==ev_que->quesize) {
             firstEventFlag = 1;
         }
         else {
             firstEventFlag = 0;
         }
-        ev_que->putix = RNGINC ( ev_que->putix );
+        ev_que->putix = RNGINC ( ev_que, ev_que->putix );
+    }
+    return firstEventFlag;
+}
+
+/*
+ * intake_drain()
+ * event queue lock _must_ be applied
+ *
+ * Move the updates waiting on the intake ring onto the ring proper.
+ * Returns TRUE if the ring was empty and now isn't.
+ */
+static int intake_drain ( struct event_que *ev_que )
+{
+    struct evSubscrip *pevent;
+    db_field_log *pLog;
+    int firstEventFlag = FALSE;
+
+    while ( intake_take ( ev_que, &pevent, &pLog ) ) {
+        db_field_log *pDiscard;
+
+        if ( ev_que_insert ( ev_que, pevent, pLog, &pDiscard ) ) {
+            firstEventFlag = TRUE;
+        }
+        /*
+         * only the event task and posters finding the intake full
+         * contend for the lock now, so this may be freed here
+         */
+        db_delete_field_log ( pDiscard );
+    }
+    return firstEventFlag;
+}
+
+/*
+ * intake_flush()
+ * event queue lock _must_ be applied
+ *
+ * Like intake_drain(), but also waits for posters which claimed
+ * positions before the call and haven't filled them yet, so that
+ * every update pushed before the call is on the ring proper when it
+ * returns. Such a poster holds no lock and never blocks, so the wait
+ * is short.
+ */
+static int intake_flush ( struct event_que *ev_que )
+{
+    const size_t end = epicsAtomicGetSizeT ( &ev_que->intakePut );
+    int firstEventFlag = FALSE;
+    unsigned nTries = 0u;
+
+    while ( TRUE ) {
+        if ( intake_drain ( ev_que ) ) {
+            firstEventFlag = TRUE;
+        }
+        if ( (long) ( ev_que->intakeGet - end ) >= 0 ) {
+            break;
+        }
+        /*
+         * a poster of lower priority only gets to run
+         * if this thread really sleeps
+         */
+        if ( ++nTries < 100u ) {
+            epicsThreadSleep ( 0.0 );
+        }
+        else {
+            epicsThreadSleep ( epicsThreadSleepQuantum () );
+        }
     }
+    return firstEventFlag;
+}
 
+/*
+ *  DB_QUEUE_EVENT_LOG()
+ *
+ */
+static void db_queue_event_log (evSubscrip *pevent, db_field_log *pLog)
+{
+    struct event_que    *ev_que;
+    db_field_log        *pDiscard = NULL;
+    int firstEventFlag;
+
+    ev_que = pevent->ev_que;
+
+    /*
+     * Many threads post to the same queue, so updates are normally
+     * pushed onto the intake ring without taking any lock. The event
+     * task is only woken when it has run out of work and said so.
+     */
+    if ( ev_que->evUser->lockFree &&
+            intake_put ( ev_que, pevent, pLog ) ) {
+        if ( epicsAtomicCmpAndSwapIntT ( &ev_que->wakeArmed,
+                TRUE, FALSE ) == TRUE ) {
+            epicsEventSignal ( ev_que->evUser->ppendsem );
+        }
+        return;
+    }
+
+    /*
+     * evUser ring buffer must be locked for the multiple
+     * threads writing/reading it.
+     *
+     * Whatever is still on the intake ring is moved first, as it may
+     * hold earlier updates of this event, waiting for any poster still
+     * filling its entry so that none of them lands behind this update.
+     * Apart from that wait, nothing which might block
+     * (freeing field logs in particular) is done for this update
+     * while the lock is held.
+     */
+    LOCKEVQUE (ev_que);
+    firstEventFlag = intake_flush ( ev_que );
+    if ( ev_que_insert ( ev_que, pevent, pLog, &pDiscard ) ) {
+        firstEventFlag = TRUE;
+    }
     UNLOCKEVQUE (ev_que);
 
+    db_delete_field_log(pDiscard);
+
     /*
      * its more efficent to notify the event handler
      * only after the event is ready and the lock
@@ -869,6 +1386,123 @@ unsigned int    caEventMask
 
 }
 
+/*
+ * Shared arrays carry their reference count in a header placed in front
+ * of the data, padded so that the data is aligned for any field type.
+ */
+typedef union sharedArrayHeader {
+    size_t      refcount;
+    epicsFloat64 alignDouble;
+    epicsInt64  alignInt64;
+    void        *alignPtr;
+} sharedArrayHeader;
+
+#define SHARED_ARRAY_HEADER(P) \
+    ((sharedArrayHeader *) ((char *) (P) - sizeof(sharedArrayHeader)))
+
+/*
+ *  DB_SHARED_ARRAY_ALLOC()
+ *
+ *  Returns a buffer holding one reference, or NULL
+ */
+void * db_shared_array_alloc ( size_t size )
+{
+    sharedArrayHeader *pHdr = (sharedArrayHeader *)
+        malloc ( sizeof(sharedArrayHeader) + size );
+
+    if ( ! pHdr ) {
+        return NULL;
+    }
+    pHdr->refcount = 1u;
+    return pHdr + 1;
+}
+
+void db_shared_array_ref ( const void *pArray )
+{
+    if ( pArray ) {
+        epicsAtomicIncrSizeT ( &SHARED_ARRAY_HEADER(pArray)->refcount );
+    }
+}
+
+void db_shared_array_release ( const void *pArray )
+{
+    if ( pArray &&
+            epicsAtomicDecrSizeT ( &SHARED_ARRAY_HEADER(pArray)->refcount ) == 0u ) {
+        free ( SHARED_ARRAY_HEADER(pArray) );
+    }
+}
+
+static void db_shared_array_dtor ( db_field_log *pfl )
+{
+    db_shared_array_release ( pfl->u.r.field );
+}
+
+/*
+ *  DB_POST_SHARED_EVENTS()
+ *
+ *  Like db_post_events(), but array subscriptions on pField are sent a
+ *  reference to the immutable buffer pArray holding nElements elements
+ *  rather than to the record's field.  The caller keeps its reference.
+ *
+ *  NOTE: This assumes that the db scan lock is already applied
+ *
+ */
+int db_post_shared_events(
+void            *pRecord,
+void            *pField,
+unsigned int    caEventMask,
+const void      *pArray,
+long            nElements
+)
+{
+    struct dbCommon   * const prec = (struct dbCommon *) pRecord;
+    struct evSubscrip *pevent;
+
+    if ( ! pField || ! pArray ) {
+        return db_post_events ( pRecord, pField, caEventMask );
+    }
+
+    if (prec->mlis.count == 0) return DB_EVENT_OK;       /* no monitors set */
+
+    LOCKREC (prec);
+
+    for (pevent = (struct evSubscrip *) prec->mlis.node.next;
+        pevent; pevent = (struct evSubscrip *) pevent->node.next){
+        struct dbChannel *chan = pevent->chan;
+        db_field_log *pLog;
+
+        if (dbChannelField(chan) != (void *)pField ||
+            !(caEventMask & pevent->select))
+            continue;
+
+        if (pevent->useValque) {
+            pLog = db_create_event_log(pevent);
+        }
+        else {
+            pLog = (db_field_log *) freeListCalloc(dbevFieldLogFreeList);
+            if (pLog) {
+                pLog->ctx  = dbfl_context_event;
+                pLog->type = dbfl_type_ref;
+                pLog->stat = prec->stat;
+                pLog->sevr = prec->sevr;
+                pLog->time = prec->time;
+                pLog->field_type  = chan->addr.field_type;
+                pLog->field_size  = chan->addr.field_size;
+                pLog->no_elements = nElements < chan->addr.no_elements ?
+                    nElements : chan->addr.no_elements;
+                pLog->u.r.dtor  = db_shared_array_dtor;
+                pLog->u.r.field = (void *) pArray;
+                db_shared_array_ref(pArray);
+            }
+        }
+        pLog = dbChannelRunPreChain(chan, pLog);
+        if (pLog) db_queue_event_log(pevent, pLog);
+    }
+
+    UNLOCKREC (prec);
+    return DB_EVENT_OK;
+}
+
 /*
  *  DB_POST_SINGLE_EVENT()
  */
@@ -887,14 +1521,41 @@ void db_post_single_event (dbEventSubscription event)
     dbScanUnlock (prec);
 }
 
+/*
+ * event_batch_done()
+ * event queue lock _must_ be applied
+ *
+ * Release the events of updates delivered by the last batch, freeing
+ * those canceled by their own callback, and waking any thread which
+ * is waiting in db_cancel_event() for the delivery to finish.
+ */
+static void event_batch_done ( struct event_user *evUser, unsigned nbatch )
+{
+    unsigned i;
+
+    for ( i = 0u; i < nbatch; i++ ) {
+        struct evSubscrip * const pevent = evUser->batchEvents[i];
+
+        assert ( pevent->callBackInProgress > 0u );
+        if ( --pevent->callBackInProgress == 0u && ! pevent->user_sub ) {
+            if ( pevent->canceledInCallBack ) {
+                freeListFree ( dbevEventSubscriptionFreeList, pevent );
+            }
+            else {
+                epicsEventSignal ( evUser->pflush_sem );
+            }
+        }
+    }
+}
+
 /*
  * EVENT_READ()
  */
 static int event_read ( struct event_que *ev_que )
 {
-    db_field_log *pfl;
-    void ( *user_sub ) ( void *user_arg, struct dbChannel *chan,
-            int eventsRemaining, db_field_log *pfl );
+    struct event_user * const evUser = ev_que->evUser;
+    dbEventBatchEntry * const batch = evUser->batch;
+    EVENTBATCHFUNC * const batch_sub = evUser->batch_sub;
 
     /*
      * evUser ring buffer must be locked for the multiple
@@ -902,98 +1563,192 @@ static int event_read ( struct event_que *ev_que )
      */
     LOCKEVQUE (ev_que);
 
+    /*
+     * updates squash on the ring proper, not on the intake ring
+     */
+    intake_drain ( ev_que );
+
     /*
      * if in flow control mode drain duplicates and then
      * suspend processing events until flow control
      * mode is over
      */
-    if ( ev_que->evUser->flowCtrlMode && ev_que->nDuplicates == 0u ) {
+    if ( evUser->flowCtrlMode && ev_que->nDuplicates == 0u &&
+            ev_que->evque[ev_que->getix] != EVENTQEMPTY ) {
         UNLOCKEVQUE (ev_que);
         return DB_EVENT_OK;
     }
 
-    while ( ev_que->evque[ev_que->getix] != EVENTQEMPTY ) {
-        struct evSubscrip *pevent = ev_que->evque[ev_que->getix];
+    while ( TRUE ) {
+        unsigned nbatch = 0u;
+        unsigned i;
+        int eventsRemaining;
+
+        intake_drain ( ev_que );
 
-        pfl = ev_que->valque[ev_que->getix];
-        if ( pevent == &canceledEvent ) {
-            ev_que->evque[ev_que->getix] = EVENTQEMPTY;
-            if (ev_que->valque[ev_que->getix]) {
-                db_delete_field_log(ev_que->valque[ev_que->getix]);
-                ev_que->valque[ev_que->getix] = NULL;
+        if ( ev_que->evque[ev_que->getix] == EVENTQEMPTY ) {
+            /*
+             * Out of work, so ask the next poster to wake us, then
+             * look once more for updates pushed before it could see
+             * that (the swap is a full barrier).
+             */
+            epicsAtomicCmpAndSwapIntT ( &ev_que->wakeArmed, FALSE, TRUE );
+            intake_drain ( ev_que );
+            if ( ev_que->evque[ev_que->getix] == EVENTQEMPTY ) {
+                break;
             }
-            ev_que->getix = RNGINC ( ev_que->getix );
-            assert ( ev_que->nCanceled > 0 );
-            ev_que->nCanceled--;
-            continue;
         }
 
         /*
-         * Simple type values queued up for reliable interprocess
-         * communication. (for other types they get whatever happens
-         * to be there upon wakeup)
+         * Take as many updates as fit in a batch off the queue
+         * while we have the lock. Simple type values queued up for
+         * reliable interprocess communication. (for other types
+         * they get whatever happens to be there upon wakeup)
          */
+        while ( nbatch < EVENTBATCHMAX &&
+                ev_que->evque[ev_que->getix] != EVENTQEMPTY ) {
+            struct evSubscrip *pevent = ev_que->evque[ev_que->getix];
+            db_field_log *pfl = ev_que->valque[ev_que->getix];
+
+            if ( pevent == &canceledEvent ) {
+                ev_que->evque[ev_que->getix] = EVENTQEMPTY;
+                if (pfl) {
+                    db_delete_field_log(pfl);
+                    ev_que->valque[ev_que->getix] = NULL;
+                }
+                ev_que->getix = RNGINC ( ev_que, ev_que->getix );
+                assert ( ev_que->nCanceled > 0 );
+                ev_que->nCanceled--;
+                continue;
+            }
 
-        event_remove ( ev_que, ev_que->getix, EVENTQEMPTY );
-        ev_que->getix = RNGINC ( ev_que->getix );
+            event_remove ( ev_que, ev_que->getix, EVENTQEMPTY );
+            ev_que->getix = RNGINC ( ev_que, ev_que->getix );
 
-        /*
-         * create a local copy of the call back parameters while
-         * we still have the lock
-         */
-        user_sub = pevent->user_sub;
+            if ( ! pevent->user_sub ) {
+                db_delete_field_log(pfl);
+                continue;
+            }
+
+            /*
+             * create a local copy of the call back parameters while
+             * we still have the lock (the ring may be reallocated
+             * by a writer once it is released).
+             *
+             * This provides a way to test to see if an event is in use
+             * despite the fact that the event queue does not point to
+             * it.
+             */
+            pevent->callBackInProgress++;
+            batch[nbatch].user_sub = pevent->user_sub;
+            batch[nbatch].user_arg = pevent->user_arg;
+            batch[nbatch].chan = pevent->chan;
+            batch[nbatch].pfl = pfl;
+            evUser->batchEvents[nbatch++] = pevent;
+        }
 
         /*
          * Next event pointer can be used by event tasks to determine
          * if more events are waiting in the queue
-         *
+         */
+        eventsRemaining = ev_que->evque[ev_que->getix] != EVENTQEMPTY;
+
+        if ( nbatch == 0u ) {
+            continue;
+        }
+
+        /*
          * Must remove the lock here so that we dont deadlock if
          * this calls dbGetField() and blocks on the record lock,
          * dbPutField() is in progress in another task, it has the
          * record lock, and it is calling db_post_events() waiting
          * for the event queue lock (which this thread now has).
          */
-        if ( user_sub ) {
-            /*
-             * This provides a way to test to see if an event is in use
-             * despite the fact that the event queue does not point to
-             * it.
-             */
-            pevent->callBackInProgress = TRUE;
-            UNLOCKEVQUE (ev_que);
-            /* Run post-event-queue filter chain */
-            if (ellCount(&pevent->chan->post_chain)) {
-                pfl = dbChannelRunPostChain(pevent->chan, pfl);
+        UNLOCKEVQUE (ev_que);
+
+        if ( batch_sub ) {
+            unsigned ndeliver = 0u;
+
+            /* Run post-event-queue filter chains */
+            for ( i = 0u; i < nbatch; i++ ) {
+                db_field_log *pfl = batch[i].pfl;
+
+                if (ellCount(&batch[i].chan->post_chain)) {
+                    pfl = dbChannelRunPostChain(batch[i].chan, pfl);
+                }
+                if (pfl) {
+                    batch[ndeliver] = batch[i];
+                    batch[ndeliver++].pfl = pfl;
+                }
             }
-            if (pfl) {
-                /* Issue user callback */
-                ( *user_sub ) ( pevent->user_arg, pevent->chan,
-                                ev_que->evque[ev_que->getix] != EVENTQEMPTY, pfl );
+            if ( ndeliver ) {
+                /* Issue user batch callback */
+                ( *batch_sub ) ( evUser->batch_arg, ndeliver, batch,
+                                 eventsRemaining );
             }
-            LOCKEVQUE (ev_que);
-
-            /*
-             * check to see if this event has been canceled each
-             * time that the callBackInProgress flag is set to false
-             * while we have the event queue lock, and post the flush
-             * complete sem if there are no longer any events on the
-             * queue
-             */
-            if ( ev_que->evUser->pSuicideEvent == pevent ) {
-                ev_que->evUser->pSuicideEvent = NULL;
+            for ( i = 0u; i < ndeliver; i++ ) {
+                db_delete_field_log(batch[i].pfl);
             }
-            else {
-                if ( pevent->user_sub==NULL && pevent->npend==0u ) {
-                    pevent->callBackInProgress = FALSE;
-                    epicsEventSignal ( ev_que->evUser->pflush_sem );
+        }
+        else {
+            for ( i = 0u; i < nbatch; i++ ) {
+                db_field_log *pfl = batch[i].pfl;
+
+                /*
+                 * skip updates for an event canceled by an
+                 * earlier callback in this batch
+                 */
+                if ( ! evUser->batchEvents[i]->user_sub ) {
+                    db_delete_field_log(pfl);
+                    continue;
                 }
-                else {
-                    pevent->callBackInProgress = FALSE;
+                /* Run post-event-queue filter chain */
+                if (ellCount(&batch[i].chan->post_chain)) {
+                    pfl = dbChannelRunPostChain(batch[i].chan, pfl);
+                }
+                if (pfl) {
+                    /* Issue user callback */
+                    ( *batch[i].user_sub ) ( batch[i].user_arg,
+                        batch[i].chan, i + 1u < nbatch || eventsRemaining,
+                        pfl );
+                    db_delete_field_log(pfl);
                 }
             }
         }
-        db_delete_field_log(pfl);
+
+        LOCKEVQUE (ev_que);
+
+        /*
+         * check to see if these events have been canceled now that
+         * their callBackInProgress counts drop while we have the
+         * event queue lock
+         */
+        event_batch_done ( evUser, nbatch );
+    }
+
+    /*
+     * the queue is now empty, so give back half of any storage added
+     * while absorbing a burst once that half has gone unused for a
+     * number of drains in a row, rather than reallocating the ring
+     * for every burst of a bursty load
+     */
+    if ( ev_que->quesize > ev_que->basesize ) {
+        unsigned newsize = ev_que->quesize / 2u;
+
+        if ( newsize < ev_que->basesize ) {
+            newsize = ev_que->basesize;
+        }
+        if ( ev_que->recentMax <= newsize ) {
+            if ( ++ev_que->nQuiet >= EVENTQUIETREADS &&
+                    ev_que_alloc_ring ( ev_que, newsize ) ) {
+                ev_que->nQuiet = 0u;
+            }
+        }
+        else {
+            ev_que->nQuiet = 0u;
+        }
     }
+    ev_que->recentMax = 0u;
 
     UNLOCKEVQUE (ev_que);
 
@@ -1055,6 +1810,8 @@ static void event_task (void *pParm)
     } while( ! pendexit );
 
     epicsMutexDestroy(evUser->firstque.writelock);
+    free(evUser->firstque.valque);
+    free(evUser->firstque.evque);
 
     {
         struct event_que    *nextque;
@@ -1063,6 +1820,8 @@ static void event_task (void *pParm)
         while (ev_que) {
             nextque = ev_que->nextque;
             epicsMutexDestroy(ev_que->writelock);
+            free(ev_que->valque);
+            free(ev_que->evque);
             freeListFree(dbevEventQueueFreeList, ev_que);
             ev_que = nextque;
         }
@@ -19,6 +19,8 @@
 #ifndef INCLdbEventh
 #define INCLdbEventh
 
+#include <stddef.h>
+
 #ifdef epicsExportSharedSymbols
 #   undef epicsExportSharedSymbols
 #   define INCLdbEventhExporting
@@ -40,6 +42,11 @@ struct dbChannel;
 struct db_field_log;
 struct evSubscrip;
 
+/* Settings copied into each context by db_init_events() */
+epicsShareExtern int dbEventQueueDepth;
+epicsShareExtern int dbEventQueueMax;
+epicsShareExtern int dbEventQueueLockFree;
+
 epicsShareFunc int db_event_list (
     const char *name, unsigned level);
 epicsShareFunc int dbel (
@@ -47,6 +54,20 @@ epicsShareFunc int dbel (
 epicsShareFunc int db_post_events (
     void *pRecord, void *pField, unsigned caEventMask );
 
+/*
+ * Shared arrays are immutable, reference counted buffers which record or
+ * device support may publish with db_post_shared_events() instead of
+ * having each subscriber's field log take its own copy of an array field.
+ * The buffer must not be modified after it has been posted; the last
+ * db_shared_array_release() frees it.
+ */
+epicsShareFunc void * db_shared_array_alloc ( size_t size );
+epicsShareFunc void db_shared_array_ref ( const void *pArray );
+epicsShareFunc void db_shared_array_release ( const void *pArray );
+epicsShareFunc int db_post_shared_events (
+    void *pRecord, void *pField, unsigned caEventMask,
+    const void *pArray, long nElements );
+
 typedef void * dbEventCtx;
 
 typedef void EXTRALABORFUNC (void *extralabor_arg);
@@ -62,9 +83,13 @@ epicsShareFunc int db_add_extra_labor_event (
 epicsShareFunc void db_flush_extra_labor_event (dbEventCtx);
 epicsShareFunc int db_post_extra_labor (dbEventCtx ctx);
 epicsShareFunc void db_event_change_priority ( dbEventCtx ctx, unsigned epicsPriority );
+epicsShareFunc void db_event_queue_size ( dbEventCtx ctx,
+    unsigned depth, unsigned maxQueueSize );
 
 #ifdef EPICS_PRIVATE_API
 epicsShareFunc void db_cleanup_events(void);
+/* for tests, called by a poster between claiming and filling an intake entry */
+epicsShareExtern void (*db_event_intake_hook)(void);
 #endif
 
 typedef void EVENTFUNC (void *user_arg, struct dbChannel *chan,
@@ -74,7 +99,38 @@ typedef void * dbEventSubscription;
 epicsShareFunc dbEventSubscription db_add_event (
     dbEventCtx ctx, struct dbChannel *chan,
     EVENTFUNC *user_sub, void *user_arg, unsigned select);
+epicsShareFunc dbEventSubscription db_add_event_depth (
+    dbEventCtx ctx, struct dbChannel *chan,
+    EVENTFUNC *user_sub, void *user_arg, unsigned select, unsigned depth);
 epicsShareFunc void db_cancel_event (dbEventSubscription es);
+epicsShareFunc unsigned long db_event_replaced (dbEventSubscription es);
+
+/*
+ * Batch delivery: when a batch handler is registered (before
+ * db_start_events()) the event task passes it all of the updates it has
+ * taken off an event queue at once, instead of calling the EVENTFUNC of
+ * each subscription for each update.  The handler must not use the field
+ * logs after it returns.  eventsRemaining is set if more updates are
+ * waiting to be delivered.  If the handler cancels a subscription, later
+ * entries for that subscription in the same batch must be skipped; so
+ * must entries for a subscription another thread cancels while the batch
+ * is being delivered.  The updates of a batch all count as callbacks in
+ * progress, so db_cancel_event() called from another thread then waits
+ * until the handler has returned, i.e. for the delivery of up to
+ * EVENTBATCHMAX (see dbEvent.c) updates rather than of a single one.
+ */
+typedef struct dbEventBatchEntry {
+    EVENTFUNC               *user_sub;  /* as given to db_add_event() */
+    void                    *user_arg;  /* as given to db_add_event() */
+    struct dbChannel        *chan;
+    struct db_field_log     *pfl;
+} dbEventBatchEntry;
+
+typedef void EVENTBATCHFUNC (void *batch_arg, unsigned nEntries,
+    const dbEventBatchEntry *pEntries, int eventsRemaining);
+
+epicsShareFunc int db_add_event_batch_handler (
+    dbEventCtx ctx, EVENTBATCHFUNC *func, void *arg);
 epicsShareFunc void db_post_single_event (dbEventSubscription es);
 epicsShareFunc void db_event_enable (dbEventSubscription es);
 epicsShareFunc void db_event_disable (dbEventSubscription es);
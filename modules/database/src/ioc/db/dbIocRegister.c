@@ -307,6 +307,18 @@ static void scanOnceQueueShowCallFunc(const iocshArgBuf *args)
     scanOnceQueueShow(args[0].ival);
 }
 
+/* scanPeriodicWorkers */
+static const iocshArg scanPeriodicWorkersArg0 = { "no of workers", iocshArgInt};
+static const iocshArg scanPeriodicWorkersArg1 = { "scan rate", iocshArgString};
+static const iocshArg * const scanPeriodicWorkersArgs[2] =
+    {&scanPeriodicWorkersArg0,&scanPeriodicWorkersArg1};
+static const iocshFuncDef scanPeriodicWorkersFuncDef =
+    {"scanPeriodicWorkers",2,scanPeriodicWorkersArgs};
+static void scanPeriodicWorkersCallFunc(const iocshArgBuf *args)
+{
+    scanPeriodicWorkers(args[0].ival, args[1].sval);
+}
+
 /* scanppl */
 static const iocshArg scanpplArg0 = { "rate",iocshArgDouble};
 static const iocshArg * const scanpplArgs[1] = {&scanpplArg0};
@@ -314,6 +326,18 @@ static const iocshFuncDef scanpplFuncDef = {"scanppl",1,scanpplArgs};
 static void scanpplCallFunc(const iocshArgBuf *args)
 { scanppl(args[0].dval);}
 
+/* scanPeriodicJitterShow */
+static const iocshArg scanPeriodicJitterShowArg0 = { "rate",iocshArgDouble};
+static const iocshArg scanPeriodicJitterShowArg1 = { "reset",iocshArgInt};
+static const iocshArg * const scanPeriodicJitterShowArgs[2] =
+    {&scanPeriodicJitterShowArg0,&scanPeriodicJitterShowArg1};
+static const iocshFuncDef scanPeriodicJitterShowFuncDef =
+    {"scanPeriodicJitterShow",2,scanPeriodicJitterShowArgs};
+static void scanPeriodicJitterShowCallFunc(const iocshArgBuf *args)
+{
+    scanPeriodicJitterShow(args[0].dval, args[1].ival);
+}
+
 /* scanpel */
 static const iocshArg scanpelArg0 = { "event name",iocshArgString};
 static const iocshArg * const scanpelArgs[1] = {&scanpelArg0};
@@ -346,6 +370,17 @@ static void callbackSetQueueSizeCallFunc(const iocshArgBuf *args)
     callbackSetQueueSize(args[0].ival);
 }
 
+/* callbackSetQueueMax */
+static const iocshArg callbackSetQueueMaxArg0 = { "bufsize",iocshArgInt};
+static const iocshArg * const callbackSetQueueMaxArgs[1] =
+    {&callbackSetQueueMaxArg0};
+static const iocshFuncDef callbackSetQueueMaxFuncDef =
+    {"callbackSetQueueMax",1,callbackSetQueueMaxArgs};
+static void callbackSetQueueMaxCallFunc(const iocshArgBuf *args)
+{
+    callbackSetQueueMax(args[0].ival);
+}
+
 /* callbackQueueShow */
 static const iocshArg callbackQueueShowArg0 = { "reset", iocshArgInt};
 static const iocshArg * const callbackQueueShowArgs[1] =
@@ -464,12 +499,15 @@ void dbIocRegister(void)
 
     iocshRegister(&scanOnceSetQueueSizeFuncDef,scanOnceSetQueueSizeCallFunc);
     iocshRegister(&scanOnceQueueShowFuncDef,scanOnceQueueShowCallFunc);
+    iocshRegister(&scanPeriodicWorkersFuncDef,scanPeriodicWorkersCallFunc);
     iocshRegister(&scanpplFuncDef,scanpplCallFunc);
+    iocshRegister(&scanPeriodicJitterShowFuncDef,scanPeriodicJitterShowCallFunc);
     iocshRegister(&scanpelFuncDef,scanpelCallFunc);
     iocshRegister(&postEventFuncDef,postEventCallFunc);
     iocshRegister(&scanpiolFuncDef,scanpiolCallFunc);
 
     iocshRegister(&callbackSetQueueSizeFuncDef,callbackSetQueueSizeCallFunc);
+    iocshRegister(&callbackSetQueueMaxFuncDef,callbackSetQueueMaxCallFunc);
     iocshRegister(&callbackQueueShowFuncDef,callbackQueueShowCallFunc);
     iocshRegister(&callbackParallelThreadsFuncDef,callbackParallelThreadsCallFunc);
 
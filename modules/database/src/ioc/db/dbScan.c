@@ -14,6 +14,8 @@
  *      Original Authors: Bob Dalesio & Marty Kraimer
  */
 
+#define EPICS_PRIVATE_API
+
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
@@ -33,6 +35,7 @@
 #include "epicsStdlib.h"
 #include "epicsString.h"
 #include "epicsThread.h"
+#include "epicsThreadPool.h"
 #include "epicsTime.h"
 #include "taskwd.h"
 
@@ -87,6 +90,33 @@ typedef struct scan_element{
 
 #define OVERRUN_REPORT_DELAY 10.0   /* Time between initial reports */
 #define OVERRUN_REPORT_MAX 3600.0   /* Maximum time between reports */
+
+/* Histogram of times in nanoseconds.  Bin 0 counts times under 1 us,
+ * bin n counts times from 2^(n-1) up to 2^n us.
+ */
+#define SCAN_HIST_BINS 24
+typedef struct scan_hist {
+    unsigned long       bins[SCAN_HIST_BINS];
+    unsigned long       count;
+    epicsUInt64         min;
+    epicsUInt64         max;
+    epicsUInt64         sum;
+} scan_hist;
+
+/* A periodic scan list with workers shares its records between them by
+ * lock set, so each lock set is always processed by one worker in list
+ * order, while different lock sets are processed in parallel.
+ */
+typedef struct periodic_worker {
+    struct periodic_scan_list *ppsl;
+    epicsJob            *job;
+    struct dbCommon     **precords;     /* this pass's records */
+    unsigned            nrecords;
+    double              busy;           /* last pass processing time */
+    double              busyMax;
+    unsigned long       overruns;
+} periodic_worker;
+
 typedef struct periodic_scan_list {
     scan_list           scan_list;
     double              period;
@@ -94,11 +124,18 @@ typedef struct periodic_scan_list {
     unsigned long       overruns;
     volatile enum ctl   scanCtl;
     epicsEventId        loopEvent;
+    int                 nWorkers;
+    unsigned            nalloc;         /* size of worker precords arrays */
+    periodic_worker     *workers;
+    epicsThreadPool     *pool;
+    scan_hist           jitter;         /* pass start after deadline */
+    scan_hist           latency;        /* pass end after deadline */
 } periodic_scan_list;
 
 static int nPeriodic = 0;
 static periodic_scan_list **papPeriodic; /* pointer to array of pointers */
 static epicsThreadId *periodicTaskId;    /* array of thread ids */
+static int *periodicWorkers;             /* configured workers per list */
 
 
 static char *priorityName[NUM_CALLBACK_PRIORITIES] = {
@@ -141,6 +178,8 @@ static void periodicTask(void *arg);
 static void initPeriodic(void);
 static void deletePeriodic(void);
 static void spawnPeriodic(int ind);
+static void periodicWorkerJob(void *arg, epicsJobMode mode);
+static void scanListParallel(periodic_scan_list *ppsl);
 static void eventCallback(CALLBACK *pcallback);
 static void ioscanInit(void);
 static void ioscanCallback(CALLBACK *pcallback);
@@ -182,8 +221,10 @@ void scanCleanup(void)
     epicsRingBytesDelete(onceQ);
 
     free(periodicTaskId);
+    free(periodicWorkers);
     papPeriodic = NULL;
     periodicTaskId = NULL;
+    periodicWorkers = NULL;
 }
 
 long scanInit(void)
@@ -372,6 +413,14 @@ double scanPeriod(int scan) {
     return ppsl ? ppsl->period : 0.0;
 }
 
+/* Does a period given to a show command select this list? */
+static int periodMatch(double period, const periodic_scan_list *ppsl)
+{
+    double tolerance = ppsl->period < 1.0 ? ppsl->period * 0.05 : 0.05;
+
+    return period <= 0.0 || fabs(period - ppsl->period) <= tolerance;
+}
+
 int scanppl(double period)      /* print periodic scan list(s) */
 {
     dbMenu *pmenu = dbFindMenu(pdbbase, "menuScan");
@@ -393,17 +442,124 @@ int scanppl(double period)      /* print periodic scan list(s) */
                 choice);
             continue;
         }
-        if (period > 0.0 &&
-            (fabs(period - ppsl->period) > 0.05))
+        if (!periodMatch(period, ppsl))
             continue;
 
         sprintf(message, "Records with SCAN = '%s' (%lu over-runs):",
             ppsl->name, ppsl->overruns);
         printList(&ppsl->scan_list, message);
+        if (ppsl->jitter.count && ppsl->latency.count) {
+            printf("    Jitter %.1f us (max %.1f), latency %.1f us (max %.1f)\n",
+                ppsl->jitter.sum * 1e-3 / ppsl->jitter.count,
+                ppsl->jitter.max * 1e-3,
+                ppsl->latency.sum * 1e-3 / ppsl->latency.count,
+                ppsl->latency.max * 1e-3);
+        }
+        if (ppsl->nWorkers) {
+            int w;
+
+            for (w = 0; w < ppsl->nWorkers; w++) {
+                periodic_worker *pw = &ppsl->workers[w];
+
+                printf("    Worker %d: %u records, %.3f seconds "
+                    "(max %.3f), %lu over-runs\n", w, pw->nrecords,
+                    pw->busy, pw->busyMax, pw->overruns);
+            }
+        }
+    }
+    return 0;
+}
+
+int scanPeriodicJitterShow(double period, int reset)
+{
+    int i;
+
+    if (!papPeriodic) {
+        printf("scanPeriodicJitterShow: dbScan subsystem not initialized\n");
+        return -1;
+    }
+
+    for (i = 0; i < nPeriodic; i++) {
+        periodic_scan_list *ppsl = papPeriodic[i];
+        scan_hist jitter, latency;
+        int bin;
+
+        if (!ppsl || !periodMatch(period, ppsl))
+            continue;
+
+        /* The scan thread adds to the histograms under the list lock */
+        epicsMutexMustLock(ppsl->scan_list.lock);
+        jitter = ppsl->jitter;
+        latency = ppsl->latency;
+        if (reset) {
+            memset(&ppsl->jitter, 0, sizeof(scan_hist));
+            memset(&ppsl->latency, 0, sizeof(scan_hist));
+        }
+        epicsMutexUnlock(ppsl->scan_list.lock);
+
+        printf("Scan list '%s': %lu passes\n", ppsl->name, jitter.count);
+        if (!jitter.count || !latency.count)
+            continue;
+        printf("    %-16s %10s %10s\n", "Time (us)", "Jitter", "Latency");
+        for (bin = 0; bin < SCAN_HIST_BINS; bin++) {
+            char range[32];
+
+            if (!jitter.bins[bin] && !latency.bins[bin])
+                continue;
+            if (bin == 0)
+                strcpy(range, "< 1");
+            else if (bin == SCAN_HIST_BINS - 1)
+                sprintf(range, ">= %lu", 1ul << (bin - 1));
+            else
+                sprintf(range, "%lu - %lu", 1ul << (bin - 1), 1ul << bin);
+            printf("    %-16s %10lu %10lu\n", range,
+                jitter.bins[bin], latency.bins[bin]);
+        }
+        printf("    %-16s %10.1f %10.1f\n", "Minimum",
+            jitter.min * 1e-3, latency.min * 1e-3);
+        printf("    %-16s %10.1f %10.1f\n", "Mean",
+            jitter.sum * 1e-3 / jitter.count, latency.sum * 1e-3 / latency.count);
+        printf("    %-16s %10.1f %10.1f\n", "Maximum",
+            jitter.max * 1e-3, latency.max * 1e-3);
     }
     return 0;
 }
 
+/* Sum one histogram's bins, for tests */
+static unsigned long histTotal(const scan_hist *ph)
+{
+    unsigned long total = 0;
+    int bin;
+
+    for (bin = 0; bin < SCAN_HIST_BINS; bin++)
+        total += ph->bins[bin];
+    return total;
+}
+
+int scanPeriodicHistStatus(double period, scanPeriodicHistStats *result)
+{
+    int i;
+
+    if (!papPeriodic || !result)
+        return -1;
+
+    for (i = 0; i < nPeriodic; i++) {
+        periodic_scan_list *ppsl = papPeriodic[i];
+
+        if (!ppsl || !periodMatch(period, ppsl))
+            continue;
+
+        epicsMutexMustLock(ppsl->scan_list.lock);
+        result->passes = ppsl->jitter.count;
+        result->jitterTotal = histTotal(&ppsl->jitter);
+        result->latencyCount = ppsl->latency.count;
+        result->latencyTotal = histTotal(&ppsl->latency);
+        epicsMutexUnlock(ppsl->scan_list.lock);
+        return 0;
+    }
+    return -1;
+}
+
 int scanpel(const char* eventname)   /* print event list */
 {
     char message[80];
@@ -773,56 +929,90 @@ static void initOnce(void)
     epicsEventWait(startStopEvent);
 }
 
+/* Add a time in nanoseconds to a histogram */
+static void histAdd(scan_hist *ph, epicsUInt64 ns)
+{
+    epicsUInt64 us = ns / 1000u;
+    int bin = 0;
+
+    while (us && bin < SCAN_HIST_BINS - 1) {
+        us >>= 1;
+        bin++;
+    }
+    ph->bins[bin]++;
+    if (!ph->count || ns < ph->min)
+        ph->min = ns;
+    if (ns > ph->max)
+        ph->max = ns;
+    ph->sum += ns;
+    ph->count++;
+}
+
 static void periodicTask(void *arg)
 {
     periodic_scan_list *ppsl = (periodic_scan_list *)arg;
-    epicsTimeStamp next, reported;
+    epicsUInt64 next, reported;
+    const epicsUInt64 period = ppsl->period * 1e9;
+    const epicsUInt64 penalty = (ppsl->period >= 2) ? 1000000000u : period / 2;
     unsigned int overruns = 0;
     double report_delay = OVERRUN_REPORT_DELAY;
     double overtime = 0.0;
     double over_min = 0.0;
     double over_max = 0.0;
-    const double penalty = (ppsl->period >= 2) ? 1 : (ppsl->period / 2);
 
     taskwdInsert(0, NULL, NULL);
     epicsEventSignal(startStopEvent);
 
-    epicsTimeGetCurrent(&next);
-    reported = next;
+    /* Deadlines are absolute times on the monotonic clock, so they don't
+     * drift or follow changes to the system time.
+     */
+    next = reported = epicsMonotonicGet();
 
     while (ppsl->scanCtl != ctlExit) {
-        double delay;
-        epicsTimeStamp now;
+        epicsUInt64 now;
+
+        if (ppsl->scanCtl == ctlRun) {
+            now = epicsMonotonicGet();
+            epicsMutexMustLock(ppsl->scan_list.lock);
+            histAdd(&ppsl->jitter, now > next ? now - next : 0u);
+            epicsMutexUnlock(ppsl->scan_list.lock);
+            if (ppsl->pool)
+                scanListParallel(ppsl);
+            else
+                scanList(&ppsl->scan_list);
+            now = epicsMonotonicGet();
+            epicsMutexMustLock(ppsl->scan_list.lock);
+            histAdd(&ppsl->latency, now > next ? now - next : 0u);
+            epicsMutexUnlock(ppsl->scan_list.lock);
+        }
 
-        if (ppsl->scanCtl == ctlRun)
-            scanList(&ppsl->scan_list);
+        next += period;
+        now = epicsMonotonicGet();
+        if (now >= next) {
+            double over = (now - next) * 1e-9;
 
-        epicsTimeAddSeconds(&next, ppsl->period);
-        epicsTimeGetCurrent(&now);
-        delay = epicsTimeDiffInSeconds(&next, &now);
-        if (delay <= 0.0) {
             if (overtime == 0.0) {
-                overtime = over_min = over_max = -delay;
+                overtime = over_min = over_max = over;
             }
             else {
-                overtime -= delay;
-                if (over_min + delay > 0)
-                    over_min = -delay;
-                if (over_max + delay < 0)
-                    over_max = -delay;
+                overtime += over;
+                if (over < over_min)
+                    over_min = over;
+                if (over > over_max)
+                    over_max = over;
             }
-            delay = penalty;
             ppsl->overruns++;
-            next = now;
-            epicsTimeAddSeconds(&next, delay);
+            next = now + penalty;
             if (++overruns >= 10 &&
-                epicsTimeDiffInSeconds(&now, &reported) > report_delay) {
+                (now - reported) * 1e-9 > report_delay) {
                 errlogPrintf("\ndbScan warning from '%s' scan thread:\n"
                     "\tScan processing averages %.3f seconds (%.3f .. %.3f).\n"
                     "\tOver-runs have now happened %u times in a row.\n"
-                    "\tTo fix this, move some records to a slower scan rate.\n",
+                    "\tTo fix this, move some records to a slower scan rate%s.\n",
                     ppsl->name, ppsl->period + overtime / overruns,
-                    ppsl->period + over_min, ppsl->period + over_max, overruns);
+                    ppsl->period + over_min, ppsl->period + over_max, overruns,
+                    ppsl->pool ? "" : "\n\tor give the scan list workers "
+                    "with scanPeriodicWorkers");
 
                 reported = now;
                 if (report_delay < (OVERRUN_REPORT_MAX / 2))
@@ -837,7 +1027,9 @@ static void periodicTask(void *arg)
             overtime = 0.0;
         }
 
-        epicsEventWaitWithTimeout(ppsl->loopEvent, delay);
+        /* Timed waits may return early, so wait until the deadline */
+        while (ppsl->scanCtl != ctlExit && (now = epicsMonotonicGet()) < next)
+            epicsEventWaitWithTimeout(ppsl->loopEvent, (next - now) * 1e-9);
     }
 
     taskwdRemove(0);
@@ -898,6 +1090,8 @@ static void initPeriodic(void)
         ppsl->name = choice;
         ppsl->scanCtl = ctlPause;
         ppsl->loopEvent = epicsEventMustCreate(epicsEventEmpty);
+        if (periodicWorkers)
+            ppsl->nWorkers = periodicWorkers[i];
 
         number = ppsl->period / quantum;
         if ((ppsl->period < 2 * quantum) ||
@@ -918,6 +1112,17 @@ static void deletePeriodic(void)
         periodic_scan_list *ppsl = papPeriodic[i];
 
         if (!ppsl) continue;
+        if (ppsl->workers) {
+            int w;
+
+            for (w = 0; w < ppsl->nWorkers; w++) {
+                epicsJobDestroy(ppsl->workers[w].job);
+                free(ppsl->workers[w].precords);
+            }
+            free(ppsl->workers);
+        }
+        if (ppsl->pool)
+            epicsThreadPoolDestroy(ppsl->pool);
         ellFree(&ppsl->scan_list.list);
         epicsEventDestroy(ppsl->loopEvent);
         epicsMutexDestroy(ppsl->scan_list.lock);
@@ -935,6 +1140,33 @@ static void spawnPeriodic(int ind)
 
     if (!ppsl) return;
 
+    if (ppsl->nWorkers > 0) {
+        epicsThreadPoolConfig opts;
+        int w;
+
+        epicsThreadPoolConfigDefaults(&opts);
+        opts.initialThreads = opts.maxThreads = ppsl->nWorkers;
+        opts.workerStack = epicsThreadGetStackSize(epicsThreadStackBig);
+        opts.workerPriority = epicsThreadPriorityScanLow + ind;
+        ppsl->pool = epicsThreadPoolCreate(&opts);
+        if (!ppsl->pool) {
+            errlogPrintf("spawnPeriodic: Can't create workers for '%s' scan,"
+                " records will be processed serially\n", ppsl->name);
+            ppsl->nWorkers = 0;
+        }
+        else {
+            ppsl->workers = dbCalloc(ppsl->nWorkers, sizeof(periodic_worker));
+            for (w = 0; w < ppsl->nWorkers; w++) {
+                periodic_worker *pw = &ppsl->workers[w];
+
+                pw->ppsl = ppsl;
+                pw->job = epicsJobCreate(ppsl->pool, periodicWorkerJob, pw);
+                if (!pw->job)
+                    cantProceed("spawnPeriodic: epicsJobCreate failed\n");
+            }
+        }
+    }
+
     sprintf(taskName, "scan-%g", ppsl->period);
     periodicTaskId[ind] = epicsThreadCreate(
         taskName, epicsThreadPriorityScanLow + ind,
@@ -944,6 +1176,77 @@ static void spawnPeriodic(int ind)
     epicsEventWait(startStopEvent);
 }
 
+static void periodicWorkerJob(void *arg, epicsJobMode mode)
+{
+    periodic_worker *pw = (periodic_worker *)arg;
+    epicsTimeStamp start, end;
+    unsigned i;
+
+    if (mode != epicsJobModeRun)
+        return;
+
+    epicsTimeGetCurrent(&start);
+    for (i = 0; i < pw->nrecords; i++) {
+        struct dbCommon *precord = pw->precords[i];
+
+        dbScanLock(precord);
+        dbProcess(precord);
+        dbScanUnlock(precord);
+    }
+    epicsTimeGetCurrent(&end);
+
+    pw->busy = epicsTimeDiffInSeconds(&end, &start);
+    if (pw->busy > pw->busyMax)
+        pw->busyMax = pw->busy;
+    if (pw->busy > pw->ppsl->period)
+        pw->overruns++;
+}
+
+int scanPeriodicWorkers(int count, const char *scan)
+{
+    dbMenu *pmenu;
+    int i;
+
+    if (papPeriodic) {
+        fprintf(stderr, "scanPeriodicWorkers: dbScan already initialized\n");
+        return -1;
+    }
+    if (!pdbbase) {
+        fprintf(stderr, "scanPeriodicWorkers: pdbbase not set\n");
+        return -1;
+    }
+    pmenu = dbFindMenu(pdbbase, "menuScan");
+    if (!pmenu || pmenu->nChoice <= SCAN_1ST_PERIODIC) {
+        fprintf(stderr, "scanPeriodicWorkers: No periodic scan rates\n");
+        return -1;
+    }
+
+    if (count < 0) {
+        count += epicsThreadGetCPUs();
+        if (count < 1)
+            count = 1;
+    }
+
+    if (!periodicWorkers)
+        periodicWorkers = dbCalloc(pmenu->nChoice - SCAN_1ST_PERIODIC,
+            sizeof(int));
+
+    if (!scan || *scan == 0 || strcmp(scan, "*") == 0) {
+        for (i = SCAN_1ST_PERIODIC; i < pmenu->nChoice; i++)
+            periodicWorkers[i - SCAN_1ST_PERIODIC] = count;
+        return 0;
+    }
+
+    for (i = SCAN_1ST_PERIODIC; i < pmenu->nChoice; i++) {
+        if (epicsStrCaseCmp(scan, pmenu->papChoiceValue[i]) == 0) {
+            periodicWorkers[i - SCAN_1ST_PERIODIC] = count;
+            return 0;
+        }
+    }
+    fprintf(stderr, "scanPeriodicWorkers: Unknown scan rate \"%s\"\n", scan);
+    return -1;
+}
+
 static void ioscanCallback(CALLBACK *pcallback)
 {
     ioscan_head *piosh;
@@ -1038,6 +1341,51 @@ static void scanList(scan_list *psl)
     }
 }
 
+/* Share out the records of a periodic scan list between its workers,
+ * then wait for them all to finish.  A snapshot of the list is taken,
+ * so records which are moved to another scan list while the workers
+ * run are still processed in this pass.
+ */
+static void scanListParallel(periodic_scan_list *ppsl)
+{
+    scan_list *psl = &ppsl->scan_list;
+    scan_element *pse;
+    unsigned count;
+    int w;
+
+    epicsMutexMustLock(psl->lock);
+    count = ellCount(&psl->list);
+    if (count > ppsl->nalloc) {
+        for (w = 0; w < ppsl->nWorkers; w++) {
+            periodic_worker *pw = &ppsl->workers[w];
+
+            free(pw->precords);
+            pw->precords = dbCalloc(count, sizeof(struct dbCommon *));
+        }
+        ppsl->nalloc = count;
+    }
+    for (w = 0; w < ppsl->nWorkers; w++)
+        ppsl->workers[w].nrecords = 0;
+
+    for (pse = (scan_element *)ellFirst(&psl->list); pse;
+         pse = (scan_element *)ellNext(&pse->node)) {
+        periodic_worker *pw = &ppsl->workers[
+            dbLockGetLockId(pse->precord) % ppsl->nWorkers];
+
+        pw->precords[pw->nrecords++] = pse->precord;
+    }
+    psl->modified = FALSE;
+    epicsMutexUnlock(psl->lock);
+
+    for (w = 0; w < ppsl->nWorkers; w++) {
+        periodic_worker *pw = &ppsl->workers[w];
+
+        if (pw->nrecords && epicsJobQueue(pw->job))
+            periodicWorkerJob(pw, epicsJobModeRun);
+    }
+    epicsThreadPoolWait(ppsl->pool, -1.0);
+}
+
 static void buildScanLists(void)
 {
     dbRecordType *pdbRecordType;
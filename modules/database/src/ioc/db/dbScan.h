@@ -61,6 +61,7 @@ epicsShareFunc void post_event(int event);
 epicsShareFunc void scanAdd(struct dbCommon *);
 epicsShareFunc void scanDelete(struct dbCommon *);
 epicsShareFunc double scanPeriod(int scan);
+epicsShareFunc int scanPeriodicWorkers(int count, const char *scan);
 epicsShareFunc int scanOnce(struct dbCommon *);
 epicsShareFunc int scanOnceCallback(struct dbCommon *, once_complete cb, void *usr);
 epicsShareFunc int scanOnceSetQueueSize(int size);
@@ -69,6 +70,20 @@ epicsShareFunc void scanOnceQueueShow(const int reset);
 
 /*print periodic lists*/
 epicsShareFunc int scanppl(double rate);
+epicsShareFunc int scanPeriodicJitterShow(double rate, int reset);
+
+#ifdef EPICS_PRIVATE_API
+/* for tests, totals of a periodic scan list's jitter and latency histograms */
+typedef struct scanPeriodicHistStats {
+    unsigned long passes;
+    unsigned long jitterTotal;
+    unsigned long latencyCount;
+    unsigned long latencyTotal;
+} scanPeriodicHistStats;
+
+epicsShareFunc int scanPeriodicHistStatus(double rate,
+    scanPeriodicHistStats *result);
+#endif
 
 /*print event lists*/
 epicsShareFunc int scanpel(const char *event_name);
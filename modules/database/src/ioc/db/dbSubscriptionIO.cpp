@@ -42,8 +42,10 @@ dbSubscriptionIO::dbSubscriptionIO (
     guard.assertIdenticalMutex ( this->mutex );
     {
         epicsGuardRelease < epicsMutex > unguard ( guard );
+        // DBE_LATEST only concerns the CA server's send queue
         this->es = db_add_event ( ctx, dbch,
-            dbSubscriptionEventCallback, (void *) this, maskIn );
+            dbSubscriptionEventCallback, (void *) this,
+            maskIn & ~DBE_LATEST );
         if ( this->es == 0 ) {
             throw std::bad_alloc();
         }
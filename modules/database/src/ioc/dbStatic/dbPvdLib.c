@@ -9,6 +9,25 @@
 
 /* dbPvdLib.c */
 
+/*
+ * The Process Variable Directory is an open addressing hash table of
+ * PVDENTRY pointers with linear probing.  dbPvdFind() takes no lock, so
+ * name lookups from many threads (CA server searches in particular) do
+ * not contend with each other.  Additions and deletions are serialized
+ * by a mutex and each slot is published with a write barrier after the
+ * entry it points to is complete.
+ *
+ * Deleted slots hold a tombstone.  When live and deleted slots fill half
+ * of the table it is rebuilt, at twice the size if necessary, and the new
+ * table replaces the old one in a single pointer store.  A lookup may
+ * still be walking an old table or holding a deleted entry, so these are
+ * kept until dbPvdFreeMem().
+ *
+ * Every change increments a generation counter, which lets caches of the
+ * names in the directory (the CA server's search filter) notice that they
+ * are out of date without taking the lock.
+ */
+
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -16,6 +35,7 @@
 
 #include "dbDefs.h"
 #include "ellLib.h"
+#include "epicsAtomic.h"
 #include "epicsMutex.h"
 #include "epicsStdio.h"
 #include "epicsString.h"
@@ -25,22 +45,31 @@
 #include "dbStaticLib.h"
 #include "dbStaticPvt.h"
 
-typedef struct {
-    ELLLIST      list;
-    epicsMutexId lock;
-} dbPvdBucket;
+typedef struct dbPvdTable {
+    ELLNODE         node;       /* on dbPvd.retiredTables once replaced */
+    unsigned int    size;
+    unsigned int    mask;
+    EpicsAtomicPtrT *slots;     /* PVDENTRY *, tombstone or NULL */
+} dbPvdTable;
 
 typedef struct dbPvd {
-    unsigned int size;
-    unsigned int mask;
-    dbPvdBucket **buckets;
+    dbPvdTable      *table;
+    unsigned int    count;      /* live entries */
+    unsigned int    deleted;    /* tombstone slots */
+    unsigned int    rebuilds;
+    int             generation; /* changes, read without the lock */
+    epicsMutexId    lock;       /* serializes changes */
+    ELLLIST         retiredTables;
+    ELLLIST         retiredEntries;
 } dbPvd;
 
 unsigned int dbPvdHashTableSize = 0;
 
 #define MIN_SIZE 256
 #define DEFAULT_SIZE 512
-#define MAX_SIZE 65536
+
+static PVDENTRY tombstone;
+#define DELETED ((void *) &tombstone)
 
 
 int dbPvdTableSize(int size)
@@ -53,13 +82,31 @@ int dbPvdTableSize(int size)
     if (size < MIN_SIZE)
         size = MIN_SIZE;
 
-    if (size > MAX_SIZE)
-        size = MAX_SIZE;
-
     dbPvdHashTableSize = size;
     return 0;
 }
 
+static dbPvdTable *tableCreate(unsigned int size)
+{
+    dbPvdTable *ptab = dbCalloc(1, sizeof(dbPvdTable));
+
+    ptab->size  = size;
+    ptab->mask  = size - 1;
+    ptab->slots = dbCalloc(size, sizeof(EpicsAtomicPtrT));
+    return ptab;
+}
+
+static void tableFree(dbPvdTable *ptab)
+{
+    free(ptab->slots);
+    free(ptab);
+}
+
+static dbPvdTable *tableGet(dbPvd *ppvd)
+{
+    return (dbPvdTable *) epicsAtomicGetPtrT((EpicsAtomicPtrT *) &ppvd->table);
+}
+
 void dbPvdInitPvt(dbBase *pdbbase)
 {
     dbPvd *ppvd;
@@ -70,10 +117,11 @@ void dbPvdInitPvt(dbBase *pdbbase)
         dbPvdHashTableSize = DEFAULT_SIZE;
     }
 
-    ppvd = (dbPvd *)dbMalloc(sizeof(dbPvd));
-    ppvd->size    = dbPvdHashTableSize;
-    ppvd->mask    = dbPvdHashTableSize - 1;
-    ppvd->buckets = dbCalloc(ppvd->size, sizeof(dbPvdBucket *));
+    ppvd = dbCalloc(1, sizeof(dbPvd));
+    ppvd->table = tableCreate(dbPvdHashTableSize);
+    ppvd->lock  = epicsMutexMustCreate();
+    ellInit(&ppvd->retiredTables);
+    ellInit(&ppvd->retiredEntries);
 
     pdbbase->ppvd = ppvd;
     return;
@@ -82,118 +130,211 @@ void dbPvdInitPvt(dbBase *pdbbase)
 PVDENTRY *dbPvdFind(dbBase *pdbbase, const char *name, size_t lenName)
 {
     dbPvd *ppvd = pdbbase->ppvd;
-    dbPvdBucket *pbucket;
+    dbPvdTable *ptab = tableGet(ppvd);
+    unsigned int hash = epicsMemHash(name, lenName, 0);
+    unsigned int h = hash & ptab->mask;
     PVDENTRY *ppvdNode;
-    
-    pbucket = ppvd->buckets[epicsMemHash(name, lenName, 0) & ppvd->mask];
-    if (pbucket == NULL) return NULL;
 
-    epicsMutexMustLock(pbucket->lock);
-    ppvdNode = (PVDENTRY *) ellFirst(&pbucket->list);
-    while (ppvdNode) {
-        const char *recordname = ppvdNode->precnode->recordname;
+    while ((ppvdNode = epicsAtomicGetPtrT(&ptab->slots[h]))) {
+        if (ppvdNode != DELETED && ppvdNode->hash == hash) {
+            const char *recordname = ppvdNode->precnode->recordname;
 
-        if (strncmp(name, recordname, lenName) == 0 &&
-            strlen(recordname) == lenName)
-            break;
-        ppvdNode = (PVDENTRY *) ellNext((ELLNODE *)ppvdNode);
+            if (strncmp(name, recordname, lenName) == 0 &&
+                recordname[lenName] == '\0')
+                return ppvdNode;
+        }
+        h = (h + 1) & ptab->mask;
     }
-    epicsMutexUnlock(pbucket->lock);
-    return ppvdNode;
+    return NULL;
 }
-
+
+/* Replace the table with one holding only live entries.
+ * Caller holds ppvd->lock.
+ */
+static dbPvdTable *tableRebuild(dbPvd *ppvd, dbPvdTable *pold)
+{
+    unsigned int size = pold->size;
+    dbPvdTable *pnew;
+    unsigned int i;
+
+    /* leave the new table at most a quarter full */
+    while ((ppvd->count + 1) * 4 > size)
+        size *= 2;
+    pnew = tableCreate(size);
+
+    for (i = 0; i < pold->size; i++) {
+        PVDENTRY *ppvdNode = pold->slots[i];
+        unsigned int h;
+
+        if (!ppvdNode || ppvdNode == DELETED) continue;
+        h = ppvdNode->hash & pnew->mask;
+        while (pnew->slots[h])
+            h = (h + 1) & pnew->mask;
+        pnew->slots[h] = ppvdNode;
+    }
+
+    epicsAtomicWriteMemoryBarrier();
+    epicsAtomicSetPtrT((EpicsAtomicPtrT *) &ppvd->table, pnew);
+    ellAdd(&ppvd->retiredTables, &pold->node);
+    ppvd->deleted = 0;
+    ppvd->rebuilds++;
+    return pnew;
+}
+
 PVDENTRY *dbPvdAdd(dbBase *pdbbase, dbRecordType *precordType,
     dbRecordNode *precnode)
 {
     dbPvd *ppvd = pdbbase->ppvd;
-    dbPvdBucket *pbucket;
+    dbPvdTable *ptab;
     PVDENTRY *ppvdNode;
     char *name = precnode->recordname;
-    unsigned int h;
-
-    h = epicsStrHash(name, 0) & ppvd->mask;
-    pbucket = ppvd->buckets[h];
-    if (pbucket == NULL) {
-        pbucket = dbCalloc(1, sizeof(dbPvdBucket));
-        ellInit(&pbucket->list);
-        pbucket->lock = epicsMutexCreate();
-        ppvd->buckets[h] = pbucket;
-    }
-
-    epicsMutexMustLock(pbucket->lock);
-    ppvdNode = (PVDENTRY *) ellFirst(&pbucket->list);
-    while (ppvdNode) {
-        if (strcmp(name, ppvdNode->precnode->recordname) == 0) {
-            epicsMutexUnlock(pbucket->lock);
+    unsigned int hash = epicsStrHash(name, 0);
+    unsigned int h, insert = 0;
+    int reuse = 0;
+
+    epicsMutexMustLock(ppvd->lock);
+    ptab = ppvd->table;
+    h = hash & ptab->mask;
+    while ((ppvdNode = ptab->slots[h])) {
+        if (ppvdNode == DELETED) {
+            if (!reuse) {
+                insert = h;
+                reuse = 1;
+            }
+        }
+        else if (ppvdNode->hash == hash &&
+            strcmp(name, ppvdNode->precnode->recordname) == 0) {
+            epicsMutexUnlock(ppvd->lock);
             return NULL;
         }
-        ppvdNode = (PVDENTRY *) ellNext((ELLNODE *)ppvdNode);
+        h = (h + 1) & ptab->mask;
+    }
+
+    if (reuse) {
+        ppvd->deleted--;
+    }
+    else if ((ppvd->count + ppvd->deleted + 1) * 2 > ptab->size) {
+        ptab = tableRebuild(ppvd, ptab);
+        insert = hash & ptab->mask;
+        while (ptab->slots[insert])
+            insert = (insert + 1) & ptab->mask;
     }
+    else {
+        insert = h;
+    }
+
     ppvdNode = dbCalloc(1, sizeof(PVDENTRY));
     ppvdNode->precordType = precordType;
     ppvdNode->precnode = precnode;
-    ellAdd(&pbucket->list, (ELLNODE *)ppvdNode);
-    epicsMutexUnlock(pbucket->lock);
+    ppvdNode->hash = hash;
+    epicsAtomicWriteMemoryBarrier();
+    epicsAtomicSetPtrT(&ptab->slots[insert], ppvdNode);
+    ppvd->count++;
+    epicsAtomicIncrIntT(&ppvd->generation);
+    epicsMutexUnlock(ppvd->lock);
     return ppvdNode;
 }
 
 void dbPvdDelete(dbBase *pdbbase, dbRecordNode *precnode)
 {
     dbPvd *ppvd = pdbbase->ppvd;
-    dbPvdBucket *pbucket;
+    dbPvdTable *ptab;
     PVDENTRY *ppvdNode;
     char *name = precnode->recordname;
+    unsigned int hash = epicsStrHash(name, 0);
+    unsigned int h;
 
-    pbucket = ppvd->buckets[epicsStrHash(name, 0) & ppvd->mask];
-    if (pbucket == NULL) return;
-
-    epicsMutexMustLock(pbucket->lock);
-    ppvdNode = (PVDENTRY *) ellFirst(&pbucket->list);
-    while (ppvdNode) {
-        if (ppvdNode->precnode &&
+    epicsMutexMustLock(ppvd->lock);
+    ptab = ppvd->table;
+    h = hash & ptab->mask;
+    while ((ppvdNode = ptab->slots[h])) {
+        if (ppvdNode != DELETED &&
+            ppvdNode->hash == hash &&
+            ppvdNode->precnode &&
             ppvdNode->precnode->recordname &&
             strcmp(name, ppvdNode->precnode->recordname) == 0) {
-            ellDelete(&pbucket->list, (ELLNODE *)ppvdNode);
-            free(ppvdNode);
+            epicsAtomicSetPtrT(&ptab->slots[h], DELETED);
+            ellAdd(&ppvd->retiredEntries, &ppvdNode->node);
+            ppvd->count--;
+            ppvd->deleted++;
+            epicsAtomicIncrIntT(&ppvd->generation);
             break;
         }
-        ppvdNode = (PVDENTRY *) ellNext((ELLNODE *)ppvdNode);
+        h = (h + 1) & ptab->mask;
     }
-    epicsMutexUnlock(pbucket->lock);
+    epicsMutexUnlock(ppvd->lock);
     return;
 }
 
+unsigned int dbPvdGeneration(dbBase *pdbbase)
+{
+    dbPvd *ppvd = pdbbase->ppvd;
+
+    return ppvd ? (unsigned int) epicsAtomicGetIntT(&ppvd->generation) : 0;
+}
+
+unsigned int dbPvdCount(dbBase *pdbbase)
+{
+    dbPvd *ppvd = pdbbase->ppvd;
+
+    return ppvd ? ppvd->count : 0;
+}
+
+unsigned int dbPvdTraverse(dbBase *pdbbase, dbPvdTraverseFunc func,
+    void *arg)
+{
+    dbPvd *ppvd = pdbbase->ppvd;
+    dbPvdTable *ptab;
+    unsigned int generation, h;
+
+    if (ppvd == NULL) return 0;
+
+    epicsMutexMustLock(ppvd->lock);
+    ptab = ppvd->table;
+    for (h = 0; h < ptab->size; h++) {
+        PVDENTRY *ppvdNode = ptab->slots[h];
+
+        if (ppvdNode && ppvdNode != DELETED)
+            func(arg, ppvdNode);
+    }
+    generation = (unsigned int) ppvd->generation;
+    epicsMutexUnlock(ppvd->lock);
+    return generation;
+}
+
 void dbPvdFreeMem(dbBase *pdbbase)
 {
     dbPvd *ppvd = pdbbase->ppvd;
+    dbPvdTable *ptab;
     unsigned int h;
 
     if (ppvd == NULL) return;
     pdbbase->ppvd = NULL;
 
-    for (h = 0; h < ppvd->size; h++) {
-        dbPvdBucket *pbucket = ppvd->buckets[h];
-        PVDENTRY *ppvdNode;
+    ptab = ppvd->table;
+    for (h = 0; h < ptab->size; h++) {
+        PVDENTRY *ppvdNode = ptab->slots[h];
 
-        if (pbucket == NULL) continue;
-        epicsMutexMustLock(pbucket->lock);
-        ppvd->buckets[h] = NULL;
-        while ((ppvdNode = (PVDENTRY *) ellFirst(&pbucket->list))) {
-            ellDelete(&pbucket->list, (ELLNODE *)ppvdNode);
+        if (ppvdNode && ppvdNode != DELETED)
             free(ppvdNode);
-        }
-        epicsMutexUnlock(pbucket->lock);
-        epicsMutexDestroy(pbucket->lock);
-        free(pbucket);
     }
-    free(ppvd->buckets);
+    tableFree(ptab);
+
+    while ((ptab = (dbPvdTable *) ellGet(&ppvd->retiredTables)))
+        tableFree(ptab);
+    ellFree(&ppvd->retiredEntries);
+
+    epicsMutexDestroy(ppvd->lock);
     free(ppvd);
 }
 
 void dbPvdDump(dbBase *pdbbase, int verbose)
 {
-    unsigned int empty = 0;
+    unsigned int empty = 0, deleted = 0, records = 0;
+    unsigned int probeMax = 0;
+    double probeSum = 0;
     dbPvd *ppvd;
+    dbPvdTable *ptab;
     unsigned int h;
 
     if (!pdbbase) {
@@ -203,27 +344,35 @@ void dbPvdDump(dbBase *pdbbase, int verbose)
     ppvd = pdbbase->ppvd;
     if (ppvd == NULL) return;
 
-    printf("Process Variable Directory has %u buckets", ppvd->size);
+    epicsMutexMustLock(ppvd->lock);
+    ptab = ppvd->table;
+    printf("Process Variable Directory has %u slots", ptab->size);
 
-    for (h = 0; h < ppvd->size; h++) {
-        dbPvdBucket *pbucket = ppvd->buckets[h];
-        PVDENTRY *ppvdNode;
-        int i = 1;
+    for (h = 0; h < ptab->size; h++) {
+        PVDENTRY *ppvdNode = ptab->slots[h];
+        unsigned int probe;
 
-        if (pbucket == NULL) {
+        if (ppvdNode == NULL) {
             empty++;
             continue;
         }
-        epicsMutexMustLock(pbucket->lock);
-        ppvdNode = (PVDENTRY *) ellFirst(&pbucket->list);
-        printf("\n [%4u] %4d  ", h, ellCount(&pbucket->list));
-        while (ppvdNode && verbose) {
-            if (!(++i % 4))
-                printf("\n         ");
-            printf("  %s", ppvdNode->precnode->recordname);
-            ppvdNode = (PVDENTRY *) ellNext((ELLNODE*)ppvdNode);
+        if (ppvdNode == DELETED) {
+            deleted++;
+            continue;
         }
-        epicsMutexUnlock(pbucket->lock);
+        records++;
+        probe = (h - ppvdNode->hash) & ptab->mask;
+        probeSum += probe;
+        if (probe > probeMax)
+            probeMax = probe;
+        if (verbose)
+            printf("\n [%4u] %3u  %s", h, probe,
+                ppvdNode->precnode->recordname);
     }
-    printf("\n%u buckets empty.\n", empty);
+    printf("\n%u records, %u slots empty, %u deleted, %u rebuilds.\n",
+        records, empty, deleted, ppvd->rebuilds);
+    if (records)
+        printf("Probe distance average %.2f, maximum %u.\n",
+            probeSum / records, probeMax);
+    epicsMutexUnlock(ppvd->lock);
 }
@@ -96,6 +96,7 @@ typedef struct{
 	ELLNODE		node;
 	dbRecordType	*precordType;
 	dbRecordNode	*precnode;
+	unsigned int	hash;
 }PVDENTRY;
 epicsShareFunc int dbPvdTableSize(int size);
 extern int dbStaticDebug;
@@ -104,6 +105,13 @@ PVDENTRY *dbPvdFind(DBBASE *pdbbase,const char *name,size_t lenname);
 PVDENTRY *dbPvdAdd(DBBASE *pdbbase,dbRecordType *precordType,dbRecordNode *precnode);
 void dbPvdDelete(DBBASE *pdbbase,dbRecordNode *precnode);
 void dbPvdFreeMem(DBBASE *pdbbase);
+/* Count of the changes to the directory */
+unsigned int dbPvdGeneration(DBBASE *pdbbase);
+unsigned int dbPvdCount(DBBASE *pdbbase);
+/* Calls func for every entry while holding the directory lock,
+ * returns the generation of the entries passed */
+typedef void dbPvdTraverseFunc(void *arg, const PVDENTRY *ppvdNode);
+unsigned int dbPvdTraverse(DBBASE *pdbbase, dbPvdTraverseFunc func, void *arg);
 
 #ifdef __cplusplus
 }
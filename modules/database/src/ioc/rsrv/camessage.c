@@ -34,7 +34,9 @@
 #include "osiPoolStatus.h"
 #include "osiSock.h"
 
+#include "caSharedRing.h"
 #include "caerr.h"
+#include "caeventmask.h"
 #include "net_convert.h"
 
 #define epicsExportSharedSymbols
@@ -129,6 +131,36 @@ static struct channel_in_use *MPTOPCIU (const caHdrLargeArray *mp)
     return pciu;
 }
 
+/*
+ * request_channel()
+ *
+ * MPTOPCIU() for the request handlers, which also counts
+ * the request in the traffic of its channel
+ */
+static struct channel_in_use *request_channel (const caHdrLargeArray *mp,
+    struct client *client)
+{
+    struct channel_in_use *pciu = MPTOPCIU ( mp );
+
+    if ( pciu && pciu->client == client ) {
+        pciu->traffic.msgsIn++;
+        pciu->traffic.bytesIn += sizeof ( caHdr ) + mp->m_postsize;
+        switch ( mp->m_cmmd ) {
+        case CA_PROTO_READ:
+        case CA_PROTO_READ_NOTIFY:
+            pciu->traffic.gets++;
+            client->traffic.gets++;
+            break;
+        case CA_PROTO_WRITE:
+        case CA_PROTO_WRITE_NOTIFY:
+            pciu->traffic.puts++;
+            client->traffic.puts++;
+            break;
+        }
+    }
+    return pciu;
+}
+
 /*  vsend_err()
  *
  *  reflect error msg back to the client
@@ -368,6 +400,9 @@ static int tcp_version_action ( caHdrLargeArray *mp, void *pPayload,
         return RSRV_ERROR;
     }
 
+    client->compress = CA_V414 ( mp->m_count ) &&
+        ( mp->m_cid & CA_PROTO_VERSION_COMPRESS );
+
     if ( mp->m_dataType > CA_PROTO_PRIORITY_MAX ) {
         return RSRV_ERROR;
     }
@@ -378,7 +413,20 @@ static int tcp_version_action ( caHdrLargeArray *mp, void *pPayload,
     tmp += epicsThreadPriorityCAServerLow;
     epicsPriorityNew = (unsigned) tmp;
     epicsPrioritySelf = epicsThreadGetPrioritySelf();
-    if ( epicsPriorityNew != epicsPrioritySelf ) {
+    if ( client->ioLoop ) {
+        /* the I/O thread is shared, only the event task changes */
+        epicsThreadBooleanStatus tbs;
+        unsigned priorityOfEvents;
+        tbs  = epicsThreadHighestPriorityLevelBelow ( epicsPriorityNew, &priorityOfEvents );
+        if ( tbs != epicsThreadBooleanStatusSuccess ) {
+            priorityOfEvents = epicsPriorityNew;
+        }
+        if ( client->priority != mp->m_dataType ) {
+            db_event_change_priority ( client->evuser, priorityOfEvents );
+            client->priority = mp->m_dataType;
+        }
+    }
+    else if ( epicsPriorityNew != epicsPrioritySelf ) {
         epicsThreadBooleanStatus tbs;
         unsigned priorityOfEvents;
         tbs  = epicsThreadHighestPriorityLevelBelow ( epicsPriorityNew, &priorityOfEvents );
@@ -419,6 +467,45 @@ static int tcp_echo_action ( caHdrLargeArray *mp,
     return RSRV_OK;
 }
 
+/*
+ * shared_mem_action ()
+ *
+ * attach the payload ring of a client on this host (CA V4.15)
+ */
+static int shared_mem_action ( caHdrLargeArray *mp,
+                       void *pPayload, struct client *pClient )
+{
+    caSharedRing *pRing = NULL;
+    char *pName = (char *) pPayload;
+    int status;
+
+    if ( casSharedMemMinBytes > 0 && ! pClient->pSharedRing &&
+            epicsStrnLen ( pName, mp->m_postsize ) < mp->m_postsize ) {
+        ca_uint32_t cookie[2];
+
+        cookie[0] = mp->m_cid;
+        cookie[1] = mp->m_available;
+        pRing = malloc ( sizeof ( *pRing ) );
+        if ( pRing && caSharedRingAttach ( pRing, pName, cookie ) ) {
+            free ( pRing );
+            pRing = NULL;
+        }
+    }
+
+    SEND_LOCK ( pClient );
+    if ( pRing ) {
+        pClient->pSharedRing = pRing;
+    }
+    status = cas_copy_in_header ( pClient, CA_PROTO_SHARED_MEM, 0u,
+        0u, 0u, mp->m_cid, pRing ? CA_PROTO_SHARED_MEM_ATTACHED : 0u, NULL );
+    if ( status == ECA_NORMAL ) {
+        cas_commit_msg ( pClient, 0u );
+    }
+    SEND_UNLOCK ( pClient );
+
+    return RSRV_OK;
+}
+
 /*
  * events_on_action ()
  */
@@ -470,7 +557,7 @@ static void no_read_access_event ( struct client *pClient,
         pevext->msg.m_available, ( void * ) &pPayloadOut );
     if ( status == ECA_NORMAL ) {
         memset ( pPayloadOut, 0, pevext->size );
-        cas_commit_msg ( pClient, pevext->size );
+        cas_commit_chan_msg ( pClient, pevext->pciu, pevext->size );
     }
     else {
         send_err ( &pevext->msg, status, pClient,
@@ -566,7 +653,7 @@ static void read_reply ( void *pArg, struct dbChannel *dbch,
         }
         memset ( pPayload, 0, payload_size );
         cas_set_header_cid ( pClient, ECA_GETFAIL );
-        cas_commit_msg ( pClient, payload_size );
+        cas_commit_chan_msg ( pClient, pciu, payload_size );
     }
     else {
         int cacStatus = caNetConvert (
@@ -582,6 +669,9 @@ static void read_reply ( void *pArg, struct dbChannel *dbch,
             else if (payload_size > data_size)
                 memset(
                     (char *) pPayload + data_size, 0, payload_size - data_size);
+            payload_size = cas_compress_msg ( pClient,
+                pevext->msg.m_dataType, pPayload, payload_size );
+            payload_size = cas_share_msg ( pClient, pPayload, payload_size );
         }
         else {
             if (autosize) {
@@ -591,7 +681,12 @@ static void read_reply ( void *pArg, struct dbChannel *dbch,
             memset ( pPayload, 0, payload_size );
             cas_set_header_cid ( pClient, cacStatus );
         }
-        cas_commit_msg ( pClient, payload_size );
+        cas_commit_chan_msg ( pClient, pciu, payload_size );
+    }
+
+    if ( pevext->msg.m_cmmd == CA_PROTO_EVENT_ADD ) {
+        pciu->traffic.updates++;
+        pClient->traffic.updates++;
     }
 
     /*
@@ -611,7 +706,7 @@ static void read_reply ( void *pArg, struct dbChannel *dbch,
  */
 static int read_action ( caHdrLargeArray *mp, void *pPayloadIn, struct client *pClient )
 {
-    struct channel_in_use *pciu = MPTOPCIU ( mp );
+    struct channel_in_use *pciu = request_channel ( mp, pClient );
     int readAccess;
     ca_uint32_t payloadSize;
     void *pPayload;
@@ -703,7 +798,7 @@ static int read_action ( caHdrLargeArray *mp, void *pPayloadIn, struct client *p
                 pStr );
         }
     }
-    cas_commit_msg ( pClient, payloadSize );
+    cas_commit_chan_msg ( pClient, pciu, payloadSize );
 
     SEND_UNLOCK ( pClient );
 
@@ -722,7 +817,7 @@ static int read_notify_action ( caHdrLargeArray *mp, void *pPayload, struct clie
         return RSRV_ERROR;
     }
 
-    pciu = MPTOPCIU ( mp );
+    pciu = request_channel ( mp, client );
     if ( !pciu ) {
         logBadId ( client, mp, pPayload );
         return RSRV_ERROR;
@@ -758,7 +853,7 @@ static int write_action ( caHdrLargeArray *mp,
     long                    dbStatus;
     void                    *asWritePvt;
 
-    pciu = MPTOPCIU(mp);
+    pciu = request_channel ( mp, client );
     if(!pciu){
         logBadId(client, mp, pPayload);
         return RSRV_ERROR;
@@ -1494,6 +1589,72 @@ void rsrv_extra_labor ( void * pArg )
     cas_send_bs_msg ( pClient, TRUE );
 }
 
+/*
+ * rsrv_event_batch()
+ * (called by the CA server event task with all of the subscription
+ * updates it took off the event queue at once)
+ *
+ * Encodes the whole batch into the send buffer while holding the
+ * send lock, which read_reply() then takes recursively.  Of the
+ * updates of a DBE_LATEST subscription only the last one in the
+ * batch is sent, as the others would be superseded before the
+ * client sees them.
+ *
+ * A subscription canceled by the TCP thread while the batch is being
+ * sent is skipped.  Its event_ext is not freed until db_cancel_event()
+ * returns, which waits for the whole batch to be delivered.
+ */
+void rsrv_event_batch ( void *pArg, unsigned nEntries,
+    const dbEventBatchEntry *pEntries, int eventsRemaining )
+{
+    struct client * pClient = pArg;
+    unsigned seq = ++pClient->eventBatchSeq;
+    int coalesce = FALSE;
+    unsigned i;
+
+    /*
+     * Find the last update in this batch of each DBE_LATEST subscription.
+     * The last entry of the batch is always sent, so eventsRemaining
+     * needs no adjustment for the entries skipped below.
+     */
+    for ( i = nEntries; i-- > 0u; ) {
+        struct event_ext *pevext = pEntries[i].user_arg;
+
+        if ( pEntries[i].user_sub != read_reply || ! pevext->latest )
+            continue;
+        if ( pevext->batchSeq != seq ) {
+            pevext->batchSeq = seq;
+            pevext->batchLast = i;
+        }
+        else {
+            coalesce = TRUE;
+        }
+    }
+
+    SEND_LOCK ( pClient );
+    for ( i = 0u; i < nEntries; i++ ) {
+        if ( pEntries[i].user_sub == read_reply ) {
+            struct event_ext *pevext = pEntries[i].user_arg;
+            int canceled;
+
+            epicsMutexMustLock ( pClient->eventqLock );
+            canceled = pevext->canceled;
+            epicsMutexUnlock ( pClient->eventqLock );
+            if ( canceled ) {
+                continue;
+            }
+            if ( coalesce && pevext->latest && pevext->batchLast != i ) {
+                pevext->pciu->traffic.coalesced++;
+                pClient->traffic.coalesced++;
+                continue;
+            }
+        }
+        ( *pEntries[i].user_sub ) ( pEntries[i].user_arg, pEntries[i].chan,
+            i + 1u < nEntries || eventsRemaining, pEntries[i].pfl );
+    }
+    SEND_UNLOCK ( pClient );
+}
+
 /*
  * putNotifyErrorReply
  */
@@ -1656,7 +1817,7 @@ static int write_notify_action ( caHdrLargeArray *mp, void *pPayload,
     int status;
     struct channel_in_use *pciu;
 
-    pciu = MPTOPCIU(mp);
+    pciu = request_channel ( mp, client );
     if(!pciu){
         logBadId ( client, mp, pPayload );
         return RSRV_ERROR;
@@ -1788,12 +1949,26 @@ static int event_add_action (caHdrLargeArray *mp, void *pPayload, struct client
         return RSRV_ERROR;
     }
 
-    pciu = MPTOPCIU ( mp );
+    pciu = request_channel ( mp, client );
     if ( ! pciu ) {
         logBadId ( client, mp, pPayload );
         return RSRV_ERROR;
     }
 
+    /*
+     * DBE_LATEST alone selects no events at all
+     */
+    if ( ntohs ( pmi->m_mask ) == DBE_LATEST ) {
+        SEND_LOCK(client);
+        send_err(
+            mp,
+            ECA_BADMASK,
+            client,
+            RECORD_NAME(pciu->dbch));
+        SEND_UNLOCK(client);
+        return RSRV_OK;
+    }
+
     /*
      * stop further use of server if memory becomes scarce
      */
@@ -1822,6 +1997,8 @@ static int event_add_action (caHdrLargeArray *mp, void *pPayload, struct client
     pevext->pciu = pciu;
     pevext->size = dbr_size_n(mp->m_dataType, mp->m_count);
     pevext->mask = ntohs ( pmi->m_mask );
+    pevext->latest = ( pevext->mask & DBE_LATEST ) != 0;
+    pevext->mask &= ~DBE_LATEST;
 
     epicsMutexMustLock(client->eventqLock);
     ellAdd( &pciu->eventq, &pevext->node);
@@ -1898,7 +2075,7 @@ static int clear_channel_reply ( caHdrLargeArray *mp,
       * Verify the channel
       *
       */
-     pciu = MPTOPCIU(mp);
+     pciu = request_channel ( mp, client );
      if(pciu?pciu->client!=client:TRUE){
          logBadId ( client, mp, pPayload );
          return RSRV_ERROR;
@@ -1909,6 +2086,12 @@ static int clear_channel_reply ( caHdrLargeArray *mp,
      while (TRUE){
          epicsMutexMustLock(client->eventqLock);
          pevext = (struct event_ext *) ellGet(&pciu->eventq);
+         if (pevext) {
+             pevext->canceled = TRUE;
+         }
+         if (pevext && pevext->pdbev) {
+             client->traffic.squashed += db_event_replaced (pevext->pdbev);
+         }
          epicsMutexUnlock(client->eventqLock);
 
          if(!pevext){
@@ -2007,7 +2190,7 @@ static int event_cancel_reply ( caHdrLargeArray *mp, void *pPayload, struct clie
       * Verify the channel
       *
       */
-     pciu = MPTOPCIU(mp);
+     pciu = request_channel ( mp, client );
      if (pciu?pciu->client!=client:TRUE) {
          logBadId ( client, mp, pPayload );
          return RSRV_ERROR;
@@ -2023,6 +2206,12 @@ static int event_cancel_reply ( caHdrLargeArray *mp, void *pPayload, struct clie
 
          if (pevext->msg.m_available == mp->m_available) {
              ellDelete(&pciu->eventq, &pevext->node);
+             pevext->canceled = TRUE;
+             if (pevext->pdbev) {
+                 unsigned long n = db_event_replaced (pevext->pdbev);
+                 pciu->traffic.squashed += n;
+                 client->traffic.squashed += n;
+             }
              break;
          }
      }
@@ -2166,6 +2355,8 @@ static int search_reply_udp ( caHdrLargeArray *mp, void *pPayload, struct client
     size_t          spaceNeeded;
     size_t          reasonableMonitorSpace = 10;
 
+    client->searches.total++;
+
     if (!CA_VSUPPORTED(mp->m_count)) {
         DLOG ( 2, ( "CAS: Ignore search from unsupported client %u\n", mp->m_count ) );
         return RSRV_ERROR;
@@ -2182,7 +2373,7 @@ static int search_reply_udp ( caHdrLargeArray *mp, void *pPayload, struct client
     pName[mp->m_postsize-1] = '\0';
 
     /* Exit quickly if channel not on this node */
-    if (dbChannelTest(pName)) {
+    if (casSearchTest(pName)) {
         DLOG ( 2, ( "CAS: Lookup for channel \"%s\" failed\n", pPayLoad ) );
         return RSRV_OK;
     }
@@ -2269,7 +2460,7 @@ static int search_reply_tcp (
     pName[mp->m_postsize-1] = '\0';
 
     /* Exit quickly if channel not on this node */
-    if (dbChannelTest(pName)) {
+    if (casSearchTest(pName)) {
         DLOG ( 2, ( "CAS: Lookup for channel \"%s\" failed\n", pPayLoad ) );
         if (mp->m_dataType == DOREPLY)
             search_fail_reply ( mp, pPayload, client );
@@ -2338,7 +2529,8 @@ static const pProtoStubTCP tcpJumpTable[] =
     bad_tcp_cmd_action,
     bad_tcp_cmd_action,
     bad_tcp_cmd_action,
-    bad_tcp_cmd_action
+    bad_tcp_cmd_action,
+    shared_mem_action
 };
 
 /*
@@ -2516,6 +2708,8 @@ int camessage ( struct client *client )
         }
 
         nmsg++;
+        client->traffic.msgsIn++;
+        client->traffic.bytesIn += msgsize;
 
         if ( CASDEBUG > 2 )
             log_header (NULL, client, &msg, pBody, nmsg);
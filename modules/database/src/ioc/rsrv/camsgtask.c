@@ -20,13 +20,25 @@
 #include <string.h>
 #include <errno.h>
 
+#include "cantProceed.h"
 #include "dbDefs.h"
+#include "epicsExit.h"
+#include "epicsSignal.h"
 #include "epicsStdio.h"
 #include "epicsTime.h"
+#include "epicsTimer.h"
 #include "errlog.h"
 #include "osiSock.h"
 #include "taskwd.h"
 
+#ifdef __linux__
+#  include <poll.h>
+#  include <unistd.h>
+#  include <sys/epoll.h>
+#  include <sys/eventfd.h>
+#  define RSRV_HAVE_EPOLL
+#endif
+
 #include "caerr.h"
 
 #define epicsExportSharedSymbols
@@ -34,6 +46,150 @@
 #include "rsrv.h"
 #include "server.h"
 
+/*
+ *  camsgFlushIdle()
+ *
+ *  send queued replies unless more requests are already waiting,
+ *  to allow messages to batch up
+ */
+static void camsgFlushIdle ( struct client *client )
+{
+    osiSockIoctl_t check_nchars;
+    int status;
+
+    status = socket_ioctl (client->sock, FIONREAD, &check_nchars);
+    if (status < 0) {
+        char sockErrBuf[64];
+
+        epicsSocketConvertErrnoToString ( 
+            sockErrBuf, sizeof ( sockErrBuf ) );
+        errlogPrintf("CAS: FIONREAD error: %s\n",
+            sockErrBuf);
+        cas_send_bs_msg(client, TRUE);
+    }
+    else if (check_nchars == 0){
+        cas_send_bs_msg(client, TRUE);
+    }
+}
+
+/*
+ *  camsgReceive()
+ *
+ *  receive and process what the client has sent, returns
+ *  negative when the client must be disconnected, or positive
+ *  when out of network buffers and the receive must be retried
+ *  after client::recvRetryDelay
+ */
+static int camsgReceive ( struct client *client )
+{
+    long nchars;
+    int status;
+
+    client->recv.stk = 0;
+    assert ( client->recv.maxstk >= client->recv.cnt );
+    nchars = recv ( client->sock, &client->recv.buf[client->recv.cnt], 
+            (int) ( client->recv.maxstk - client->recv.cnt ), 0 );
+    if ( nchars == 0 ){
+        if ( CASDEBUG > 0 ) {
+            /* convert to u long so that %lu works on both 32 and 64 bit archs */
+            unsigned long cnt = sizeof ( client->recv.buf ) - client->recv.cnt;
+            errlogPrintf ( "CAS: nill message disconnect ( %lu bytes request )\n",
+                cnt );
+        }
+        return -1;
+    }
+    else if ( nchars < 0 ) {
+        int anerrno = SOCKERRNO;
+
+        /* the sockets of I/O thread clients don't block */
+        if ( anerrno == SOCK_EINTR || anerrno == SOCK_EWOULDBLOCK ) {
+            return 0;
+        }
+
+        if ( anerrno == SOCK_ENOBUFS ) {
+            /* usually brief, back off up to the former fixed delay */
+            if ( client->recvRetryDelay == 0.0 ) {
+                errlogPrintf (
+                    "CAS: Out of network buffers, retrying receive\n" );
+                client->recvRetryDelay = 0.01;
+            }
+            else if ( client->recvRetryDelay < 15.0 ) {
+                client->recvRetryDelay *= 2.0;
+            }
+            return 1;
+        }
+
+        /*
+         * normal conn lost conditions
+         */
+        if (    ( anerrno != SOCK_ECONNABORTED &&
+            anerrno != SOCK_ECONNRESET &&
+            anerrno != SOCK_ETIMEDOUT ) ||
+            CASDEBUG > 2 ) {
+            char sockErrBuf[64];
+
+            epicsSocketConvertErrorToString(
+                sockErrBuf, sizeof ( sockErrBuf ), anerrno);
+            errlogPrintf ( "CAS: Client disconnected - %s\n",
+                sockErrBuf );
+        }
+        return -1;
+    }
+
+    epicsTimeGetCurrent ( &client->time_at_last_recv );
+    client->recv.cnt += ( unsigned ) nchars;
+    client->recvRetryDelay = 0.0;
+
+    status = camessage ( client );
+    if (status == 0) {
+        /*
+         * if there is a partial message
+         * align it with the start of the buffer
+         */
+        if (client->recv.cnt > client->recv.stk) {
+            unsigned bytes_left;
+
+            bytes_left = client->recv.cnt - client->recv.stk;
+
+            /*
+             * overlapping regions handled
+             * properly by memmove 
+             */
+            memmove (client->recv.buf, 
+                &client->recv.buf[client->recv.stk], bytes_left);
+            client->recv.cnt = bytes_left;
+        }
+        else {
+            client->recv.cnt = 0ul;
+        }
+    }
+    else {
+        char buf[64];
+
+        /* flush any queued messages before shutdown */
+        cas_send_bs_msg(client, 1);
+        
+        client->recv.cnt = 0ul;
+        
+        /*
+         * disconnect when there are severe message errors
+         */
+        ipAddrToDottedIP (&client->addr, buf, sizeof(buf));
+        epicsPrintf ("CAS: forcing disconnect from %s\n", buf);
+        return -1;
+    }
+    return 0;
+}
+
+static void camsgDisconnect ( struct client *client )
+{
+    LOCK_CLIENTQ;
+    ellDelete ( &clientQ, &client->node );
+    UNLOCK_CLIENTQ;
+
+    destroy_tcp_client ( client );
+}
+
 /*
  *  camsgtask()
  *
@@ -46,121 +202,443 @@ void camsgtask ( void *pParm )
     casAttachThreadToClient ( client );
 
     while (castcp_ctl == ctlRun && !client->disconnect) {
-        osiSockIoctl_t check_nchars;
-        long nchars;
         int status;
 
-        /*
-         * allow message to batch up if more are comming
-         */
-        status = socket_ioctl (client->sock, FIONREAD, &check_nchars);
-        if (status < 0) {
-            char sockErrBuf[64];
+        camsgFlushIdle ( client );
+        status = camsgReceive ( client );
+        if ( status < 0 )
+            break;
+        if ( status > 0 )
+            epicsThreadSleep ( client->recvRetryDelay );
+    }
 
-            epicsSocketConvertErrnoToString ( 
-                sockErrBuf, sizeof ( sockErrBuf ) );
-            errlogPrintf("CAS: FIONREAD error: %s\n",
-                sockErrBuf);
-            cas_send_bs_msg(client, TRUE);
-        }
-        else if (check_nchars == 0){
-            cas_send_bs_msg(client, TRUE);
-        }
+    camsgDisconnect ( client );
+}
+
+/*
+ * When casTcpIoThreads is set, TCP clients are instead served by a fixed
+ * set of I/O threads, each of which waits for requests from its share of
+ * the clients with epoll and handles them as camsgtask() would.  Each
+ * client stays with one I/O thread, so its requests are still processed
+ * in order by one thread at a time.
+ *
+ * The sockets of these clients don't block, so a slow client can't hold
+ * up the others of its I/O thread.  What a full socket won't take stays
+ * queued (cf. casSendBacklog()) until epoll reports room for it, and the
+ * client's requests aren't read while its replies are backed up.  A
+ * receive which runs out of network buffers is retried by a timer.  Each
+ * client still has its own event task, which sends subscription updates
+ * and may wait for a full socket as before.
+ */
+#ifdef RSRV_HAVE_EPOLL
+
+#define RSRV_IO_EVENTS 64
+
+struct rsrv_io_loop {
+    int             epfd;
+    int             wakefd;     /* eventfd, written to stop the thread */
+    unsigned        index;
+    unsigned        nclients;   /* guarded by clientQlock */
+    size_t          nwakeups;
+    size_t          nevents;
+    epicsThreadId   tid;
+    epicsEventId    exited;
+};
+
+static struct rsrv_io_loop *ioLoops;
+static unsigned nIoLoops;
+static epicsTimerQueueId ioTimerQueue;
+
+int camsgIoSelf ( const struct client *client )
+{
+    return client->ioLoop &&
+        client->ioLoop->tid == epicsThreadGetIdSelf ();
+}
+
+/*
+ * camsgIoUpdate()
+ *
+ * register interest in the socket events which the client's state calls
+ * for, reading requests unless held back and sending when blocked
+ *
+ * send lock must be on while in this routine
+ */
+void camsgIoUpdate ( struct client *client )
+{
+    struct epoll_event event;
+    unsigned events = 0u;
+
+    if ( ! client->ioAttached )
+        return;
+
+    if ( ! client->recvHeld && ( ! client->sendBlocked ||
+            (unsigned) ellCount ( &client->sendQ ) < RSRV_SEND_QUEUE_MAX ) )
+        events |= EPOLLIN;
+    if ( client->sendBlocked && ! client->sendHeld && ! client->sendWaiting )
+        events |= EPOLLOUT;
+    if ( events == client->ioEvents )
+        return;
+
+    memset ( &event, 0, sizeof ( event ) );
+    event.events = events;
+    event.data.ptr = client;
+    if ( epoll_ctl ( client->ioLoop->epfd, EPOLL_CTL_MOD, client->sock,
+            &event ) == 0 ) {
+        client->ioEvents = events;
+    }
+}
+
+/*
+ * camsgIoWaitWritable()
+ *
+ * wait for room in the socket of a client served by an I/O thread,
+ * for threads which can't leave their data to the I/O thread
+ *
+ * The send lock is released while waiting, so that the I/O thread
+ * doesn't block on it with all of its other clients.  A caller which
+ * has taken the lock more than once can't release it, and keeps it.
+ * The I/O thread stops watching for room meanwhile, rather than spin
+ * on a lock which this thread may hold again when room appears.
+ *
+ * send lock must be on while in this routine
+ */
+void camsgIoWaitWritable ( struct client *client )
+{
+    struct pollfd pfd;
+    int release = client->sendLockDepth == 1u;
+
+    /* stop reading requests which would need the send lock */
+    client->sendBlocked = TRUE;
+    client->sendWaiting = TRUE;
+    camsgIoUpdate ( client );
+
+    pfd.fd = client->sock;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+    if ( release )
+        SEND_UNLOCK ( client );
+    poll ( &pfd, 1, 1000 );
+    if ( release )
+        SEND_LOCK ( client );
+
+    /* cas_send_bs_msg() updates the registration once done */
+    client->sendWaiting = FALSE;
+}
+
+static void camsgIoSendRetry ( void *pParm )
+{
+    struct client *client = pParm;
+
+    SEND_LOCK ( client );
+    client->sendHeld = FALSE;
+    camsgIoUpdate ( client );
+    SEND_UNLOCK ( client );
+}
 
-        client->recv.stk = 0;
-        assert ( client->recv.maxstk >= client->recv.cnt );
-        nchars = recv ( client->sock, &client->recv.buf[client->recv.cnt], 
-                (int) ( client->recv.maxstk - client->recv.cnt ), 0 );
-        if ( nchars == 0 ){
-            if ( CASDEBUG > 0 ) {
-                /* convert to u long so that %lu works on both 32 and 64 bit archs */
-                unsigned long cnt = sizeof ( client->recv.buf ) - client->recv.cnt;
-                errlogPrintf ( "CAS: nill message disconnect ( %lu bytes request )\n",
-                    cnt );
+/*
+ * camsgIoHoldSend()
+ *
+ * The I/O thread ran out of network buffers while sending to a client.
+ * Leave what is waiting queued, and stop waiting for room in its socket
+ * until client::sendRetryDelay has passed, instead of sleeping.
+ *
+ * send lock must be on while in this routine
+ */
+void camsgIoHoldSend ( struct client *client )
+{
+    /* usually brief, back off up to the former fixed delay */
+    if ( client->sendRetryDelay == 0.0 ) {
+        errlogPrintf ( "CAS: Out of network buffers, retrying send\n" );
+        client->sendRetryDelay = 0.01;
+    }
+    else if ( client->sendRetryDelay < 15.0 ) {
+        client->sendRetryDelay *= 2.0;
+    }
+    if ( ! client->sendRetryTimer ) {
+        client->sendRetryTimer = epicsTimerQueueCreateTimer (
+            ioTimerQueue, camsgIoSendRetry, client );
+        if ( ! client->sendRetryTimer )
+            return;
+    }
+    client->sendHeld = TRUE;
+    camsgIoUpdate ( client );
+    epicsTimerStartDelay ( client->sendRetryTimer, client->sendRetryDelay );
+}
+
+static void camsgIoRecvRetry ( void *pParm )
+{
+    struct client *client = pParm;
+
+    SEND_LOCK ( client );
+    client->recvHeld = FALSE;
+    camsgIoUpdate ( client );
+    SEND_UNLOCK ( client );
+}
+
+/*
+ * stop reading from a client which ran out of network
+ * buffers until client::recvRetryDelay has passed
+ */
+static void camsgIoHoldRecv ( struct client *client )
+{
+    if ( ! client->recvRetryTimer ) {
+        client->recvRetryTimer = epicsTimerQueueCreateTimer (
+            ioTimerQueue, camsgIoRecvRetry, client );
+        if ( ! client->recvRetryTimer )
+            return;
+    }
+    SEND_LOCK ( client );
+    client->recvHeld = TRUE;
+    camsgIoUpdate ( client );
+    SEND_UNLOCK ( client );
+    epicsTimerStartDelay ( client->recvRetryTimer, client->recvRetryDelay );
+}
+
+static void camsgIoDetach ( struct rsrv_io_loop *loop, struct client *client )
+{
+    struct epoll_event event;
+
+    memset ( &event, 0, sizeof ( event ) );
+    SEND_LOCK ( client );
+    epoll_ctl ( loop->epfd, EPOLL_CTL_DEL, client->sock, &event );
+    client->ioAttached = FALSE;
+    SEND_UNLOCK ( client );
+
+    if ( client->recvRetryTimer ) {
+        epicsTimerQueueDestroyTimer ( ioTimerQueue, client->recvRetryTimer );
+        client->recvRetryTimer = NULL;
+    }
+    if ( client->sendRetryTimer ) {
+        epicsTimerQueueDestroyTimer ( ioTimerQueue, client->sendRetryTimer );
+        client->sendRetryTimer = NULL;
+    }
+
+    LOCK_CLIENTQ;
+    loop->nclients--;
+    UNLOCK_CLIENTQ;
+    camsgDisconnect ( client );
+}
+
+static void camsgIoLoop ( void *pParm )
+{
+    struct rsrv_io_loop *loop = pParm;
+    struct epoll_event events[RSRV_IO_EVENTS];
+    int running = TRUE;
+
+    epicsSignalInstallSigAlarmIgnore ();
+    epicsSignalInstallSigPipeIgnore ();
+    loop->tid = epicsThreadGetIdSelf ();
+    taskwdInsert ( loop->tid, NULL, NULL );
+
+    while ( running ) {
+        int i, n;
+
+        n = epoll_wait ( loop->epfd, events, RSRV_IO_EVENTS, -1 );
+        if ( n < 0 ) {
+            if ( errno != EINTR ) {
+                char sockErrBuf[64];
+
+                epicsSocketConvertErrnoToString (
+                    sockErrBuf, sizeof ( sockErrBuf ) );
+                errlogPrintf ( "CAS: epoll_wait error: %s\n", sockErrBuf );
+                epicsThreadSleep ( 1.0 );
             }
-            break;
+            continue;
         }
-        else if ( nchars < 0 ) {
-            int anerrno = SOCKERRNO;
+        loop->nwakeups++;
+        loop->nevents += n;
 
-            if ( anerrno == SOCK_EINTR ) {
-                continue;
-            }
+        for ( i = 0; i < n; i++ ) {
+            struct client *client = events[i].data.ptr;
+            unsigned ready = events[i].events;
+            int done;
 
-            if ( anerrno == SOCK_ENOBUFS ) {
-                errlogPrintf (
-                    "CAS: Out of network buffers, retring receive in 15 seconds\n" );
-                epicsThreadSleep ( 15.0 );
+            if ( ! client ) {
+                /* camsgIoStop() */
+                running = FALSE;
                 continue;
             }
 
-            /*
-             * normal conn lost conditions
-             */
-            if (    ( anerrno != SOCK_ECONNABORTED &&
-                anerrno != SOCK_ECONNRESET &&
-                anerrno != SOCK_ETIMEDOUT ) ||
-                CASDEBUG > 2 ) {
-                char sockErrBuf[64];
+            epicsThreadPrivateSet ( rsrvCurrentClient, client );
+            done = castcp_ctl != ctlRun || client->disconnect;
+            if ( ! done && ( ready & EPOLLOUT ) ) {
+                /* unless another thread is waiting to send itself */
+                if ( epicsMutexTryLock ( client->lock ) == epicsMutexLockOK ) {
+                    client->sendLockDepth++;
+                    cas_send_bs_msg ( client, FALSE );
+                    SEND_UNLOCK ( client );
+                }
+            }
+            if ( ! done && ( ready & ( EPOLLIN | EPOLLERR | EPOLLHUP ) ) ) {
+                int status = camsgReceive ( client );
 
-                epicsSocketConvertErrorToString(
-                    sockErrBuf, sizeof ( sockErrBuf ), anerrno);
-                errlogPrintf ( "CAS: Client disconnected - %s\n",
-                    sockErrBuf );
+                if ( status > 0 )
+                    camsgIoHoldRecv ( client );
+                done = status < 0 || client->disconnect;
+                if ( ! done )
+                    camsgFlushIdle ( client );
             }
-            break;
+            epicsThreadPrivateSet ( rsrvCurrentClient, NULL );
+
+            if ( done )
+                camsgIoDetach ( loop, client );
         }
+    }
 
-        epicsTimeGetCurrent ( &client->time_at_last_recv );
-        client->recv.cnt += ( unsigned ) nchars;
+    taskwdRemove ( loop->tid );
+    epicsEventSignal ( loop->exited );
+}
 
-        status = camessage ( client );
-        if (status == 0) {
-            /*
-             * if there is a partial message
-             * align it with the start of the buffer
-             */
-            if (client->recv.cnt > client->recv.stk) {
-                unsigned bytes_left;
-
-                bytes_left = client->recv.cnt - client->recv.stk;
-
-                /*
-                 * overlapping regions handled
-                 * properly by memmove 
-                 */
-                memmove (client->recv.buf, 
-                    &client->recv.buf[client->recv.stk], bytes_left);
-                client->recv.cnt = bytes_left;
-            }
-            else {
-                client->recv.cnt = 0ul;
-            }
+/*
+ * Stop the I/O threads when the IOC exits.  Their clients are left
+ * connected, as those of camsgtask() are.
+ */
+static void camsgIoStop ( void *arg )
+{
+    unsigned i;
+
+    for ( i = 0; i < nIoLoops; i++ ) {
+        eventfd_write ( ioLoops[i].wakefd, 1 );
+    }
+    for ( i = 0; i < nIoLoops; i++ ) {
+        struct rsrv_io_loop *loop = &ioLoops[i];
+
+        if ( epicsEventWaitWithTimeout ( loop->exited, 5.0 ) !=
+                epicsEventWaitOK ) {
+            errlogPrintf ( "CAS: TCP I/O thread %u did not stop\n", i );
+            continue;
         }
-        else {
-            char buf[64];
+        close ( loop->wakefd );
+        close ( loop->epfd );
+        epicsEventDestroy ( loop->exited );
+    }
+    nIoLoops = 0;
+}
 
-            /* flush any queued messages before shutdown */
-            cas_send_bs_msg(client, 1);
-            
-            client->recv.cnt = 0ul;
-            
-            /*
-             * disconnect when there are severe message errors
-             */
-            ipAddrToDottedIP (&client->addr, buf, sizeof(buf));
-            epicsPrintf ("CAS: forcing disconnect from %s\n", buf);
-                break;
+int camsgIoStart ( unsigned nthreads )
+{
+    unsigned i;
+
+    ioLoops = callocMustSucceed ( nthreads, sizeof ( *ioLoops ),
+        "camsgIoStart" );
+    ioTimerQueue = epicsTimerQueueAllocate ( 1, epicsThreadPriorityCAServerLow );
+
+    for ( i = 0; i < nthreads; i++ ) {
+        struct rsrv_io_loop *loop = &ioLoops[i];
+        struct epoll_event event;
+
+        loop->index = i;
+        loop->epfd = epoll_create1 ( EPOLL_CLOEXEC );
+        loop->wakefd = eventfd ( 0, EFD_CLOEXEC | EFD_NONBLOCK );
+        memset ( &event, 0, sizeof ( event ) );
+        event.events = EPOLLIN;
+        event.data.ptr = NULL;
+        if ( loop->epfd < 0 || loop->wakefd < 0 ||
+                epoll_ctl ( loop->epfd, EPOLL_CTL_ADD, loop->wakefd, &event ) ) {
+            char sockErrBuf[64];
+
+            epicsSocketConvertErrnoToString (
+                sockErrBuf, sizeof ( sockErrBuf ) );
+            errlogPrintf ( "CAS: epoll_create error: %s\n", sockErrBuf );
+            if ( loop->epfd >= 0 )
+                close ( loop->epfd );
+            if ( loop->wakefd >= 0 )
+                close ( loop->wakefd );
+            break;
         }
+        loop->exited = epicsEventMustCreate ( epicsEventEmpty );
+        epicsThreadMustCreate ( "CAS-io", epicsThreadPriorityCAServerLow,
+            epicsThreadGetStackSize ( epicsThreadStackBig ),
+            camsgIoLoop, loop );
+        nIoLoops++;
     }
+    if ( ! nIoLoops )
+        return -1;
+    epicsAtExit ( camsgIoStop, NULL );
+    return 0;
+}
 
-    LOCK_CLIENTQ;
-    ellDelete ( &clientQ, &client->node );
-    UNLOCK_CLIENTQ;
+int camsgIoAdd ( struct client *client )
+{
+    struct rsrv_io_loop *loop = NULL;
+    struct epoll_event event;
+    osiSockIoctl_t yes = TRUE, no = FALSE;
+    unsigned i;
 
-    destroy_tcp_client ( client );
+    if ( ! nIoLoops )
+        return -1;
+
+    /* caller holds clientQlock */
+    for ( i = 0; i < nIoLoops; i++ ) {
+        if ( ! loop || ioLoops[i].nclients < loop->nclients )
+            loop = &ioLoops[i];
+    }
+
+    if ( socket_ioctl ( client->sock, FIONBIO, &yes ) )
+        return -1;
+
+    client->ioLoop = loop;
+    client->ioEvents = EPOLLIN;
+    client->ioAttached = TRUE;
+    memset ( &event, 0, sizeof ( event ) );
+    event.events = EPOLLIN;
+    event.data.ptr = client;
+    if ( epoll_ctl ( loop->epfd, EPOLL_CTL_ADD, client->sock, &event ) ) {
+        client->ioLoop = NULL;
+        client->ioAttached = FALSE;
+        socket_ioctl ( client->sock, FIONBIO, &no );
+        return -1;
+    }
+    loop->nclients++;
+    return 0;
 }
 
+void camsgIoShow ( unsigned level )
+{
+    unsigned i;
+
+    if ( ! nIoLoops )
+        return;
+
+    printf ( "%u TCP I/O thread%s:\n", nIoLoops, nIoLoops == 1 ? "" : "s" );
+    for ( i = 0; i < nIoLoops; i++ ) {
+        struct rsrv_io_loop *loop = &ioLoops[i];
+
+        printf ( "    %u: %u client%s", i, loop->nclients,
+            loop->nclients == 1 ? "" : "s" );
+        if ( level >= 2 && loop->nwakeups )
+            printf ( ", %.1f ready per wakeup",
+                (double) loop->nevents / loop->nwakeups );
+        printf ( "\n" );
+    }
+}
+
+#else /* RSRV_HAVE_EPOLL */
+
+int camsgIoStart ( unsigned nthreads )
+{
+    errlogPrintf ( "CAS: casTcpIoThreads is not supported on this target\n" );
+    return -1;
+}
+
+int camsgIoAdd ( struct client *client )
+{
+    return -1;
+}
+
+void camsgIoShow ( unsigned level ) {}
+
+int camsgIoSelf ( const struct client *client )
+{
+    return FALSE;
+}
+
+void camsgIoUpdate ( struct client *client ) {}
+
+void camsgIoWaitWritable ( struct client *client ) {}
+void camsgIoHoldSend ( struct client *client ) {}
+
+#endif /* RSRV_HAVE_EPOLL */
 
 int casClientInitiatingCurrentThread ( char * pBuf, size_t bufSize )
 {
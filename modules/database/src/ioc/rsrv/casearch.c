@@ -0,0 +1,229 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+
+/*
+ *  Filter of the names searched for by CA clients
+ *
+ *  Most of the searches an IOC receives are broadcasts for PVs which
+ *  it does not host.  A Bloom filter of the names of all records and
+ *  aliases rejects nearly all of them without a database lookup.
+ *  The filter is rebuilt by the first search which finds that records
+ *  have been added or deleted since it was built.  Search threads read
+ *  it without a lock, so a filter is never changed once published, and
+ *  those it replaces are kept until the IOC exits.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "epicsAtomic.h"
+#include "epicsMutex.h"
+#include "epicsString.h"
+#include "epicsThread.h"
+#include "epicsTypes.h"
+#include "errlog.h"
+
+#define epicsExportSharedSymbols
+#include "dbAccess.h"
+#include "dbChannel.h"
+#include "dbStaticLib.h"
+#include "dbStaticPvt.h"
+#include "rsrv.h"
+#include "server.h"
+
+#define FILTER_HASHES   4u          /* bits set per name */
+#define FILTER_MIN_BITS 1024u
+
+typedef struct searchFilter {
+    struct searchFilter *pReplaced;
+    unsigned            generation;     /* dbPvdGeneration() when built */
+    unsigned            names;
+    epicsUInt32         mask;           /* bits - 1 */
+    epicsUInt32         bits[1];
+} searchFilter;
+
+static epicsThreadOnceId filterOnce = EPICS_THREAD_ONCE_INIT;
+static epicsMutexId filterLock;         /* serializes rebuilds */
+static searchFilter *pFilter;
+static unsigned filterRebuilds;
+
+static size_t nHits;            /* passed, and the record exists */
+static size_t nRejected;        /* rejected by the filter */
+static size_t nFalse;           /* passed but no such record */
+
+static void filterInit ( void *arg )
+{
+    filterLock = epicsMutexMustCreate ();
+}
+
+/*
+ * The bit positions of a name come from two hashes,
+ * cf. Kirsch and Mitzenmacher, "Less Hashing, Same Performance"
+ */
+static void filterHashes ( const char *pName, size_t len,
+    epicsUInt32 *pH1, epicsUInt32 *pH2 )
+{
+    *pH1 = epicsMemHash ( pName, len, 0u );
+    *pH2 = epicsMemHash ( pName, len, 0x9e3779b9u ) | 1u;
+}
+
+static void filterAdd ( void *arg, const PVDENTRY *ppvdNode )
+{
+    searchFilter *pf = arg;
+    const char *pName = ppvdNode->precnode->recordname;
+    epicsUInt32 h1, h2;
+    unsigned i;
+
+    filterHashes ( pName, strlen ( pName ), &h1, &h2 );
+    for ( i = 0u; i < FILTER_HASHES; i++, h1 += h2 ) {
+        epicsUInt32 bit = h1 & pf->mask;
+        pf->bits[bit >> 5] |= 1u << ( bit & 31u );
+    }
+    pf->names++;
+}
+
+static searchFilter * filterBuild ( void )
+{
+    epicsUInt32 nbits = FILTER_MIN_BITS;
+    size_t want = (size_t) dbPvdCount ( pdbbase ) * casSearchFilterBits;
+    searchFilter *pf;
+
+    while ( nbits < want && nbits < 0x80000000u )
+        nbits <<= 1;
+    pf = calloc ( 1, sizeof ( *pf ) + ( nbits / 32u - 1u ) *
+        sizeof ( pf->bits[0] ) );
+    if ( ! pf ) {
+        errlogPrintf ( "CAS: no memory for a search filter of %u bits\n",
+            nbits );
+        return NULL;
+    }
+    pf->mask = nbits - 1u;
+    pf->generation = dbPvdTraverse ( pdbbase, filterAdd, pf );
+    return pf;
+}
+
+/*
+ * filterGet ()
+ *
+ * the current filter, NULL if there is none and searches
+ * have to be looked up in the database
+ */
+static searchFilter * filterGet ( void )
+{
+    searchFilter *pf = epicsAtomicGetPtrT ( (EpicsAtomicPtrT *) &pFilter );
+    unsigned generation = dbPvdGeneration ( pdbbase );
+
+    if ( pf && pf->generation == generation )
+        return pf;
+
+    epicsThreadOnce ( &filterOnce, filterInit, NULL );
+    /* other threads use the database while one rebuilds the filter */
+    if ( epicsMutexTryLock ( filterLock ) != epicsMutexLockOK )
+        return NULL;
+    pf = pFilter;
+    if ( ! pf || pf->generation != generation ) {
+        searchFilter *pNew = filterBuild ();
+
+        if ( pNew ) {
+            pNew->pReplaced = pf;
+            epicsAtomicWriteMemoryBarrier ();
+            epicsAtomicSetPtrT ( (EpicsAtomicPtrT *) &pFilter, pNew );
+            filterRebuilds++;
+        }
+        pf = pNew;
+    }
+    epicsMutexUnlock ( filterLock );
+    return pf;
+}
+
+static int filterPass ( const searchFilter *pf, const char *pName )
+{
+    const char *pDot = strchr ( pName, '.' );
+    epicsUInt32 h1, h2;
+    unsigned i;
+
+    filterHashes ( pName, pDot ? (size_t) ( pDot - pName ) :
+        strlen ( pName ), &h1, &h2 );
+    for ( i = 0u; i < FILTER_HASHES; i++, h1 += h2 ) {
+        epicsUInt32 bit = h1 & pf->mask;
+
+        if ( ! ( pf->bits[bit >> 5] & ( 1u << ( bit & 31u ) ) ) )
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * casSearchTest ()
+ *
+ * dbChannelTest() for the name in a search request,
+ * which fails quickly for most names this IOC doesn't have
+ */
+long casSearchTest ( const char *pName )
+{
+    searchFilter *pf;
+    long status;
+
+    if ( casSearchFilterBits <= 0 || ! pdbbase )
+        return dbChannelTest ( pName );
+
+    pf = filterGet ();
+    if ( pf && ! filterPass ( pf, pName ) ) {
+        epicsAtomicIncrSizeT ( &nRejected );
+        return S_db_notFound;
+    }
+    status = dbChannelTest ( pName );
+    if ( pf ) {
+        if ( status == S_dbLib_recNotFound )
+            epicsAtomicIncrSizeT ( &nFalse );
+        else
+            epicsAtomicIncrSizeT ( &nHits );
+    }
+    return status;
+}
+
+/*
+ * casSearchFilterStatsFetch ()
+ */
+void casSearchFilterStatsFetch ( unsigned *pNames, unsigned *pRebuilds,
+    size_t *pFound, size_t *pRejected, size_t *pFalse )
+{
+    searchFilter *pf = epicsAtomicGetPtrT ( (EpicsAtomicPtrT *) &pFilter );
+
+    *pNames = pf ? pf->names : 0u;
+    *pRebuilds = filterRebuilds;
+    *pFound = epicsAtomicGetSizeT ( &nHits );
+    *pRejected = epicsAtomicGetSizeT ( &nRejected );
+    *pFalse = epicsAtomicGetSizeT ( &nFalse );
+}
+
+/*
+ * casSearchFilterShow ()
+ */
+void casSearchFilterShow ( unsigned level )
+{
+    searchFilter *pf = epicsAtomicGetPtrT ( (EpicsAtomicPtrT *) &pFilter );
+    size_t hits = epicsAtomicGetSizeT ( &nHits );
+    size_t rejected = epicsAtomicGetSizeT ( &nRejected );
+    size_t falsePos = epicsAtomicGetSizeT ( &nFalse );
+
+    if ( casSearchFilterBits <= 0 ) {
+        printf ( "Search filter disabled\n" );
+        return;
+    }
+    if ( ! pf ) {
+        printf ( "Search filter not built yet\n" );
+        return;
+    }
+    printf ( "Search filter of %u names in %lu bits, %u rebuilds%s\n",
+        pf->names, (unsigned long) pf->mask + 1ul, filterRebuilds,
+        pf->generation == dbPvdGeneration ( pdbbase ) ? "" : ", outdated" );
+    printf ( "\t%lu found, %lu rejected, %lu false positives (%.2f%%)\n",
+        (unsigned long) hits, (unsigned long) rejected,
+        (unsigned long) falsePos,
+        rejected + falsePos ? 100.0 * falsePos / ( rejected + falsePos ) : 0.0 );
+}
@@ -25,14 +25,223 @@
 #include "epicsSignal.h"
 #include "epicsTime.h"
 #include "errlog.h"
+#include "freeList.h"
 #include "osiSock.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#  include <sys/uio.h>
+#  define RSRV_HAVE_SENDMSG
+#endif
+
+#include "caCompress.h"
+#include "caSharedRing.h"
 #include "caerr.h"
 #include "net_convert.h"
 
 #define epicsExportSharedSymbols
 #include "server.h"
 
+/*
+ * The bytes waiting to be sent to a TCP client are the buffers queued on
+ * client::sendQ, oldest first, followed by client::send.  sendOffset
+ * bytes of the oldest of these have already been sent.
+ *
+ * The sockets of clients served by the TCP I/O threads don't block.
+ * When such a socket is full the buffers are left queued, and the I/O
+ * thread finishes sending them once epoll reports room.
+ */
+
+/*
+ * casSendDiscard()
+ *
+ * send lock must be on while in this routine
+ */
+void casSendDiscard ( struct client *pclient )
+{
+    send_segment *pSeg;
+
+    while ( ( pSeg = (send_segment *) ellGet ( &pclient->sendQ ) ) ) {
+        casFreeBuffer ( pSeg->buf, pSeg->type, pSeg->maxstk );
+        freeListFree ( rsrvSendSegFreeList, pSeg );
+    }
+    pclient->sendQBytes = 0u;
+    pclient->sendOffset = 0u;
+    pclient->send.stk = 0u;
+    pclient->sendBlocked = FALSE;
+}
+
+/*
+ * casSendConsume()
+ *
+ * account for nbytes which have been sent
+ */
+static void casSendConsume ( struct client *pclient, unsigned nbytes )
+{
+    send_segment *pSeg;
+
+    while ( ( pSeg = (send_segment *) ellFirst ( &pclient->sendQ ) ) ) {
+        unsigned left = pSeg->stk - pclient->sendOffset;
+
+        if ( nbytes < left ) {
+            pclient->sendOffset += nbytes;
+            return;
+        }
+        nbytes -= left;
+        ellDelete ( &pclient->sendQ, &pSeg->node );
+        pclient->sendQBytes -= pSeg->stk;
+        pclient->sendOffset = 0u;
+        casFreeBuffer ( pSeg->buf, pSeg->type, pSeg->maxstk );
+        freeListFree ( rsrvSendSegFreeList, pSeg );
+    }
+
+    if ( nbytes < pclient->send.stk - pclient->sendOffset ) {
+        pclient->sendOffset += nbytes;
+    }
+    else {
+        pclient->send.stk = 0u;
+        pclient->sendOffset = 0u;
+        epicsTimeGetCurrent ( &pclient->time_at_last_send );
+    }
+}
+
+/*
+ * casSendSome()
+ *
+ * one send of as much of the queued data as the socket will take
+ */
+static int casSendSome ( struct client *pclient, int flags )
+{
+#ifdef RSRV_HAVE_SENDMSG
+    struct iovec iov[RSRV_SEND_QUEUE_MAX + 1u];
+    struct msghdr msg;
+    send_segment *pSeg;
+    unsigned offset = pclient->sendOffset;
+    int n = 0;
+
+    /*
+     * An I/O thread may queue more buffers than iov holds, the rest
+     * are sent by the next call
+     */
+    for ( pSeg = (send_segment *) ellFirst ( &pclient->sendQ );
+            pSeg && n < (int) NELEMENTS ( iov );
+            pSeg = (send_segment *) ellNext ( &pSeg->node ) ) {
+        iov[n].iov_base = pSeg->buf + offset;
+        iov[n++].iov_len = pSeg->stk - offset;
+        offset = 0u;
+    }
+    if ( ! pSeg && n < (int) NELEMENTS ( iov ) &&
+            pclient->send.stk > offset ) {
+        iov[n].iov_base = pclient->send.buf + offset;
+        iov[n++].iov_len = pclient->send.stk - offset;
+    }
+
+    memset ( &msg, 0, sizeof ( msg ) );
+    msg.msg_iov = iov;
+    msg.msg_iovlen = n;
+    return sendmsg ( pclient->sock, &msg, flags );
+#else
+    send_segment *pSeg = (send_segment *) ellFirst ( &pclient->sendQ );
+
+    if ( pSeg ) {
+        return send ( pclient->sock, pSeg->buf + pclient->sendOffset,
+            pSeg->stk - pclient->sendOffset, flags );
+    }
+    return send ( pclient->sock, pclient->send.buf + pclient->sendOffset,
+        pclient->send.stk - pclient->sendOffset, flags );
+#endif
+}
+
+/*
+ * casSendQueueCurrent()
+ *
+ * queue client::send behind the other full buffers and start a new,
+ * empty one; returns non-zero if that can't be allocated
+ *
+ * send lock must be on while in this routine
+ */
+static int casSendQueueCurrent ( struct client *pclient )
+{
+    send_segment *pSeg;
+    char *pBuf;
+
+    pSeg = freeListMalloc ( rsrvSendSegFreeList );
+    pBuf = freeListMalloc ( rsrvSmallBufFreeListTCP );
+    if ( ! pSeg || ! pBuf ) {
+        if ( pSeg ) freeListFree ( rsrvSendSegFreeList, pSeg );
+        if ( pBuf ) freeListFree ( rsrvSmallBufFreeListTCP, pBuf );
+        return -1;
+    }
+    pSeg->buf = pclient->send.buf;
+    pSeg->stk = pclient->send.stk;
+    pSeg->maxstk = pclient->send.maxstk;
+    pSeg->type = pclient->send.type;
+    ellAdd ( &pclient->sendQ, &pSeg->node );
+    pclient->sendQBytes += pSeg->stk;
+    pclient->send.buf = pBuf;
+    pclient->send.stk = 0u;
+    pclient->send.maxstk = MAX_TCP;
+    pclient->send.type = mbtSmallTCP;
+    return 0;
+}
+
+/*
+ * casSendBacklog()
+ *
+ * The non-blocking socket of an I/O thread client is full.  Leave what
+ * is waiting to the I/O thread, queuing client::send so that there is
+ * room for further messages.  The I/O thread itself must not wait, so
+ * it may queue any number of buffers, but then stops reading requests
+ * until they have been sent.  Returns FALSE if the caller must wait for
+ * the socket instead.
+ *
+ * send lock must be on while in this routine
+ */
+static int casSendBacklog ( struct client *pclient )
+{
+    if ( pclient->send.stk ) {
+        if ( (unsigned) ellCount ( &pclient->sendQ ) >= RSRV_SEND_QUEUE_MAX &&
+                ! camsgIoSelf ( pclient ) ) {
+            return FALSE;
+        }
+        if ( casSendQueueCurrent ( pclient ) ) {
+            return FALSE;
+        }
+    }
+    pclient->sendBlocked = TRUE;
+    return TRUE;
+}
+
+/*
+ * casSendQueueBuffer()
+ *
+ * Make room for a message of msgSize bytes without waiting for the
+ * client, by sending what the socket will take now and queuing the
+ * full buffer.  Returns non-zero if the caller must use cas_send_bs_msg().
+ *
+ * send lock must be on while in this routine
+ */
+int casSendQueueBuffer ( struct client *pclient, unsigned msgSize )
+{
+#ifdef MSG_DONTWAIT
+    while ( pclient->send.stk && ! pclient->disconnect ) {
+        int status = casSendSome ( pclient, MSG_DONTWAIT );
+        if ( status <= 0 ) {
+            break;
+        }
+        casSendConsume ( pclient, (unsigned) status );
+    }
+    if ( pclient->send.stk <= pclient->send.maxstk - msgSize ) {
+        return 0;
+    }
+#endif
+
+    if ( pclient->send.type != mbtSmallTCP || msgSize > MAX_TCP ||
+            (unsigned) ellCount ( &pclient->sendQ ) >= RSRV_SEND_QUEUE_MAX ) {
+        return -1;
+    }
+    return casSendQueueCurrent ( pclient );
+}
+
 /*
  *  cas_send_bs_msg()
  *
@@ -44,13 +253,15 @@
 void cas_send_bs_msg ( struct client *pclient, int lock_needed )
 {
     int status;
+    double retryDelay = 0.01;
 
     if ( lock_needed ) {
         SEND_LOCK ( pclient );
     }
 
     if ( CASDEBUG > 2 && pclient->send.stk ) {
-        errlogPrintf ( "CAS: Sending a message of %d bytes\n", pclient->send.stk );
+        errlogPrintf ( "CAS: Sending a message of %d bytes\n",
+            pclient->sendQBytes + pclient->send.stk - pclient->sendOffset );
     }
 
     if ( pclient->disconnect ) {
@@ -58,27 +269,19 @@ void cas_send_bs_msg ( struct client *pclient, int lock_needed )
             errlogPrintf ( "CAS: msg Discard for sock %d addr %x\n",
                 pclient->sock, (unsigned) pclient->addr.sin_addr.s_addr );
         }
-        pclient->send.stk = 0u;
+        casSendDiscard ( pclient );
         if(lock_needed)
             SEND_UNLOCK(pclient);
         return;
     }
 
-    while ( pclient->send.stk && ! pclient->disconnect ) {
-        status = send ( pclient->sock, pclient->send.buf, pclient->send.stk, 0 );
+    pclient->sendBlocked = FALSE;
+    while ( ( pclient->send.stk || ellCount ( &pclient->sendQ ) ) &&
+            ! pclient->disconnect ) {
+        status = casSendSome ( pclient, 0 );
         if ( status >= 0 ) {
-            unsigned transferSize = (unsigned) status;
-            if ( transferSize >= pclient->send.stk ) {
-                pclient->send.stk = 0;
-                epicsTimeGetCurrent ( &pclient->time_at_last_send );
-                break;
-            }
-            else {
-                unsigned bytesLeft = pclient->send.stk - transferSize;
-                memmove ( pclient->send.buf, &pclient->send.buf[transferSize], 
-                    bytesLeft );
-                pclient->send.stk = bytesLeft;
-            }
+            casSendConsume ( pclient, (unsigned) status );
+            pclient->sendRetryDelay = 0.0;
         }
         else {
             int causeWasSocketHangup = 0;
@@ -86,7 +289,7 @@ void cas_send_bs_msg ( struct client *pclient, int lock_needed )
             char buf[64];
 
             if ( pclient->disconnect ) {
-                pclient->send.stk = 0u;
+                casSendDiscard ( pclient );
                 break;
             }
 
@@ -94,10 +297,29 @@ void cas_send_bs_msg ( struct client *pclient, int lock_needed )
                 continue;
             }
 
+            if ( anerrno == SOCK_EWOULDBLOCK && pclient->ioLoop ) {
+                if ( casSendBacklog ( pclient ) ) {
+                    break;
+                }
+                camsgIoWaitWritable ( pclient );
+                continue;
+            }
+
             if ( anerrno == SOCK_ENOBUFS ) {
-                errlogPrintf (
-                    "CAS: Out of network buffers, retrying send in 15 seconds\n" );
-                epicsThreadSleep ( 15.0 );
+                /* the I/O thread mustn't sleep, a timer resumes the send */
+                if ( camsgIoSelf ( pclient ) && casSendBacklog ( pclient ) ) {
+                    camsgIoHoldSend ( pclient );
+                    break;
+                }
+                /* usually brief, back off up to the former fixed delay */
+                if ( retryDelay == 0.01 ) {
+                    errlogPrintf (
+                        "CAS: Out of network buffers, retrying send\n" );
+                }
+                epicsThreadSleep ( retryDelay );
+                if ( retryDelay < 15.0 ) {
+                    retryDelay *= 2.0;
+                }
                 continue;
             }
 
@@ -118,7 +340,7 @@ void cas_send_bs_msg ( struct client *pclient, int lock_needed )
                     buf, sockErrBuf);
             }
             pclient->disconnect = TRUE;
-            pclient->send.stk = 0u;
+            casSendDiscard ( pclient );
 
             /*
              * wakeup the receive thread
@@ -156,6 +378,18 @@ void cas_send_bs_msg ( struct client *pclient, int lock_needed )
         }
     }
 
+    /* set by another thread while the send lock was released */
+    if ( pclient->disconnect ) {
+        casSendDiscard ( pclient );
+    }
+
+    if ( pclient->ioLoop ) {
+        if ( ! pclient->send.stk && ! ellCount ( &pclient->sendQ ) ) {
+            pclient->sendBlocked = FALSE;
+        }
+        camsgIoUpdate ( pclient );
+    }
+
     if ( lock_needed ) {
         SEND_UNLOCK(pclient);
     }
@@ -280,11 +514,20 @@ int cas_copy_in_header (
 
     if ( pclient->send.stk > pclient->send.maxstk - msgSize ) {
         if ( pclient->disconnect ) {
-            pclient->send.stk = 0;
+            casSendDiscard ( pclient );
         }
         else{
             if ( pclient->proto == IPPROTO_TCP) {
-                cas_send_bs_msg ( pclient, FALSE );
+                if ( casSendQueueBuffer ( pclient, msgSize ) ) {
+                    cas_send_bs_msg ( pclient, FALSE );
+                }
+                /* a large buffer may have been queued for an I/O thread */
+                if ( msgSize > pclient->send.maxstk ) {
+                    casExpandSendBuffer ( pclient, msgSize );
+                    if ( msgSize > pclient->send.maxstk ) {
+                        return ECA_TOLARGE;
+                    }
+                }
             }
             else if ( pclient->proto == IPPROTO_UDP ) {
                 cas_send_dg_msg ( pclient );
@@ -364,6 +607,95 @@ void cas_commit_msg ( struct client *pClient, ca_uint32_t size )
         size += sizeof ( caHdr );
     }
     pClient->send.stk += size;
+    pClient->traffic.msgsOut++;
+    pClient->traffic.bytesOut += size;
+}
+
+/*
+ * cas_commit_chan_msg ()
+ *
+ * cas_commit_msg () of a response or update which is also
+ * counted in the traffic of channel pciu
+ */
+void cas_commit_chan_msg ( struct client *pClient,
+    struct channel_in_use *pciu, ca_uint32_t size )
+{
+    unsigned stk = pClient->send.stk;
+
+    cas_commit_msg ( pClient, size );
+    pciu->traffic.msgsOut++;
+    pciu->traffic.bytesOut += pClient->send.stk - stk;
+}
+
+/*
+ * cas_compress_msg ()
+ *
+ * compress the payload of the message set up by cas_copy_in_header ()
+ * if the client accepts that and it is large enough to be worthwhile,
+ * returns the size to pass to cas_commit_msg ()
+ */
+ca_uint32_t cas_compress_msg ( struct client *pClient, ca_uint16_t dataType,
+    void *pPayload, ca_uint32_t size )
+{
+    caHdr *pMsg = ( caHdr * ) &pClient->send.buf[pClient->send.stk];
+    unsigned workSize;
+    ca_uint32_t compressed;
+
+    if ( ! pClient->compress || casCompressMinBytes <= 0 ||
+            size < (unsigned) casCompressMinBytes ) {
+        return size;
+    }
+
+    workSize = size + CA_COMPRESS_WORK_BYTES;
+    if ( workSize > pClient->compressWorkSize ) {
+        void *pWork = malloc ( workSize );
+        if ( ! pWork ) {
+            return size;
+        }
+        free ( pClient->pCompressWork );
+        pClient->pCompressWork = pWork;
+        pClient->compressWorkSize = workSize;
+    }
+
+    compressed = caCompressPayload ( dataType, pPayload, size,
+        pClient->pCompressWork );
+    if ( ! compressed ) {
+        return size;
+    }
+    pMsg->m_dataType = htons ( dataType | CA_PROTO_DATA_COMPRESSED );
+    if ( compressed < CA_MESSAGE_ALIGN ( compressed ) ) {
+        memset ( ( char * ) pPayload + compressed, '\0',
+            CA_MESSAGE_ALIGN ( compressed ) - compressed );
+    }
+    return compressed;
+}
+
+/*
+ * cas_share_msg ()
+ *
+ * move the payload of the message set up by cas_copy_in_header ()
+ * into the shared memory ring of a client on this host if there is
+ * one, there is room and it is large enough to be worthwhile,
+ * returns the size to pass to cas_commit_msg ()
+ */
+ca_uint32_t cas_share_msg ( struct client *pClient,
+    void *pPayload, ca_uint32_t size )
+{
+    caHdr *pMsg = ( caHdr * ) &pClient->send.buf[pClient->send.stk];
+    caSharedRingRef ref;
+
+    if ( ! pClient->pSharedRing || casSharedMemMinBytes <= 0 ||
+            size < (unsigned) casSharedMemMinBytes ) {
+        return size;
+    }
+
+    if ( caSharedRingPut ( pClient->pSharedRing, pPayload, size, &ref ) ) {
+        return size;
+    }
+    pMsg->m_dataType = htons ( ntohs ( pMsg->m_dataType ) |
+        CA_PROTO_DATA_SHARED );
+    memcpy ( pPayload, &ref, sizeof ( ref ) );
+    return sizeof ( ref );
 }
 
 /*
@@ -14,6 +14,8 @@
  *  Author: Jeffrey O. Hill
  */
 
+#define EPICS_PRIVATE_API
+
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -22,6 +24,8 @@
 #include <errno.h>
 
 #include "addrList.h"
+#include "caSharedRing.h"
+#include "epicsAtomic.h"
 #include "epicsEvent.h"
 #include "epicsMutex.h"
 #include "epicsSignal.h"
@@ -105,6 +109,7 @@ static void req_server (void *pParm)
         else {
             epicsThreadId id;
             struct client *pClient;
+            int status;
 
             /* socket passed in is closed if unsuccessful here */
             pClient = create_tcp_client ( clientSock, &sockAddr );
@@ -115,7 +120,11 @@ static void req_server (void *pParm)
 
             LOCK_CLIENTQ;
             ellAdd ( &clientQ, &pClient->node );
+            status = camsgIoAdd ( pClient );
             UNLOCK_CLIENTQ;
+            if ( status == 0 ) {
+                continue;
+            }
 
             id = epicsThreadCreate ( "CAS-client", epicsThreadPriorityCAServerLow,
                     epicsThreadGetStackSize ( epicsThreadStackBig ),
@@ -285,6 +294,8 @@ static
 void rsrv_build_addr_lists(void)
 {
     int autobeaconlist = 1;
+    int useMCastGroup;
+    struct in_addr mcastGroup;
 
     /* the UDP ports are known at this point, but the TCP port is not */
     assert(ca_beacon_port!=0);
@@ -341,6 +352,19 @@ void rsrv_build_addr_lists(void)
 #endif
     }
 
+    /* With a multicast group, searches are received from the group and
+     * beacons sent to it instead of the automatic broadcast addresses.
+     */
+    useMCastGroup = getChannelAccessMulticastGroup(&mcastGroup);
+    if (useMCastGroup) {
+        osiSockAddrNode *pNode = (osiSockAddrNode *) callocMustSucceed( 1, sizeof(*pNode), "rsrv_init" );
+        pNode->addr.ia.sin_family = AF_INET;
+        pNode->addr.ia.sin_addr = mcastGroup;
+        pNode->addr.ia.sin_port = htons(ca_udp_port);
+        ellAdd(&casMCastAddrList, &pNode->node);
+        autobeaconlist = 0;
+    }
+
     /* populate the interface address list (default is empty) */
     {
         ELLLIST temp = ELLLIST_INIT;
@@ -419,6 +443,14 @@ void rsrv_build_addr_lists(void)
          */
         addAddrToChannelAccessAddressList ( &temp, &EPICS_CAS_BEACON_ADDR_LIST, ca_beacon_port, 0 );
 
+        if (useMCastGroup) {
+            pNode = (osiSockAddrNode *) callocMustSucceed( 1, sizeof(*pNode), "rsrv_init" );
+            pNode->addr.ia.sin_family = AF_INET;
+            pNode->addr.ia.sin_addr = mcastGroup;
+            pNode->addr.ia.sin_port = htons(ca_beacon_port);
+            ellAdd(&temp, &pNode->node);
+        }
+
         if (autobeaconlist) {
             /* auto populate with all broadcast addresses.
              * Note that autobeaconlist is zeroed above if an interface
@@ -472,6 +504,181 @@ void rsrv_build_addr_lists(void)
     }
 }
 
+/*
+ * Buffers for messages larger than MAX_TCP are either allocated to fit
+ * (EPICS_CA_AUTO_ARRAY_BYTES=YES) or taken from free lists of power of
+ * two sizes, the largest being rsrvSizeofLargeBufTCP.  A client then
+ * only holds a buffer about the size of the largest message it has
+ * actually sent or received.
+ */
+typedef struct {
+    void        *freeList;
+    unsigned    size;
+    size_t      inUse;
+    size_t      maxInUse;
+} largeBufClass;
+
+static largeBufClass *largeBufClasses;
+static unsigned nLargeBufClasses;
+static int largeBufAuto;
+static size_t largeBufAutoCount, largeBufAutoBytes;
+
+static void casLargeBufInit ( int autoMaxBytes )
+{
+    unsigned size, i;
+
+    largeBufAuto = autoMaxBytes;
+    if ( largeBufAuto )
+        return;
+
+    for ( size = MAX_TCP; size < rsrvSizeofLargeBufTCP; size *= 2u ) {
+        nLargeBufClasses++;
+        if ( size > UINT_MAX / 2u )
+            break;
+    }
+    if ( ! nLargeBufClasses )
+        return;
+
+    largeBufClasses = callocMustSucceed ( nLargeBufClasses,
+        sizeof ( largeBufClass ), "casLargeBufInit" );
+    for ( i = 0, size = 2u * MAX_TCP; i < nLargeBufClasses; i++, size *= 2u ) {
+        largeBufClass *pClass = &largeBufClasses[i];
+
+        pClass->size = ( i + 1 == nLargeBufClasses ) ?
+            rsrvSizeofLargeBufTCP : size;
+        freeListInitPvt ( &pClass->freeList, pClass->size, 1 );
+    }
+}
+
+static largeBufClass * casLargeBufClass ( unsigned size )
+{
+    unsigned i;
+
+    for ( i = 0; i < nLargeBufClasses; i++ ) {
+        if ( size <= largeBufClasses[i].size )
+            return &largeBufClasses[i];
+    }
+    return NULL;
+}
+
+static char * casLargeBufAlloc ( unsigned size, unsigned *pSize )
+{
+    largeBufClass *pClass = casLargeBufClass ( size );
+    char *pBuf;
+    size_t inUse;
+
+    if ( ! pClass )
+        return NULL;
+    pBuf = freeListMalloc ( pClass->freeList );
+    if ( ! pBuf )
+        return NULL;
+    inUse = epicsAtomicIncrSizeT ( &pClass->inUse );
+    while ( TRUE ) {
+        size_t maxInUse = epicsAtomicGetSizeT ( &pClass->maxInUse );
+
+        if ( inUse <= maxInUse || epicsAtomicCmpAndSwapSizeT (
+                &pClass->maxInUse, maxInUse, inUse ) == maxInUse )
+            break;
+    }
+    *pSize = pClass->size;
+    return pBuf;
+}
+
+static void casLargeBufFree ( char *pBuf, unsigned size )
+{
+    if ( largeBufAuto ) {
+        free ( pBuf );
+        epicsAtomicDecrSizeT ( &largeBufAutoCount );
+        epicsAtomicSubSizeT ( &largeBufAutoBytes, size );
+    }
+    else {
+        largeBufClass *pClass = casLargeBufClass ( size );
+
+        assert ( pClass && pClass->size == size );
+        freeListFree ( pClass->freeList, pBuf );
+        epicsAtomicDecrSizeT ( &pClass->inUse );
+    }
+}
+
+/*
+ * casFreeBuffer()
+ *
+ * free a TCP buffer of either type, such as one queued on client::sendQ
+ */
+void casFreeBuffer ( char *pBuf, enum messageBufferType type, unsigned size )
+{
+    if ( type == mbtSmallTCP ) {
+        freeListFree ( rsrvSmallBufFreeListTCP, pBuf );
+    }
+    else if ( type == mbtLargeTCP ) {
+        casLargeBufFree ( pBuf, size );
+    }
+    else {
+        errlogPrintf ( "CAS: Corrupt TCP buffer type code=%u\n", type );
+    }
+}
+
+static void casLargeBufShow ( void )
+{
+    unsigned i;
+
+    if ( largeBufAuto ) {
+        printf ( "Large TCP buffers allocated to fit: %u using %u bytes\n",
+            (unsigned) epicsAtomicGetSizeT ( &largeBufAutoCount ),
+            (unsigned) epicsAtomicGetSizeT ( &largeBufAutoBytes ) );
+        return;
+    }
+    if ( ! nLargeBufClasses )
+        return;
+
+    printf ( "Large TCP buffers:\n" );
+    printf ( "    %10s %8s %8s %8s\n", "size", "in use", "max", "free" );
+    for ( i = 0; i < nLargeBufClasses; i++ ) {
+        largeBufClass *pClass = &largeBufClasses[i];
+
+        printf ( "    %10u %8u %8u %8u\n", pClass->size,
+            (unsigned) epicsAtomicGetSizeT ( &pClass->inUse ),
+            (unsigned) epicsAtomicGetSizeT ( &pClass->maxInUse ),
+            (unsigned) freeListItemsAvail ( pClass->freeList ) );
+    }
+}
+
+/*
+ * casLargeBufClassFind ()
+ *
+ * for tests, the size class serving a buffer of size bytes
+ */
+int casLargeBufClassFind ( unsigned size, unsigned *pIndex,
+    unsigned *pClassSize )
+{
+    largeBufClass *pClass = casLargeBufClass ( size );
+
+    if ( ! pClass )
+        return -1;
+    *pIndex = (unsigned) ( pClass - largeBufClasses );
+    *pClassSize = pClass->size;
+    return 0;
+}
+
+/*
+ * casLargeBufClassStatus ()
+ *
+ * for tests, the use of one size class
+ */
+int casLargeBufClassStatus ( unsigned index, unsigned *pSize,
+    size_t *pInUse, size_t *pMaxInUse )
+{
+    largeBufClass *pClass;
+
+    if ( index >= nLargeBufClasses )
+        return -1;
+    pClass = &largeBufClasses[index];
+    *pSize = pClass->size;
+    *pInUse = epicsAtomicGetSizeT ( &pClass->inUse );
+    *pMaxInUse = epicsAtomicGetSizeT ( &pClass->maxInUse );
+    return 0;
+}
+
 /*
  * rsrv_init ()
  */
@@ -489,6 +696,7 @@ void rsrv_init (void)
     freeListInitPvt ( &rsrvChanFreeList, sizeof(struct channel_in_use), 512 );
     freeListInitPvt ( &rsrvEventFreeList, sizeof(struct event_ext), 512 );
     freeListInitPvt ( &rsrvSmallBufFreeListTCP, MAX_TCP, 16 );
+    freeListInitPvt ( &rsrvSendSegFreeList, sizeof(send_segment), 64 );
     initializePutNotifyFreeList ();
 
     epicsSignalInstallSigPipeIgnore ();
@@ -541,10 +749,7 @@ void rsrv_init (void)
     if(envGetBoolConfigParam(&EPICS_CA_AUTO_ARRAY_BYTES, &autoMaxBytes))
         autoMaxBytes = 1;
 
-    if (!autoMaxBytes)
-        freeListInitPvt ( &rsrvLargeBufFreeListTCP, rsrvSizeofLargeBufTCP, 1 );
-    else
-        rsrvLargeBufFreeListTCP = NULL;
+    casLargeBufInit ( autoMaxBytes );
     pCaBucket = bucketCreate(CAS_HASH_TABLE_SIZE);
     if (!pCaBucket)
         cantProceed("RSRV failed to allocate ID lookup table\n");
@@ -560,11 +765,14 @@ void rsrv_init (void)
      * Now starting per interface
      *  TCP Listener: epicsThreadPriorityCAServerLow-2
      *  Name receiver: epicsThreadPriorityCAServerLow-4
+     *  Name search workers (casUdpSearchThreads): epicsThreadPriorityCAServerLow-4
      * Now starting global
      *  Beacon sender: epicsThreadPriorityCAServerLow-3
      * Started later per TCP client
      *  TCP receiver: epicsThreadPriorityCAServerLow
      *  TCP sender : epicsThreadPriorityCAServerLow-1
+     * Or if casTcpIoThreads, started now instead of TCP receivers
+     *  TCP I/O: epicsThreadPriorityCAServerLow
      */
     {
         unsigned i;
@@ -596,6 +804,10 @@ void rsrv_init (void)
         }
     }
 
+    if ( casTcpIoThreads > 0 ) {
+        camsgIoStart ( casTcpIoThreads );
+    }
+
     /* start servers (TCP and UDP(s) for each interface.
      */
     {
@@ -868,7 +1080,17 @@ static void log_one_client (struct client *client, unsigned level)
         printf(
         "\tUnprocessed request bytes = %u, Undelivered response bytes = %u\n",
             client->recv.cnt - client->recv.stk,
-            client->send.stk );
+            client->sendQBytes + client->send.stk - client->sendOffset );
+        printf(
+        "\tTraffic: %lu msgs %lu bytes in, %lu msgs %lu bytes out, "
+        "%lu gets, %lu puts, %lu updates\n",
+            (unsigned long) client->traffic.msgsIn,
+            (unsigned long) client->traffic.bytesIn,
+            (unsigned long) client->traffic.msgsOut,
+            (unsigned long) client->traffic.bytesOut,
+            (unsigned long) client->traffic.gets,
+            (unsigned long) client->traffic.puts,
+            (unsigned long) client->traffic.updates );
         printf(
         "\tState = %s%s%s\n",
             state[client->disconnect?1:0],
@@ -902,6 +1124,94 @@ static void log_one_client (struct client *client, unsigned level)
     }
 }
 
+/*
+ *  udpPoolStatus ()
+ */
+static void udpPoolStatus (rsrv_udp_pool *pool, unsigned *pThreads,
+    unsigned *pQueued, unsigned *pMaxQueued, size_t *pDropped,
+    size_t *pSearches, double *pRate)
+{
+    unsigned i, nworkers;
+
+    epicsMutexMustLock(pool->lock);
+    nworkers = pool->nworkers;
+    *pQueued += pool->nqueued;
+    *pMaxQueued += pool->maxQueued;
+    *pDropped += pool->ndropped;
+    epicsMutexUnlock(pool->lock);
+
+    for (i = 0; i < nworkers; i++) {
+        *pRate += rsrvRateGet(&pool->workers[i]->searches);
+        *pSearches += pool->workers[i]->searches.total;
+    }
+    *pThreads += nworkers;
+}
+
+/*
+ *  casUdpSearchStatus ()
+ */
+void casUdpSearchStatus (unsigned *pThreads, unsigned *pQueued,
+    unsigned *pMaxQueued, size_t *pDropped, size_t *pSearches, double *pRate)
+{
+    rsrv_iface_config *iface;
+
+    *pThreads = *pQueued = *pMaxQueued = 0;
+    *pDropped = *pSearches = 0;
+    *pRate = 0.0;
+    for (iface = (rsrv_iface_config *) ellFirst(&servers); iface;
+         iface = (rsrv_iface_config *) ellNext(&iface->node)) {
+        if (iface->pool)
+            udpPoolStatus(iface->pool, pThreads, pQueued, pMaxQueued,
+                pDropped, pSearches, pRate);
+        if (iface->bpool)
+            udpPoolStatus(iface->bpool, pThreads, pQueued, pMaxQueued,
+                pDropped, pSearches, pRate);
+    }
+}
+
+/*
+ *  showUdpServer ()
+ */
+static void showUdpServer (const char *kind, const char *addr,
+    struct client *client, rsrv_udp_pool *pool, unsigned level)
+{
+    printf("    CAS-UDP %sname server on %s\n", kind, addr);
+
+    if (pool) {
+        double rate = 0.0;
+        size_t total = 0, ndropped = 0;
+        unsigned i, nworkers = 0, nqueued = 0, maxQueued = 0;
+
+        udpPoolStatus(pool, &nworkers, &nqueued, &maxQueued, &ndropped,
+            &total, &rate);
+        printf("\t%.0f searches/sec, %lu total, by %u threads\n",
+            rate, (unsigned long) total, nworkers);
+        printf("\t%u datagrams queued, max %u, %lu dropped\n",
+            nqueued, maxQueued, (unsigned long) ndropped);
+        for (i = 0; level >= 2 && i < nworkers; i++) {
+            struct client *worker = pool->workers[i];
+
+            double wrate = rsrvRateGet(&worker->searches);
+            double wpeak = worker->searches.peak;
+
+            printf("\tThread %u: %.0f searches/sec, peak %.0f, %lu total\n", i,
+                wrate, wrate > wpeak ? wrate : wpeak,
+                (unsigned long) worker->searches.total);
+            log_one_client(worker, level - 2);
+        }
+    }
+    else if (client) {
+        double rate = rsrvRateGet(&client->searches);
+        double peak = client->searches.peak;
+
+        printf("\t%.0f searches/sec, peak %.0f, %lu total\n",
+            rate, rate > peak ? rate : peak,
+            (unsigned long) client->searches.total);
+        if (level >= 2)
+            log_one_client(client, level - 2);
+    }
+}
+
 /*
  *  casr()
  */
@@ -936,6 +1246,9 @@ void casr (unsigned level)
             client = (struct client *) ellNext(&client->node);
         }
     }
+    if (level>=1) {
+        camsgIoShow(level);
+    }
     UNLOCK_CLIENTQ
 
     if (level>=1) {
@@ -948,28 +1261,23 @@ void casr (unsigned level)
 
             ipAddrToDottedIP (&iface->udpAddr.ia, buf, sizeof(buf));
 #if defined(_WIN32)
-            printf("    CAS-UDP name server on %s\n", buf);
-            if (level >= 2)
-                log_one_client(iface->client, level - 2);
+            showUdpServer("", buf, iface->client, iface->pool, level);
 #else
             if (iface->udpbcast==INVALID_SOCKET) {
-                printf("    CAS-UDP name server on %s\n", buf);
-                if (level >= 2)
-                    log_one_client(iface->client, level - 2);
+                showUdpServer("", buf, iface->client, iface->pool, level);
             }
             else {
-                printf("    CAS-UDP unicast name server on %s\n", buf);
-                if (level >= 2)
-                    log_one_client(iface->client, level - 2);
+                showUdpServer("unicast ", buf, iface->client, iface->pool,
+                    level);
                 ipAddrToDottedIP (&iface->udpbcastAddr.ia, buf, sizeof(buf));
-                printf("    CAS-UDP broadcast name server on %s\n", buf);
-                if (level >= 2)
-                    log_one_client(iface->bclient, level - 2);
+                showUdpServer("broadcast ", buf, iface->bclient, iface->bpool,
+                    level);
             }
 #endif
 
             iface = (rsrv_iface_config *) ellNext(&iface->node);
         }
+        casSearchFilterShow(level);
     }
 
     if (level>=1) {
@@ -1017,7 +1325,13 @@ void casr (unsigned level)
         }
     }
 
+    if (level>=2u) {
+        casLargeBufShow ();
+    }
+
     if (level>=4u) {
+        unsigned i;
+
         bytes_reserved = 0u;
         bytes_reserved += sizeof (struct client) *
                     freeListItemsAvail (rsrvClientFreeList);
@@ -1027,9 +1341,9 @@ void casr (unsigned level)
                     freeListItemsAvail (rsrvEventFreeList);
         bytes_reserved += MAX_TCP *
                     freeListItemsAvail ( rsrvSmallBufFreeListTCP );
-        if(rsrvLargeBufFreeListTCP) {
-            bytes_reserved += rsrvSizeofLargeBufTCP *
-                        freeListItemsAvail ( rsrvLargeBufFreeListTCP );
+        for (i = 0; i < nLargeBufClasses; i++) {
+            bytes_reserved += largeBufClasses[i].size *
+                        freeListItemsAvail ( largeBufClasses[i].freeList );
         }
         bytes_reserved += rsrvSizeOfPutNotify ( 0 ) *
                     freeListItemsAvail ( rsrvPutNotifyFreeList );
@@ -1040,11 +1354,9 @@ void casr (unsigned level)
             (unsigned int) freeListItemsAvail ( rsrvChanFreeList ),
             (unsigned int) freeListItemsAvail ( rsrvEventFreeList ),
             (unsigned int) freeListItemsAvail ( rsrvPutNotifyFreeList ));
-        printf( "    %u small (%u byte) buffers, %u jumbo (%u byte) buffers\n",
+        printf( "    %u small (%u byte) buffers\n",
             (unsigned int) freeListItemsAvail ( rsrvSmallBufFreeListTCP ),
-            MAX_TCP,
-            (unsigned int)(rsrvLargeBufFreeListTCP ? freeListItemsAvail ( rsrvLargeBufFreeListTCP ) : -1),
-            rsrvSizeofLargeBufTCP );
+            MAX_TCP );
         printf( "Server resource id table:\n");
         LOCK_CLIENTQ;
         bucketShow (pCaBucket);
@@ -1070,15 +1382,13 @@ void destroy_client ( struct client *client )
     }
 
     if ( client->proto == IPPROTO_TCP ) {
+        casSendDiscard ( client );
         if ( client->send.buf ) {
             if ( client->send.type == mbtSmallTCP ) {
                 freeListFree ( rsrvSmallBufFreeListTCP,  client->send.buf );
             }
             else if ( client->send.type == mbtLargeTCP ) {
-                if(rsrvLargeBufFreeListTCP)
-                    freeListFree ( rsrvLargeBufFreeListTCP,  client->send.buf );
-                else
-                    free(client->send.buf);
+                casLargeBufFree ( client->send.buf, client->send.maxstk );
             }
             else {
                 errlogPrintf ( "CAS: Corrupt send buffer free list type code=%u during client cleanup?\n",
@@ -1090,10 +1400,7 @@ void destroy_client ( struct client *client )
                 freeListFree ( rsrvSmallBufFreeListTCP,  client->recv.buf );
             }
             else if ( client->recv.type == mbtLargeTCP ) {
-                if(rsrvLargeBufFreeListTCP)
-                    freeListFree ( rsrvLargeBufFreeListTCP,  client->recv.buf );
-                else
-                    free(client->recv.buf);
+                casLargeBufFree ( client->recv.buf, client->recv.maxstk );
             }
             else {
                 errlogPrintf ( "CAS: Corrupt recv buffer free list type code=%u during client cleanup?\n",
@@ -1138,6 +1445,13 @@ void destroy_client ( struct client *client )
         free ( client->pHostName );
     }
 
+    free ( client->pCompressWork );
+
+    if ( client->pSharedRing ) {
+        caSharedRingDestroy ( client->pSharedRing );
+        free ( client->pSharedRing );
+    }
+
     freeListFree ( rsrvClientFreeList, client );
 }
 
@@ -1168,6 +1482,9 @@ static void destroyAllChannels (
             */
             epicsMutexMustLock ( client->eventqLock );
             pevext = (struct event_ext *) ellGet ( &pciu->eventq );
+            if ( pevext ) {
+                pevext->canceled = TRUE;
+            }
             epicsMutexUnlock ( client->eventqLock );
 
             if ( ! pevext ) {
@@ -1274,6 +1591,7 @@ struct client * create_client ( SOCKET sock, int proto )
 
     client->pUserName = NULL;
     client->pHostName = NULL;
+    ellInit ( & client->sendQ );
     ellInit ( & client->chanList );
     ellInit ( & client->chanPendingUpdateARList );
     ellInit ( & client->putNotifyQue );
@@ -1329,7 +1647,7 @@ void casExpandBuffer ( struct message_buffer *buf, ca_uint32_t size, int sendbuf
 {
     char *newbuf = NULL;
     unsigned newsize;
-    enum messageBufferType newtype;
+    enum messageBufferType newtype = mbtLargeTCP;
 
     assert (size > MAX_TCP);
 
@@ -1339,7 +1657,7 @@ void casExpandBuffer ( struct message_buffer *buf, ca_uint32_t size, int sendbuf
     if (size <= MAX_TCP) {
         return; /* shouldn't happen */
 
-    } else if(!rsrvLargeBufFreeListTCP) {
+    } else if(largeBufAuto) {
         // round up to multiple of 4K
         size = ((size-1)|0xfff)+1;
 
@@ -1347,20 +1665,26 @@ void casExpandBuffer ( struct message_buffer *buf, ca_uint32_t size, int sendbuf
             newbuf = realloc (buf->buf, size);
         else
             newbuf = malloc (size);
-        newtype = mbtLargeTCP;
         newsize = size;
 
-    } else if (size <= rsrvSizeofLargeBufTCP) {
-        newbuf = freeListCalloc ( rsrvLargeBufFreeListTCP );
-        newsize = rsrvSizeofLargeBufTCP;
-        newtype = mbtLargeTCP;
+        if (newbuf) {
+            if (buf->type==mbtLargeTCP) {
+                epicsAtomicAddSizeT ( &largeBufAutoBytes, size - buf->maxstk );
+            } else {
+                epicsAtomicIncrSizeT ( &largeBufAutoCount );
+                epicsAtomicAddSizeT ( &largeBufAutoBytes, size );
+            }
+        }
+
+    } else {
+        newbuf = casLargeBufAlloc ( size, &newsize );
     }
 
     if (newbuf) {
         /* copy existing buffer */
         if (sendbuf) {
             /* send buffer uses [0, stk) */
-            if (!rsrvLargeBufFreeListTCP && buf->type==mbtLargeTCP) {
+            if (largeBufAuto && buf->type==mbtLargeTCP) {
                 /* realloc already copied */
             } else {
                 memcpy ( newbuf, buf->buf, buf->stk );
@@ -1382,8 +1706,8 @@ void casExpandBuffer ( struct message_buffer *buf, ca_uint32_t size, int sendbuf
         /* free existing buffer */
         if(buf->type==mbtSmallTCP) {
             freeListFree ( rsrvSmallBufFreeListTCP,  buf->buf );
-        } else if(rsrvLargeBufFreeListTCP && buf->type==mbtLargeTCP) {
-            freeListFree ( rsrvLargeBufFreeListTCP,  buf->buf );
+        } else if(!largeBufAuto && buf->type==mbtLargeTCP) {
+            casLargeBufFree ( buf->buf, buf->maxstk );
         } else {
             /* realloc() already free()'d if necessary */
         }
@@ -1481,6 +1805,10 @@ struct client *create_tcp_client (SOCKET sock , const osiSockAddr *peerAddr)
     }
 
     status = db_add_extra_labor_event ( client->evuser, rsrv_extra_labor, client );
+    if (status == DB_EVENT_OK) {
+        status = db_add_event_batch_handler ( client->evuser,
+            rsrv_event_batch, client );
+    }
     if (status != DB_EVENT_OK) {
         errlogPrintf("CAS: unable to setup the event facility\n");
         destroy_tcp_client (client);
@@ -30,6 +30,8 @@
  */
 
 
+#define EPICS_PRIVATE_API
+
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -44,6 +46,7 @@
 #include "freeList.h"
 #include "osiSock.h"
 #include "taskwd.h"
+#include "cantProceed.h"
 
 #define epicsExportSharedSymbols
 #include "rsrv.h"
@@ -108,26 +111,159 @@ static void clean_addrq(struct client *client)
 }
 
 /*
- * CAST_SERVER
+ * rsrvRateUpdate ()
  *
- * service UDP messages
- * 
+ * Close the current rate window once it is at least a second old.
  */
-void cast_server(void *pParm)
+void rsrvRateUpdate ( rsrvRate *pRate, epicsUInt64 now )
 {
-    rsrv_iface_config *conf = pParm;
-    int                 status;
-    int                 count=0;
-    int                 mysocket=0;
-    struct sockaddr_in  new_recv_addr;
-    osiSocklen_t        recv_addr_size;
-    osiSockIoctl_t      nchars;
-    SOCKET              recv_sock, reply_sock;
-    struct client      *client;
+    epicsUInt64 elapsed = now - pRate->windowStart;
+
+    if ( elapsed < 1000000000u )
+        return;
+    if ( pRate->windowStart ) {
+        pRate->last = (unsigned) ( 1e9 *
+            ( pRate->total - pRate->windowCount ) / elapsed );
+        if ( pRate->last > pRate->peak )
+            pRate->peak = pRate->last;
+    }
+    pRate->windowStart = now;
+    pRate->windowCount = pRate->total;
+}
 
-    recv_addr_size = sizeof(new_recv_addr);
+/*
+ * rsrvRateGet ()
+ *
+ * Requests per second, including a window which is overdue
+ * because no requests have arrived to close it.
+ */
+double rsrvRateGet ( const rsrvRate *pRate )
+{
+    epicsUInt64 elapsed = epicsMonotonicGet () - pRate->windowStart;
 
-    reply_sock = conf->udp;
+    if ( ! pRate->windowStart )
+        return 0.0;
+    if ( elapsed >= 1000000000u )
+        return 1e9 * ( pRate->total - pRate->windowCount ) / elapsed;
+    return pRate->last;
+}
+
+/* datagram waiting for a search thread */
+typedef struct cast_dgram {
+    ELLNODE             node;
+    struct sockaddr_in  addr;
+    epicsTimeStamp      time;
+    unsigned            cnt;
+} cast_dgram;
+
+#define CAST_QUEUE_MAX 1024u    /* datagrams per receiver */
+#define CAST_BATCH_MAX 32u      /* datagrams from one sender per batch */
+#define CAST_RECV_MAX 8u        /* datagrams per receive system call */
+
+static int cast_ignored ( const struct sockaddr_in *addr )
+{
+    size_t idx;
+
+    for ( idx=0; casIgnoreAddrs[idx]; idx++ ) {
+        if ( addr->sin_addr.s_addr == casIgnoreAddrs[idx] )
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * cast_process ()
+ *
+ * Handle the datagram in client->recv from addr.  Replies to the
+ * same sender accumulate in client->send until cast_flush().
+ */
+static void cast_process ( struct client *client,
+    const struct sockaddr_in *addr )
+{
+    int status;
+    int count = 0;
+
+    client->recv.stk = 0ul;
+    client->minor_version_number = CA_UKN_MINOR_VERSION;
+    client->seqNoOfReq = 0;
+    rsrvRateUpdate ( &client->searches, epicsMonotonicGet () );
+
+    /*
+     * If we are talking to a new client flush to the old one 
+     * in case we are holding UDP messages waiting to 
+     * see if the next message is for this same client.
+     */
+    if (client->send.stk>sizeof(caHdr)) {
+        status = memcmp(&client->addr, addr, sizeof(*addr));
+        if(status){     
+            /* 
+             * if the address is different 
+             */
+            cas_send_dg_msg(client);
+            client->addr = *addr;
+        }
+    }
+    else {
+        client->addr = *addr;
+    }
+
+    if (CASDEBUG>1) {
+        char    buf[40];
+
+        ipAddrToDottedIP (&client->addr, buf, sizeof(buf));
+        errlogPrintf ("CAS: cast server msg of %d bytes from addr %s\n", 
+            client->recv.cnt, buf);
+    }
+
+    if (CASDEBUG>2)
+        count = ellCount (&client->chanList);
+
+    status = camessage ( client );
+    if(status == RSRV_OK){
+        if(client->recv.cnt !=
+            client->recv.stk){
+            char buf[40];
+
+            ipAddrToDottedIP (&client->addr, buf, sizeof(buf));
+
+            epicsPrintf ("CAS: partial (damaged?) UDP msg of %d bytes from %s ?\n",
+                client->recv.cnt - client->recv.stk, buf);
+
+            epicsTimeToStrftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S",
+                &client->time_at_last_recv);
+            epicsPrintf ("CAS: message received at %s\n", buf);
+        }
+    }
+    else if (CASDEBUG>0){
+        char buf[40];
+
+        ipAddrToDottedIP (&client->addr, buf, sizeof(buf));
+
+        epicsPrintf ("CAS: invalid (damaged?) UDP request from %s ?\n", buf);
+
+        epicsTimeToStrftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S",
+            &client->time_at_last_recv);
+        epicsPrintf ("CAS: message received at %s\n", buf);
+    }
+
+    if (CASDEBUG>2) {
+        if ( ellCount (&client->chanList) ) {
+            errlogPrintf ("CAS: Fnd %d name matches (%d tot)\n",
+                ellCount(&client->chanList)-count,
+                ellCount(&client->chanList));
+        }
+    }
+}
+
+static void cast_flush ( struct client *client )
+{
+    cas_send_dg_msg ( client );
+    clean_addrq ( client );
+}
+
+static struct client *cast_create_client ( SOCKET reply_sock, SOCKET recv_sock )
+{
+    struct client *client;
 
     /*
      * setup new client structure but reuse old structure if
@@ -141,14 +277,6 @@ void cast_server(void *pParm)
         }
         epicsThreadSleep(300.0);
     }
-    if (conf->startbcast) {
-        recv_sock = conf->udpbcast;
-        conf->bclient = client;
-    }
-    else {
-        recv_sock = conf->udp;
-        conf->client = client;
-    }
     client->udpRecv = recv_sock;
 
     casAttachThreadToClient ( client );
@@ -158,114 +286,304 @@ void cast_server(void *pParm)
      */
     rsrv_version_reply ( client );
 
-    /* these pointers become invalid after signaling casudp_startStopEvent */
-    conf = NULL;
+    return client;
+}
 
-    epicsEventSignal(casudp_startStopEvent);
+/*
+ * CAST_WORKER
+ *
+ * process datagrams queued by cast_dispatch()
+ */
+static void cast_worker ( void *pParm )
+{
+    rsrv_udp_pool *pool = pParm;
+    struct client *client;
 
-    while (TRUE) {
-        status = recvfrom (
-            recv_sock,
-            client->recv.buf,
-            client->recv.maxstk,
-            0,
-            (struct sockaddr *)&new_recv_addr, 
-            &recv_addr_size);
-        if (status < 0) {
-            if (SOCKERRNO != SOCK_EINTR) {
-                char sockErrBuf[64];
-                epicsSocketConvertErrnoToString ( 
-                    sockErrBuf, sizeof ( sockErrBuf ) );
-                epicsPrintf ("CAS: UDP recv error: %s\n",
-                        sockErrBuf);
-                epicsThreadSleep(1.0);
-            }
+    client = cast_create_client ( pool->sock, pool->recvSock );
 
-        } else {
-            size_t idx;
-            for(idx=0; casIgnoreAddrs[idx]; idx++)
-            {
-                if(new_recv_addr.sin_addr.s_addr==casIgnoreAddrs[idx]) {
-                    status = -1; /* ignore */
-                    break;
-                }
+    epicsMutexMustLock ( pool->lock );
+    pool->workers[pool->nworkers++] = client;
+    epicsMutexUnlock ( pool->lock );
+    epicsEventSignal ( pool->started );
+
+    while ( TRUE ) {
+        cast_dgram *batch[CAST_BATCH_MAX];
+        cast_dgram *pdg;
+        unsigned i, n = 0;
+        int more;
+
+        /*
+         * take the next datagram and any others from the same
+         * sender right behind it, so that their replies share
+         * one reply datagram
+         */
+        epicsMutexMustLock ( pool->lock );
+        while ( ! pool->held && n < CAST_BATCH_MAX &&
+                ( pdg = (cast_dgram *) ellFirst ( &pool->queue ) ) ) {
+            if ( n && memcmp ( &pdg->addr, &batch[0]->addr,
+                               sizeof ( pdg->addr ) ) )
+                break;
+            ellDelete ( &pool->queue, &pdg->node );
+            pool->nqueued--;
+            batch[n++] = pdg;
+        }
+        more = ! pool->held && pool->nqueued > 0;
+        epicsMutexUnlock ( pool->lock );
+
+        if ( n == 0 ) {
+            cast_flush ( client );
+            epicsEventMustWait ( pool->wakeup );
+            continue;
+        }
+        if ( more ) {
+            /* let another thread take the rest */
+            epicsEventSignal ( pool->wakeup );
+        }
+
+        for ( i = 0; i < n; i++ ) {
+            pdg = batch[i];
+            if ( casudp_ctl == ctlRun ) {
+                memcpy ( client->recv.buf, pdg + 1, pdg->cnt );
+                client->recv.cnt = pdg->cnt;
+                client->time_at_last_recv = pdg->time;
+                cast_process ( client, &pdg->addr );
             }
+            free ( pdg );
+        }
+        if ( ! more ) {
+            cast_flush ( client );
         }
+    }
+}
 
-        if (status >= 0 && casudp_ctl == ctlRun) {
-            client->recv.cnt = (unsigned) status;
-            client->recv.stk = 0ul;
-            epicsTimeGetCurrent(&client->time_at_last_recv);
+/*
+ * cast_recv_init ()
+ *
+ * Buffers for a batch of received datagrams.  Each can hold the
+ * largest datagram, as any of them may be a search request larger
+ * than an ethernet frame (which the IP layer fragments).
+ */
+static void cast_recv_init ( osiSockDatagram *dg )
+{
+    char *buf;
+    unsigned i;
+
+    buf = mallocMustSucceed ( CAST_RECV_MAX * MAX_UDP_RECV,
+        "cast_recv_init" );
+    for ( i = 0u; i < CAST_RECV_MAX; i++ ) {
+        dg[i].pBuf = buf;
+        dg[i].bufSize = MAX_UDP_RECV;
+        buf += MAX_UDP_RECV;
+    }
+}
 
-            client->minor_version_number = CA_UKN_MINOR_VERSION;
-            client->seqNoOfReq = 0;
+/*
+ * cast_recv ()
+ *
+ * Wait for datagrams and take as many as are waiting, up to
+ * CAST_RECV_MAX, with one system call where the OS allows it.
+ * Returns the number received.
+ */
+static unsigned cast_recv ( SOCKET sock, osiSockDatagram *dg )
+{
+    int status = epicsSocketRecvDatagrams ( sock, dg, CAST_RECV_MAX );
+
+    if (status < 0) {
+        if (SOCKERRNO != SOCK_EINTR) {
+            char sockErrBuf[64];
+            epicsSocketConvertErrnoToString ( 
+                sockErrBuf, sizeof ( sockErrBuf ) );
+            epicsPrintf ("CAS: UDP recv error: %s\n",
+                    sockErrBuf);
+            epicsThreadSleep(1.0);
+        }
+        return 0u;
+    }
+    return (unsigned) status;
+}
 
-            /*
-             * If we are talking to a new client flush to the old one 
-             * in case we are holding UDP messages waiting to 
-             * see if the next message is for this same client.
-             */
-            if (client->send.stk>sizeof(caHdr)) {
-                status = memcmp(&client->addr,
-                    &new_recv_addr, recv_addr_size);
-                if(status){     
-                    /* 
-                     * if the address is different 
-                     */
-                    cas_send_dg_msg(client);
-                    client->addr = new_recv_addr;
-                }
-            }
-            else {
-                client->addr = new_recv_addr;
-            }
+static int cast_recv_ignored ( const osiSockDatagram *dg )
+{
+    if ( dg->truncated ) {
+        if ( CASDEBUG > 0 ) {
+            char buf[40];
 
-            if (CASDEBUG>1) {
-                char    buf[40];
-    
-                ipAddrToDottedIP (&client->addr, buf, sizeof(buf));
-                errlogPrintf ("CAS: cast server msg of %d bytes from addr %s\n", 
-                    client->recv.cnt, buf);
+            ipAddrToDottedIP ( &dg->addr.ia, buf, sizeof(buf) );
+            epicsPrintf ( "CAS: truncated UDP msg from %s ignored\n", buf );
+        }
+        return TRUE;
+    }
+    return cast_ignored ( &dg->addr.ia ) || casudp_ctl != ctlRun;
+}
+
+/*
+ * cast_dispatch ()
+ *
+ * receive datagrams and queue them for the search threads
+ */
+static void cast_dispatch ( rsrv_udp_pool *pool )
+{
+    osiSockDatagram dg[CAST_RECV_MAX];
+
+    cast_recv_init ( dg );
+
+    while ( TRUE ) {
+        cast_dgram *batch[CAST_RECV_MAX];
+        epicsTimeStamp now;
+        unsigned nrecv, n = 0u, i;
+
+        nrecv = cast_recv ( pool->recvSock, dg );
+        epicsTimeGetCurrent ( &now );
+
+        for ( i = 0u; i < nrecv; i++ ) {
+            cast_dgram *pdg;
+
+            if ( cast_recv_ignored ( &dg[i] ) )
+                continue;
+            pdg = malloc ( sizeof ( *pdg ) + dg[i].nBytes );
+            if ( ! pdg )
+                continue;
+            pdg->addr = dg[i].addr.ia;
+            pdg->cnt = dg[i].nBytes;
+            pdg->time = now;
+            memcpy ( pdg + 1, dg[i].pBuf, pdg->cnt );
+            batch[n++] = pdg;
+        }
+        if ( n == 0u )
+            continue;
+
+        epicsMutexMustLock ( pool->lock );
+        for ( i = 0u; i < n; i++ ) {
+            if ( pool->nqueued >= CAST_QUEUE_MAX ) {
+                /* clients repeat unanswered searches */
+                pool->ndropped++;
+                free ( batch[i] );
+                continue;
             }
+            ellAdd ( &pool->queue, &batch[i]->node );
+            if ( ++pool->nqueued > pool->maxQueued )
+                pool->maxQueued = pool->nqueued;
+        }
+        epicsMutexUnlock ( pool->lock );
+        epicsEventSignal ( pool->wakeup );
+    }
+}
+
+static rsrv_udp_pool *cast_pool_create ( SOCKET reply_sock, SOCKET recv_sock )
+{
+    rsrv_udp_pool *pool;
+    int i;
+
+    pool = callocMustSucceed ( 1, sizeof ( *pool ), "cast_pool_create" );
+    pool->lock = epicsMutexMustCreate ();
+    pool->wakeup = epicsEventMustCreate ( epicsEventEmpty );
+    pool->started = epicsEventMustCreate ( epicsEventEmpty );
+    ellInit ( &pool->queue );
+    pool->sock = reply_sock;
+    pool->recvSock = recv_sock;
+    pool->workers = callocMustSucceed ( casUdpSearchThreads,
+        sizeof ( struct client * ), "cast_pool_create" );
+
+    for ( i = 0; i < casUdpSearchThreads; i++ ) {
+        epicsThreadMustCreate ( "CAS-UDP-search", threadPrios[4],
+            epicsThreadGetStackSize ( epicsThreadStackMedium ),
+            cast_worker, pool );
+        epicsEventMustWait ( pool->started );
+    }
+    return pool;
+}
+
+static void cast_pool_hold ( rsrv_udp_pool *pool, int hold )
+{
+    if ( ! pool )
+        return;
+    epicsMutexMustLock ( pool->lock );
+    pool->held = hold;
+    epicsMutexUnlock ( pool->lock );
+    epicsEventSignal ( pool->wakeup );
+}
 
-            if (CASDEBUG>2)
-                count = ellCount (&client->chanList);
+/*
+ * casUdpSearchHold ()
+ *
+ * Received datagrams stay queued (or are dropped once the queue is
+ * full) while the search threads are held.
+ */
+void casUdpSearchHold ( int hold )
+{
+    rsrv_iface_config *iface;
 
-            status = camessage ( client );
-            if(status == RSRV_OK){
-                if(client->recv.cnt !=
-                    client->recv.stk){
-                    char buf[40];
+    for ( iface = (rsrv_iface_config *) ellFirst ( &servers ); iface;
+          iface = (rsrv_iface_config *) ellNext ( &iface->node ) ) {
+        cast_pool_hold ( iface->pool, hold );
+        cast_pool_hold ( iface->bpool, hold );
+    }
+}
 
-                    ipAddrToDottedIP (&client->addr, buf, sizeof(buf));
+/*
+ * CAST_SERVER
+ *
+ * service UDP messages
+ * 
+ */
+void cast_server(void *pParm)
+{
+    rsrv_iface_config *conf = pParm;
+    int                 status;
+    osiSockDatagram     dg[CAST_RECV_MAX];
+    osiSockIoctl_t      nchars;
+    SOCKET              recv_sock, reply_sock;
+    struct client      *client;
 
-                    epicsPrintf ("CAS: partial (damaged?) UDP msg of %d bytes from %s ?\n",
-                        client->recv.cnt - client->recv.stk, buf);
+    reply_sock = conf->udp;
+    recv_sock = conf->startbcast ? conf->udpbcast : conf->udp;
 
-                    epicsTimeToStrftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S",
-                        &client->time_at_last_recv);
-                    epicsPrintf ("CAS: message received at %s\n", buf);
-                }
-            }
-            else if (CASDEBUG>0){
-                char buf[40];
+    if ( casUdpSearchThreads > 0 ) {
+        rsrv_udp_pool *pool = cast_pool_create ( reply_sock, recv_sock );
 
-                ipAddrToDottedIP (&client->addr, buf, sizeof(buf));
+        if (conf->startbcast)
+            conf->bpool = pool;
+        else
+            conf->pool = pool;
 
-                epicsPrintf ("CAS: invalid (damaged?) UDP request from %s ?\n", buf);
+        /* these pointers become invalid after signaling casudp_startStopEvent */
+        conf = NULL;
 
-                epicsTimeToStrftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S",
-                    &client->time_at_last_recv);
-                epicsPrintf ("CAS: message received at %s\n", buf);
-            }
+        epicsEventSignal(casudp_startStopEvent);
 
-            if (CASDEBUG>2) {
-                if ( ellCount (&client->chanList) ) {
-                    errlogPrintf ("CAS: Fnd %d name matches (%d tot)\n",
-                        ellCount(&client->chanList)-count,
-                        ellCount(&client->chanList));
-                }
-            }
+        cast_dispatch ( pool );
+        return;
+    }
+
+    client = cast_create_client ( reply_sock, recv_sock );
+    if (conf->startbcast) {
+        conf->bclient = client;
+    }
+    else {
+        conf->client = client;
+    }
+
+    /* these pointers become invalid after signaling casudp_startStopEvent */
+    conf = NULL;
+
+    epicsEventSignal(casudp_startStopEvent);
+
+    cast_recv_init ( dg );
+
+    while (TRUE) {
+        unsigned nrecv, i;
+
+        nrecv = cast_recv ( recv_sock, dg );
+        if ( nrecv )
+            epicsTimeGetCurrent(&client->time_at_last_recv);
+
+        for ( i = 0u; i < nrecv; i++ ) {
+            if ( cast_recv_ignored ( &dg[i] ) ||
+                    dg[i].nBytes > client->recv.maxstk )
+                continue;
+            memcpy ( client->recv.buf, dg[i].pBuf, dg[i].nBytes );
+            client->recv.cnt = dg[i].nBytes;
+            cast_process ( client, &dg[i].addr.ia );
         }
 
         /*
@@ -275,19 +593,10 @@ void cast_server(void *pParm)
         status = socket_ioctl(recv_sock, FIONREAD, &nchars);
         if (status<0) {
             errlogPrintf ("CA cast server: Unable to fetch N characters pending\n");
-            cas_send_dg_msg (client);
-            clean_addrq (client);
+            cast_flush (client);
         }
         else if (nchars == 0) {
-            cas_send_dg_msg (client);
-            clean_addrq (client);
+            cast_flush (client);
         }
     }
-
-    /* ATM never reached, just a placeholder */
-
-    if(!mysocket)
-        client->sock = INVALID_SOCKET; /* only one cast_server should destroy the reply socket */
-    destroy_client(client);
-    epicsSocketDestroy(recv_sock);
 }
@@ -0,0 +1,336 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+
+/*
+ *  Reports of the traffic counted per client and per channel
+ *  by the CA server, cf. rsrvTraffic in server.h
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "dbDefs.h"
+#include "epicsStdio.h"
+#include "epicsString.h"
+#include "errlog.h"
+#include "osiSock.h"
+
+#define epicsExportSharedSymbols
+#include "dbChannel.h"
+#include "dbEvent.h"
+#include "rsrv.h"
+#include "server.h"
+
+/* one line of the casTop() tables */
+typedef struct trafficEntry {
+    rsrvTraffic traffic;
+    size_t      key;            /* the sort field of traffic */
+    char        *name;          /* channel name, NULL for a client */
+    char        client[64];
+} trafficEntry;
+
+static const struct {
+    const char  *name;
+    const char  *title;
+    size_t      offset;
+} trafficKeys[] = {
+    { "bytes",    "bytes sent",       offsetof ( rsrvTraffic, bytesOut ) },
+    { "msgs",     "messages sent",    offsetof ( rsrvTraffic, msgsOut ) },
+    { "in",       "bytes received",   offsetof ( rsrvTraffic, bytesIn ) },
+    { "updates",  "monitor updates",  offsetof ( rsrvTraffic, updates ) },
+    { "squashed", "squashed updates", offsetof ( rsrvTraffic, squashed ) },
+    { "coalesced", "coalesced updates", offsetof ( rsrvTraffic, coalesced ) },
+    { "gets",     "gets",             offsetof ( rsrvTraffic, gets ) },
+    { "puts",     "puts",             offsetof ( rsrvTraffic, puts ) },
+};
+
+/*
+ * live_squashed ()
+ *
+ * updates squashed on the event queue for the subscriptions of
+ * a channel which have not been cancelled
+ */
+static size_t live_squashed ( struct client *client,
+    struct channel_in_use *pciu )
+{
+    struct event_ext *pevext;
+    size_t n = 0u;
+
+    epicsMutexMustLock ( client->eventqLock );
+    for ( pevext = (struct event_ext *) ellFirst ( &pciu->eventq );
+            pevext; pevext = (struct event_ext *) ellNext ( &pevext->node ) ) {
+        if ( pevext->pdbev )
+            n += db_event_replaced ( pevext->pdbev );
+    }
+    epicsMutexUnlock ( client->eventqLock );
+    return n;
+}
+
+/*
+ * snapshot of the traffic of a channel and of a client
+ * caller holds client->chanListLock
+ */
+static void channel_traffic ( struct client *client,
+    struct channel_in_use *pciu, rsrvTraffic *pChan, rsrvTraffic *pClient )
+{
+    size_t live = live_squashed ( client, pciu );
+
+    *pChan = pciu->traffic;
+    pChan->squashed += live;
+    pClient->squashed += live;
+}
+
+static void client_name ( struct client *client, char *pBuf, size_t bufSize )
+{
+    if ( client->pUserName && client->pHostName ) {
+        epicsSnprintf ( pBuf, bufSize, "%s@%s",
+            client->pUserName, client->pHostName );
+    }
+    else {
+        ipAddrToDottedIP ( &client->addr, pBuf, bufSize );
+    }
+}
+
+static int compare_entries ( const void *pA, const void *pB )
+{
+    const trafficEntry *a = pA, *b = pB;
+
+    if ( a->key != b->key )
+        return a->key < b->key ? 1 : -1;
+    return 0;
+}
+
+static void show_entries ( const char *kind, trafficEntry *pEntries,
+    unsigned n, unsigned count, unsigned key )
+{
+    unsigned i;
+
+    qsort ( pEntries, n, sizeof ( *pEntries ), compare_entries );
+    printf ( "Top %u of %u %s by %s:\n", count < n ? count : n, n,
+        kind, trafficKeys[key].title );
+    printf ( "%12s %10s %12s %10s %10s %10s %10s %8s %8s  %s\n",
+        "bytes out", "msgs out", "bytes in", "msgs in",
+        "updates", "squashed", "coalesced", "gets", "puts", "name" );
+    for ( i = 0u; i < n && i < count; i++ ) {
+        const rsrvTraffic *t = &pEntries[i].traffic;
+
+        printf ( "%12lu %10lu %12lu %10lu %10lu %10lu %10lu %8lu %8lu  ",
+            (unsigned long) t->bytesOut, (unsigned long) t->msgsOut,
+            (unsigned long) t->bytesIn, (unsigned long) t->msgsIn,
+            (unsigned long) t->updates, (unsigned long) t->squashed,
+            (unsigned long) t->coalesced,
+            (unsigned long) t->gets, (unsigned long) t->puts );
+        if ( pEntries[i].name )
+            printf ( "%s (%s)\n", pEntries[i].name, pEntries[i].client );
+        else
+            printf ( "%s\n", pEntries[i].client );
+    }
+}
+
+/*
+ * casTop ()
+ *
+ * show the channels and clients with the most traffic
+ */
+void casTop ( unsigned count, const char *sortKey )
+{
+    trafficEntry *pChans, *pClients;
+    unsigned nChans = 0u, nClients = 0u, maxChans, maxClients;
+    unsigned key = 0u, i;
+    struct client *client;
+
+    if ( ! clientQlock ) {
+        printf ( "The CA server is not running\n" );
+        return;
+    }
+    if ( count == 0u )
+        count = 10u;
+    if ( sortKey && *sortKey ) {
+        for ( key = 0u; key < NELEMENTS ( trafficKeys ); key++ ) {
+            if ( strcmp ( sortKey, trafficKeys[key].name ) == 0 )
+                break;
+        }
+        if ( key >= NELEMENTS ( trafficKeys ) ) {
+            printf ( "Unknown sort key '%s', use one of", sortKey );
+            for ( key = 0u; key < NELEMENTS ( trafficKeys ); key++ )
+                printf ( " %s", trafficKeys[key].name );
+            printf ( "\n" );
+            return;
+        }
+    }
+
+    LOCK_CLIENTQ;
+    maxClients = ellCount ( &clientQ );
+    maxChans = rsrvChannelCount;
+    pClients = calloc ( maxClients + 1u, sizeof ( *pClients ) );
+    pChans = calloc ( maxChans + 1u, sizeof ( *pChans ) );
+    if ( ! pClients || ! pChans ) {
+        UNLOCK_CLIENTQ;
+        free ( pClients );
+        free ( pChans );
+        errlogPrintf ( "casTop: no memory for %u channels\n", maxChans );
+        return;
+    }
+
+    for ( client = (struct client *) ellFirst ( &clientQ );
+            client && nClients < maxClients;
+            client = (struct client *) ellNext ( &client->node ) ) {
+        trafficEntry *pClient = &pClients[nClients++];
+        ELLLIST *lists[2];
+        unsigned j;
+
+        client_name ( client, pClient->client, sizeof ( pClient->client ) );
+        pClient->traffic = client->traffic;
+
+        lists[0] = &client->chanList;
+        lists[1] = &client->chanPendingUpdateARList;
+        epicsMutexMustLock ( client->chanListLock );
+        for ( j = 0u; j < NELEMENTS ( lists ); j++ ) {
+            struct channel_in_use *pciu;
+
+            for ( pciu = (struct channel_in_use *) ellFirst ( lists[j] );
+                    pciu && nChans < maxChans;
+                    pciu = (struct channel_in_use *) ellNext ( &pciu->node ) ) {
+                trafficEntry *pChan = &pChans[nChans];
+
+                pChan->name = epicsStrDup ( dbChannelName ( pciu->dbch ) );
+                strcpy ( pChan->client, pClient->client );
+                channel_traffic ( client, pciu, &pChan->traffic,
+                    &pClient->traffic );
+                pChan->key = *(size_t *) ( (char *) &pChan->traffic +
+                    trafficKeys[key].offset );
+                nChans++;
+            }
+        }
+        epicsMutexUnlock ( client->chanListLock );
+        pClient->key = *(size_t *) ( (char *) &pClient->traffic +
+            trafficKeys[key].offset );
+    }
+    UNLOCK_CLIENTQ;
+
+    show_entries ( "channels", pChans, nChans, count, key );
+    show_entries ( "clients", pClients, nClients, count, key );
+
+    for ( i = 0u; i < nChans; i++ )
+        free ( pChans[i].name );
+    free ( pChans );
+    free ( pClients );
+}
+
+static void dump_string ( FILE *fp, const char *str )
+{
+    putc ( '"', fp );
+    for ( ; *str; str++ ) {
+        unsigned char c = (unsigned char) *str;
+
+        if ( c == '"' || c == '\\' )
+            fprintf ( fp, "\\%c", c );
+        else if ( c < 0x20u )
+            fprintf ( fp, "\\u%04x", c );
+        else
+            putc ( c, fp );
+    }
+    putc ( '"', fp );
+}
+
+static void dump_traffic ( FILE *fp, const rsrvTraffic *t )
+{
+    fprintf ( fp, "\"msgsIn\":%lu,\"bytesIn\":%lu,"
+        "\"msgsOut\":%lu,\"bytesOut\":%lu,"
+        "\"gets\":%lu,\"puts\":%lu,\"updates\":%lu,\"squashed\":%lu,"
+        "\"coalesced\":%lu",
+        (unsigned long) t->msgsIn, (unsigned long) t->bytesIn,
+        (unsigned long) t->msgsOut, (unsigned long) t->bytesOut,
+        (unsigned long) t->gets, (unsigned long) t->puts,
+        (unsigned long) t->updates, (unsigned long) t->squashed,
+        (unsigned long) t->coalesced );
+}
+
+/*
+ * casTrafficDump ()
+ *
+ * write the traffic of all clients and their channels as JSON
+ * to a file, or to stdout if no file name is given
+ */
+int casTrafficDump ( const char *fileName )
+{
+    FILE *fp = epicsGetStdout ();
+    struct client *client;
+    int first = 1;
+
+    if ( ! clientQlock ) {
+        errlogPrintf ( "casTrafficDump: the CA server is not running\n" );
+        return -1;
+    }
+    if ( fileName && *fileName ) {
+        fp = fopen ( fileName, "w" );
+        if ( ! fp ) {
+            errlogPrintf ( "casTrafficDump: can't create '%s'\n", fileName );
+            return -1;
+        }
+    }
+
+    fprintf ( fp, "{\"clients\":[" );
+    LOCK_CLIENTQ;
+    for ( client = (struct client *) ellFirst ( &clientQ ); client;
+            client = (struct client *) ellNext ( &client->node ) ) {
+        rsrvTraffic total = client->traffic;
+        ELLLIST *lists[2];
+        char addr[40];
+        int firstChan = 1;
+        unsigned j;
+
+        ipAddrToDottedIP ( &client->addr, addr, sizeof ( addr ) );
+        fprintf ( fp, "%s\n{\"addr\":", first ? "" : "," );
+        dump_string ( fp, addr );
+        fprintf ( fp, ",\"host\":" );
+        dump_string ( fp, client->pHostName ? client->pHostName : "" );
+        fprintf ( fp, ",\"user\":" );
+        dump_string ( fp, client->pUserName ? client->pUserName : "" );
+        fprintf ( fp, ",\"channels\":[" );
+        first = 0;
+
+        lists[0] = &client->chanList;
+        lists[1] = &client->chanPendingUpdateARList;
+        epicsMutexMustLock ( client->chanListLock );
+        for ( j = 0u; j < NELEMENTS ( lists ); j++ ) {
+            struct channel_in_use *pciu;
+
+            for ( pciu = (struct channel_in_use *) ellFirst ( lists[j] );
+                    pciu;
+                    pciu = (struct channel_in_use *) ellNext ( &pciu->node ) ) {
+                rsrvTraffic chan;
+
+                channel_traffic ( client, pciu, &chan, &total );
+                fprintf ( fp, "%s\n {\"name\":", firstChan ? "" : "," );
+                dump_string ( fp, dbChannelName ( pciu->dbch ) );
+                fprintf ( fp, ",\"cid\":%u,\"sid\":%u,", pciu->cid, pciu->sid );
+                dump_traffic ( fp, &chan );
+                fprintf ( fp, "}" );
+                firstChan = 0;
+            }
+        }
+        epicsMutexUnlock ( client->chanListLock );
+
+        fprintf ( fp, "],\n " );
+        dump_traffic ( fp, &total );
+        fprintf ( fp, "}" );
+    }
+    UNLOCK_CLIENTQ;
+    fprintf ( fp, "\n]}\n" );
+
+    if ( fp != epicsGetStdout () ) {
+        if ( fclose ( fp ) ) {
+            errlogPrintf ( "casTrafficDump: error writing '%s'\n", fileName );
+            return -1;
+        }
+    }
+    else {
+        fflush ( fp );
+    }
+    return 0;
+}
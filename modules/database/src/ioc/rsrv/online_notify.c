@@ -47,6 +47,8 @@ void rsrv_online_notify_task(void *pParm)
     int                         status;
     ca_uint32_t                 beaconCounter = 0;
     int *lastError;
+    osiSockDatagram *dg;
+    unsigned nAddrs;
     
     taskwdInsert (epicsThreadGetIdSelf(),NULL,NULL);
     
@@ -73,20 +75,32 @@ void rsrv_online_notify_task(void *pParm)
     msg.m_dataType = htons (CA_MINOR_PROTOCOL_REVISION);
 
     /* beaconAddrList should not change after rsrv_init(), which then starts this thread */
-    lastError = callocMustSucceed(ellCount(&beaconAddrList), sizeof(*lastError), "rsrv_online_notify_task lastError");
+    nAddrs = ellCount(&beaconAddrList);
+    lastError = callocMustSucceed(nAddrs + 1, sizeof(*lastError), "rsrv_online_notify_task lastError");
 
-    epicsEventSignal(beacon_startStopEvent);
-
-    while (TRUE) {
+    /* one beacon datagram per address, all sent with as few system calls as possible */
+    dg = callocMustSucceed(nAddrs + 1, sizeof(*dg), "rsrv_online_notify_task dg");
+    {
         ELLNODE *cur;
         unsigned i;
 
-        /* send beacon to each interface */
         for(i=0, cur=ellFirst(&beaconAddrList); cur; i++, cur=ellNext(cur))
         {
             osiSockAddrNode *pAddr = CONTAINER(cur, osiSockAddrNode, node);
-            status = sendto (beaconSocket, (char *)&msg, sizeof(msg), 0,
-                             &pAddr->addr.sa, sizeof(pAddr->addr));
+            dg[i].pBuf = &msg;
+            dg[i].bufSize = sizeof(msg);
+            dg[i].addr = pAddr->addr;
+        }
+    }
+
+    epicsEventSignal(beacon_startStopEvent);
+
+    while (TRUE) {
+        unsigned i = 0, nSent;
+
+        /* send beacon to each interface */
+        while (i < nAddrs) {
+            status = epicsSocketSendDatagrams (beaconSocket, &dg[i], nAddrs - i);
             if (status < 0) {
                 int err = SOCKERRNO;
                 if(err != lastError[i]) {
@@ -94,19 +108,20 @@ void rsrv_online_notify_task(void *pParm)
                     char sockDipBuf[22];
 
                     epicsSocketConvertErrorToString(sockErrBuf, sizeof(sockErrBuf), err);
-                    ipAddrToDottedIP(&pAddr->addr.ia, sockDipBuf, sizeof(sockDipBuf));
+                    ipAddrToDottedIP(&dg[i].addr.ia, sockDipBuf, sizeof(sockDipBuf));
                     errlogPrintf ( "CAS: CA beacon send to %s error: %s\n",
                         sockDipBuf, sockErrBuf);
 
                     lastError[i] = err;
                 }
+                i++;
+                continue;
             }
-            else {
-                assert (status == sizeof(msg));
+            for (nSent = i + status; i < nSent; i++) {
                 if(lastError[i]) {
                     char sockDipBuf[22];
 
-                    ipAddrToDottedIP(&pAddr->addr.ia, sockDipBuf, sizeof(sockDipBuf));
+                    ipAddrToDottedIP(&dg[i].addr.ia, sockDipBuf, sizeof(sockDipBuf));
                     errlogPrintf ( "CAS: CA beacon send to %s ok\n",
                         sockDipBuf);
                 }
@@ -130,6 +145,7 @@ void rsrv_online_notify_task(void *pParm)
         }
     }
 
+    free(dg);
     free(lastError);
 }
 
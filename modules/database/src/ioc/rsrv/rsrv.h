@@ -34,6 +34,26 @@ epicsShareFunc int casClientInitiatingCurrentThread (
                         char * pBuf, size_t bufSize );
 epicsShareFunc void casStatsFetch (
                         unsigned *pChanCount, unsigned *pConnCount );
+epicsShareFunc void casTop ( unsigned count, const char *sortKey );
+epicsShareFunc int casTrafficDump ( const char *fileName );
+epicsShareFunc long casSearchTest ( const char *pName );
+epicsShareFunc void casSearchFilterStatsFetch ( unsigned *pNames,
+                        unsigned *pRebuilds, size_t *pFound,
+                        size_t *pRejected, size_t *pFalse );
+
+#ifdef EPICS_PRIVATE_API
+/* for tests, the size classes of large TCP buffers */
+epicsShareFunc int casLargeBufClassFind ( unsigned size,
+                        unsigned *pIndex, unsigned *pClassSize );
+epicsShareFunc int casLargeBufClassStatus ( unsigned index,
+                        unsigned *pSize, size_t *pInUse, size_t *pMaxInUse );
+/* for tests, the UDP search threads of all receivers, as casr shows them */
+epicsShareFunc void casUdpSearchStatus ( unsigned *pThreads,
+                        unsigned *pQueued, unsigned *pMaxQueued,
+                        size_t *pDropped, size_t *pSearches, double *pRate );
+/* for tests, stop (hold!=0) or restart the UDP search threads */
+epicsShareFunc void casUdpSearchHold ( int hold );
+#endif
 
 #ifdef __cplusplus
 }
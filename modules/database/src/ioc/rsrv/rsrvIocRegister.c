@@ -25,12 +25,39 @@ static void casrCallFunc(const iocshArgBuf *args)
     casr(args[0].ival);
 }
 
+/* casTop */
+static const iocshArg casTopArg0 = { "count",iocshArgInt};
+static const iocshArg casTopArg1 = { "sort by",iocshArgString};
+static const iocshArg * const casTopArgs[2] = {&casTopArg0,&casTopArg1};
+static const iocshFuncDef casTopFuncDef = {"casTop",2,casTopArgs};
+static void casTopCallFunc(const iocshArgBuf *args)
+{
+    casTop(args[0].ival, args[1].sval);
+}
+
+/* casTrafficDump */
+static const iocshArg casTrafficDumpArg0 = { "file name",iocshArgString};
+static const iocshArg * const casTrafficDumpArgs[1] = {&casTrafficDumpArg0};
+static const iocshFuncDef casTrafficDumpFuncDef =
+    {"casTrafficDump",1,casTrafficDumpArgs};
+static void casTrafficDumpCallFunc(const iocshArgBuf *args)
+{
+    casTrafficDump(args[0].sval);
+}
+
 static
 void rsrvRegistrar(void)
 {
     rsrv_register_server();
     iocshRegister(&casrFuncDef,casrCallFunc);
+    iocshRegister(&casTopFuncDef,casTopCallFunc);
+    iocshRegister(&casTrafficDumpFuncDef,casTrafficDumpCallFunc);
 }
 
 epicsExportAddress(int, CASDEBUG);
+epicsExportAddress(int, casUdpSearchThreads);
+epicsExportAddress(int, casTcpIoThreads);
+epicsExportAddress(int, casCompressMinBytes);
+epicsExportAddress(int, casSharedMemMinBytes);
+epicsExportAddress(int, casSearchFilterBits);
 epicsExportRegistrar(rsrvRegistrar);
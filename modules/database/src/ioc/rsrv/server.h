@@ -27,10 +27,11 @@
 #include "asLib.h"
 #include "dbChannel.h"
 #include "dbNotify.h"
-#define CA_MINOR_PROTOCOL_REVISION 13
+#define CA_MINOR_PROTOCOL_REVISION 15
 #include "caProto.h"
 #include "ellLib.h"
 #include "epicsTime.h"
+#include "epicsTimer.h"
 #include "epicsAssert.h"
 #include "osiSock.h"
 
@@ -71,12 +72,61 @@ struct message_buffer {
   enum messageBufferType    type;
 };
 
+/* full TCP send buffer queued behind client::send */
+typedef struct send_segment {
+    ELLNODE         node;
+    char            *buf;
+    unsigned        stk;
+    unsigned        maxstk;     /* size, for casFreeBuffer() */
+    enum messageBufferType type;
+} send_segment;
+
+#define RSRV_SEND_QUEUE_MAX 8u  /* buffers queued behind client::send */
+
 extern epicsThreadPrivateId rsrvCurrentClient;
 
+/*
+ * Request counter which also tracks the rate over about the
+ * last second, cf. rsrvRateUpdate()
+ */
+typedef struct rsrvRate {
+    epicsUInt64     windowStart;    /* epicsMonotonicGet() */
+    size_t          windowCount;    /* total at windowStart */
+    size_t          total;
+    unsigned        last;           /* per second, previous window */
+    unsigned        peak;           /* per second */
+} rsrvRate;
+
+/*
+ * Traffic counters of a client or channel.  Each is only written by
+ * one thread at a time, either the thread receiving the client's
+ * requests (In, gets, puts) or a thread holding SEND_LOCK() (Out,
+ * updates, coalesced), so plain increments suffice; readers accept
+ * stale values.
+ * The squashed count of monitor updates replaced while queued is
+ * kept by dbEvent, and only added here when a subscription is
+ * cancelled, under client::eventqLock.
+ */
+typedef struct rsrvTraffic {
+    size_t          msgsIn, bytesIn;    /* requests received */
+    size_t          msgsOut, bytesOut;  /* responses and updates sent */
+    size_t          gets, puts;
+    size_t          updates;            /* monitor updates sent */
+    size_t          squashed;           /* of cancelled subscriptions */
+    size_t          coalesced;          /* DBE_LATEST updates not sent */
+} rsrvTraffic;
+
+struct rsrv_io_loop;
+
 typedef struct client {
   ELLNODE               node;
   /*! guarded by SEND_LOCK()  aka. client::lock */
   struct message_buffer send;
+  /*! TCP buffers waiting to be sent before send, guarded by SEND_LOCK() */
+  ELLLIST               sendQ;
+  unsigned              sendQBytes;
+  /*! bytes of the first of sendQ and send already sent */
+  unsigned              sendOffset;
   /*! accessed by receive thread w/o locks cf. camsgtask() */
   struct message_buffer recv;
   epicsMutexId          lock;
@@ -101,6 +151,35 @@ typedef struct client {
   unsigned              recvBytesToDrain;
   unsigned              priority;
   char                  disconnect; /* disconnect detected */
+  /*! UDP only, updated by the receiving thread */
+  rsrvRate              searches;
+  /*! TCP I/O thread serving this client, NULL for camsgtask() */
+  struct rsrv_io_loop   *ioLoop;
+  /*! epoll registration of an ioLoop client, guarded by SEND_LOCK() */
+  unsigned              ioEvents;
+  char                  ioAttached;
+  char                  sendBlocked;    /* socket full, waiting for EPOLLOUT */
+  char                  recvHeld;       /* until recvRetryTimer expires */
+  char                  sendHeld;       /* until sendRetryTimer expires */
+  char                  sendWaiting;    /* another thread waits for room */
+  /*! receive thread only, back off while out of network buffers */
+  double                recvRetryDelay;
+  epicsTimerId          recvRetryTimer;
+  /*! I/O thread sends, back off while out of network buffers */
+  double                sendRetryDelay;
+  epicsTimerId          sendRetryTimer;
+  /*! times the holder of SEND_LOCK() has taken it */
+  unsigned              sendLockDepth;
+  rsrvTraffic           traffic;
+  /*! event task only, numbers the batches of rsrv_event_batch() */
+  unsigned              eventBatchSeq;
+  /*! client accepts compressed payloads (CA V4.14) */
+  char                  compress;
+  /*! scratch space of cas_compress_msg(), locked by lock */
+  void                  *pCompressWork;
+  unsigned              compressWorkSize;
+  /*! payload ring of a client on this host (CA V4.15), locked by lock */
+  struct caSharedRing   *pSharedRing;
 } client;
 
 /* Channel state shows which struct client list a
@@ -139,6 +218,7 @@ struct channel_in_use {
     struct dbChannel *dbch;
     ASCLIENTPVT asClientPVT;
     enum rsrvChanState state;
+    rsrvTraffic traffic;
 };
 
 /*
@@ -153,8 +233,29 @@ struct event_ext {
     unsigned                size;       /* for speed */
     unsigned                mask;
     char                    modified;   /* mod & ev flw ctrl enbl */
+    char                    latest;     /* DBE_LATEST requested */
+    char                    canceled;   /* off eventq, guarded by eventqLock */
+    unsigned                batchSeq;   /* rsrv_event_batch() state */
+    unsigned                batchLast;
 };
 
+/*
+ * Queue and threads which process the datagrams received by one
+ * cast_server() when casUdpSearchThreads is set
+ */
+typedef struct rsrv_udp_pool {
+    epicsMutexId lock;
+    epicsEventId wakeup;
+    ELLLIST queue;              /* of queued datagrams */
+    unsigned nqueued, maxQueued;
+    size_t ndropped;            /* queue full */
+    unsigned nworkers;
+    struct client **workers;
+    SOCKET sock, recvSock;
+    epicsEventId started;
+    int held;                   /* for tests, cf. casUdpSearchHold() */
+} rsrv_udp_pool;
+
 typedef struct {
     ELLNODE node;
     osiSockAddr tcpAddr, /* TCP listener endpoint */
@@ -162,6 +263,7 @@ typedef struct {
                 udpbcastAddr; /* UDP name broadcast receiver endpoint */
     SOCKET tcp, udp, udpbcast;
     struct client *client, *bclient;
+    rsrv_udp_pool *pool, *bpool; /* NULL unless casUdpSearchThreads */
 
     unsigned int startbcast:1;
 } rsrv_iface_config;
@@ -201,7 +303,7 @@ GLBLTYPE void               *rsrvClientFreeList;
 GLBLTYPE void               *rsrvChanFreeList;
 GLBLTYPE void               *rsrvEventFreeList;
 GLBLTYPE void               *rsrvSmallBufFreeListTCP;
-GLBLTYPE void               *rsrvLargeBufFreeListTCP;
+GLBLTYPE void               *rsrvSendSegFreeList;
 GLBLTYPE unsigned           rsrvSizeofLargeBufTCP;
 GLBLTYPE void               *rsrvPutNotifyFreeList;
 GLBLTYPE unsigned           rsrvChannelCount; /* locked by clientQlock */
@@ -215,19 +317,57 @@ GLBLTYPE volatile enum ctl  castcp_ctl;
 
 GLBLTYPE unsigned int       threadPrios[5];
 
+/* threads processing UDP name searches from each socket, 0 for one
+ * thread which both receives and processes them */
+GLBLTYPE int                casUdpSearchThreads;
+
+/* threads serving all TCP clients, 0 for a thread per client */
+GLBLTYPE int                casTcpIoThreads;
+
+/* smallest read or update payload compressed for clients
+ * which accept it, 0 to never compress */
+GLBLTYPE int                casCompressMinBytes GLBLTYPE_INIT(16384);
+
+/* smallest read or update payload passed through the shared memory
+ * ring of a client on the same host, 0 to never attach a ring */
+GLBLTYPE int                casSharedMemMinBytes GLBLTYPE_INIT(4096);
+
+/* bits per record name in the filter of searched names, 0 disables it */
+GLBLTYPE int                casSearchFilterBits GLBLTYPE_INIT(16);
+
 #define CAS_HASH_TABLE_SIZE 4096
 
-#define SEND_LOCK(CLIENT) epicsMutexMustLock((CLIENT)->lock)
-#define SEND_UNLOCK(CLIENT) epicsMutexUnlock((CLIENT)->lock)
+#define SEND_LOCK(CLIENT) \
+    do { \
+        epicsMutexMustLock((CLIENT)->lock); \
+        (CLIENT)->sendLockDepth++; \
+    } while (0)
+#define SEND_UNLOCK(CLIENT) \
+    do { \
+        (CLIENT)->sendLockDepth--; \
+        epicsMutexUnlock((CLIENT)->lock); \
+    } while (0)
 
 #define LOCK_CLIENTQ    epicsMutexMustLock (clientQlock);
 #define UNLOCK_CLIENTQ  epicsMutexUnlock (clientQlock);
 
 void camsgtask (void *client);
+int camsgIoStart ( unsigned nthreads );
+int camsgIoAdd ( struct client *client );
+void camsgIoShow ( unsigned level );
+int camsgIoSelf ( const struct client *client );
+void camsgIoUpdate ( struct client *client );
+void camsgIoWaitWritable ( struct client *client );
+void camsgIoHoldSend ( struct client *client );
 void cas_send_bs_msg ( struct client *pclient, int lock_needed );
 void cas_send_dg_msg ( struct client *pclient );
+int casSendQueueBuffer ( struct client *pclient, unsigned msgSize );
+void casSendDiscard ( struct client *pclient );
 void rsrv_online_notify_task (void *);
 void cast_server (void *);
+void rsrvRateUpdate ( rsrvRate *pRate, epicsUInt64 now );
+void casSearchFilterShow ( unsigned level );
+double rsrvRateGet ( const rsrvRate *pRate );
 struct client *create_client ( SOCKET sock, int proto );
 void destroy_client ( struct client * );
 struct client *create_tcp_client ( SOCKET sock, const osiSockAddr* peerAddr );
@@ -235,6 +375,9 @@ void destroy_tcp_client ( struct client * );
 void casAttachThreadToClient ( struct client * );
 int camessage ( struct client *client );
 void rsrv_extra_labor ( void * pArg );
+struct dbEventBatchEntry;
+void rsrv_event_batch ( void *pArg, unsigned nEntries,
+    const struct dbEventBatchEntry *pEntries, int eventsRemaining );
 int rsrvCheckPut ( const struct channel_in_use *pciu );
 int rsrv_version_reply ( struct client *client );
 void rsrvFreePutNotify ( struct client *pClient,
@@ -251,6 +394,7 @@ void casExpandRecvBuffer ( struct client *pClient, ca_uint32_t size );
  * outgoing protocol maintenance
  */
 void casExpandSendBuffer ( struct client *pClient, ca_uint32_t size );
+void casFreeBuffer ( char *pBuf, enum messageBufferType type, unsigned size );
 int cas_copy_in_header (
     struct client *pClient, ca_uint16_t response, ca_uint32_t payloadSize,
     ca_uint16_t dataType, ca_uint32_t nElem, ca_uint32_t cid,
@@ -258,5 +402,11 @@ int cas_copy_in_header (
 void cas_set_header_cid ( struct client *pClient, ca_uint32_t );
 void cas_set_header_count (struct client *pClient, ca_uint32_t count);
 void cas_commit_msg ( struct client *pClient, ca_uint32_t size );
+void cas_commit_chan_msg ( struct client *pClient,
+    struct channel_in_use *pciu, ca_uint32_t size );
+ca_uint32_t cas_compress_msg ( struct client *pClient, ca_uint16_t dataType,
+    void *pPayload, ca_uint32_t size );
+ca_uint32_t cas_share_msg ( struct client *pClient,
+    void *pPayload, ca_uint32_t size );
 
 #endif /*INCLserverh*/
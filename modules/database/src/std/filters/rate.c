@@ -0,0 +1,208 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+
+/*
+ *  Rate limiting and decimation of monitor updates
+ */
+
+#include <stdio.h>
+
+#include <freeList.h>
+#include <dbConvertFast.h>
+#include <chfPlugin.h>
+#include <epicsExit.h>
+#include <epicsTime.h>
+#include <db_field_log.h>
+#include <epicsExport.h>
+
+typedef enum rateAgg {
+    rateAggNone=0,
+    rateAggMin=1,
+    rateAggMax=2,
+    rateAggMean=3
+} rateAgg;
+
+static const
+chfPluginEnumType aggEnum[] = {
+    {"none", rateAggNone},
+    {"min", rateAggMin},
+    {"max", rateAggMax},
+    {"mean", rateAggMean},
+    {NULL, 0}
+};
+
+typedef struct myStruct {
+    double rate;            /* max. updates per second, 0 for no limit */
+    epicsInt32 every;       /* forward every Nth update */
+    rateAgg agg;
+    epicsUInt64 interval;   /* min. ns between updates sent */
+    epicsUInt64 lastSent;   /* epicsMonotonicGet() */
+    int sent;
+    epicsInt32 count;       /* updates since the last one sent */
+    unsigned nagg;          /* values aggregated since then */
+    double aggval;
+} myStruct;
+
+static void *myStructFreeList;
+
+static const
+chfPluginArgDef opts[] = {
+    chfDouble (myStruct, rate,  "r", 0, 1),
+    chfInt32  (myStruct, every, "n", 0, 1),
+    chfEnum   (myStruct, agg,   "a", 0, 1, aggEnum),
+    chfPluginArgEnd
+};
+
+static void * allocPvt(void)
+{
+    return freeListCalloc(myStructFreeList);
+}
+
+static void freePvt(void *pvt)
+{
+    freeListFree(myStructFreeList, pvt);
+}
+
+static int parse_ok(void *pvt)
+{
+    myStruct *my = (myStruct*) pvt;
+
+    if (my->rate < 0. || my->every < 0)
+        return -1;
+    if (my->rate == 0. && my->every <= 1)
+        return -1;
+    if (my->every == 0)
+        my->every = 1;
+    if (my->rate > 0.)
+        my->interval = (epicsUInt64) (1e9 / my->rate);
+    return 0;
+}
+
+/* Only numeric scalars can be aggregated */
+static int canAggregate(const db_field_log *pfl)
+{
+    return pfl->type == dbfl_type_val &&
+        pfl->field_type > DBF_STRING && pfl->field_type <= DBF_DOUBLE;
+}
+
+static long convertValue(dbChannel *chan, db_field_log *pfl,
+    double *pval, int put)
+{
+    DBADDR localAddr = chan->addr; /* Structure copy */
+
+    localAddr.field_type = pfl->field_type;
+    localAddr.field_size = pfl->field_size;
+    localAddr.no_elements = pfl->no_elements;
+    localAddr.pfield = (char *) &pfl->u.v.field;
+    if (put)
+        return dbFastPutConvertRoutine[DBR_DOUBLE][pfl->field_type]
+            ((void*) pval, localAddr.pfield, &localAddr);
+    return dbFastGetConvertRoutine[pfl->field_type][DBR_DOUBLE]
+        (localAddr.pfield, (void*) pval, &localAddr);
+}
+
+static void aggregate(myStruct *my, double val)
+{
+    if (my->nagg++ == 0) {
+        my->aggval = val;
+        return;
+    }
+    switch (my->agg) {
+    case rateAggMin:
+        if (val < my->aggval)
+            my->aggval = val;
+        break;
+    case rateAggMax:
+        if (val > my->aggval)
+            my->aggval = val;
+        break;
+    case rateAggMean:
+        my->aggval += (val - my->aggval) / my->nagg;
+        break;
+    default:
+        break;
+    }
+}
+
+static db_field_log* filter(void* pvt, dbChannel *chan, db_field_log *pfl) {
+    myStruct *my = (myStruct*) pvt;
+    double val;
+
+    if (pfl->ctx == dbfl_context_read)
+        return pfl;
+
+    if (my->agg != rateAggNone && canAggregate(pfl) &&
+        !convertValue(chan, pfl, &val, 0))
+        aggregate(my, val);
+
+    if (++my->count < my->every)
+        goto drop;
+
+    if (my->interval) {
+        epicsUInt64 now = epicsMonotonicGet();
+
+        if (my->sent && now - my->lastSent < my->interval)
+            goto drop;
+        my->lastSent = now;
+        my->sent = 1;
+    }
+
+    if (my->nagg && canAggregate(pfl))
+        convertValue(chan, pfl, &my->aggval, 1);
+    my->count = 0;
+    my->nagg = 0;
+    return pfl;
+
+drop:
+    db_delete_field_log(pfl);
+    return NULL;
+}
+
+static void channelRegisterPre(dbChannel *chan, void *pvt,
+                               chPostEventFunc **cb_out, void **arg_out, db_field_log *probe)
+{
+    *cb_out = filter;
+    *arg_out = pvt;
+}
+
+static void channel_report(dbChannel *chan, void *pvt, int level, const unsigned short indent)
+{
+    myStruct *my = (myStruct*) pvt;
+    printf("%*sRate (rate): max. rate=%g/s, every=%d, aggregate=%s\n",
+           indent, "", my->rate, my->every,
+           chfPluginEnumString(aggEnum, my->agg, "n/a"));
+}
+
+static chfPluginIf pif = {
+    allocPvt,
+    freePvt,
+
+    NULL, /* parse_error, */
+    parse_ok,
+
+    NULL, /* channel_open, */
+    channelRegisterPre,
+    NULL, /* channelRegisterPost, */
+    channel_report,
+    NULL /* channel_close */
+};
+
+static void rateShutdown(void* ignore)
+{
+    if(myStructFreeList)
+        freeListCleanup(myStructFreeList);
+    myStructFreeList = NULL;
+}
+
+static void rateInitialize(void)
+{
+    if (!myStructFreeList)
+        freeListInitPvt(&myStructFreeList, sizeof(myStruct), 64);
+
+    chfPluginRegister("rate", &pif, opts);
+    epicsAtExit(rateShutdown, NULL);
+}
+
+epicsExportRegistrar(rateInitialize);
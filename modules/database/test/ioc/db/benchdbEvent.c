@@ -0,0 +1,170 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+
+/*
+ * Measure the cost of handing db_post_events() updates to an event task
+ * when many threads post to records monitored through one event context,
+ * with the lock-free intake rings and with the event queue mutex.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "epicsAtomic.h"
+#include "epicsEvent.h"
+#include "epicsThread.h"
+#include "epicsTime.h"
+#include "errlog.h"
+#include "dbAccess.h"
+#include "dbChannel.h"
+#include "dbEvent.h"
+#include "dbUnitTest.h"
+#include "testMain.h"
+
+#include "xRecord.h"
+
+void dbTestIoc_registerRecordDeviceDriver(struct dbBase *);
+
+#define MAXTHREADS 8
+#define NRECS (4*MAXTHREADS)
+
+typedef struct {
+    xRecord *prec[NRECS/MAXTHREADS];
+    unsigned niter;
+    epicsEventId start, done;
+} producer;
+
+static size_t ndelivered;
+
+static
+void monitor(void *user_arg, struct dbChannel *chan,
+             int eventsRemaining, struct db_field_log *pfl)
+{
+    epicsAtomicIncrSizeT(&ndelivered);
+}
+
+static
+void produce(void *raw)
+{
+    producer *P = raw;
+    unsigned i, j;
+
+    epicsEventMustWait(P->start);
+    for (i = 0; i < P->niter; i++) {
+        for (j = 0; j < NELEMENTS(P->prec); j++) {
+            xRecord *prec = P->prec[j];
+
+            dbScanLock((dbCommon *) prec);
+            prec->val++;
+            db_post_events(prec, &prec->val, DBE_VALUE);
+            dbScanUnlock((dbCommon *) prec);
+        }
+        /* let the event task keep up rather than measure squashing */
+        if ((i & 0xf) == 0)
+            epicsThreadSleep(0.0);
+    }
+    epicsEventMustTrigger(P->done);
+}
+
+static
+void runBench(int lockFree, unsigned nthreads, unsigned niter)
+{
+    producer prod[MAXTHREADS];
+    dbEventSubscription subs[NRECS];
+    dbChannel *chans[NRECS];
+    dbEventCtx ctx;
+    epicsTimeStamp start, stop;
+    double elapsed;
+    unsigned i, j, nposts = 0;
+
+    dbEventQueueLockFree = lockFree;
+    ctx = db_init_events();
+    if (!ctx || db_start_events(ctx, "bench-event", NULL, NULL,
+                                epicsThreadPriorityMedium))
+        testAbort("Can't start event context");
+
+    for (i = 0; i < NRECS; i++) {
+        char name[20];
+
+        sprintf(name, "rec%u.VAL", i);
+        chans[i] = dbChannelCreate(name);
+        if (!chans[i] || dbChannelOpen(chans[i]))
+            testAbort("Can't open channel %s", name);
+        subs[i] = db_add_event(ctx, chans[i], monitor, NULL, DBE_VALUE);
+        db_event_enable(subs[i]);
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        prod[i].niter = niter;
+        prod[i].start = epicsEventMustCreate(epicsEventEmpty);
+        prod[i].done = epicsEventMustCreate(epicsEventEmpty);
+        for (j = 0; j < NELEMENTS(prod[i].prec); j++) {
+            prod[i].prec[j] = (xRecord *) dbChannelRecord(
+                chans[i*NELEMENTS(prod[i].prec) + j]);
+            nposts += niter;
+        }
+        epicsThreadMustCreate("producer", epicsThreadPriorityMedium - 1,
+            epicsThreadGetStackSize(epicsThreadStackSmall),
+            produce, &prod[i]);
+    }
+
+    epicsAtomicSetSizeT(&ndelivered, 0);
+    epicsTimeGetCurrent(&start);
+    for (i = 0; i < nthreads; i++)
+        epicsEventMustTrigger(prod[i].start);
+    for (i = 0; i < nthreads; i++)
+        epicsEventMustWait(prod[i].done);
+    epicsTimeGetCurrent(&stop);
+    elapsed = epicsTimeDiffInSeconds(&stop, &start);
+
+    testDiag("%s, %u producers: %u posts in %.03f ms, %.0f posts/s, "
+             "%.1f%% delivered", lockFree ? "lock-free" : "mutex",
+             nthreads, nposts, elapsed * 1e3, nposts / elapsed,
+             100.0 * epicsAtomicGetSizeT(&ndelivered) / nposts);
+
+    for (i = 0; i < NRECS; i++) {
+        db_cancel_event(subs[i]);
+        dbChannelDelete(chans[i]);
+    }
+    db_close_events(ctx);
+    for (i = 0; i < nthreads; i++) {
+        epicsEventDestroy(prod[i].start);
+        epicsEventDestroy(prod[i].done);
+    }
+}
+
+MAIN(benchdbEvent)
+{
+    unsigned i;
+
+    testPlan(0);
+
+    testdbPrepare();
+
+    testdbReadDatabase("dbTestIoc.dbd", NULL, NULL);
+    dbTestIoc_registerRecordDeviceDriver(pdbbase);
+    for (i = 0; i < NRECS; i++) {
+        char macros[20];
+
+        sprintf(macros, "N=rec%u", i);
+        testdbReadDatabase("benchdbEvent.db", NULL, macros);
+    }
+
+    eltc(0);
+    testIocInitOk();
+    eltc(1);
+
+    for (i = 1; i <= MAXTHREADS; i *= 2) {
+        runBench(0, i, 100000 / i);
+        runBench(1, i, 100000 / i);
+    }
+    dbEventQueueLockFree = 1;
+
+    testIocShutdownOk();
+
+    testdbCleanup();
+
+    return testDone();
+}
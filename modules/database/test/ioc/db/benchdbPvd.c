@@ -0,0 +1,132 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+
+/*
+ * Measure record name lookup throughput in the Process Variable Directory
+ * as several threads look up existing and unknown names at once, as a CA
+ * server's search threads do.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cantProceed.h"
+#include "epicsEvent.h"
+#include "epicsThread.h"
+#include "epicsTime.h"
+#include "dbStaticLib.h"
+#include "dbAccess.h"
+#include "dbUnitTest.h"
+#include "testMain.h"
+
+void dbTestIoc_registerRecordDeviceDriver(struct dbBase *);
+
+#define MAXTHREADS 8
+#define NLOOKUPS 200000
+
+typedef struct {
+    unsigned nrecs;
+    unsigned seed;
+    unsigned nfound;
+    epicsEventId start, done;
+} searcher;
+
+static
+void search(void *raw)
+{
+    searcher *S = raw;
+    DBENTRY dbentry;
+    char name[20];
+    unsigned i, r = S->seed;
+
+    dbInitEntry(pdbbase, &dbentry);
+    epicsEventMustWait(S->start);
+    for (i = 0; i < NLOOKUPS; i++) {
+        r = r * 1103515245u + 12345u;
+        /* every other name is unknown, like most CA searches */
+        if (i & 1)
+            sprintf(name, "rec%u", (r >> 8) % S->nrecs);
+        else
+            sprintf(name, "none%u", (r >> 8) % S->nrecs);
+        if (dbFindRecord(&dbentry, name) == 0)
+            S->nfound++;
+    }
+    dbFinishEntry(&dbentry);
+    epicsEventMustTrigger(S->done);
+}
+
+static
+void runBench(unsigned nrecs, unsigned nthreads)
+{
+    searcher S[MAXTHREADS];
+    epicsTimeStamp start, stop;
+    double elapsed;
+    unsigned i, nfound = 0;
+
+    for (i = 0; i < nthreads; i++) {
+        S[i].nrecs = nrecs;
+        S[i].seed = i + 1;
+        S[i].nfound = 0;
+        S[i].start = epicsEventMustCreate(epicsEventEmpty);
+        S[i].done = epicsEventMustCreate(epicsEventEmpty);
+        epicsThreadMustCreate("searcher", epicsThreadPriorityMedium,
+            epicsThreadGetStackSize(epicsThreadStackSmall),
+            search, &S[i]);
+    }
+
+    epicsTimeGetCurrent(&start);
+    for (i = 0; i < nthreads; i++)
+        epicsEventMustTrigger(S[i].start);
+    for (i = 0; i < nthreads; i++)
+        epicsEventMustWait(S[i].done);
+    epicsTimeGetCurrent(&stop);
+    elapsed = epicsTimeDiffInSeconds(&stop, &start);
+
+    for (i = 0; i < nthreads; i++) {
+        nfound += S[i].nfound;
+        epicsEventDestroy(S[i].start);
+        epicsEventDestroy(S[i].done);
+    }
+
+    testDiag("%6u records, %u threads: %u lookups in %.03f ms, "
+             "%.0f lookups/s, %u found",
+             nrecs, nthreads, nthreads * NLOOKUPS, elapsed * 1e3,
+             nthreads * NLOOKUPS / elapsed, nfound);
+}
+
+MAIN(benchdbPvd)
+{
+    static const unsigned nrecs[] = {1000, 10000, 100000};
+    DBENTRY dbentry;
+    unsigned i, j, n = 0;
+
+    testPlan(0);
+
+    testdbPrepare();
+
+    testdbReadDatabase("dbTestIoc.dbd", NULL, NULL);
+    dbTestIoc_registerRecordDeviceDriver(pdbbase);
+
+    dbInitEntry(pdbbase, &dbentry);
+    if (dbFindRecordType(&dbentry, "x"))
+        testAbort("Can't find record type x");
+
+    for (i = 0; i < NELEMENTS(nrecs); i++) {
+        for (; n < nrecs[i]; n++) {
+            char name[20];
+
+            sprintf(name, "rec%u", n);
+            if (dbCreateRecord(&dbentry, name))
+                testAbort("Can't create record %s", name);
+        }
+        for (j = 1; j <= MAXTHREADS; j *= 2)
+            runBench(nrecs[i], j);
+    }
+    dbFinishEntry(&dbentry);
+
+    testdbCleanup();
+
+    return testDone();
+}
@@ -0,0 +1,242 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*
+ * Tests of the CA client library against the CA server of the same
+ * process
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cadef.h"
+#include "envDefs.h"
+#include "epicsMutex.h"
+#include "epicsThread.h"
+#include "db_access_routines.h"
+#include "dbUnitTest.h"
+#include "errlog.h"
+#include "iocInit.h"
+#include "rsrv.h"
+#include "testMain.h"
+
+#define NARRAY 1000000
+
+void dbTestIoc_registerRecordDeviceDriver(struct dbBase *);
+
+typedef struct {
+    unsigned count;
+    long last;
+} monitor;
+
+static epicsMutexId lock;
+
+static void monitorUpdate ( struct event_handler_args args )
+{
+    monitor *pmon = args.usr;
+
+    epicsMutexMustLock ( lock );
+    if ( args.status == ECA_NORMAL ) {
+        pmon->count++;
+        pmon->last = *(const dbr_long_t *) args.dbr;
+    }
+    epicsMutexUnlock ( lock );
+}
+
+static int waitForValue ( monitor *pmon, unsigned count, long value )
+{
+    unsigned i;
+
+    for ( i = 0u; i < 500u; i++ ) {
+        int done;
+
+        epicsMutexMustLock ( lock );
+        done = pmon->count >= count && pmon->last == value;
+        epicsMutexUnlock ( lock );
+        if ( done )
+            return 1;
+        epicsThreadSleep ( 0.01 );
+    }
+    return 0;
+}
+
+/*
+ * Connect, put, get and subscribe through the current context
+ */
+static void testCircuit ( const char *ctxName, int ioThreads )
+{
+    monitor mon;
+    dbr_long_t val;
+    chid chan;
+    evid sub;
+    int status;
+
+    testDiag ( "Scalar access through %s", ctxName );
+
+    memset ( &mon, 0, sizeof ( mon ) );
+    ca_create_channel ( "lb:x", NULL, NULL, 0, &chan );
+    testOk ( ca_pend_io ( 5.0 ) == ECA_NORMAL, "Channel connected" );
+
+    testOk1 ( ca_create_subscription ( DBR_LONG, 1, chan, DBE_VALUE,
+        monitorUpdate, &mon, &sub ) == ECA_NORMAL );
+    val = 42;
+    ca_put ( DBR_LONG, chan, &val );
+    val = 0;
+    ca_get ( DBR_LONG, chan, &val );
+    status = ca_pend_io ( 5.0 );
+    testOk ( status == ECA_NORMAL && val == 42,
+        "Put and get back %ld", (long) val );
+    testOk ( waitForValue ( &mon, 1u, 42 ), "Subscription update received" );
+
+    val = 43;
+    ca_put ( DBR_LONG, chan, &val );
+    ca_flush_io ();
+    testOk ( waitForValue ( &mon, 2u, 43 ), "Next update received" );
+
+    if ( ioThreads ) {
+        testOk ( epicsThreadGetId ( "CAC-TCP-io" ) != 0,
+            "Circuit served by an I/O thread" );
+        testOk ( epicsThreadGetId ( "CAC-TCP-recv" ) == 0,
+            "No receive thread per circuit" );
+    }
+    else {
+        testOk ( epicsThreadGetId ( "CAC-TCP-recv" ) != 0,
+            "Circuit has a receive thread" );
+    }
+
+    ca_clear_channel ( chan );
+}
+
+static int checkArray ( const double *pDouble, const float *pFloat )
+{
+    unsigned i;
+
+    for ( i = 0u; i < NARRAY; i++ ) {
+        double expect = i * 0.5;
+
+        if ( pDouble ? pDouble[i] != expect : pFloat[i] != (float) expect )
+            return 0;
+    }
+    return 1;
+}
+
+static void arrayUpdate ( struct event_handler_args args )
+{
+    int *pOK = args.usr;
+
+    epicsMutexMustLock ( lock );
+    *pOK = args.status == ECA_NORMAL && args.count == NARRAY &&
+        checkArray ( args.dbr, NULL ) ? 1 : -1;
+    epicsMutexUnlock ( lock );
+}
+
+/*
+ * Reads of an array of 8 MB, whose bodies are received in place
+ */
+static void testLargeArray ( const char *ctxName )
+{
+    double *pDouble = malloc ( NARRAY * sizeof ( double ) );
+    float *pFloat = malloc ( NARRAY * sizeof ( float ) );
+    int status, callbackOK = 0;
+    unsigned i;
+    chid chan;
+
+    testDiag ( "Array access through %s", ctxName );
+
+    if ( ! pDouble || ! pFloat )
+        testAbort ( "Out of memory" );
+
+    for ( i = 0u; i < NARRAY; i++ )
+        pDouble[i] = i * 0.5;
+    ca_create_channel ( "lb:arr", NULL, NULL, 0, &chan );
+    ca_pend_io ( 5.0 );
+    ca_array_put ( DBR_DOUBLE, NARRAY, chan, pDouble );
+    status = ca_pend_io ( 5.0 );
+    testOk ( status == ECA_NORMAL, "Put %u doubles", NARRAY );
+
+    memset ( pDouble, 0, NARRAY * sizeof ( double ) );
+    ca_array_get ( DBR_DOUBLE, NARRAY, chan, pDouble );
+    status = ca_pend_io ( 10.0 );
+    testOk ( status == ECA_NORMAL && checkArray ( pDouble, NULL ),
+        "ca_array_get of doubles" );
+
+    memset ( pFloat, 0, NARRAY * sizeof ( float ) );
+    ca_array_get ( DBR_FLOAT, NARRAY, chan, pFloat );
+    status = ca_pend_io ( 10.0 );
+    testOk ( status == ECA_NORMAL && checkArray ( NULL, pFloat ),
+        "ca_array_get of floats" );
+
+    ca_array_get_callback ( DBR_DOUBLE, NARRAY, chan, arrayUpdate,
+        &callbackOK );
+    ca_flush_io ();
+    for ( i = 0u; i < 1000u; i++ ) {
+        epicsMutexMustLock ( lock );
+        status = callbackOK;
+        epicsMutexUnlock ( lock );
+        if ( status )
+            break;
+        epicsThreadSleep ( 0.01 );
+    }
+    testOk ( status == 1, "ca_array_get_callback of doubles" );
+
+    ca_clear_channel ( chan );
+    free ( pDouble );
+    free ( pFloat );
+}
+
+MAIN(caLoopbackTest)
+{
+    struct ca_client_context *pIoCtx, *pThreadCtx;
+
+    testPlan(23);
+
+    lock = epicsMutexMustCreate ();
+
+    epicsEnvSet ( "EPICS_CA_AUTO_ADDR_LIST", "NO" );
+    epicsEnvSet ( "EPICS_CA_ADDR_LIST", "127.0.0.1" );
+    epicsEnvSet ( "EPICS_CAS_INTF_ADDR_LIST", "127.0.0.1" );
+    epicsEnvSet ( "EPICS_CA_SERVER_PORT", "15078" );
+    epicsEnvSet ( "EPICS_CA_REPEATER_PORT", "15079" );
+    epicsEnvSet ( "EPICS_CA_MAX_ARRAY_BYTES", "10000000" );
+
+    testdbPrepare();
+    testdbReadDatabase("dbTestIoc.dbd", NULL, NULL);
+    dbTestIoc_registerRecordDeviceDriver(pdbbase);
+    testdbReadDatabase("caLoopbackTest.db", NULL, NULL);
+
+    rsrv_register_server();
+
+    /*
+     * Contexts created before iocInit don't use the local database
+     * service, so their channels go through the CA server.
+     */
+    epicsEnvSet ( "EPICS_CA_TCP_IO_THREADS", "2" );
+    ca_context_create ( ca_enable_preemptive_callback );
+    pIoCtx = ca_current_context ();
+    ca_detach_context ();
+    epicsEnvSet ( "EPICS_CA_TCP_IO_THREADS", "0" );
+    ca_context_create ( ca_enable_preemptive_callback );
+    pThreadCtx = ca_current_context ();
+    ca_detach_context ();
+    testOk1 ( pIoCtx && pThreadCtx );
+
+    /* testIocInitOk() builds an isolated IOC without servers */
+    eltc(0);
+    testOk1 ( iocBuild () == 0 && iocRun () == 0 );
+    eltc(1);
+
+    ca_attach_context ( pIoCtx );
+    testCircuit ( "TCP I/O threads", 1 );
+    testLargeArray ( "TCP I/O threads" );
+    ca_context_destroy ();
+
+    ca_attach_context ( pThreadCtx );
+    testCircuit ( "threads per circuit", 0 );
+    testLargeArray ( "threads per circuit" );
+    ca_context_destroy ();
+
+    /* rsrv can't be stopped, so the IOC is left running */
+
+    return testDone();
+}
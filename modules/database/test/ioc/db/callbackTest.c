@@ -19,6 +19,8 @@
 
 #include "callback.h"
 #include "cantProceed.h"
+#include "dbAccessDefs.h"
+#include "epicsAtomic.h"
 #include "epicsThread.h"
 #include "epicsEvent.h"
 #include "epicsTime.h"
@@ -96,6 +98,150 @@ static void printStats(double *stats, const char* tag) {
             sqrt(stats[4]*stats[3]-pow(stats[2], 2.0))/stats[4]);
 }
 
+/*
+ * The tests below keep one callback thread busy with a blocker callback
+ * while they queue further requests.
+ */
+
+static epicsEventId blockerRunning, releaseBlocker;
+static CALLBACK blocker;
+
+static void blockerCallback(CALLBACK *pCallback)
+{
+    epicsEventSignal(blockerRunning);
+    epicsEventMustWait(releaseBlocker);
+}
+
+static void startBlocker(void)
+{
+    blockerRunning = epicsEventMustCreate(epicsEventEmpty);
+    releaseBlocker = epicsEventMustCreate(epicsEventEmpty);
+
+    callbackSetCallback(blockerCallback, &blocker);
+    callbackSetPriority(priorityLow, &blocker);
+    callbackRequest(&blocker);
+    epicsEventMustWait(blockerRunning);
+}
+
+static void stopBlocker(void)
+{
+    epicsEventSignal(releaseBlocker);
+}
+
+static void destroyBlocker(void)
+{
+    epicsEventDestroy(blockerRunning);
+    epicsEventDestroy(releaseBlocker);
+}
+
+/*
+ * A burst of requests larger than the callback queue is absorbed by the
+ * overflow queue when callbackSetQueueMax() permits it.
+ */
+
+#define QSIZE 10
+#define QMAX 100
+
+static epicsEventId burstDone;
+static CALLBACK burst[QMAX + 10];
+static int burstOrder[QMAX + 10];
+static int nBurstRun, nBurst;
+
+static void burstCallback(CALLBACK *pCallback)
+{
+    burstOrder[nBurstRun] = pCallback - burst;
+    if (++nBurstRun == nBurst)
+        epicsEventSignal(burstDone);
+}
+
+static void testBurst(void)
+{
+    int i, nOK = 0, inOrder = 1;
+
+    testDiag("Callback queue of %d growing to %d", QSIZE, QMAX);
+
+    burstDone = epicsEventMustCreate(epicsEventEmpty);
+
+    callbackSetQueueSize(QSIZE);
+    callbackSetQueueMax(QMAX);
+    callbackInit();
+    startBlocker();
+
+    for (i = 0; i < QMAX + 10; i++) {
+        callbackSetCallback(burstCallback, &burst[i]);
+        callbackSetPriority(priorityLow, &burst[i]);
+        if (callbackRequest(&burst[i]) == 0)
+            nOK++;
+        else
+            break;
+    }
+    testOk(nOK == QMAX, "%d requests queued", nOK);
+    testOk(callbackRequest(&burst[0]) == S_db_bufFull,
+        "Further requests fail until the queue is serviced");
+
+    nBurst = nOK;
+    stopBlocker();
+    testOk1(epicsEventWaitWithTimeout(burstDone, 10.0) == epicsEventOK);
+    for (i = 0; i < nBurst; i++)
+        if (burstOrder[i] != i)
+            inOrder = 0;
+    testOk(inOrder, "Callbacks run in order");
+
+    callbackStop();
+    callbackCleanup();
+    callbackSetQueueSize(2000);
+    callbackSetQueueMax(0);
+
+    destroyBlocker();
+    epicsEventDestroy(burstDone);
+}
+
+/*
+ * With several threads per priority, callbacks queued for a thread
+ * which is busy must be taken and run by its peers.
+ */
+
+#define NSTEAL 30
+
+static epicsEventId stealDone;
+static int nStealRun;
+
+static void quickCallback(CALLBACK *pCallback)
+{
+    if (epicsAtomicIncrIntT(&nStealRun) == NSTEAL)
+        epicsEventSignal(stealDone);
+}
+
+static void testWorkStealing(void)
+{
+    CALLBACK quick[NSTEAL];
+    int i;
+
+    testDiag("Starting 3 parallel callback threads");
+
+    stealDone = epicsEventMustCreate(epicsEventEmpty);
+
+    callbackParallelThreads(3, "");
+    callbackInit();
+    startBlocker();
+
+    for (i = 0; i < NSTEAL; i++) {
+        callbackSetCallback(quickCallback, &quick[i]);
+        callbackSetPriority(priorityLow, &quick[i]);
+        callbackRequest(&quick[i]);
+    }
+
+    testOk(epicsEventWaitWithTimeout(stealDone, 10.0) == epicsEventOK,
+        "%d callbacks run while one thread is blocked", nStealRun);
+
+    stopBlocker();
+    callbackStop();
+    callbackCleanup();
+
+    destroyBlocker();
+    epicsEventDestroy(stealDone);
+}
+
 MAIN(callbackTest)
 {
     myPvt *pcbt[NCALLBACKS];
@@ -110,7 +256,7 @@ MAIN(callbackTest)
         for (j = 0; j < 5; j++)
             setupError[i][j] = timeError[i][j] = defaultError[j];
 
-    testPlan(2);
+    testPlan(7);
 
     callbackInit();
     epicsThreadSleep(1.0);
@@ -202,5 +348,8 @@ MAIN(callbackTest)
     callbackStop();
     callbackCleanup();
 
+    testBurst();
+    testWorkStealing();
+
     return testDone();
 }
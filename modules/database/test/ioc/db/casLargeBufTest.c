@@ -0,0 +1,173 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*
+ * Test of the size classes of the CA server's large TCP buffers
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#define EPICS_PRIVATE_API
+
+#include "cadef.h"
+#include "caProto.h"
+#include "envDefs.h"
+#include "db_access_routines.h"
+#include "dbUnitTest.h"
+#include "errlog.h"
+#include "iocInit.h"
+#include "rsrv.h"
+#include "testMain.h"
+
+#define MAX_ARRAY_BYTES 1000000u
+#define NARRAY ( MAX_ARRAY_BYTES / sizeof ( double ) )
+/* the server adds room for the extended header */
+#define LARGEST ( MAX_ARRAY_BYTES + sizeof ( caHdr ) + 2u * sizeof ( ca_uint32_t ) )
+
+void dbTestIoc_registerRecordDeviceDriver(struct dbBase *);
+
+static unsigned nClasses;
+
+/*
+ * Classes double from twice MAX_TCP, the last holding the largest message
+ */
+static void testClasses ( void )
+{
+    unsigned i, size, index, classSize, nBad = 0u;
+    size_t inUse, maxInUse;
+
+    testDiag ( "Size classes" );
+
+    for ( i = 0u; casLargeBufClassStatus ( i, &size, &inUse,
+            &maxInUse ) == 0; i++ ) {
+        unsigned expect = i ? 2u * MAX_TCP << i : 2u * MAX_TCP;
+
+        if ( expect >= LARGEST )
+            expect = LARGEST;
+        if ( size != expect )
+            nBad++;
+        /* casLargeBufFree() finds the class from the size it was given */
+        if ( casLargeBufClassFind ( size, &index, &classSize ) ||
+                index != i || classSize != size )
+            nBad++;
+    }
+    nClasses = i;
+    testOk ( nClasses == 6u, "%u classes", nClasses );
+    testOk ( nBad == 0u, "Classes double, each found from its size" );
+    testOk ( casLargeBufClassStatus ( nClasses - 1u, &size, &inUse,
+        &maxInUse ) == 0 && size == LARGEST,
+        "Last class holds %u bytes", size );
+
+    testOk ( casLargeBufClassFind ( MAX_TCP + 1u, &index, &classSize ) == 0 &&
+        index == 0u && classSize == 2u * MAX_TCP,
+        "Message of MAX_TCP + 1 bytes uses the first class" );
+    testOk ( casLargeBufClassFind ( 4u * MAX_TCP + 1u, &index,
+        &classSize ) == 0 && index == 2u && classSize == 8u * MAX_TCP,
+        "Message of 4 MAX_TCP + 1 bytes uses the third class" );
+    testOk ( casLargeBufClassFind ( LARGEST - 1u, &index, &classSize ) == 0 &&
+        index == nClasses - 1u && classSize == LARGEST,
+        "Largest messages use the last class" );
+    testOk ( casLargeBufClassFind ( LARGEST + 1u, &index, &classSize ) != 0,
+        "Message past the largest has no class" );
+}
+
+static int checkArray ( const double *pDouble, unsigned count )
+{
+    unsigned i;
+
+    for ( i = 0u; i < count; i++ ) {
+        if ( pDouble[i] != i * 0.25 )
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * Reads of growing arrays move the server's send buffer up the classes
+ */
+static void testReads ( void )
+{
+    static const unsigned counts[] = { 3000u, 12000u, 100000u };
+    /*
+     * The put's receive buffer and the last read's send buffer are
+     * both held in the last class
+     */
+    static const size_t expectMax[] = { 1u, 0u, 1u, 0u, 0u, 2u };
+    double *pDouble = malloc ( NARRAY * sizeof ( double ) );
+    unsigned i;
+    chid chan;
+
+    testDiag ( "Array reads through the size classes" );
+
+    if ( ! pDouble )
+        testAbort ( "Out of memory" );
+    for ( i = 0u; i < NARRAY; i++ )
+        pDouble[i] = i * 0.25;
+
+    ca_create_channel ( "lbuf:arr", NULL, NULL, 0, &chan );
+    testOk ( ca_pend_io ( 5.0 ) == ECA_NORMAL, "Channel connected" );
+    ca_array_put ( DBR_DOUBLE, NARRAY, chan, pDouble );
+    testOk ( ca_pend_io ( 10.0 ) == ECA_NORMAL, "Put %u doubles",
+        (unsigned) NARRAY );
+
+    for ( i = 0u; i < NELEMENTS ( counts ); i++ ) {
+        memset ( pDouble, 0, NARRAY * sizeof ( double ) );
+        ca_array_get ( DBR_DOUBLE, counts[i], chan, pDouble );
+        testOk ( ca_pend_io ( 10.0 ) == ECA_NORMAL &&
+            checkArray ( pDouble, counts[i] ),
+            "Read %u doubles", counts[i] );
+    }
+
+    for ( i = 0u; i < NELEMENTS ( expectMax ); i++ ) {
+        unsigned size = 0u;
+        size_t inUse, maxInUse = 0u;
+
+        casLargeBufClassStatus ( i, &size, &inUse, &maxInUse );
+        testOk ( maxInUse == expectMax[i],
+            "Class of %u bytes held %u buffers at once",
+            size, (unsigned) maxInUse );
+    }
+
+    ca_clear_channel ( chan );
+    free ( pDouble );
+}
+
+MAIN(casLargeBufTest)
+{
+    testPlan(19);
+
+    epicsEnvSet ( "EPICS_CA_AUTO_ADDR_LIST", "NO" );
+    epicsEnvSet ( "EPICS_CA_ADDR_LIST", "127.0.0.1" );
+    epicsEnvSet ( "EPICS_CAS_INTF_ADDR_LIST", "127.0.0.1" );
+    epicsEnvSet ( "EPICS_CA_SERVER_PORT", "15082" );
+    epicsEnvSet ( "EPICS_CA_REPEATER_PORT", "15083" );
+    epicsEnvSet ( "EPICS_CA_MAX_ARRAY_BYTES", "1000000" );
+    epicsEnvSet ( "EPICS_CA_AUTO_ARRAY_BYTES", "NO" );
+
+    testdbPrepare();
+    testdbReadDatabase("dbTestIoc.dbd", NULL, NULL);
+    dbTestIoc_registerRecordDeviceDriver(pdbbase);
+    testdbReadDatabase("casLargeBufTest.db", NULL, NULL);
+
+    rsrv_register_server();
+
+    /* created before iocInit, so its channels go through the CA server */
+    ca_context_create ( ca_enable_preemptive_callback );
+
+    /* testIocInitOk() builds an isolated IOC without servers */
+    eltc(0);
+    testOk1 ( iocBuild () == 0 && iocRun () == 0 );
+    eltc(1);
+
+    testClasses ();
+    testReads ();
+
+    ca_context_destroy ();
+
+    /* rsrv can't be stopped, so the IOC is left running */
+
+    return testDone();
+}
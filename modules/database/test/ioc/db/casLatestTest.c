@@ -0,0 +1,180 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*
+ * Test of DBE_LATEST subscriptions through the CA server
+ */
+
+#include <string.h>
+
+#include "cadef.h"
+#include "envDefs.h"
+#include "epicsMutex.h"
+#include "epicsThread.h"
+#include "db_access_routines.h"
+#include "dbEvent.h"
+#include "dbLock.h"
+#include "dbUnitTest.h"
+#include "errlog.h"
+#include "iocInit.h"
+#include "rsrv.h"
+#include "testMain.h"
+
+#include "xRecord.h"
+
+#define NUPDATES 10
+
+void dbTestIoc_registerRecordDeviceDriver(struct dbBase *);
+
+typedef struct {
+    unsigned count;
+    long last;
+} monitor;
+
+static epicsMutexId lock;
+
+static void monitorUpdate ( struct event_handler_args args )
+{
+    monitor *pmon = args.usr;
+
+    epicsMutexMustLock ( lock );
+    if ( args.status == ECA_NORMAL ) {
+        pmon->count++;
+        pmon->last = *(const dbr_long_t *) args.dbr;
+    }
+    epicsMutexUnlock ( lock );
+}
+
+static unsigned monitorCount ( monitor *pmon )
+{
+    unsigned count;
+
+    epicsMutexMustLock ( lock );
+    count = pmon->count;
+    epicsMutexUnlock ( lock );
+    return count;
+}
+
+static int waitForCount ( monitor *pmon, unsigned count )
+{
+    unsigned i;
+
+    for ( i = 0u; i < 500u; i++ ) {
+        if ( monitorCount ( pmon ) >= count )
+            return 1;
+        epicsThreadSleep ( 0.01 );
+    }
+    return 0;
+}
+
+static void postValue ( xRecord *prec, epicsInt32 val )
+{
+    dbScanLock ( (dbCommon *) prec );
+    prec->val = val;
+    db_post_events ( prec, &prec->val, DBE_VALUE | DBE_LOG );
+    dbScanUnlock ( (dbCommon *) prec );
+}
+
+MAIN(casLatestTest)
+{
+    monitor latest, all, blocker;
+    xRecord *pa, *pb;
+    chid chanA, chanB;
+    evid sub;
+    int i;
+
+    testPlan(12);
+
+    memset ( &latest, 0, sizeof ( latest ) );
+    memset ( &all, 0, sizeof ( all ) );
+    memset ( &blocker, 0, sizeof ( blocker ) );
+    lock = epicsMutexMustCreate ();
+
+    epicsEnvSet ( "EPICS_CA_AUTO_ADDR_LIST", "NO" );
+    epicsEnvSet ( "EPICS_CA_ADDR_LIST", "127.0.0.1" );
+    epicsEnvSet ( "EPICS_CAS_INTF_ADDR_LIST", "127.0.0.1" );
+    epicsEnvSet ( "EPICS_CA_SERVER_PORT", "15076" );
+    epicsEnvSet ( "EPICS_CA_REPEATER_PORT", "15077" );
+
+    testdbPrepare();
+    testdbReadDatabase("dbTestIoc.dbd", NULL, NULL);
+    dbTestIoc_registerRecordDeviceDriver(pdbbase);
+    testdbReadDatabase("casLatestTest.db", NULL, NULL);
+
+    rsrv_register_server();
+
+    /*
+     * A context created before iocInit doesn't use the local database
+     * service, so its channels go through the CA server.
+     */
+    testOk1 ( ca_context_create ( ca_enable_preemptive_callback ) == ECA_NORMAL );
+
+    /* testIocInitOk() builds an isolated IOC without servers */
+    eltc(0);
+    testOk1 ( iocBuild () == 0 && iocRun () == 0 );
+    eltc(1);
+
+    pa = (xRecord *) testdbRecordPtr ( "latest:a" );
+    pb = (xRecord *) testdbRecordPtr ( "latest:b" );
+
+    ca_create_channel ( "latest:a", NULL, NULL, 0, &chanA );
+    ca_create_channel ( "latest:b", NULL, NULL, 0, &chanB );
+    testOk ( ca_pend_io ( 5.0 ) == ECA_NORMAL, "Channels connected" );
+
+    testOk ( ca_create_subscription ( DBR_LONG, 1, chanA, DBE_LATEST,
+        monitorUpdate, &latest, &sub ) == ECA_BADMASK,
+        "DBE_LATEST alone is rejected" );
+
+    ca_create_subscription ( DBR_LONG, 1, chanA, DBE_VALUE | DBE_LATEST,
+        monitorUpdate, &latest, &sub );
+    ca_create_subscription ( DBR_LONG, 1, chanA, DBE_VALUE,
+        monitorUpdate, &all, &sub );
+    ca_create_subscription ( DBR_LONG, 1, chanB, DBE_VALUE,
+        monitorUpdate, &blocker, &sub );
+    ca_flush_io ();
+    testOk ( waitForCount ( &latest, 1u ) && waitForCount ( &all, 1u ) &&
+        waitForCount ( &blocker, 1u ), "Initial updates received" );
+
+    /*
+     * While the server's event task waits for the lock of latest:b to
+     * send its update, the updates of latest:a queue up behind it and
+     * are taken off the queue in one batch.
+     */
+    dbScanLock ( (dbCommon *) pb );
+    pb->val = 1;
+    db_post_events ( pb, &pb->val, DBE_VALUE | DBE_LOG );
+    epicsThreadSleep ( 0.1 );
+    for ( i = 1; i <= NUPDATES; i++ )
+        postValue ( pa, i );
+    dbScanUnlock ( (dbCommon *) pb );
+
+    testOk ( waitForCount ( &blocker, 2u ), "latest:b update received" );
+    testOk ( waitForCount ( &all, 1u + NUPDATES ),
+        "All %d updates received without DBE_LATEST", NUPDATES );
+    epicsThreadSleep ( 0.1 );
+
+    epicsMutexMustLock ( lock );
+    testOk ( all.last == NUPDATES, "Last value %ld", all.last );
+    testOk ( latest.count == 2u, "%u updates received with DBE_LATEST",
+        latest.count );
+    testOk ( latest.last == NUPDATES, "Last value %ld", latest.last );
+    epicsMutexUnlock ( lock );
+
+    ca_context_destroy ();
+
+    /* the local database service ignores DBE_LATEST */
+    memset ( &latest, 0, sizeof ( latest ) );
+    ca_context_create ( ca_enable_preemptive_callback );
+    ca_create_channel ( "latest:a", NULL, NULL, 0, &chanA );
+    ca_pend_io ( 5.0 );
+    testOk ( ca_create_subscription ( DBR_LONG, 1, chanA,
+        DBE_VALUE | DBE_LATEST, monitorUpdate, &latest, &sub ) == ECA_NORMAL,
+        "Local DBE_LATEST subscription added" );
+    testOk ( waitForCount ( &latest, 1u ), "Local update received" );
+    ca_context_destroy ();
+
+    /* rsrv can't be stopped, so the IOC is left running */
+
+    return testDone();
+}
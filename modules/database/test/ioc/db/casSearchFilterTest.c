@@ -0,0 +1,140 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*
+ * Test of the CA server's filter of searched names
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "dbAccess.h"
+#include "dbStaticLib.h"
+#include "dbUnitTest.h"
+#include "rsrv.h"
+#include "testMain.h"
+
+#define NRECORDS 500
+#define NABSENT 20000
+
+void dbTestIoc_registerRecordDeviceDriver(struct dbBase *);
+
+typedef struct {
+    unsigned names, rebuilds;
+    size_t found, rejected, falsePos;
+} filterStats;
+
+static void statsFetch ( filterStats *pStats )
+{
+    casSearchFilterStatsFetch ( &pStats->names, &pStats->rebuilds,
+        &pStats->found, &pStats->rejected, &pStats->falsePos );
+}
+
+static void testSearch ( void )
+{
+    filterStats before, after;
+    char name[32];
+    int i, nOK;
+
+    testDiag ( "Searches for present and absent names" );
+
+    statsFetch ( &before );
+    for ( i = 0, nOK = 0; i < NRECORDS; i++ ) {
+        sprintf ( name, "filt%d", i );
+        if ( casSearchTest ( name ) == 0 )
+            nOK++;
+        sprintf ( name, "filt%d.VAL", i );
+        if ( casSearchTest ( name ) == 0 )
+            nOK++;
+    }
+    statsFetch ( &after );
+    testOk ( nOK == 2 * NRECORDS, "All %d names found, with and without "
+        "a field", nOK / 2 );
+    testOk ( after.names == NRECORDS, "Filter holds %u names", after.names );
+    testOk1 ( after.found - before.found == 2 * NRECORDS );
+
+    statsFetch ( &before );
+    for ( i = 0, nOK = 0; i < NABSENT; i++ ) {
+        sprintf ( name, "none%d", i );
+        if ( casSearchTest ( name ) != 0 )
+            nOK++;
+    }
+    statsFetch ( &after );
+    testOk ( nOK == NABSENT, "All %d absent names not found", nOK );
+    testOk ( after.rejected - before.rejected > NABSENT - NABSENT / 100,
+        "%lu rejected by the filter",
+        (unsigned long) ( after.rejected - before.rejected ) );
+    testOk ( after.falsePos - before.falsePos > 0u,
+        "%lu false positives looked up in the database",
+        (unsigned long) ( after.falsePos - before.falsePos ) );
+    testOk1 ( after.rejected + after.falsePos ==
+        before.rejected + before.falsePos + NABSENT );
+    testOk1 ( after.rebuilds == before.rebuilds );
+}
+
+static void testRebuild ( void )
+{
+    filterStats before, after;
+    DBENTRY entry;
+
+    testDiag ( "Rebuild as records come and go" );
+
+    statsFetch ( &before );
+    testOk1 ( casSearchTest ( "filt:added" ) != 0 );
+
+    dbInitEntry ( pdbbase, &entry );
+    if ( dbFindRecordType ( &entry, "x" ) != 0 )
+        testAbort ( "Can't find record type 'x'" );
+    testOk1 ( dbCreateRecord ( &entry, "filt:added" ) == 0 );
+
+    testOk ( casSearchTest ( "filt:added" ) == 0, "New record found" );
+    statsFetch ( &after );
+    testOk ( after.rebuilds == before.rebuilds + 1u, "Filter rebuilt" );
+    testOk ( after.names == NRECORDS + 1u, "Filter holds %u names",
+        after.names );
+
+    testOk1 ( dbFindRecord ( &entry, "filt:added" ) == 0 &&
+        dbDeleteRecord ( &entry ) == 0 );
+    testOk ( casSearchTest ( "filt:added" ) != 0, "Deleted record not found" );
+    statsFetch ( &after );
+    testOk ( after.rebuilds == before.rebuilds + 2u, "Filter rebuilt" );
+    testOk ( after.names == NRECORDS, "Filter holds %u names", after.names );
+
+    testOk1 ( casSearchTest ( "filt0" ) == 0 );
+    statsFetch ( &after );
+    testOk ( after.rebuilds == before.rebuilds + 2u,
+        "Unchanged database reuses the filter" );
+
+    dbFinishEntry ( &entry );
+}
+
+MAIN(casSearchFilterTest)
+{
+    DBENTRY entry;
+    char name[32];
+    int i;
+
+    testPlan(19);
+
+    testdbPrepare();
+    testdbReadDatabase("dbTestIoc.dbd", NULL, NULL);
+    dbTestIoc_registerRecordDeviceDriver(pdbbase);
+
+    dbInitEntry ( pdbbase, &entry );
+    if ( dbFindRecordType ( &entry, "x" ) != 0 )
+        testAbort ( "Can't find record type 'x'" );
+    for ( i = 0; i < NRECORDS; i++ ) {
+        sprintf ( name, "filt%d", i );
+        if ( dbCreateRecord ( &entry, name ) != 0 )
+            testAbort ( "Can't create record %s", name );
+    }
+    dbFinishEntry ( &entry );
+
+    testSearch ();
+    testRebuild ();
+
+    testdbCleanup();
+
+    return testDone();
+}
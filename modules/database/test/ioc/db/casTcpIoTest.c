@@ -0,0 +1,403 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*
+ * Test of the CA server's TCP I/O threads (casTcpIoThreads) and its
+ * queue of TCP send buffers with a slow client, which doesn't read its
+ * replies, beside a well behaved one
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cadef.h"
+#include "caProto.h"
+#include "envDefs.h"
+#include "epicsThread.h"
+#include "epicsTime.h"
+#include "db_access_routines.h"
+#include "dbUnitTest.h"
+#include "errlog.h"
+#include "iocInit.h"
+#include "iocsh.h"
+#include "osiSock.h"
+#include "testMain.h"
+
+#define SERVER_PORT 15084
+#define NARRAY 100000u
+#define NREADS 30u
+#define NPUTS 20
+#define NSMALL 2000u
+
+void casTestIoc_registerRecordDeviceDriver(struct dbBase *);
+
+static epicsInt32 arrayValue ( unsigned i )
+{
+    return (epicsInt32) ( i * 7u + 1u );
+}
+
+/*
+ * A CA client on a raw socket, so that it can stop reading
+ */
+typedef struct {
+    SOCKET sock;
+    caHdr hdr;
+    ca_uint32_t postsize, count;
+    char *pPayload;
+    unsigned payloadSize;
+} rawClient;
+
+static void rawSend ( rawClient *pClient, unsigned cmmd, unsigned dataType,
+    unsigned count, ca_uint32_t cid, ca_uint32_t available,
+    const void *pPayload, unsigned size )
+{
+    char buf[sizeof ( caHdr ) + 8u + 64u];
+    unsigned hdrSize = sizeof ( caHdr );
+    caHdr hdr;
+
+    memset ( &hdr, 0, sizeof ( hdr ) );
+    hdr.m_cmmd = htons ( (ca_uint16_t) cmmd );
+    hdr.m_dataType = htons ( (ca_uint16_t) dataType );
+    hdr.m_cid = htonl ( cid );
+    hdr.m_available = htonl ( available );
+    if ( count < 0xffff ) {
+        hdr.m_postsize = htons ( (ca_uint16_t) size );
+        hdr.m_count = htons ( (ca_uint16_t) count );
+    }
+    else {
+        ca_uint32_t large[2];
+
+        hdr.m_postsize = htons ( 0xffff );
+        large[0] = htonl ( size );
+        large[1] = htonl ( count );
+        memcpy ( buf + hdrSize, large, sizeof ( large ) );
+        hdrSize += sizeof ( large );
+    }
+    memcpy ( buf, &hdr, sizeof ( hdr ) );
+    if ( size )
+        memcpy ( buf + hdrSize, pPayload, size );
+    if ( send ( pClient->sock, buf, hdrSize + size, 0 ) !=
+            (int) ( hdrSize + size ) )
+        testAbort ( "Raw client send failed" );
+}
+
+static int rawRecvAll ( rawClient *pClient, void *pBuf, unsigned size )
+{
+    char *p = pBuf;
+
+    while ( size ) {
+        struct timeval tv;
+        fd_set fds;
+        int n;
+
+        tv.tv_sec = 10;
+        tv.tv_usec = 0;
+        FD_ZERO ( &fds );
+        FD_SET ( pClient->sock, &fds );
+        if ( select ( pClient->sock + 1, &fds, NULL, NULL, &tv ) <= 0 )
+            return 0;
+        n = recv ( pClient->sock, p, size, 0 );
+        if ( n <= 0 )
+            return 0;
+        p += n;
+        size -= n;
+    }
+    return 1;
+}
+
+/*
+ * Receive the next message, returns its command or -1
+ */
+static int rawRecv ( rawClient *pClient )
+{
+    caHdr *pHdr = &pClient->hdr;
+
+    if ( ! rawRecvAll ( pClient, pHdr, sizeof ( *pHdr ) ) )
+        return -1;
+    pClient->postsize = ntohs ( pHdr->m_postsize );
+    pClient->count = ntohs ( pHdr->m_count );
+    if ( pClient->postsize == 0xffff && pClient->count == 0u ) {
+        ca_uint32_t large[2];
+
+        if ( ! rawRecvAll ( pClient, large, sizeof ( large ) ) )
+            return -1;
+        pClient->postsize = ntohl ( large[0] );
+        pClient->count = ntohl ( large[1] );
+    }
+    if ( pClient->postsize > pClient->payloadSize ) {
+        free ( pClient->pPayload );
+        pClient->pPayload = malloc ( pClient->postsize );
+        pClient->payloadSize = pClient->postsize;
+        if ( ! pClient->pPayload )
+            testAbort ( "Out of memory" );
+    }
+    if ( ! rawRecvAll ( pClient, pClient->pPayload, pClient->postsize ) )
+        return -1;
+    return ntohs ( pHdr->m_cmmd );
+}
+
+static void rawConnect ( rawClient *pClient )
+{
+    static const char host[16] = "localhost";
+    static const char user[8] = "slow";
+    osiSockAddr addr;
+    int size = 4096;
+
+    memset ( pClient, 0, sizeof ( *pClient ) );
+    pClient->sock = epicsSocketCreate ( AF_INET, SOCK_STREAM, 0 );
+    if ( pClient->sock == INVALID_SOCKET )
+        testAbort ( "Can't create a TCP socket" );
+    /* a small window, so that the server's replies back up soon */
+    setsockopt ( pClient->sock, SOL_SOCKET, SO_RCVBUF,
+        (char *) &size, sizeof ( size ) );
+    memset ( &addr, 0, sizeof ( addr ) );
+    addr.ia.sin_family = AF_INET;
+    addr.ia.sin_addr.s_addr = htonl ( INADDR_LOOPBACK );
+    addr.ia.sin_port = htons ( SERVER_PORT );
+    if ( connect ( pClient->sock, &addr.sa, sizeof ( addr ) ) )
+        testAbort ( "Raw client can't connect" );
+
+    rawSend ( pClient, CA_PROTO_VERSION, 0u, 13u, 0u, 0u, NULL, 0u );
+    rawSend ( pClient, CA_PROTO_HOST_NAME, 0u, 0u, 0u, 0u,
+        host, sizeof ( host ) );
+    rawSend ( pClient, CA_PROTO_CLIENT_NAME, 0u, 0u, 0u, 0u,
+        user, sizeof ( user ) );
+}
+
+static void rawDisconnect ( rawClient *pClient )
+{
+    epicsSocketDestroy ( pClient->sock );
+    free ( pClient->pPayload );
+}
+
+/*
+ * Create a channel, returns its server id
+ */
+static ca_uint32_t rawCreateChannel ( rawClient *pClient, const char *pName,
+    ca_uint32_t cid )
+{
+    char name[40];
+    unsigned size = CA_MESSAGE_ALIGN ( strlen ( pName ) + 1u );
+    int cmmd;
+
+    memset ( name, 0, sizeof ( name ) );
+    strcpy ( name, pName );
+    rawSend ( pClient, CA_PROTO_CREATE_CHAN, 0u, 0u, cid, 13u, name, size );
+    while ( ( cmmd = rawRecv ( pClient ) ) >= 0 ) {
+        if ( cmmd == CA_PROTO_CREATE_CHAN &&
+                ntohl ( pClient->hdr.m_cid ) == cid )
+            return ntohl ( pClient->hdr.m_available );
+        if ( cmmd == CA_PROTO_CREATE_CH_FAIL )
+            break;
+    }
+    testAbort ( "Raw client can't create channel %s", pName );
+    return 0u;
+}
+
+static void rawSubscribe ( rawClient *pClient, ca_uint32_t sid,
+    ca_uint32_t subid )
+{
+    char info[16];
+    ca_uint16_t mask = htons ( DBE_VALUE );
+
+    memset ( info, 0, sizeof ( info ) );
+    memcpy ( info + 12, &mask, sizeof ( mask ) );
+    rawSend ( pClient, CA_PROTO_EVENT_ADD, DBR_LONG, 1u, sid, subid,
+        info, sizeof ( info ) );
+}
+
+static int checkArray ( const rawClient *pClient, unsigned count )
+{
+    const epicsInt32 *p = (const epicsInt32 *) pClient->pPayload;
+    unsigned i;
+
+    if ( pClient->count != count ||
+            pClient->postsize !=
+                CA_MESSAGE_ALIGN ( count * sizeof ( epicsInt32 ) ) )
+        return 0;
+    for ( i = 0u; i < count; i++ ) {
+        if ( (epicsInt32) ntohl ( p[i] ) != arrayValue ( i ) )
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * The slow client's pipelined reads are replied to by the I/O thread,
+ * which queues more buffers than a send gathers at once.  Its updates
+ * leave the event task waiting for room.  Meanwhile the other client of
+ * the same I/O thread must be served as usual.
+ */
+static void testSlowClient ( chid fastX )
+{
+    rawClient slow;
+    ca_uint32_t arrSid, xSid;
+    epicsTimeStamp start, end;
+    unsigned i, nReads = 0u, nBad = 0u, nUpdates = 0u;
+    int nFast = 0, lastUpdate = -1, cmmd;
+    double worst = 0.0;
+
+    testDiag ( "Slow client beside a fast one on one I/O thread" );
+
+    rawConnect ( &slow );
+    arrSid = rawCreateChannel ( &slow, "tio:arr", 1u );
+    xSid = rawCreateChannel ( &slow, "tio:x", 2u );
+    rawSubscribe ( &slow, xSid, 1u );
+    for ( i = 0u; i < NREADS; i++ )
+        rawSend ( &slow, CA_PROTO_READ_NOTIFY, DBR_LONG, NARRAY, arrSid,
+            100u + i, NULL, 0u );
+    epicsThreadSleep ( 1.0 );
+
+    for ( i = 0u; i < NPUTS; i++ ) {
+        dbr_long_t val = i;
+
+        epicsTimeGetCurrent ( &start );
+        ca_put ( DBR_LONG, fastX, &val );
+        val = -1;
+        ca_get ( DBR_LONG, fastX, &val );
+        if ( ca_pend_io ( 2.0 ) == ECA_NORMAL && val == (dbr_long_t) i )
+            nFast++;
+        epicsTimeGetCurrent ( &end );
+        if ( epicsTimeDiffInSeconds ( &end, &start ) > worst )
+            worst = epicsTimeDiffInSeconds ( &end, &start );
+    }
+    testOk ( nFast == NPUTS, "Fast client did %d of %d puts and gets",
+        nFast, NPUTS );
+    testOk ( worst < 1.0, "Slowest put and get took %.3f sec", worst );
+
+    /* now read everything the slow client was sent */
+    while ( nReads < NREADS || lastUpdate != NPUTS - 1 ) {
+        cmmd = rawRecv ( &slow );
+        if ( cmmd < 0 )
+            break;
+        if ( cmmd == CA_PROTO_READ_NOTIFY ) {
+            if ( ntohl ( slow.hdr.m_available ) != 100u + nReads ||
+                    ! checkArray ( &slow, NARRAY ) )
+                nBad++;
+            nReads++;
+        }
+        else if ( cmmd == CA_PROTO_EVENT_ADD && slow.postsize >= 4u ) {
+            ca_uint32_t val;
+
+            memcpy ( &val, slow.pPayload, sizeof ( val ) );
+            lastUpdate = (int) ntohl ( val );
+            nUpdates++;
+        }
+    }
+    testOk ( nReads == NREADS, "Slow client got %u of %u array reads",
+        nReads, NREADS );
+    testOk ( nBad == 0u, "%u array reads in order and intact", nReads - nBad );
+    testOk ( lastUpdate == NPUTS - 1, "Slow client got %u updates, the last %d",
+        nUpdates, lastUpdate );
+
+    rawDisconnect ( &slow );
+}
+
+static unsigned smallCount ( unsigned i )
+{
+    return 1u + ( i * 37u ) % 2000u;
+}
+
+/*
+ * Replies of many sizes, each smaller than a TCP buffer, to a client
+ * which doesn't read them yet.  They fill the send buffer, partly go out
+ * without waiting and are queued, so must arrive whole and in order
+ * across the boundaries of the queued buffers.
+ */
+static void testSendQueue ( void )
+{
+    rawClient slow;
+    ca_uint32_t arrSid;
+    unsigned i, nReads = 0u, nBad = 0u;
+    size_t nBytes = 0u;
+    int cmmd;
+
+    testDiag ( "Replies queued for a slow client" );
+
+    rawConnect ( &slow );
+    arrSid = rawCreateChannel ( &slow, "tio:arr", 1u );
+    for ( i = 0u; i < NSMALL; i++ )
+        rawSend ( &slow, CA_PROTO_READ_NOTIFY, DBR_LONG, smallCount ( i ),
+            arrSid, i, NULL, 0u );
+    epicsThreadSleep ( 1.0 );
+
+    while ( nReads < NSMALL ) {
+        cmmd = rawRecv ( &slow );
+        if ( cmmd < 0 )
+            break;
+        if ( cmmd != CA_PROTO_READ_NOTIFY )
+            continue;
+        if ( ntohl ( slow.hdr.m_available ) != nReads ||
+                ! checkArray ( &slow, smallCount ( nReads ) ) )
+            nBad++;
+        nBytes += sizeof ( caHdr ) + slow.postsize;
+        nReads++;
+    }
+    testOk ( nReads == NSMALL, "Slow client got %u of %u replies",
+        nReads, NSMALL );
+    testOk ( nBad == 0u, "%u replies, %u bytes, in order and intact",
+        nReads - nBad, (unsigned) nBytes );
+
+    rawDisconnect ( &slow );
+}
+
+MAIN(casTcpIoTest)
+{
+    dbr_long_t *pArray;
+    chid fastX, fastArr;
+    unsigned i;
+
+    testPlan(10);
+
+    if ( ! osiSockAttach () )
+        testAbort ( "osiSockAttach failed" );
+
+    epicsEnvSet ( "EPICS_CA_AUTO_ADDR_LIST", "NO" );
+    epicsEnvSet ( "EPICS_CA_ADDR_LIST", "127.0.0.1" );
+    epicsEnvSet ( "EPICS_CAS_INTF_ADDR_LIST", "127.0.0.1" );
+    epicsEnvSet ( "EPICS_CA_SERVER_PORT", "15084" );
+    epicsEnvSet ( "EPICS_CA_REPEATER_PORT", "15085" );
+    epicsEnvSet ( "EPICS_CA_MAX_ARRAY_BYTES", "1000000" );
+
+    testdbPrepare();
+    testdbReadDatabase("casTestIoc.dbd", NULL, NULL);
+    casTestIoc_registerRecordDeviceDriver(pdbbase);
+    testdbReadDatabase("casTcpIoTest.db", NULL, NULL);
+
+    /* all TCP clients share one I/O thread */
+    iocshCmd ( "var casTcpIoThreads 1" );
+
+    /* created before iocInit, so its channels go through the CA server */
+    ca_context_create ( ca_enable_preemptive_callback );
+
+    /* testIocInitOk() builds an isolated IOC without servers */
+    eltc(0);
+    testOk1 ( iocBuild () == 0 && iocRun () == 0 );
+    eltc(1);
+
+    testOk ( epicsThreadGetId ( "CAS-io" ) != 0, "Server has an I/O thread" );
+
+    pArray = malloc ( NARRAY * sizeof ( dbr_long_t ) );
+    if ( ! pArray )
+        testAbort ( "Out of memory" );
+    for ( i = 0u; i < NARRAY; i++ )
+        pArray[i] = arrayValue ( i );
+    ca_create_channel ( "tio:x", NULL, NULL, 0, &fastX );
+    ca_create_channel ( "tio:arr", NULL, NULL, 0, &fastArr );
+    ca_pend_io ( 5.0 );
+    ca_array_put ( DBR_LONG, NARRAY, fastArr, pArray );
+    testOk ( ca_pend_io ( 10.0 ) == ECA_NORMAL, "Put %u longs", NARRAY );
+    free ( pArray );
+
+    testSlowClient ( fastX );
+    testSendQueue ();
+
+    ca_clear_channel ( fastArr );
+    ca_clear_channel ( fastX );
+    ca_context_destroy ();
+
+    /* rsrv can't be stopped, so the IOC is left running */
+
+    return testDone();
+}
@@ -0,0 +1,491 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*
+ * Test of the traffic counted per client and per channel by the CA
+ * server, as casTop() and casTrafficDump() report it, with two clients
+ * doing gets, puts and monitors
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cadef.h"
+#include "envDefs.h"
+#include "epicsStdio.h"
+#include "epicsThread.h"
+#include "db_access_routines.h"
+#include "dbUnitTest.h"
+#include "errlog.h"
+#include "iocInit.h"
+#include "osiSock.h"
+#include "rsrv.h"
+#include "yajl_alloc.h"
+#include "yajl_parse.h"
+#include "testMain.h"
+
+#define DUMP_FILE "casTrafficTest.json"
+#define NGETS_A 20u
+#define NGETS_B 5u
+#define NPUTS_A 10u
+#define NPUTS_B 5u
+#define NUPDATES ( NPUTS_B + 1u )   /* with the initial update */
+
+void casTestIoc_registerRecordDeviceDriver(struct dbBase *);
+
+static volatile unsigned nUpdates;
+
+static void countUpdate ( struct event_handler_args args )
+{
+    nUpdates++;
+}
+
+/*
+ * The counters as casTrafficDump() writes them
+ */
+enum { fMsgsIn, fBytesIn, fMsgsOut, fBytesOut, fGets, fPuts, fUpdates,
+    NFIELDS };
+static const char *dumpFields[NFIELDS] = {
+    "msgsIn", "bytesIn", "msgsOut", "bytesOut", "gets", "puts", "updates"
+};
+
+typedef struct dumpEntry {
+    char name[40];              /* channel name, empty for a client */
+    unsigned client;            /* index of the client */
+    size_t value[NFIELDS];
+} dumpEntry;
+
+typedef struct dumpParser {
+    unsigned depth;             /* of maps */
+    int field;                  /* index of the current key, or -1 */
+    int isName;
+    unsigned nClients, nChans;
+    dumpEntry clients[4], chans[16];
+} dumpParser;
+
+static dumpEntry *dumpCurrent ( dumpParser *parser )
+{
+    if ( parser->depth == 3u && parser->nChans )
+        return &parser->chans[parser->nChans - 1u];
+    if ( parser->depth == 2u && parser->nClients )
+        return &parser->clients[parser->nClients - 1u];
+    return NULL;
+}
+
+static int dumpInteger ( void *ctx, long long value )
+{
+    dumpParser *parser = ctx;
+    dumpEntry *pEntry = dumpCurrent ( parser );
+
+    if ( pEntry && parser->field >= 0 )
+        pEntry->value[parser->field] = (size_t) value;
+    return 1;
+}
+
+static int dumpString ( void *ctx, const unsigned char *str, size_t len )
+{
+    dumpParser *parser = ctx;
+    dumpEntry *pEntry = dumpCurrent ( parser );
+
+    if ( pEntry && parser->isName && parser->depth == 3u &&
+            len < sizeof ( pEntry->name ) ) {
+        memcpy ( pEntry->name, str, len );
+        pEntry->name[len] = '\0';
+    }
+    return 1;
+}
+
+static int dumpStartMap ( void *ctx )
+{
+    dumpParser *parser = ctx;
+
+    if ( ++parser->depth == 2u ) {
+        if ( parser->nClients >= NELEMENTS ( parser->clients ) )
+            return 0;
+        parser->nClients++;
+    }
+    else if ( parser->depth == 3u ) {
+        if ( parser->nChans >= NELEMENTS ( parser->chans ) )
+            return 0;
+        parser->chans[parser->nChans++].client = parser->nClients - 1u;
+    }
+    return 1;
+}
+
+static int dumpMapKey ( void *ctx, const unsigned char *key, size_t len )
+{
+    dumpParser *parser = ctx;
+    int i;
+
+    parser->field = -1;
+    parser->isName = len == 4u && memcmp ( key, "name", len ) == 0;
+    for ( i = 0; i < NFIELDS; i++ ) {
+        if ( strlen ( dumpFields[i] ) == len &&
+                memcmp ( key, dumpFields[i], len ) == 0 )
+            parser->field = i;
+    }
+    return 1;
+}
+
+static int dumpEndMap ( void *ctx )
+{
+    dumpParser *parser = ctx;
+
+    parser->depth--;
+    return 1;
+}
+
+static yajl_callbacks dumpCallbacks = {
+    NULL, NULL, dumpInteger, NULL, NULL, dumpString,
+    dumpStartMap, dumpMapKey, dumpEndMap, NULL, NULL
+};
+
+static const dumpEntry *dumpFind ( const dumpParser *parser,
+    unsigned client, const char *name )
+{
+    unsigned i;
+
+    for ( i = 0u; i < parser->nChans; i++ ) {
+        if ( parser->chans[i].client == client &&
+                strcmp ( parser->chans[i].name, name ) == 0 )
+            return &parser->chans[i];
+    }
+    return NULL;
+}
+
+/*
+ * The rows of the casTop() tables
+ */
+typedef struct topRow {
+    unsigned long value[9];     /* in the order of the columns */
+    char name[80];
+} topRow;
+
+enum { cBytesOut, cMsgsOut, cBytesIn, cMsgsIn, cUpdates, cSquashed,
+    cCoalesced, cGets, cPuts };
+
+typedef struct topTable {
+    unsigned shown, total;
+    unsigned nRows;
+    topRow rows[8];
+} topTable;
+
+/*
+ * Run casTop() with its output in a file, and read back its tables
+ * of channels and clients, return false if any are missing
+ */
+static int topRun ( unsigned count, const char *sortKey,
+    topTable *pChans, topTable *pClients, char *pFirstLine, size_t size )
+{
+    FILE *fp = epicsTempFile ();
+    topTable *pTable = NULL;
+    char line[256];
+    int nTables = 0;
+
+    if ( ! fp )
+        testAbort ( "Can't create a temporary file" );
+    epicsSetThreadStdout ( fp );
+    casTop ( count, sortKey );
+    epicsSetThreadStdout ( NULL );
+    rewind ( fp );
+
+    memset ( pChans, 0, sizeof ( *pChans ) );
+    memset ( pClients, 0, sizeof ( *pClients ) );
+    *pFirstLine = '\0';
+    while ( fgets ( line, sizeof ( line ), fp ) ) {
+        unsigned shown, total;
+        char kind[16];
+        topRow row;
+        int pos;
+
+        if ( ! *pFirstLine ) {
+            strncpy ( pFirstLine, line, size - 1u );
+            pFirstLine[size - 1u] = '\0';
+        }
+        if ( sscanf ( line, "Top %u of %u %15s", &shown, &total, kind )
+                == 3 ) {
+            pTable = strcmp ( kind, "clients" ) == 0 ? pClients : pChans;
+            pTable->shown = shown;
+            pTable->total = total;
+            nTables++;
+            continue;
+        }
+        if ( ! pTable || sscanf ( line,
+                "%lu %lu %lu %lu %lu %lu %lu %lu %lu %n",
+                &row.value[0], &row.value[1], &row.value[2], &row.value[3],
+                &row.value[4], &row.value[5], &row.value[6], &row.value[7],
+                &row.value[8], &pos ) != 9 ||
+                pTable->nRows >= NELEMENTS ( pTable->rows ) )
+            continue;
+        strncpy ( row.name, line + pos, sizeof ( row.name ) - 1u );
+        row.name[sizeof ( row.name ) - 1u] = '\0';
+        pTable->rows[pTable->nRows++] = row;
+    }
+    fclose ( fp );
+    return nTables == 2;
+}
+
+static int topSorted ( const topTable *pTable, int column )
+{
+    unsigned i;
+
+    for ( i = 1u; i < pTable->nRows; i++ ) {
+        if ( pTable->rows[i].value[column] >
+                pTable->rows[i - 1u].value[column] )
+            return 0;
+    }
+    return 1;
+}
+
+static void testTop ( void )
+{
+    topTable chans, clients;
+    char first[80];
+    int ok;
+
+    testDiag ( "Top talkers from casTop()" );
+
+    ok = topRun ( 10u, "gets", &chans, &clients, first, sizeof ( first ) );
+    testOk ( ok && topSorted ( &chans, cGets ) && topSorted ( &clients, cGets ),
+        "Channels and clients sorted by gets" );
+    testOk ( ok && chans.nRows == 6u && chans.total == 6u &&
+        chans.rows[0].value[cGets] == NGETS_A &&
+        strncmp ( chans.rows[0].name, "tt:a ", 5 ) == 0 &&
+        chans.rows[1].value[cGets] == NGETS_B &&
+        strncmp ( chans.rows[1].name, "tt:a ", 5 ) == 0,
+        "Top channels by gets %lu and %lu, of %u",
+        chans.rows[0].value[cGets], chans.rows[1].value[cGets], chans.total );
+    testOk ( ok && clients.nRows == 2u && clients.total == 2u &&
+        clients.rows[0].value[cGets] == NGETS_A &&
+        clients.rows[1].value[cGets] == NGETS_B,
+        "Top clients by gets %lu and %lu",
+        clients.rows[0].value[cGets], clients.rows[1].value[cGets] );
+
+    ok = topRun ( 2u, "puts", &chans, &clients, first, sizeof ( first ) );
+    testOk ( ok && chans.shown == 2u && chans.nRows == 2u &&
+        chans.total == 6u && chans.rows[0].value[cPuts] == NPUTS_A &&
+        strncmp ( chans.rows[0].name, "tt:b ", 5 ) == 0 &&
+        chans.rows[1].value[cPuts] == NPUTS_B &&
+        strncmp ( chans.rows[1].name, "tt:c ", 5 ) == 0,
+        "Top 2 channels by puts %lu and %lu",
+        chans.rows[0].value[cPuts], chans.rows[1].value[cPuts] );
+
+    ok = topRun ( 1u, "updates", &chans, &clients, first, sizeof ( first ) );
+    testOk ( ok && chans.nRows == 1u &&
+        chans.rows[0].value[cUpdates] == NUPDATES &&
+        strncmp ( chans.rows[0].name, "tt:c ", 5 ) == 0 &&
+        clients.nRows == 1u && clients.rows[0].value[cUpdates] == NUPDATES,
+        "Top channel and client by updates %lu and %lu",
+        chans.rows[0].value[cUpdates], clients.rows[0].value[cUpdates] );
+
+    ok = topRun ( 10u, "nonsense", &chans, &clients, first, sizeof ( first ) );
+    testOk ( ! ok && strncmp ( first, "Unknown sort key", 16 ) == 0,
+        "Unknown sort key rejected" );
+}
+
+static void testDump ( void )
+{
+    dumpParser parser;
+    yajl_alloc_funcs allocs;
+    yajl_handle yh;
+    yajl_status ys = yajl_status_error;
+    const dumpEntry *pA[3], *pB[3];
+    unsigned a, b, i;
+    char buf[1024];
+    size_t n;
+    FILE *fp;
+
+    testDiag ( "JSON from casTrafficDump()" );
+
+    testOk1 ( casTrafficDump ( DUMP_FILE ) == 0 );
+
+    memset ( &parser, 0, sizeof ( parser ) );
+    parser.field = -1;
+    yajl_set_default_alloc_funcs ( &allocs );
+    yh = yajl_alloc ( &dumpCallbacks, &allocs, &parser );
+    fp = fopen ( DUMP_FILE, "r" );
+    if ( ! yh || ! fp )
+        testAbort ( "Can't read %s", DUMP_FILE );
+    while ( ( n = fread ( buf, 1u, sizeof ( buf ), fp ) ) > 0u ) {
+        ys = yajl_parse ( yh, (const unsigned char *) buf, n );
+        if ( ys != yajl_status_ok )
+            break;
+    }
+    if ( ys == yajl_status_ok )
+        ys = yajl_complete_parse ( yh );
+    fclose ( fp );
+    yajl_free ( yh );
+    remove ( DUMP_FILE );
+
+    testOk ( ys == yajl_status_ok && parser.nClients == 2u &&
+        parser.nChans == 6u,
+        "Dump parses, %u clients with %u channels",
+        parser.nClients, parser.nChans );
+
+    /* client A is the one with tt:b */
+    a = dumpFind ( &parser, 0u, "tt:b" ) ? 0u : 1u;
+    b = 1u - a;
+    pA[0] = dumpFind ( &parser, a, "tt:a" );
+    pA[1] = dumpFind ( &parser, a, "tt:b" );
+    pA[2] = dumpFind ( &parser, a, "tt:c" );
+    pB[0] = dumpFind ( &parser, b, "tt:a" );
+    pB[1] = dumpFind ( &parser, b, "tt:b" );
+    pB[2] = dumpFind ( &parser, b, "tt:c" );
+    for ( i = 0u; i < 3u; i++ ) {
+        if ( ! pA[i] || ! pB[i] )
+            break;
+    }
+    if ( i < 3u ) {
+        testFail ( "Channel %u of a client missing from the dump", i );
+        testSkip ( 3, "Dump incomplete" );
+        return;
+    }
+    testOk ( pA[0]->value[fGets] == NGETS_A && pA[1]->value[fPuts] == NPUTS_A &&
+        pA[2]->value[fUpdates] == NUPDATES && pA[2]->value[fGets] == 0u &&
+        pA[2]->value[fPuts] == 0u,
+        "Channels of client A: %lu gets, %lu puts, %lu updates",
+        (unsigned long) pA[0]->value[fGets],
+        (unsigned long) pA[1]->value[fPuts],
+        (unsigned long) pA[2]->value[fUpdates] );
+    testOk ( pB[0]->value[fGets] == NGETS_B && pB[2]->value[fPuts] == NPUTS_B &&
+        pB[1]->value[fGets] == 0u && pB[1]->value[fPuts] == 0u &&
+        pB[2]->value[fUpdates] == 0u,
+        "Channels of client B: %lu gets, %lu puts",
+        (unsigned long) pB[0]->value[fGets],
+        (unsigned long) pB[2]->value[fPuts] );
+    testOk ( parser.clients[a].value[fGets] == NGETS_A &&
+        parser.clients[a].value[fPuts] == NPUTS_A &&
+        parser.clients[a].value[fUpdates] == NUPDATES &&
+        parser.clients[b].value[fGets] == NGETS_B &&
+        parser.clients[b].value[fPuts] == NPUTS_B &&
+        parser.clients[b].value[fUpdates] == 0u,
+        "Client totals match their channels" );
+
+    /*
+     * a channel counts its requests and the replies and updates for
+     * it, a client also counts messages which aren't for any channel
+     */
+    for ( i = 0u; i < 3u; i++ ) {
+        if ( pA[i]->value[fMsgsIn] == 0u ||
+                pA[i]->value[fBytesIn] < pA[i]->value[fMsgsIn] * 16u ||
+                pA[i]->value[fBytesOut] < pA[i]->value[fMsgsOut] * 16u )
+            break;
+    }
+    testOk ( i == 3u && pA[0]->value[fMsgsOut] == NGETS_A &&
+        pA[1]->value[fMsgsOut] == 0u && pA[2]->value[fMsgsOut] == NUPDATES &&
+        parser.clients[a].value[fMsgsIn] > pA[0]->value[fMsgsIn] +
+            pA[1]->value[fMsgsIn] + pA[2]->value[fMsgsIn] &&
+        parser.clients[a].value[fBytesOut] >= pA[0]->value[fBytesOut] +
+            pA[1]->value[fBytesOut] + pA[2]->value[fBytesOut],
+        "Messages and bytes of client A: %lu in, %lu bytes out",
+        (unsigned long) parser.clients[a].value[fMsgsIn],
+        (unsigned long) parser.clients[a].value[fBytesOut] );
+}
+
+static void channelsCreate ( chid *pChans )
+{
+    ca_create_channel ( "tt:a", NULL, NULL, 0, &pChans[0] );
+    ca_create_channel ( "tt:b", NULL, NULL, 0, &pChans[1] );
+    ca_create_channel ( "tt:c", NULL, NULL, 0, &pChans[2] );
+}
+
+MAIN(casTrafficTest)
+{
+    struct ca_client_context *contextA, *contextB;
+    chid chansA[3], chansB[3];
+    dbr_long_t value;
+    evid monitor;
+    unsigned i;
+
+    testPlan(14);
+
+    if ( ! osiSockAttach () )
+        testAbort ( "osiSockAttach failed" );
+
+    epicsEnvSet ( "EPICS_CA_AUTO_ADDR_LIST", "NO" );
+    epicsEnvSet ( "EPICS_CA_ADDR_LIST", "127.0.0.1" );
+    epicsEnvSet ( "EPICS_CAS_INTF_ADDR_LIST", "127.0.0.1" );
+    epicsEnvSet ( "EPICS_CA_SERVER_PORT", "15088" );
+    epicsEnvSet ( "EPICS_CA_REPEATER_PORT", "15089" );
+
+    testdbPrepare();
+    testdbReadDatabase("casTestIoc.dbd", NULL, NULL);
+    casTestIoc_registerRecordDeviceDriver(pdbbase);
+    testdbReadDatabase("casTrafficTest.db", NULL, NULL);
+
+    /*
+     * two clients of the server, created before iocInit so that
+     * their channels go through it
+     */
+    ca_context_create ( ca_enable_preemptive_callback );
+    contextA = ca_current_context ();
+    ca_detach_context ();
+    ca_context_create ( ca_enable_preemptive_callback );
+    contextB = ca_current_context ();
+
+    /* testIocInitOk() builds an isolated IOC without servers */
+    eltc(0);
+    testOk1 ( iocBuild () == 0 && iocRun () == 0 );
+    eltc(1);
+
+    /*
+     * client A monitors tt:c, puts tt:b and gets tt:a, the replies to
+     * the gets come after the puts are done
+     */
+    ca_detach_context ();
+    ca_attach_context ( contextA );
+    channelsCreate ( chansA );
+    if ( ca_pend_io ( 5.0 ) != ECA_NORMAL )
+        testAbort ( "Client A didn't connect" );
+    ca_create_subscription ( DBR_LONG, 1, chansA[2], DBE_VALUE,
+        countUpdate, NULL, &monitor );
+    for ( i = 0u; i < NPUTS_A; i++ ) {
+        value = i;
+        ca_put ( DBR_LONG, chansA[1], &value );
+    }
+    for ( i = 0u; i < NGETS_A; i++ ) {
+        ca_get ( DBR_LONG, chansA[0], &value );
+        ca_pend_io ( 5.0 );
+    }
+
+    /* client B puts tt:c, one update for A at a time, and gets tt:a */
+    ca_detach_context ();
+    ca_attach_context ( contextB );
+    channelsCreate ( chansB );
+    if ( ca_pend_io ( 5.0 ) != ECA_NORMAL )
+        testAbort ( "Client B didn't connect" );
+    for ( i = 0u; i < NPUTS_B; i++ ) {
+        unsigned j;
+
+        value = i + 1;
+        ca_put ( DBR_LONG, chansB[2], &value );
+        ca_flush_io ();
+        for ( j = 0u; j < 500u && nUpdates < i + 2u; j++ )
+            epicsThreadSleep ( 0.01 );
+    }
+    for ( i = 0u; i < NGETS_B; i++ ) {
+        ca_get ( DBR_LONG, chansB[0], &value );
+        ca_pend_io ( 5.0 );
+    }
+    testOk ( nUpdates == NUPDATES, "Client A saw %u updates of tt:c",
+        nUpdates );
+
+    testTop ();
+    testDump ();
+
+    ca_clear_channel ( chansB[2] );
+    ca_clear_channel ( chansB[1] );
+    ca_clear_channel ( chansB[0] );
+    ca_context_destroy ();
+    ca_attach_context ( contextA );
+    ca_clear_subscription ( monitor );
+    ca_clear_channel ( chansA[2] );
+    ca_clear_channel ( chansA[1] );
+    ca_clear_channel ( chansA[0] );
+    ca_context_destroy ();
+
+    /* rsrv can't be stopped, so the IOC is left running */
+
+    return testDone();
+}
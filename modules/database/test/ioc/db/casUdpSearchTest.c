@@ -0,0 +1,300 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*
+ * Test of the CA server's UDP search threads (casUdpSearchThreads),
+ * with bursts of searches from two senders queued while the threads
+ * are held
+ */
+
+#define EPICS_PRIVATE_API
+
+#include <string.h>
+
+#include "caProto.h"
+#include "dbAccess.h"
+#include "envDefs.h"
+#include "epicsThread.h"
+#include "dbUnitTest.h"
+#include "errlog.h"
+#include "iocInit.h"
+#include "iocsh.h"
+#include "osiSock.h"
+#include "rsrv.h"
+#include "testMain.h"
+
+#define SERVER_PORT 15086
+#define CHANNEL "tus:x"
+#define MINOR_REVISION 13u
+#define QUEUE_MAX 1024u         /* CAST_QUEUE_MAX */
+#define NBURST 100u
+#define NEXTRA 200u
+#define NSEARCH ( QUEUE_MAX + NEXTRA )
+
+void casTestIoc_registerRecordDeviceDriver(struct dbBase *);
+
+static unsigned char answered[QUEUE_MAX];
+
+typedef struct searchStatus {
+    unsigned threads, queued, maxQueued;
+    size_t dropped, searches;
+    double rate;
+} searchStatus;
+
+static void statusGet ( searchStatus *pStatus )
+{
+    casUdpSearchStatus ( &pStatus->threads, &pStatus->queued,
+        &pStatus->maxQueued, &pStatus->dropped, &pStatus->searches,
+        &pStatus->rate );
+}
+
+static SOCKET udpSocket ( void )
+{
+    SOCKET sock = epicsSocketCreate ( AF_INET, SOCK_DGRAM, 0 );
+    osiSockAddr addr;
+    int size = 1 << 20;
+
+    if ( sock == INVALID_SOCKET )
+        testAbort ( "Can't create a UDP socket" );
+    memset ( &addr, 0, sizeof ( addr ) );
+    addr.ia.sin_family = AF_INET;
+    addr.ia.sin_addr.s_addr = htonl ( INADDR_LOOPBACK );
+    if ( bind ( sock, &addr.sa, sizeof ( addr ) ) )
+        testAbort ( "Can't bind a UDP socket" );
+    setsockopt ( sock, SOL_SOCKET, SO_RCVBUF, (char *) &size, sizeof ( size ) );
+    return sock;
+}
+
+static void headerPut ( char *pBuf, unsigned cmmd, unsigned postsize,
+    unsigned dataType, unsigned count, unsigned cid, unsigned available )
+{
+    caHdr hdr;
+
+    hdr.m_cmmd = htons ( (ca_uint16_t) cmmd );
+    hdr.m_postsize = htons ( (ca_uint16_t) postsize );
+    hdr.m_dataType = htons ( (ca_uint16_t) dataType );
+    hdr.m_count = htons ( (ca_uint16_t) count );
+    hdr.m_cid = htonl ( cid );
+    hdr.m_available = htonl ( available );
+    memcpy ( pBuf, &hdr, sizeof ( hdr ) );
+}
+
+/*
+ * One datagram with a version message and a search for CHANNEL
+ */
+static void searchSend ( SOCKET sock, unsigned cid )
+{
+    char buf[2 * sizeof ( caHdr ) + 8];
+    osiSockAddr addr;
+
+    memset ( buf, 0, sizeof ( buf ) );
+    headerPut ( buf, CA_PROTO_VERSION, 0u, 0u,
+        MINOR_REVISION, 0u, 0u );
+    headerPut ( buf + sizeof ( caHdr ), CA_PROTO_SEARCH, 8u, DOREPLY,
+        MINOR_REVISION, cid, cid );
+    strcpy ( buf + 2 * sizeof ( caHdr ), CHANNEL );
+
+    memset ( &addr, 0, sizeof ( addr ) );
+    addr.ia.sin_family = AF_INET;
+    addr.ia.sin_addr.s_addr = htonl ( INADDR_LOOPBACK );
+    addr.ia.sin_port = htons ( SERVER_PORT );
+    if ( sendto ( sock, buf, sizeof ( buf ), 0, &addr.sa,
+            sizeof ( addr ) ) != sizeof ( buf ) )
+        testAbort ( "Can't send a search" );
+}
+
+/*
+ * Send searches first..first+n-1, in steps small enough for the
+ * socket, waiting for each step to be queued or dropped
+ */
+static void searchBurst ( SOCKET sock, unsigned first, unsigned n )
+{
+    searchStatus start, now;
+    unsigned i, j;
+
+    statusGet ( &start );
+    for ( i = 0u; i < n; ) {
+        for ( j = 0u; j < 32u && i < n; j++, i++ )
+            searchSend ( sock, first + i );
+        for ( j = 0u; j < 500u; j++ ) {
+            statusGet ( &now );
+            if ( now.queued - start.queued +
+                    now.dropped - start.dropped >= i )
+                break;
+            epicsThreadSleep ( 0.01 );
+        }
+    }
+}
+
+/*
+ * Read replies to searches first..first+n-1, return the number of
+ * them answered and count the reply datagrams and the replies which
+ * aren't for this sender
+ */
+static unsigned replyRecv ( SOCKET sock, unsigned first, unsigned n,
+    unsigned *pDatagrams, unsigned *pStray )
+{
+    char buf[MAX_UDP_SEND];
+    unsigned nAnswered = 0u;
+
+    memset ( answered, 0, sizeof ( answered ) );
+    *pDatagrams = *pStray = 0u;
+    while ( nAnswered < n ) {
+        struct timeval tv;
+        fd_set fds;
+        int cnt, pos;
+
+        tv.tv_sec = 5;
+        tv.tv_usec = 0;
+        FD_ZERO ( &fds );
+        FD_SET ( sock, &fds );
+        if ( select ( sock + 1, &fds, NULL, NULL, &tv ) <= 0 )
+            break;
+        cnt = recv ( sock, buf, sizeof ( buf ), 0 );
+        if ( cnt <= 0 )
+            break;
+        ( *pDatagrams )++;
+        for ( pos = 0; pos + (int) sizeof ( caHdr ) <= cnt; ) {
+            caHdr hdr;
+            unsigned cid;
+
+            memcpy ( &hdr, buf + pos, sizeof ( hdr ) );
+            pos += sizeof ( hdr ) + ntohs ( hdr.m_postsize );
+            if ( ntohs ( hdr.m_cmmd ) != CA_PROTO_SEARCH )
+                continue;
+            cid = ntohl ( hdr.m_available );
+            if ( cid < first || cid >= first + n ) {
+                ( *pStray )++;
+            }
+            else if ( ! answered[cid - first] ) {
+                answered[cid - first] = 1;
+                nAnswered++;
+            }
+        }
+    }
+    return nAnswered;
+}
+
+/*
+ * Queued datagrams from one sender are taken together, so their
+ * replies share reply datagrams, but each sender gets only its own
+ */
+static void testBatching ( SOCKET senderA, SOCKET senderB )
+{
+    searchStatus start, end;
+    unsigned nA, nB, dgramsA, dgramsB, strayA, strayB;
+
+    testDiag ( "Replies to bursts from two senders" );
+
+    statusGet ( &start );
+    casUdpSearchHold ( 1 );
+    searchBurst ( senderA, 0u, NBURST );
+    searchBurst ( senderB, NBURST, NBURST );
+    casUdpSearchHold ( 0 );
+
+    nA = replyRecv ( senderA, 0u, NBURST, &dgramsA, &strayA );
+    nB = replyRecv ( senderB, NBURST, NBURST, &dgramsB, &strayB );
+    statusGet ( &end );
+
+    testOk ( nA == NBURST && nB == NBURST,
+        "Answered %u and %u of %u searches", nA, nB, NBURST );
+    testOk ( strayA == 0u && strayB == 0u,
+        "%u and %u replies went to the other sender", strayA, strayB );
+    testOk ( dgramsA * 4u <= nA && dgramsB * 4u <= nB,
+        "Replies batched in %u and %u datagrams", dgramsA, dgramsB );
+    testOk ( end.searches - start.searches == 2u * NBURST,
+        "%lu searches counted",
+        (unsigned long) ( end.searches - start.searches ) );
+}
+
+/*
+ * Datagrams beyond the queue limit are dropped and counted
+ */
+static void testDrops ( SOCKET sender )
+{
+    searchStatus start, held, end;
+    unsigned nAnswered, dgrams, stray;
+
+    testDiag ( "A burst of %u searches, %u more than the queue holds",
+        NSEARCH, NEXTRA );
+
+    statusGet ( &start );
+    casUdpSearchHold ( 1 );
+    searchBurst ( sender, 0u, NSEARCH );
+    statusGet ( &held );
+    casUdpSearchHold ( 0 );
+
+    testOk ( held.queued - start.queued == QUEUE_MAX &&
+        held.maxQueued == QUEUE_MAX,
+        "%u datagrams queued, max %u", held.queued - start.queued,
+        held.maxQueued );
+    testOk ( held.dropped - start.dropped == NEXTRA,
+        "%lu datagrams dropped",
+        (unsigned long) ( held.dropped - start.dropped ) );
+
+    /* searches beyond QUEUE_MAX were the ones dropped */
+    nAnswered = replyRecv ( sender, 0u, QUEUE_MAX, &dgrams, &stray );
+    statusGet ( &end );
+
+    testOk ( nAnswered == QUEUE_MAX && stray == 0u,
+        "The first %u searches answered, %u others", nAnswered, stray );
+    testOk ( end.searches - start.searches == QUEUE_MAX && end.queued == 0u,
+        "%lu searches counted, %u left queued",
+        (unsigned long) ( end.searches - start.searches ), end.queued );
+}
+
+MAIN(casUdpSearchTest)
+{
+    searchStatus status;
+    SOCKET senderA, senderB;
+
+    testPlan(12);
+
+    if ( ! osiSockAttach () )
+        testAbort ( "osiSockAttach failed" );
+
+    epicsEnvSet ( "EPICS_CA_AUTO_ADDR_LIST", "NO" );
+    epicsEnvSet ( "EPICS_CA_ADDR_LIST", "127.0.0.1" );
+    epicsEnvSet ( "EPICS_CAS_INTF_ADDR_LIST", "127.0.0.1" );
+    epicsEnvSet ( "EPICS_CA_SERVER_PORT", "15086" );
+    epicsEnvSet ( "EPICS_CA_REPEATER_PORT", "15087" );
+
+    testdbPrepare();
+    testdbReadDatabase("casTestIoc.dbd", NULL, NULL);
+    casTestIoc_registerRecordDeviceDriver(pdbbase);
+    testdbReadDatabase("casUdpSearchTest.db", NULL, NULL);
+
+    iocshCmd ( "var casUdpSearchThreads 2" );
+
+    /* testIocInitOk() builds an isolated IOC without servers */
+    eltc(0);
+    testOk1 ( iocBuild () == 0 && iocRun () == 0 );
+    eltc(1);
+
+    statusGet ( &status );
+    testOk ( status.threads >= 2u, "Server has %u search threads",
+        status.threads );
+
+    senderA = udpSocket ();
+    senderB = udpSocket ();
+
+    testBatching ( senderA, senderB );
+    testDrops ( senderA );
+
+    /* what casr shows, a rate window closes once it is a second old */
+    epicsThreadSleep ( 1.1 );
+    statusGet ( &status );
+    testOk ( status.searches == 2u * NBURST + QUEUE_MAX,
+        "%lu searches in total", (unsigned long) status.searches );
+    testOk ( status.rate > 0.0 && status.rate <= status.searches,
+        "%.0f searches/sec", status.rate );
+    casr ( 1 );
+
+    epicsSocketDestroy ( senderB );
+    epicsSocketDestroy ( senderA );
+
+    /* rsrv can't be stopped, so the IOC is left running */
+
+    return testDone();
+}
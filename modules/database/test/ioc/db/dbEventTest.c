@@ -0,0 +1,552 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+
+/*
+ * Tests for the event queue depth, growth, batch delivery and shared
+ * array posting of dbEvent.c, with and without the lock-free intake
+ */
+
+#include <string.h>
+
+#define EPICS_PRIVATE_API
+
+#include "epicsAtomic.h"
+#include "epicsEvent.h"
+#include "epicsMutex.h"
+#include "epicsThread.h"
+#include "errlog.h"
+#include "dbAccess.h"
+#include "dbChannel.h"
+#include "dbEvent.h"
+#include "db_field_log.h"
+#include "dbUnitTest.h"
+#include "testMain.h"
+
+#include "xRecord.h"
+#include "arrRecord.h"
+
+void dbTestIoc_registerRecordDeviceDriver(struct dbBase *);
+
+#define NPOSTS 200
+
+static epicsMutexId lock;
+static epicsEventId block, blocked, done;
+static unsigned nupdates;
+static epicsInt32 values[NPOSTS+1];
+
+static
+void monitor(void *user_arg, struct dbChannel *chan,
+             int eventsRemaining, struct db_field_log *pfl)
+{
+    epicsInt32 val;
+    int wait;
+
+    if (pfl->type == dbfl_type_val) {
+        val = pfl->u.v.field.dbf_long;
+    } else {
+        dbScanLock(dbChannelRecord(chan));
+        val = *(epicsInt32 *) dbChannelField(chan);
+        dbScanUnlock(dbChannelRecord(chan));
+    }
+
+    epicsMutexMustLock(lock);
+    if (nupdates <= NPOSTS)
+        values[nupdates] = val;
+    wait = nupdates++ == 0;
+    epicsMutexUnlock(lock);
+
+    /* hold up the event task on the first update */
+    if (wait) {
+        epicsEventMustTrigger(blocked);
+        epicsEventMustWait(block);
+    }
+    if (val == NPOSTS)
+        epicsEventMustTrigger(done);
+}
+
+static
+void postBurst(xRecord *prec)
+{
+    epicsInt32 i;
+
+    for (i = 0; i <= NPOSTS; i++) {
+        dbScanLock((dbCommon *) prec);
+        prec->val = i;
+        db_post_events(prec, &prec->val, DBE_VALUE);
+        dbScanUnlock((dbCommon *) prec);
+
+        if (i == 0)
+            epicsEventMustWait(blocked);
+    }
+    epicsEventMustTrigger(block);
+    epicsEventMustWait(done);
+}
+
+static
+int inOrder(void)
+{
+    unsigned i;
+
+    for (i = 1; i < nupdates && i <= NPOSTS; i++)
+        if (values[i] <= values[i-1])
+            return 0;
+    return 1;
+}
+
+static
+void testBurst(const char *what, unsigned depth, unsigned maxSize,
+               unsigned expect)
+{
+    dbEventCtx ctx;
+    dbChannel *chan;
+    dbEventSubscription sub;
+    xRecord *prec = (xRecord *) testdbRecordPtr("x");
+
+    testDiag("%s", what);
+
+    ctx = db_init_events();
+    testOk1(ctx != NULL);
+    if (maxSize)
+        db_event_queue_size(ctx, 0, maxSize);
+    testOk1(db_start_events(ctx, "test-event", NULL, NULL,
+                            epicsThreadPriorityMedium) == DB_EVENT_OK);
+
+    chan = dbChannelCreate("x.VAL");
+    testOk1(chan && !dbChannelOpen(chan));
+
+    sub = db_add_event_depth(ctx, chan, monitor, NULL, DBE_VALUE, depth);
+    testOk1(sub != NULL);
+    db_event_enable(sub);
+
+    nupdates = 0;
+    memset(values, 0, sizeof(values));
+    postBurst(prec);
+
+    epicsMutexMustLock(lock);
+    if (expect)
+        testOk(nupdates == expect, "received %u of %u updates",
+               nupdates, expect);
+    else
+        testOk(nupdates < NPOSTS+1, "received %u of %u updates, some squashed",
+               nupdates, NPOSTS+1);
+    testOk1(values[nupdates-1] == NPOSTS);
+    testOk(inOrder(), "updates delivered in order");
+    testOk(db_event_replaced(sub) == NPOSTS+1 - nupdates,
+           "%lu updates replaced on the queue", db_event_replaced(sub));
+    epicsMutexUnlock(lock);
+
+    db_cancel_event(sub);
+    dbChannelDelete(chan);
+    db_close_events(ctx);
+}
+
+static unsigned nbatches, maxbatch;
+
+static
+void batchMonitor(void *batch_arg, unsigned nEntries,
+                  const dbEventBatchEntry *pEntries, int eventsRemaining)
+{
+    unsigned i;
+
+    epicsMutexMustLock(lock);
+    nbatches++;
+    if (nEntries > maxbatch)
+        maxbatch = nEntries;
+    epicsMutexUnlock(lock);
+
+    for (i = 0; i < nEntries; i++)
+        (*pEntries[i].user_sub)(pEntries[i].user_arg, pEntries[i].chan,
+            i + 1 < nEntries || eventsRemaining, pEntries[i].pfl);
+}
+
+static
+void testBatch(void)
+{
+    dbEventCtx ctx;
+    dbChannel *chan;
+    dbEventSubscription sub;
+    xRecord *prec = (xRecord *) testdbRecordPtr("x");
+
+    testDiag("Batch delivery");
+
+    ctx = db_init_events();
+    testOk1(ctx != NULL);
+    testOk1(db_add_event_batch_handler(ctx, batchMonitor, NULL) == DB_EVENT_OK);
+    testOk1(db_start_events(ctx, "test-event", NULL, NULL,
+                            epicsThreadPriorityMedium) == DB_EVENT_OK);
+    testOk(db_add_event_batch_handler(ctx, batchMonitor, NULL) != DB_EVENT_OK,
+           "Can't add batch handler to a running context");
+
+    chan = dbChannelCreate("x.VAL");
+    testOk1(chan && !dbChannelOpen(chan));
+
+    sub = db_add_event_depth(ctx, chan, monitor, NULL, DBE_VALUE, 300);
+    testOk1(sub != NULL);
+    db_event_enable(sub);
+
+    nupdates = nbatches = maxbatch = 0;
+    memset(values, 0, sizeof(values));
+    postBurst(prec);
+
+    epicsMutexMustLock(lock);
+    testOk(nupdates == NPOSTS+1, "received %u of %u updates",
+           nupdates, NPOSTS+1);
+    testOk(nbatches < nupdates, "in %u batches of up to %u",
+           nbatches, maxbatch);
+    testOk(inOrder(), "updates delivered in order");
+    epicsMutexUnlock(lock);
+
+    db_cancel_event(sub);
+    dbChannelDelete(chan);
+    db_close_events(ctx);
+}
+
+static dbEventSubscription cancelSub;
+static unsigned ncancelUpdates;
+
+static
+void cancelMonitor(void *user_arg, struct dbChannel *chan,
+                   int eventsRemaining, struct db_field_log *pfl)
+{
+    ncancelUpdates++;
+    db_cancel_event(cancelSub);
+    epicsEventMustTrigger(done);
+}
+
+static
+void testCancelInBatch(void)
+{
+    dbEventCtx ctx;
+    dbChannel *chan;
+    xRecord *prec = (xRecord *) testdbRecordPtr("x");
+    epicsInt32 i;
+
+    testDiag("Cancel from a callback with more updates in the batch");
+
+    ctx = db_init_events();
+    testOk1(ctx != NULL);
+    chan = dbChannelCreate("x.VAL");
+    testOk1(chan && !dbChannelOpen(chan));
+
+    cancelSub = db_add_event(ctx, chan, cancelMonitor, NULL, DBE_VALUE);
+    testOk1(cancelSub != NULL);
+    db_event_enable(cancelSub);
+
+    /* queue some updates before the event task starts */
+    for (i = 0; i < 10; i++) {
+        dbScanLock((dbCommon *) prec);
+        prec->val = i;
+        db_post_events(prec, &prec->val, DBE_VALUE);
+        dbScanUnlock((dbCommon *) prec);
+    }
+
+    ncancelUpdates = 0;
+    testOk1(db_start_events(ctx, "test-event", NULL, NULL,
+                            epicsThreadPriorityMedium) == DB_EVENT_OK);
+    epicsEventMustWait(done);
+    db_flush_extra_labor_event(ctx);
+    epicsThreadSleep(0.1);
+    testOk(ncancelUpdates == 1, "one update delivered (%u)", ncancelUpdates);
+
+    db_close_events(ctx);
+    dbChannelDelete(chan);
+}
+
+static epicsInt32 sharedVals[8];
+static long nShared;
+
+static
+void sharedMonitor(void *user_arg, struct dbChannel *chan,
+                   int eventsRemaining, struct db_field_log *pfl)
+{
+    nShared = 8;
+    testOk(pfl->type == dbfl_type_ref, "update references the shared array");
+    testOk1(dbChannelGet(chan, DBR_LONG, sharedVals, NULL, &nShared, pfl) == 0);
+    epicsEventMustTrigger(done);
+}
+
+static
+void testSharedArray(void)
+{
+    dbEventCtx ctx;
+    dbChannel *chan;
+    dbEventSubscription sub;
+    arrRecord *prec = (arrRecord *) testdbRecordPtr("arr");
+    epicsInt32 *pArray;
+    long i;
+
+    testDiag("Posting a shared array");
+
+    ctx = db_init_events();
+    testOk1(ctx != NULL);
+    chan = dbChannelCreate("arr.VAL");
+    testOk1(chan && !dbChannelOpen(chan));
+
+    sub = db_add_event(ctx, chan, sharedMonitor, NULL, DBE_VALUE);
+    testOk1(sub != NULL);
+    db_event_enable(sub);
+
+    pArray = db_shared_array_alloc(4 * sizeof(epicsInt32));
+    testOk1(pArray != NULL);
+    for (i = 0; i < 4; i++)
+        pArray[i] = i + 1;
+
+    /* the record's own array changes after the post */
+    dbScanLock((dbCommon *) prec);
+    db_post_shared_events(prec, dbChannelField(chan), DBE_VALUE, pArray, 4);
+    memset(prec->bptr, 0, 8 * sizeof(epicsInt32));
+    prec->nord = 8;
+    dbScanUnlock((dbCommon *) prec);
+    db_shared_array_release(pArray);
+
+    testOk1(db_start_events(ctx, "test-event", NULL, NULL,
+                            epicsThreadPriorityMedium) == DB_EVENT_OK);
+    epicsEventMustWait(done);
+
+    testOk(nShared == 4, "received %ld elements", nShared);
+    testOk(sharedVals[0] == 1 && sharedVals[3] == 4,
+           "received posted values %d .. %d", sharedVals[0], sharedVals[3]);
+
+    db_cancel_event(sub);
+    dbChannelDelete(chan);
+    db_close_events(ctx);
+}
+
+static epicsEventId stalled, unstall, posted;
+
+/* hold up the stalling thread with its intake entry claimed */
+static
+void stallHook(void)
+{
+    if (strcmp(epicsThreadGetNameSelf(), "stallPoster") == 0) {
+        epicsEventMustTrigger(stalled);
+        epicsEventMustWait(unstall);
+    }
+}
+
+static
+void stallPoster(void *arg)
+{
+    arrRecord *prec = (arrRecord *) testdbRecordPtr("arr");
+
+    dbScanLock((dbCommon *) prec);
+    db_post_events(prec, NULL, DBE_VALUE);
+    dbScanUnlock((dbCommon *) prec);
+    epicsEventMustTrigger(posted);
+}
+
+static
+void stallStart(void)
+{
+    db_event_intake_hook = stallHook;
+    epicsThreadMustCreate("stallPoster",
+        epicsThreadPriorityMedium,
+        epicsThreadGetStackSize(epicsThreadStackSmall),
+        stallPoster, NULL);
+    epicsEventMustWait(stalled);
+}
+
+static
+void unstallLater(void *arg)
+{
+    epicsThreadSleep(0.2);
+    epicsEventMustTrigger(unstall);
+}
+
+static unsigned nStallUpdates;
+
+static
+void countMonitor(void *user_arg, struct dbChannel *chan,
+                  int eventsRemaining, struct db_field_log *pfl)
+{
+    epicsMutexMustLock(lock);
+    (*(unsigned *) user_arg)++;
+    epicsMutexUnlock(lock);
+}
+
+static int cancelDone;
+
+static
+void canceler(void *arg)
+{
+    db_cancel_event(arg);
+    epicsAtomicSetIntT(&cancelDone, 1);
+    epicsEventMustTrigger(block);
+}
+
+static
+void testCancelStalled(void)
+{
+    dbEventCtx ctx;
+    dbChannel *chan, *arrChan;
+    dbEventSubscription sub, arrSub;
+    xRecord *prec = (xRecord *) testdbRecordPtr("x");
+    unsigned nArr = 0u;
+    epicsInt32 i;
+
+    testDiag("Cancel while a poster is stalled on the intake ring");
+
+    ctx = db_init_events();
+    testOk1(db_start_events(ctx, "test-event", NULL, NULL,
+                            epicsThreadPriorityMedium) == DB_EVENT_OK);
+    chan = dbChannelCreate("x.VAL");
+    arrChan = dbChannelCreate("arr.VAL");
+    testOk1(chan && !dbChannelOpen(chan) && arrChan && !dbChannelOpen(arrChan));
+
+    nStallUpdates = 0u;
+    sub = db_add_event(ctx, chan, countMonitor, &nStallUpdates, DBE_VALUE);
+    arrSub = db_add_event(ctx, arrChan, countMonitor, &nArr, DBE_VALUE);
+    db_event_enable(sub);
+    db_event_enable(arrSub);
+
+    /* these updates are pushed behind the stalled poster's entry */
+    stallStart();
+    for (i = 0; i < 5; i++) {
+        dbScanLock((dbCommon *) prec);
+        prec->val = i;
+        db_post_events(prec, &prec->val, DBE_VALUE);
+        dbScanUnlock((dbCommon *) prec);
+    }
+    epicsThreadSleep(0.1);
+    epicsMutexMustLock(lock);
+    testOk(nStallUpdates == 0u, "Updates wait behind the unfilled entry");
+    epicsMutexUnlock(lock);
+
+    epicsAtomicSetIntT(&cancelDone, 0);
+    epicsThreadMustCreate("canceler", epicsThreadPriorityMedium,
+        epicsThreadGetStackSize(epicsThreadStackSmall), canceler, sub);
+    epicsThreadSleep(0.1);
+    testOk(!epicsAtomicGetIntT(&cancelDone),
+           "Cancel waits for the stalled poster");
+    epicsEventMustTrigger(unstall);
+    epicsEventMustWait(block);
+    epicsEventMustWait(posted);
+    db_event_intake_hook = NULL;
+    testOk1(epicsAtomicGetIntT(&cancelDone));
+
+    db_flush_extra_labor_event(ctx);
+    epicsThreadSleep(0.1);
+    epicsMutexMustLock(lock);
+    testOk(nStallUpdates == 0u, "No update of the canceled subscription "
+           "delivered (%u)", nStallUpdates);
+    testOk(nArr == 1u, "Stalled poster's update delivered (%u)", nArr);
+    epicsMutexUnlock(lock);
+
+    db_cancel_event(arrSub);
+    dbChannelDelete(arrChan);
+    dbChannelDelete(chan);
+    db_close_events(ctx);
+}
+
+static
+void testFullStalled(void)
+{
+    dbEventCtx ctx;
+    dbChannel *chan, *arrChan;
+    dbEventSubscription sub, arrSub;
+    xRecord *prec = (xRecord *) testdbRecordPtr("x");
+    unsigned nArr = 0u;
+    epicsInt32 i;
+
+    testDiag("Full intake ring while a poster is stalled on it");
+
+    ctx = db_init_events();
+    testOk1(db_start_events(ctx, "test-event", NULL, NULL,
+                            epicsThreadPriorityMedium) == DB_EVENT_OK);
+    chan = dbChannelCreate("x.VAL");
+    arrChan = dbChannelCreate("arr.VAL");
+    testOk1(chan && !dbChannelOpen(chan) && arrChan && !dbChannelOpen(arrChan));
+
+    sub = db_add_event_depth(ctx, chan, monitor, NULL, DBE_VALUE, 300);
+    arrSub = db_add_event(ctx, arrChan, countMonitor, &nArr, DBE_VALUE);
+    db_event_enable(sub);
+    db_event_enable(arrSub);
+
+    /*
+     * fill the intake ring behind the stalled poster, so that
+     * the later posts take the event queue lock
+     */
+    nupdates = 1;   /* don't block in monitor() */
+    memset(values, 0, sizeof(values));
+    stallStart();
+    epicsThreadMustCreate("unstall", epicsThreadPriorityMedium,
+        epicsThreadGetStackSize(epicsThreadStackSmall), unstallLater, NULL);
+    for (i = 1; i <= NPOSTS; i++) {
+        dbScanLock((dbCommon *) prec);
+        prec->val = i;
+        db_post_events(prec, &prec->val, DBE_VALUE);
+        dbScanUnlock((dbCommon *) prec);
+    }
+    epicsEventMustWait(posted);
+    db_event_intake_hook = NULL;
+    epicsEventMustWait(done);
+
+    epicsMutexMustLock(lock);
+    testOk(nupdates == NPOSTS+1, "received %u of %u updates",
+           nupdates - 1, NPOSTS);
+    testOk(inOrder(), "updates delivered in order");
+    testOk1(values[nupdates-1] == NPOSTS);
+    epicsMutexUnlock(lock);
+
+    db_cancel_event(arrSub);
+    db_cancel_event(sub);
+    dbChannelDelete(arrChan);
+    dbChannelDelete(chan);
+    db_close_events(ctx);
+}
+
+MAIN(dbEventTest)
+{
+    testPlan(83);
+
+    lock = epicsMutexMustCreate();
+    block = epicsEventMustCreate(epicsEventEmpty);
+    blocked = epicsEventMustCreate(epicsEventEmpty);
+    done = epicsEventMustCreate(epicsEventEmpty);
+    stalled = epicsEventMustCreate(epicsEventEmpty);
+    unstall = epicsEventMustCreate(epicsEventEmpty);
+    posted = epicsEventMustCreate(epicsEventEmpty);
+
+    testdbPrepare();
+
+    testdbReadDatabase("dbTestIoc.dbd", NULL, NULL);
+    dbTestIoc_registerRecordDeviceDriver(pdbbase);
+    testdbReadDatabase("xRecord.db", NULL, NULL);
+    testdbReadDatabase("dbEventTest.db", NULL, NULL);
+
+    eltc(0);
+    testIocInitOk();
+    eltc(1);
+
+    testBurst("Default queue squashes a burst", 0, 0, 0);
+    testBurst("Deep subscription queues the burst", 300, 0, NPOSTS+1);
+    testBurst("Growing queue absorbs the burst", 0, 1024, NPOSTS+1);
+
+    testDiag("Posting through the event queue mutex");
+    dbEventQueueLockFree = 0;
+    testBurst("Default queue squashes a burst", 0, 0, 0);
+    testBurst("Deep subscription queues the burst", 300, 0, NPOSTS+1);
+    testBurst("Growing queue absorbs the burst", 0, 1024, NPOSTS+1);
+    dbEventQueueLockFree = 1;
+    testBatch();
+    testCancelInBatch();
+    testSharedArray();
+    testCancelStalled();
+    testFullStalled();
+
+    testIocShutdownOk();
+
+    testdbCleanup();
+
+    epicsEventDestroy(posted);
+    epicsEventDestroy(unstall);
+    epicsEventDestroy(stalled);
+    epicsEventDestroy(done);
+    epicsEventDestroy(blocked);
+    epicsEventDestroy(block);
+    epicsMutexDestroy(lock);
+
+    return testDone();
+}
@@ -11,6 +11,8 @@
 
 #include <string.h>
 
+#define EPICS_PRIVATE_API
+
 #include "dbScan.h"
 #include "epicsEvent.h"
 
@@ -18,8 +20,13 @@
 #include "testMain.h"
 
 #include "dbAccess.h"
+#include "dbLock.h"
+#include "epicsMutex.h"
+#include "epicsThread.h"
 #include "errlog.h"
 
+#include "xRecord.h"
+
 void dbTestIoc_registerRecordDeviceDriver(struct dbBase *);
 
 static epicsEventId waiter;
@@ -65,9 +72,182 @@ static void testOnce(void)
     epicsEventDestroy(waiter);
 }
 
+#define NLOG 40
+
+static const char *wrkNames[] = {"wrka", "wrkb", "wrkc1", "wrkc2"};
+static epicsMutexId logLock;
+static struct {
+    int rec;
+    epicsThreadId tid;
+} wrkLog[NLOG];
+static int nLog;
+
+static void wrkProcess(xRecord *prec)
+{
+    epicsMutexMustLock(logLock);
+    if (nLog < NLOG) {
+        wrkLog[nLog].rec = prec->val;
+        wrkLog[nLog].tid = epicsThreadGetIdSelf();
+        if (++nLog == NLOG)
+            epicsEventMustTrigger(waiter);
+    }
+    epicsMutexUnlock(logLock);
+}
+
+static void testPeriodicWorkers(void)
+{
+    int seen[4] = {0, 0, 0, 0};
+    int i, last = -1, ordered = 1, sameThread = 1;
+    epicsThreadId c1tid = 0;
+
+    testDiag("check periodic scan workers");
+    waiter = epicsEventMustCreate(epicsEventEmpty);
+    logLock = epicsMutexMustCreate();
+
+    testdbPrepare();
+
+    testdbReadDatabase("dbTestIoc.dbd", NULL, NULL);
+    dbTestIoc_registerRecordDeviceDriver(pdbbase);
+    testdbReadDatabase("dbScanTest.db", NULL, NULL);
+
+    testOk1(scanPeriodicWorkers(2, ".1 second") == 0);
+    testOk(scanPeriodicWorkers(2, "1 fortnight") != 0,
+           "Unknown scan rate rejected");
+
+    eltc(0);
+    testIocInitOk();
+    eltc(1);
+
+    testOk(scanPeriodicWorkers(2, "*") != 0,
+           "Can't add workers once running");
+    testOk1(dbLockGetLockId(testdbRecordPtr("wrkc1")) ==
+            dbLockGetLockId(testdbRecordPtr("wrkc2")));
+
+    for (i = 0; i < 4; i++) {
+        xRecord *prec = (xRecord *) testdbRecordPtr(wrkNames[i]);
+
+        dbScanLock((dbCommon *) prec);
+        prec->val = i;
+        prec->clbk = wrkProcess;
+        dbScanUnlock((dbCommon *) prec);
+    }
+
+    epicsEventMustWait(waiter);
+
+    /* wrkc1 and wrkc2 share a lock set, so must be processed by the
+     * same worker in PHAS order.
+     */
+    for (i = 0; i < NLOG; i++) {
+        int rec = wrkLog[i].rec;
+
+        seen[rec]++;
+        if (rec == 2) {
+            if (last == 2)
+                ordered = 0;
+            last = 2;
+            c1tid = wrkLog[i].tid;
+        }
+        else if (rec == 3) {
+            if (last == 3)
+                ordered = 0;
+            if (last == 2 && wrkLog[i].tid != c1tid)
+                sameThread = 0;
+            last = 3;
+        }
+    }
+    for (i = 0; i < 4; i++)
+        testOk(seen[i] > 0, "%s processed %d times", wrkNames[i], seen[i]);
+    testOk(ordered, "Records in one lock set processed in order");
+    testOk(sameThread, "Records in one lock set processed by one worker");
+
+    testIocShutdownOk();
+
+    testdbCleanup();
+    epicsMutexDestroy(logLock);
+    epicsEventDestroy(waiter);
+}
+
+static unsigned long nHist;
+
+static void histProcess(xRecord *prec)
+{
+    epicsMutexMustLock(logLock);
+    nHist++;
+    epicsMutexUnlock(logLock);
+}
+
+static void testPeriodicHist(void)
+{
+    scanPeriodicHistStats stats;
+    xRecord *prec;
+    unsigned long nproc;
+
+    testDiag("check periodic scan deadlines and histograms");
+    logLock = epicsMutexMustCreate();
+
+    testdbPrepare();
+
+    testdbReadDatabase("dbTestIoc.dbd", NULL, NULL);
+    dbTestIoc_registerRecordDeviceDriver(pdbbase);
+    testdbReadDatabase("dbScanTest.db", NULL, NULL);
+
+    eltc(0);
+    testIocInitOk();
+    eltc(1);
+
+    prec = (xRecord *) testdbRecordPtr("wrka");
+    dbScanLock((dbCommon *) prec);
+    prec->clbk = histProcess;
+    dbScanUnlock((dbCommon *) prec);
+
+    /* start counting from a clean histogram */
+    scanPeriodicJitterShow(0.1, 1);
+    epicsMutexMustLock(logLock);
+    nHist = 0;
+    epicsMutexUnlock(logLock);
+
+    epicsThreadSleep(1.0);
+
+    testOk(scanPeriodicHistStatus(7.3, &stats) != 0,
+           "Unknown scan rate rejected");
+    testOk1(scanPeriodicHistStatus(0.1, &stats) == 0);
+    epicsMutexMustLock(logLock);
+    nproc = nHist;
+    epicsMutexUnlock(logLock);
+
+    testOk(stats.passes >= 5 && stats.passes <= 15,
+           "%lu passes of a .1 second list in 1 second", stats.passes);
+    testOk(nproc + 1 >= stats.passes && nproc <= stats.passes + 1,
+           "%lu passes processed the record %lu times", stats.passes, nproc);
+    testOk(stats.jitterTotal == stats.passes,
+           "Jitter bins hold %lu of %lu passes",
+           stats.jitterTotal, stats.passes);
+    testOk(stats.latencyTotal == stats.latencyCount,
+           "Latency bins hold %lu of %lu passes",
+           stats.latencyTotal, stats.latencyCount);
+    testOk(stats.latencyCount + 1 >= stats.passes &&
+           stats.latencyCount <= stats.passes,
+           "%lu passes completed of %lu started",
+           stats.latencyCount, stats.passes);
+
+    scanPeriodicJitterShow(0.1, 1);
+    testOk1(scanPeriodicHistStatus(0.1, &stats) == 0);
+    testOk(stats.passes <= 1 && stats.latencyCount <= 1 &&
+           stats.jitterTotal == stats.passes &&
+           stats.latencyTotal == stats.latencyCount,
+           "Reset cleared the histograms (%lu passes since)", stats.passes);
+
+    testIocShutdownOk();
+
+    testdbCleanup();
+    epicsMutexDestroy(logLock);
+}
+
 MAIN(dbScanTest)
 {
-    testPlan(3);
+    testPlan(22);
     testOnce();
+    testPeriodicWorkers();
+    testPeriodicHist();
     return testDone();
 }
@@ -1,4 +1,5 @@
 #include <string.h>
+#include <stdio.h>
 
 #include <errlog.h>
 #include <dbAccess.h>
@@ -183,11 +184,126 @@ static void testDbVerify(const char *record)
     dbFinishEntry(&entry);
 }
 
+static void countEntry(void *arg, const PVDENTRY *ppvdNode)
+{
+    (*(unsigned *) arg)++;
+}
+
+static void testPvdTraverse(void)
+{
+    DBENTRY entry;
+    unsigned generation, count = 0;
+
+    testDiag("# # # # # # # testPvdTraverse() # # # # # # # #");
+
+    generation = dbPvdTraverse(pdbbase, countEntry, &count);
+    testOk(count == 4, "Traversed %u names", count);
+    testOk1(dbPvdCount(pdbbase) == 4);
+    testOk1(generation == dbPvdGeneration(pdbbase));
+
+    dbInitEntry(pdbbase, &entry);
+    if (dbFindRecord(&entry, "testrec") != 0)
+        testAbort("Can't find record 'testrec'");
+    testOk1(dbCreateAlias(&entry, "testalias4") == 0);
+    testOk(dbPvdGeneration(pdbbase) != generation,
+        "Adding an alias changes the generation");
+    dbFinishEntry(&entry);
+
+    count = 0;
+    dbPvdTraverse(pdbbase, countEntry, &count);
+    testOk(count == 5, "Traversed %u names", count);
+}
+
+/*
+ * Enough records to fill the directory past half of its default size of
+ * 512 slots several times over, forcing it to be rebuilt as they are
+ * added, deleted and added again.
+ */
+#define NPVD 1200
+
+static int pvdFindAll(int first, int step, int expect)
+{
+    char name[32];
+    int i, nOK = 0, n = 0;
+
+    for (i = first; i < NPVD; i += step) {
+        PVDENTRY *ppvd;
+
+        sprintf(name, "pvdrec%d", i);
+        ppvd = dbPvdFind(pdbbase, name, strlen(name));
+        if (expect ? ppvd && strcmp(ppvd->precnode->recordname, name) == 0
+                   : !ppvd)
+            nOK++;
+        n++;
+    }
+    return nOK == n;
+}
+
+static void testPvdRebuild(void)
+{
+    DBENTRY entry;
+    char name[32];
+    unsigned generation, count;
+    int i, nOK;
+
+    testDiag("# # # # # # # testPvdRebuild() # # # # # # # #");
+
+    count = dbPvdCount(pdbbase);
+    dbInitEntry(pdbbase, &entry);
+    if (dbFindRecordType(&entry, "x") != 0)
+        testAbort("Can't find record type 'x'");
+
+    for (i = 0, nOK = 0; i < NPVD; i++) {
+        sprintf(name, "pvdrec%d", i);
+        if (dbCreateRecord(&entry, name) == 0)
+            nOK++;
+    }
+    testOk(nOK == NPVD, "Created %d records", nOK);
+    testOk1(dbPvdCount(pdbbase) == count + NPVD);
+    testOk(pvdFindAll(0, 1, 1), "dbPvdFind() finds them all");
+    testOk1(dbPvdFind(pdbbase, "pvdrec", 6) == NULL);
+
+    generation = dbPvdGeneration(pdbbase);
+    for (i = 0, nOK = 0; i < NPVD; i += 2) {
+        sprintf(name, "pvdrec%d", i);
+        if (dbFindRecord(&entry, name) == 0 && dbDeleteRecord(&entry) == 0)
+            nOK++;
+    }
+    testOk(nOK == NPVD / 2, "Deleted %d records", nOK);
+    testOk(dbPvdGeneration(pdbbase) != generation,
+        "Deleting records changes the generation");
+    testOk1(dbPvdCount(pdbbase) == count + NPVD / 2);
+    testOk(pvdFindAll(0, 2, 0), "dbPvdFind() misses the deleted records");
+    testOk(pvdFindAll(1, 2, 1), "dbPvdFind() finds the others");
+
+    if (dbFindRecordType(&entry, "x") != 0)
+        testAbort("Can't find record type 'x'");
+    for (i = 0, nOK = 0; i < NPVD; i += 2) {
+        sprintf(name, "pvdrec%d", i);
+        if (dbCreateRecord(&entry, name) == 0)
+            nOK++;
+    }
+    testOk(nOK == NPVD / 2, "Added %d records again", nOK);
+    testOk1(dbPvdCount(pdbbase) == count + NPVD);
+    testOk(pvdFindAll(0, 1, 1), "dbPvdFind() finds them all");
+
+    for (i = 0, nOK = 0; i < NPVD; i++) {
+        sprintf(name, "pvdrec%d", i);
+        if (dbFindRecord(&entry, name) == 0 && dbDeleteRecord(&entry) == 0)
+            nOK++;
+    }
+    testOk(nOK == NPVD, "Deleted %d records", nOK);
+    testOk1(dbPvdCount(pdbbase) == count);
+    testOk(pvdFindAll(0, 1, 0), "dbPvdFind() misses them all");
+    testOk1(dbPvdFind(pdbbase, "testrec", 7) != NULL);
+    dbFinishEntry(&entry);
+}
+
 void dbTestIoc_registerRecordDeviceDriver(struct dbBase *);
 
 MAIN(dbStaticTest)
 {
-    testPlan(223);
+    testPlan(245);
     testdbPrepare();
 
     testdbReadDatabase("dbTestIoc.dbd", NULL, NULL);
@@ -206,6 +322,8 @@ MAIN(dbStaticTest)
     testRec2Entry("testalias");
     testRec2Entry("testalias2");
     testRec2Entry("testalias3");
+    testPvdTraverse();
+    testPvdRebuild();
 
     eltc(0);
     testIocInitOk();
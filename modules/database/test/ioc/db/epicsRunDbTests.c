@@ -26,9 +26,11 @@ int dbShutdownTest(void);
 int dbScanTest(void);
 int scanIoTest(void);
 int dbLockTest(void);
+int dbEventTest(void);
 int dbPutLinkTest(void);
 int dbStaticTest(void);
 int dbCaLinkTest(void);
+int casSearchFilterTest(void);
 int testDbChannel(void);
 int chfPluginTest(void);
 int arrShorthandTest(void);
@@ -48,9 +50,11 @@ void epicsRunDbTests(void)
     runTest(dbScanTest);
     runTest(scanIoTest);
     runTest(dbLockTest);
+    runTest(dbEventTest);
     runTest(dbPutLinkTest);
     runTest(dbStaticTest);
     runTest(dbCaLinkTest);
+    runTest(casSearchFilterTest);
     runTest(testDbChannel);
     runTest(arrShorthandTest);
     runTest(recGblCheckDeadbandTest);
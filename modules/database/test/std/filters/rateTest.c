@@ -0,0 +1,193 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+
+/*
+ *  Tests for the rate limiting filter
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "dbStaticLib.h"
+#include "dbAccessDefs.h"
+#include "db_field_log.h"
+#include "dbCommon.h"
+#include "registry.h"
+#include "errlog.h"
+#include "chfPlugin.h"
+#include "epicsUnitTest.h"
+#include "dbUnitTest.h"
+#include "epicsThread.h"
+#include "epicsTime.h"
+#include "testMain.h"
+
+void filterTest_registerRecordDeviceDriver(struct dbBase *);
+
+static db_field_log *newLog(dbChannel *chan, long val, int ctx) {
+    db_field_log *pfl = db_create_read_log(chan);
+    struct dbCommon *prec = dbChannelRecord(chan);
+
+    pfl->ctx  = ctx;
+    pfl->type = dbfl_type_val;
+    pfl->stat = prec->stat;
+    pfl->sevr = prec->sevr;
+    pfl->time = prec->time;
+    pfl->field_type  = dbChannelFieldType(chan);
+    pfl->no_elements = dbChannelElements(chan);
+    pfl->u.v.field.dbf_long = val;
+    return pfl;
+}
+
+/* Run a value through the channel's pre chain, return whether it passed */
+static int runValue(dbChannel *pch, long val, long *pOut) {
+    db_field_log *pfl = dbChannelRunPreChain(pch,
+        newLog(pch, val, dbfl_context_event));
+
+    if (!pfl)
+        return 0;
+    if (pOut)
+        *pOut = pfl->u.v.field.dbf_long;
+    db_delete_field_log(pfl);
+    return 1;
+}
+
+static void testHead (char* title) {
+    testDiag("--------------------------------------------------------");
+    testDiag("%s", title);
+    testDiag("--------------------------------------------------------");
+}
+
+static void testBadArgs(void) {
+    testHead("Invalid parameters");
+    eltc(0);
+    testOk(!dbChannelCreate("x.VAL{\"rate\":{}}"),
+           "no rate and no decimation rejected");
+    testOk(!dbChannelCreate("x.VAL{\"rate\":{\"n\":1}}"),
+           "n=1 without rate rejected");
+    testOk(!dbChannelCreate("x.VAL{\"rate\":{\"r\":-1}}"),
+           "negative rate rejected");
+    testOk(!dbChannelCreate("x.VAL{\"rate\":{\"n\":-3}}"),
+           "negative decimation rejected");
+    testOk(!dbChannelCreate("x.VAL{\"rate\":{\"n\":2,\"a\":\"median\"}}"),
+           "unknown aggregate rejected");
+    eltc(1);
+}
+
+static void testEvery(void) {
+    dbChannel *pch;
+    db_field_log *pfl, *pfl2;
+    int i, npass = 0;
+    long out = 0;
+
+    testHead("Decimation n=3");
+    testOk(!!(pch = dbChannelCreate("x.VAL{\"rate\":{\"n\":3}}")),
+           "dbChannel with plugin rate (n=3) created");
+    testOk(!(dbChannelOpen(pch)), "dbChannel with plugin rate opened");
+    testOk((ellCount(&pch->pre_chain) == 1 && ellCount(&pch->post_chain) == 0),
+           "rate has one filter in pre chain, none in post chain");
+
+    for (i = 1; i <= 9; i++) {
+        int passed = runValue(pch, i, &out);
+
+        npass += passed;
+        if (passed && out != i)
+            break;
+    }
+    testOk(npass == 3 && out == 9, "3 of 9 updates passed (last %ld)", out);
+
+    pfl2 = newLog(pch, 1, dbfl_context_read);
+    pfl = dbChannelRunPreChain(pch, pfl2);
+    testOk(pfl == pfl2, "reads are not filtered");
+    db_delete_field_log(pfl2);
+
+    dbChannelDelete(pch);
+}
+
+static void testAggregate(const char *agg, long expect) {
+    dbChannel *pch;
+    char name[80];
+    static const long vals[] = {5, 2, 9, 4};
+    long out = 0;
+    int i, passed = 0;
+
+    sprintf(name, "x.VAL{\"rate\":{\"n\":4,\"a\":\"%s\"}}", agg);
+    testOk(!!(pch = dbChannelCreate(name)),
+           "dbChannel with plugin rate (n=4, a=%s) created", agg);
+    testOk(!(dbChannelOpen(pch)), "dbChannel with plugin rate opened");
+
+    for (i = 0; i < 4; i++)
+        passed = runValue(pch, vals[i], &out);
+    testOk(passed && out == expect, "aggregate %s of 5 2 9 4 is %ld", agg, out);
+
+    /* the window restarts after each forwarded update */
+    for (i = 0; i < 4; i++)
+        passed = runValue(pch, 7, &out);
+    testOk(passed && out == 7, "next window aggregates to %ld", out);
+
+    dbChannelDelete(pch);
+}
+
+static void testRate(void) {
+    dbChannel *pch;
+    int i, npass = 0;
+
+    testHead("Rate r=2");
+    testOk(!!(pch = dbChannelCreate("x.VAL{\"rate\":{\"r\":2}}")),
+           "dbChannel with plugin rate (r=2) created");
+    testOk(!(dbChannelOpen(pch)), "dbChannel with plugin rate opened");
+
+    testOk(runValue(pch, 1, NULL), "first update passes");
+    for (i = 2; i <= 20; i++)
+        npass += runValue(pch, i, NULL);
+    testOk(npass == 0, "burst of 19 updates dropped (%d passed)", npass);
+
+    epicsThreadSleep(0.6);
+    testOk(runValue(pch, 21, NULL), "update passes after the interval");
+    testOk(!runValue(pch, 22, NULL), "next update dropped again");
+
+    dbChannelDelete(pch);
+}
+
+MAIN(rateTest)
+{
+    dbEventCtx evtctx;
+    char rate[] = "rate";
+
+    testPlan(29);
+
+    testdbPrepare();
+
+    testdbReadDatabase("filterTest.dbd", NULL, NULL);
+
+    filterTest_registerRecordDeviceDriver(pdbbase);
+
+    testdbReadDatabase("xRecord.db", NULL, NULL);
+
+    eltc(0);
+    testIocInitOk();
+    eltc(1);
+
+    evtctx = db_init_events();
+
+    testOk(!!dbFindFilter(rate, strlen(rate)), "plugin rate registered correctly");
+
+    testBadArgs();
+    testEvery();
+
+    testHead("Aggregation");
+    testAggregate("min", 2);
+    testAggregate("max", 9);
+    testAggregate("mean", 5);
+
+    testRate();
+
+    db_close_events(evtctx);
+
+    testIocShutdownOk();
+
+    testdbCleanup();
+
+    return testDone();
+}
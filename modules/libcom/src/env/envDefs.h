@@ -52,6 +52,11 @@ epicsShareExtern const ENV_PARAM EPICS_CA_AUTO_ARRAY_BYTES;
 epicsShareExtern const ENV_PARAM EPICS_CA_MAX_SEARCH_PERIOD;
 epicsShareExtern const ENV_PARAM EPICS_CA_NAME_SERVERS;
 epicsShareExtern const ENV_PARAM EPICS_CA_MCAST_TTL;
+epicsShareExtern const ENV_PARAM EPICS_CA_MCAST_GROUP;
+epicsShareExtern const ENV_PARAM EPICS_CA_COMPRESS;
+epicsShareExtern const ENV_PARAM EPICS_CA_TCP_IO_THREADS;
+epicsShareExtern const ENV_PARAM EPICS_CA_SEARCH_BANDWIDTH;
+epicsShareExtern const ENV_PARAM EPICS_CA_SHARED_MEM_BYTES;
 epicsShareExtern const ENV_PARAM EPICS_CAS_INTF_ADDR_LIST;
 epicsShareExtern const ENV_PARAM EPICS_CAS_IGNORE_ADDR_LIST;
 epicsShareExtern const ENV_PARAM EPICS_CAS_AUTO_BEACON_ADDR_LIST;
@@ -0,0 +1,253 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/* epicsByteSwap.c */
+
+/*
+ * The vector loops swap whole registers and leave the remainder of an
+ * array to the scalar code. SSE2 is always present on x86-64, AVX2 is
+ * used when the CPU has it.
+ */
+
+#include <string.h>
+
+#define epicsExportSharedSymbols
+#include "compilerSpecific.h"
+#include "epicsEndian.h"
+#include "epicsTypes.h"
+#include "epicsByteSwap.h"
+
+#if defined ( __GNUC__ ) && defined ( __SSE2__ )
+#   include <emmintrin.h>
+#   define SWAP_HAVE_SSE2
+#   if __GNUC__ >= 5 || defined ( __clang__ )
+#       include <immintrin.h>
+#       define SWAP_HAVE_AVX2
+#   endif
+#endif
+
+static EPICS_ALWAYS_INLINE void swapScalar ( epicsUInt8 *pDst, const epicsUInt8 *pSrc,
+    size_t count, unsigned size )
+{
+    size_t i;
+
+    switch ( size ) {
+    case 2u:
+        for ( i = 0u; i < count; i++, pDst += 2, pSrc += 2 ) {
+            epicsUInt16 v;
+            memcpy ( &v, pSrc, sizeof ( v ) );
+            v = (epicsUInt16) ( ( v << 8 ) | ( v >> 8 ) );
+            memcpy ( pDst, &v, sizeof ( v ) );
+        }
+        break;
+    case 4u:
+        for ( i = 0u; i < count; i++, pDst += 4, pSrc += 4 ) {
+            epicsUInt32 v;
+            memcpy ( &v, pSrc, sizeof ( v ) );
+            v = ( v << 24 ) | ( ( v << 8 ) & 0x00ff0000u ) |
+                ( ( v >> 8 ) & 0x0000ff00u ) | ( v >> 24 );
+            memcpy ( pDst, &v, sizeof ( v ) );
+        }
+        break;
+    case 8u:
+        for ( i = 0u; i < count; i++, pDst += 8, pSrc += 8 ) {
+            epicsUInt32 v[2], w;
+            memcpy ( v, pSrc, sizeof ( v ) );
+            w = v[0];
+            v[0] = ( v[1] << 24 ) | ( ( v[1] << 8 ) & 0x00ff0000u ) |
+                ( ( v[1] >> 8 ) & 0x0000ff00u ) | ( v[1] >> 24 );
+            v[1] = ( w << 24 ) | ( ( w << 8 ) & 0x00ff0000u ) |
+                ( ( w >> 8 ) & 0x0000ff00u ) | ( w >> 24 );
+            memcpy ( pDst, v, sizeof ( v ) );
+        }
+        break;
+    }
+}
+
+#ifdef SWAP_HAVE_SSE2
+
+static EPICS_ALWAYS_INLINE __m128i swapSse2 ( __m128i v, unsigned size )
+{
+    if ( size == 8u )
+        v = _mm_shuffle_epi32 ( v, _MM_SHUFFLE ( 2, 3, 0, 1 ) );
+    if ( size >= 4u ) {
+        v = _mm_shufflelo_epi16 ( v, _MM_SHUFFLE ( 2, 3, 0, 1 ) );
+        v = _mm_shufflehi_epi16 ( v, _MM_SHUFFLE ( 2, 3, 0, 1 ) );
+    }
+    return _mm_or_si128 ( _mm_slli_epi16 ( v, 8 ), _mm_srli_epi16 ( v, 8 ) );
+}
+
+/* returns the number of bytes swapped */
+static EPICS_ALWAYS_INLINE size_t swapVectorSse2 ( epicsUInt8 *pDst, const epicsUInt8 *pSrc,
+    size_t nBytes, unsigned size )
+{
+    size_t i;
+
+    for ( i = 0u; i + 32u <= nBytes; i += 32u ) {
+        __m128i v0 = _mm_loadu_si128 ( (const __m128i *) ( pSrc + i ) );
+        __m128i v1 = _mm_loadu_si128 ( (const __m128i *) ( pSrc + i + 16u ) );
+        _mm_storeu_si128 ( (__m128i *) ( pDst + i ), swapSse2 ( v0, size ) );
+        _mm_storeu_si128 ( (__m128i *) ( pDst + i + 16u ),
+            swapSse2 ( v1, size ) );
+    }
+    if ( i + 16u <= nBytes ) {
+        __m128i v = _mm_loadu_si128 ( (const __m128i *) ( pSrc + i ) );
+        _mm_storeu_si128 ( (__m128i *) ( pDst + i ), swapSse2 ( v, size ) );
+        i += 16u;
+    }
+    return i;
+}
+
+#endif /* SWAP_HAVE_SSE2 */
+
+#ifdef SWAP_HAVE_AVX2
+
+static int haveAvx2 ( void )
+{
+    /* racing threads all store the same value */
+    static volatile int have = -1;
+
+    if ( have < 0 ) {
+        __builtin_cpu_init ();
+        have = __builtin_cpu_supports ( "avx2" ) != 0;
+    }
+    return have;
+}
+
+__attribute__ (( target ( "avx2" ) ))
+static size_t swapVectorAvx2 ( epicsUInt8 *pDst, const epicsUInt8 *pSrc,
+    size_t nBytes, unsigned size )
+{
+    __m256i mask;
+    size_t i;
+
+    switch ( size ) {
+    case 2u:
+        mask = _mm256_setr_epi8 (
+            1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+            1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 );
+        break;
+    case 4u:
+        mask = _mm256_setr_epi8 (
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 );
+        break;
+    default:
+        mask = _mm256_setr_epi8 (
+            7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+            7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 );
+        break;
+    }
+    for ( i = 0u; i + 64u <= nBytes; i += 64u ) {
+        __m256i v0 = _mm256_loadu_si256 ( (const __m256i *) ( pSrc + i ) );
+        __m256i v1 = _mm256_loadu_si256 (
+            (const __m256i *) ( pSrc + i + 32u ) );
+        _mm256_storeu_si256 ( (__m256i *) ( pDst + i ),
+            _mm256_shuffle_epi8 ( v0, mask ) );
+        _mm256_storeu_si256 ( (__m256i *) ( pDst + i + 32u ),
+            _mm256_shuffle_epi8 ( v1, mask ) );
+    }
+    if ( i + 32u <= nBytes ) {
+        __m256i v = _mm256_loadu_si256 ( (const __m256i *) ( pSrc + i ) );
+        _mm256_storeu_si256 ( (__m256i *) ( pDst + i ),
+            _mm256_shuffle_epi8 ( v, mask ) );
+        i += 32u;
+    }
+    return i;
+}
+
+#endif /* SWAP_HAVE_AVX2 */
+
+static EPICS_ALWAYS_INLINE void swapBytes ( void *pDst, const void *pSrc, size_t count,
+    unsigned size )
+{
+    epicsUInt8 *pd = (epicsUInt8 *) pDst;
+    const epicsUInt8 *ps = (const epicsUInt8 *) pSrc;
+    size_t nBytes = count * size;
+    size_t done = 0u;
+
+#ifdef SWAP_HAVE_AVX2
+    /* short arrays are faster without the AVX state transitions */
+    if ( nBytes >= 256u && haveAvx2 () )
+        done = swapVectorAvx2 ( pd, ps, nBytes, size );
+#endif
+#ifdef SWAP_HAVE_SSE2
+    done += swapVectorSse2 ( pd + done, ps + done, nBytes - done, size );
+#endif
+    swapScalar ( pd + done, ps + done, ( nBytes - done ) / size, size );
+}
+
+#if EPICS_BYTE_ORDER == EPICS_ENDIAN_BIG
+static void copyBytes ( void *pDst, const void *pSrc, size_t nBytes )
+{
+    if ( pDst != pSrc )
+        memmove ( pDst, pSrc, nBytes );
+}
+#endif
+
+void epicsByteSwap16 ( void *pDst, const void *pSrc, size_t count )
+{
+    swapBytes ( pDst, pSrc, count, 2u );
+}
+
+void epicsByteSwap32 ( void *pDst, const void *pSrc, size_t count )
+{
+    swapBytes ( pDst, pSrc, count, 4u );
+}
+
+void epicsByteSwap64 ( void *pDst, const void *pSrc, size_t count )
+{
+    swapBytes ( pDst, pSrc, count, 8u );
+}
+
+void epicsNetOrder16 ( void *pDst, const void *pSrc, size_t count )
+{
+#if EPICS_BYTE_ORDER == EPICS_ENDIAN_BIG
+    copyBytes ( pDst, pSrc, count * 2u );
+#else
+    swapBytes ( pDst, pSrc, count, 2u );
+#endif
+}
+
+void epicsNetOrder32 ( void *pDst, const void *pSrc, size_t count )
+{
+#if EPICS_BYTE_ORDER == EPICS_ENDIAN_BIG
+    copyBytes ( pDst, pSrc, count * 4u );
+#else
+    swapBytes ( pDst, pSrc, count, 4u );
+#endif
+}
+
+void epicsNetOrder64 ( void *pDst, const void *pSrc, size_t count )
+{
+#if EPICS_BYTE_ORDER == EPICS_ENDIAN_BIG
+    copyBytes ( pDst, pSrc, count * 8u );
+#else
+    swapBytes ( pDst, pSrc, count, 8u );
+#endif
+}
+
+void epicsNetOrderFloat64 ( void *pDst, const void *pSrc, size_t count )
+{
+#if EPICS_FLOAT_WORD_ORDER == EPICS_ENDIAN_BIG
+    /* the words are in order, only their bytes may need swapping */
+    epicsNetOrder32 ( pDst, pSrc, count * 2u );
+#elif EPICS_BYTE_ORDER == EPICS_ENDIAN_LITTLE
+    swapBytes ( pDst, pSrc, count, 8u );
+#else
+    /* big endian bytes in little endian words */
+    epicsUInt8 *pd = (epicsUInt8 *) pDst;
+    const epicsUInt8 *ps = (const epicsUInt8 *) pSrc;
+    size_t i;
+
+    for ( i = 0u; i < count; i++, pd += 8, ps += 8 ) {
+        epicsUInt32 v[2], w;
+        memcpy ( v, ps, sizeof ( v ) );
+        w = v[0];
+        v[0] = v[1];
+        v[1] = w;
+        memcpy ( pd, v, sizeof ( v ) );
+    }
+#endif
+}
@@ -0,0 +1,53 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/* epicsByteSwap.h */
+
+/*
+ * Bulk byte order conversion of arrays, for the network protocols.
+ *
+ * Each routine copies count elements from pSrc to pDst. The buffers
+ * need not be aligned. pDst may be the same as pSrc, otherwise the
+ * buffers must not overlap.
+ */
+
+#ifndef INC_epicsByteSwap_H
+#define INC_epicsByteSwap_H
+
+#include <stddef.h>
+
+#include "shareLib.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Reverse the byte order of each 2, 4 or 8 byte element */
+epicsShareFunc void epicsByteSwap16 ( void *pDst, const void *pSrc,
+    size_t count );
+epicsShareFunc void epicsByteSwap32 ( void *pDst, const void *pSrc,
+    size_t count );
+epicsShareFunc void epicsByteSwap64 ( void *pDst, const void *pSrc,
+    size_t count );
+
+/*
+ * Convert between host byte order and network byte order (big endian).
+ * The conversion is the same in both directions, and is a plain copy on
+ * big endian hosts. Use epicsNetOrderFloat64 for doubles, which also
+ * takes care of EPICS_FLOAT_WORD_ORDER.
+ */
+epicsShareFunc void epicsNetOrder16 ( void *pDst, const void *pSrc,
+    size_t count );
+epicsShareFunc void epicsNetOrder32 ( void *pDst, const void *pSrc,
+    size_t count );
+epicsShareFunc void epicsNetOrder64 ( void *pDst, const void *pSrc,
+    size_t count );
+epicsShareFunc void epicsNetOrderFloat64 ( void *pDst, const void *pSrc,
+    size_t count );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_epicsByteSwap_H */
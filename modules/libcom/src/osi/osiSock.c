@@ -18,6 +18,7 @@
 #include <string.h>
 
 #define epicsExportSharedSymbols
+#include "epicsAtomic.h"
 #include "epicsAssert.h"
 #include "epicsSignal.h"
 #include "epicsStdio.h"
@@ -28,6 +29,11 @@
 
 #define makeMask(NBITS) ( ( 1u << ( (unsigned) NBITS) ) - 1u )
 
+#if defined ( __linux__ ) && defined ( MSG_WAITFORONE )
+#   define OSI_SOCK_HAVE_MMSG
+#   define OSI_SOCK_MMSG_MAX 64u /* datagrams per system call */
+#endif
+
 /*
  * sockAddrAreIdentical() 
  * (returns true if addresses are identical)
@@ -187,3 +193,125 @@ unsigned epicsShareAPI ipAddrToDottedIP (
     }
 }
 
+
+#ifdef OSI_SOCK_HAVE_MMSG
+/* cleared if the kernel predates recvmmsg() and sendmmsg() */
+static int mmsgAvailable = 1;
+#endif
+
+/*
+ * epicsSocketRecvDatagrams ()
+ */
+int epicsShareAPI epicsSocketRecvDatagrams (
+    SOCKET sock, osiSockDatagram *pDatagrams, unsigned count )
+{
+    osiSocklen_t addrSize;
+    int status;
+
+    if ( count == 0u ) {
+        return 0;
+    }
+#ifdef OSI_SOCK_HAVE_MMSG
+    if ( count > 1u && epicsAtomicGetIntT ( &mmsgAvailable ) ) {
+        struct mmsghdr msgs[OSI_SOCK_MMSG_MAX];
+        struct iovec iov[OSI_SOCK_MMSG_MAX];
+        unsigned i;
+
+        if ( count > OSI_SOCK_MMSG_MAX ) {
+            count = OSI_SOCK_MMSG_MAX;
+        }
+        memset ( msgs, 0, count * sizeof ( msgs[0] ) );
+        for ( i = 0u; i < count; i++ ) {
+            iov[i].iov_base = pDatagrams[i].pBuf;
+            iov[i].iov_len = pDatagrams[i].bufSize;
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &pDatagrams[i].addr;
+            msgs[i].msg_hdr.msg_namelen = sizeof ( pDatagrams[i].addr );
+        }
+        status = recvmmsg ( sock, msgs, count, MSG_WAITFORONE, NULL );
+        if ( status >= 0 ) {
+            for ( i = 0u; i < (unsigned) status; i++ ) {
+                pDatagrams[i].nBytes = msgs[i].msg_len;
+                pDatagrams[i].truncated =
+                    ( msgs[i].msg_hdr.msg_flags & MSG_TRUNC ) != 0;
+            }
+            return status;
+        }
+        if ( SOCKERRNO != ENOSYS ) {
+            return -1;
+        }
+        epicsAtomicSetIntT ( &mmsgAvailable, 0 );
+    }
+#endif
+    addrSize = sizeof ( pDatagrams->addr );
+    status = recvfrom ( sock, pDatagrams->pBuf, pDatagrams->bufSize, 0,
+        &pDatagrams->addr.sa, &addrSize );
+    if ( status < 0 ) {
+        return -1;
+    }
+    pDatagrams->nBytes = (unsigned) status;
+    pDatagrams->truncated = 0;
+    return 1;
+}
+
+/*
+ * epicsSocketSendDatagrams ()
+ */
+int epicsShareAPI epicsSocketSendDatagrams (
+    SOCKET sock, const osiSockDatagram *pDatagrams, unsigned count )
+{
+    unsigned nSent = 0u;
+
+#ifdef OSI_SOCK_HAVE_MMSG
+    if ( count > 1u && epicsAtomicGetIntT ( &mmsgAvailable ) ) {
+        struct mmsghdr msgs[OSI_SOCK_MMSG_MAX];
+        struct iovec iov[OSI_SOCK_MMSG_MAX];
+
+        while ( nSent < count ) {
+            unsigned n = count - nSent;
+            unsigned i;
+            int status;
+
+            if ( n > OSI_SOCK_MMSG_MAX ) {
+                n = OSI_SOCK_MMSG_MAX;
+            }
+            memset ( msgs, 0, n * sizeof ( msgs[0] ) );
+            for ( i = 0u; i < n; i++ ) {
+                const osiSockDatagram *pDg = &pDatagrams[nSent + i];
+
+                iov[i].iov_base = pDg->pBuf;
+                iov[i].iov_len = pDg->bufSize;
+                msgs[i].msg_hdr.msg_iov = &iov[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+                msgs[i].msg_hdr.msg_name = (void *) &pDg->addr;
+                msgs[i].msg_hdr.msg_namelen = sizeof ( pDg->addr );
+            }
+            status = sendmmsg ( sock, msgs, n, 0 );
+            if ( status < 0 ) {
+                if ( SOCKERRNO == ENOSYS && nSent == 0u ) {
+                    epicsAtomicSetIntT ( &mmsgAvailable, 0 );
+                    break;
+                }
+                return nSent ? (int) nSent : -1;
+            }
+            nSent += (unsigned) status;
+            if ( (unsigned) status < n ) {
+                return (int) nSent;
+            }
+        }
+        if ( nSent == count ) {
+            return (int) nSent;
+        }
+    }
+#endif
+    for ( ; nSent < count; nSent++ ) {
+        const osiSockDatagram *pDg = &pDatagrams[nSent];
+        int status = sendto ( sock, (char *) pDg->pBuf, (int) pDg->bufSize,
+            0, &pDg->addr.sa, sizeof ( pDg->addr ) );
+        if ( status < 0 ) {
+            return nSent ? (int) nSent : -1;
+        }
+    }
+    return (int) nSent;
+}
@@ -201,6 +201,39 @@ epicsShareFunc void epicsShareAPI osiSockDiscoverBroadcastAddresses
  */
 epicsShareFunc osiSockAddr epicsShareAPI osiLocalAddr (SOCKET socket);
 
+/*
+ * Batched datagram I/O
+ *
+ * Where the OS provides recvmmsg() and sendmmsg() a whole batch of
+ * datagrams is moved with one system call, otherwise each datagram
+ * takes its own recvfrom() or sendto() call.
+ */
+typedef struct osiSockDatagram {
+    void        *pBuf;      /* payload */
+    unsigned    bufSize;    /* recv: size of pBuf, send: bytes to send */
+    unsigned    nBytes;     /* recv: bytes received */
+    int         truncated;  /* recv: datagram did not fit in pBuf */
+    osiSockAddr addr;       /* recv: source, send: destination */
+} osiSockDatagram;
+
+/*
+ * epicsSocketRecvDatagrams ()
+ * Blocks until at least one datagram arrives, then also takes any others
+ * already waiting, up to count.  Returns the number of datagrams received,
+ * or -1 with SOCKERRNO set if none could be received.
+ */
+epicsShareFunc int epicsShareAPI epicsSocketRecvDatagrams (
+    SOCKET sock, osiSockDatagram *pDatagrams, unsigned count );
+
+/*
+ * epicsSocketSendDatagrams ()
+ * Sends the datagrams in order, stopping at the first one which fails.
+ * Returns the number sent, or -1 with SOCKERRNO set if the first one
+ * could not be sent.
+ */
+epicsShareFunc int epicsShareAPI epicsSocketSendDatagrams (
+    SOCKET sock, const osiSockDatagram *pDatagrams, unsigned count );
+
 #ifdef __cplusplus
 }
 #endif
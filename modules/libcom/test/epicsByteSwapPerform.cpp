@@ -0,0 +1,126 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*
+ * Throughput of the bulk byte order conversions used for the arrays
+ * of the CA protocol, compared with converting one element at a time
+ * the way the CA client and server used to.
+ */
+
+#include <cstring>
+#include <cstdio>
+
+#include "epicsByteSwap.h"
+#include "epicsTime.h"
+#include "epicsTypes.h"
+#include "osiWireFormat.h"
+#include "testMain.h"
+
+static const unsigned totalBytes = 64u * 1024u * 1024u;
+static const unsigned maxBytes = 1024u * 1024u;
+
+class PerfType {
+public:
+    PerfType ( const char * dbrName ) : dbrName ( dbrName ) {}
+    virtual ~PerfType () {}
+    virtual unsigned size () const = 0;
+    virtual void elementwise ( epicsUInt8 * pDst, const void * pSrc,
+        unsigned count ) const = 0;
+    virtual void bulk ( epicsUInt8 * pDst, const void * pSrc,
+        unsigned count ) const = 0;
+    const char * const dbrName;
+};
+
+template < class T >
+class PerfNetType : public PerfType {
+public:
+    typedef void ( * bulkFunc ) ( void *, const void *, size_t );
+    PerfNetType ( const char * dbrName, bulkFunc pBulk ) :
+        PerfType ( dbrName ), pBulk ( pBulk ) {}
+    unsigned size () const { return sizeof ( T ); }
+    void elementwise ( epicsUInt8 * pDst, const void * pSrc,
+        unsigned count ) const
+    {
+        const T * pValue = static_cast < const T * > ( pSrc );
+        for ( unsigned i = 0u; i < count; i++ ) {
+            WireSet ( pValue[i], pDst );
+            pDst += sizeof ( T );
+        }
+    }
+    void bulk ( epicsUInt8 * pDst, const void * pSrc, unsigned count ) const
+    {
+        ( *pBulk ) ( pDst, pSrc, count );
+    }
+private:
+    bulkFunc pBulk;
+};
+
+enum method { copy, elementwise, bulk };
+
+static double measure ( const PerfType & type, method m, unsigned nBytes,
+    const epicsUInt8 * pSrc, epicsUInt8 * pDst )
+{
+    unsigned count = nBytes / type.size ();
+    unsigned nIterations = totalBytes / nBytes;
+
+    epicsTime beg = epicsTime :: getCurrent ();
+    for ( unsigned i = 0u; i < nIterations; i++ ) {
+        switch ( m ) {
+        case copy:
+            memcpy ( pDst, pSrc, nBytes );
+            break;
+        case elementwise:
+            type.elementwise ( pDst, pSrc, count );
+            break;
+        case bulk:
+            type.bulk ( pDst, pSrc, count );
+            break;
+        }
+    }
+    epicsTime end = epicsTime :: getCurrent ();
+
+    double elapsed = end - beg;
+    if ( elapsed <= 0.0 )
+        return 0.0;
+    return 1e-9 * nIterations * nBytes / elapsed;
+}
+
+MAIN(epicsByteSwapPerform)
+{
+    static const unsigned sizes[] = { 64u, 1024u, 16u * 1024u, maxBytes };
+    PerfNetType < epicsInt16 > shortType ( "DBR_SHORT", epicsNetOrder16 );
+    PerfNetType < epicsUInt16 > enumType ( "DBR_ENUM", epicsNetOrder16 );
+    PerfNetType < epicsInt32 > longType ( "DBR_LONG", epicsNetOrder32 );
+    PerfNetType < epicsFloat32 > floatType ( "DBR_FLOAT", epicsNetOrder32 );
+    PerfNetType < epicsFloat64 > doubleType ( "DBR_DOUBLE",
+        epicsNetOrderFloat64 );
+    const PerfType * types[] = {
+        &shortType, &enumType, &longType, &floatType, &doubleType };
+
+    // doubles keep the source of every type aligned
+    epicsFloat64 * pSrcBuf = new epicsFloat64 [ maxBytes / 8u ];
+    epicsFloat64 * pDstBuf = new epicsFloat64 [ maxBytes / 8u ];
+    epicsUInt8 * pSrc = reinterpret_cast < epicsUInt8 * > ( pSrcBuf );
+    epicsUInt8 * pDst = reinterpret_cast < epicsUInt8 * > ( pDstBuf );
+    for ( unsigned i = 0u; i < maxBytes; i++ )
+        pSrc[i] = static_cast < epicsUInt8 > ( i * 13u );
+
+    printf ( "Host to network conversion throughput in GB/s, "
+        "%u MB per measurement\n", totalBytes / ( 1024u * 1024u ) );
+    for ( unsigned j = 0u; j < sizeof ( sizes ) / sizeof ( sizes[0] ); j++ ) {
+        printf ( "\n%u byte arrays\n%-12s %12s %12s %12s\n", sizes[j],
+            "type", "memcpy", "per element", "bulk" );
+        for ( unsigned k = 0u; k < sizeof ( types ) / sizeof ( types[0] ); k++ ) {
+            const PerfType & type = *types[k];
+            printf ( "%-12s %12.2f %12.2f %12.2f\n", type.dbrName,
+                measure ( type, copy, sizes[j], pSrc, pDst ),
+                measure ( type, elementwise, sizes[j], pSrc, pDst ),
+                measure ( type, bulk, sizes[j], pSrc, pDst ) );
+        }
+    }
+
+    delete [] pSrcBuf;
+    delete [] pDstBuf;
+    return 0;
+}
@@ -0,0 +1,116 @@
+/*************************************************************************\
+* EPICS BASE is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*
+ * Tests of the bulk byte order conversions
+ */
+
+#include <string.h>
+
+#include "epicsByteSwap.h"
+#include "epicsTypes.h"
+#include "epicsUnitTest.h"
+#include "testMain.h"
+
+#define MAX_BYTES 1100u
+
+typedef void swapFunc ( void *pDst, const void *pSrc, size_t count );
+
+static epicsUInt8 src[MAX_BYTES + 8], dst[MAX_BYTES + 8], ref[MAX_BYTES + 8];
+
+static void fill ( epicsUInt8 *pBuf, size_t nBytes, unsigned seed )
+{
+    size_t i;
+
+    for ( i = 0u; i < nBytes; i++ )
+        pBuf[i] = (epicsUInt8) ( seed + i * 7u + ( i >> 8 ) );
+}
+
+/*
+ * check every length up to MAX_BYTES / size elements at every
+ * misalignment, copying and in place
+ */
+static void testSwap ( const char *name, swapFunc *pFunc, unsigned size )
+{
+    unsigned offset, nBad = 0u, nBadInPlace = 0u;
+    size_t count;
+
+    for ( offset = 0u; offset < 8u; offset++ ) {
+        for ( count = 0u; count * size <= MAX_BYTES - 8u; count++ ) {
+            size_t nBytes = count * size, i;
+            unsigned j;
+
+            fill ( src, sizeof ( src ), offset + (unsigned) count );
+            memset ( dst, 0xa5, sizeof ( dst ) );
+            memcpy ( ref, dst, sizeof ( ref ) );
+            for ( i = 0u; i < count; i++ ) {
+                for ( j = 0u; j < size; j++ )
+                    ref[offset + i * size + j] =
+                        src[offset + i * size + size - 1u - j];
+            }
+
+            ( *pFunc ) ( dst + offset, src + offset, count );
+            if ( memcmp ( dst, ref, sizeof ( dst ) ) != 0 )
+                nBad++;
+
+            memcpy ( dst, src, sizeof ( dst ) );
+            memcpy ( ref, src, offset );
+            memcpy ( ref + offset + nBytes, src + offset + nBytes,
+                sizeof ( ref ) - offset - nBytes );
+            ( *pFunc ) ( dst + offset, dst + offset, count );
+            if ( memcmp ( dst, ref, sizeof ( dst ) ) != 0 )
+                nBadInPlace++;
+        }
+    }
+    testOk ( nBad == 0u, "%s copies, %u failures", name, nBad );
+    testOk ( nBadInPlace == 0u, "%s in place, %u failures",
+        name, nBadInPlace );
+}
+
+static void testNetOrder ( void )
+{
+    static const epicsUInt8 net16[] = { 0x12, 0x34, 0xfe, 0xdc };
+    static const epicsUInt8 net32[] = { 0x12, 0x34, 0x56, 0x78 };
+    static const epicsUInt8 net64[] = {
+        0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef };
+    static const epicsUInt8 netDbl[] = {
+        0xc0, 0x09, 0x21, 0xfb, 0x54, 0x44, 0x2d, 0x18 };
+    epicsUInt16 h16[2] = { 0x1234u, 0xfedcu };
+    epicsUInt32 h32 = 0x12345678u;
+    epicsUInt64 h64 = 0x0123456789abcdefull;
+    epicsFloat64 dbl = -3.141592653589793;
+    epicsUInt8 buf[16];
+
+    epicsNetOrder16 ( buf, h16, 2u );
+    testOk1 ( memcmp ( buf, net16, sizeof ( net16 ) ) == 0 );
+    epicsNetOrder16 ( buf, buf, 2u );
+    testOk1 ( memcmp ( buf, h16, sizeof ( h16 ) ) == 0 );
+
+    epicsNetOrder32 ( buf, &h32, 1u );
+    testOk1 ( memcmp ( buf, net32, sizeof ( net32 ) ) == 0 );
+    epicsNetOrder32 ( buf, buf, 1u );
+    testOk1 ( memcmp ( buf, &h32, sizeof ( h32 ) ) == 0 );
+
+    epicsNetOrder64 ( buf, &h64, 1u );
+    testOk1 ( memcmp ( buf, net64, sizeof ( net64 ) ) == 0 );
+    epicsNetOrder64 ( buf, buf, 1u );
+    testOk1 ( memcmp ( buf, &h64, sizeof ( h64 ) ) == 0 );
+
+    epicsNetOrderFloat64 ( buf, &dbl, 1u );
+    testOk1 ( memcmp ( buf, netDbl, sizeof ( netDbl ) ) == 0 );
+    epicsNetOrderFloat64 ( buf, buf, 1u );
+    testOk1 ( memcmp ( buf, &dbl, sizeof ( dbl ) ) == 0 );
+}
+
+MAIN(epicsByteSwapTest)
+{
+    testPlan(14);
+
+    testSwap ( "epicsByteSwap16", epicsByteSwap16, 2u );
+    testSwap ( "epicsByteSwap32", epicsByteSwap32, 4u );
+    testSwap ( "epicsByteSwap64", epicsByteSwap64, 8u );
+    testNetOrder ();
+
+    return testDone();
+}
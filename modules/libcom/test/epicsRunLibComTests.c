@@ -20,6 +20,7 @@ int aslibtest(void);
 int blockingSockTest(void);
 int epicsAlgorithm(void);
 int epicsAtomicTest(void);
+int epicsByteSwapTest(void);
 int epicsCalcTest(void);
 int epicsEllTest(void);
 int epicsEnvTest(void);
@@ -78,6 +79,7 @@ void epicsRunLibComTests(void)
     runTest(blockingSockTest);
     runTest(epicsAlgorithm);
     runTest(epicsAtomicTest);
+    runTest(epicsByteSwapTest);
     runTest(epicsCalcTest);
     runTest(epicsEllTest);
     runTest(epicsEnvTest);
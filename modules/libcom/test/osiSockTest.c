@@ -76,16 +76,73 @@ void udpSockTest(void)
     epicsSocketDestroy(s);
 }
 
+#define NDGRAMS 5
+
+void udpBatchTest(void)
+{
+    SOCKET tx, rx;
+    osiSockAddr addr;
+    osiSocklen_t len = sizeof(addr);
+    osiSockDatagram out[NDGRAMS], in[NDGRAMS + 3];
+    char outBuf[NDGRAMS][16], inBuf[NDGRAMS + 3][16];
+    int i, n, status, nrecv = 0, inOrder = 1;
+
+    tx = epicsSocketCreate(AF_INET, SOCK_DGRAM, 0);
+    rx = epicsSocketCreate(AF_INET, SOCK_DGRAM, 0);
+    testOk(tx != INVALID_SOCKET && rx != INVALID_SOCKET,
+        "created datagram sockets");
+
+    memset(&addr, 0, sizeof(addr));
+    addr.ia.sin_family = AF_INET;
+    addr.ia.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.ia.sin_port = 0;
+    status = bind(rx, &addr.sa, sizeof(addr));
+    if (status == 0)
+        status = getsockname(rx, &addr.sa, &len);
+    testOk(status == 0,
+        "bound receiver to loopback port %u", ntohs(addr.ia.sin_port));
+
+    for (i = 0; i < NDGRAMS; i++) {
+        out[i].pBuf = outBuf[i];
+        out[i].bufSize = sprintf(outBuf[i], "datagram %d", i) + 1;
+        out[i].addr = addr;
+    }
+    n = epicsSocketSendDatagrams(tx, out, NDGRAMS);
+    testOk(n == NDGRAMS, "sent %d of %d datagrams", n, NDGRAMS);
+
+    while (nrecv < NDGRAMS) {
+        for (i = 0; i < NDGRAMS + 3; i++) {
+            in[i].pBuf = inBuf[i];
+            in[i].bufSize = sizeof(inBuf[i]);
+        }
+        n = epicsSocketRecvDatagrams(rx, in, NDGRAMS + 3);
+        if (n <= 0)
+            break;
+        for (i = 0; i < n; i++, nrecv++) {
+            if (nrecv >= NDGRAMS || in[i].truncated ||
+                    in[i].nBytes != out[nrecv].bufSize ||
+                    strcmp(inBuf[i], outBuf[nrecv]) != 0)
+                inOrder = 0;
+        }
+        testDiag("received %d datagrams in one call", n);
+    }
+    testOk(nrecv == NDGRAMS, "received %d of %d datagrams", nrecv, NDGRAMS);
+    testOk(inOrder, "datagrams received intact and in order");
+
+    epicsSocketDestroy(tx);
+    epicsSocketDestroy(rx);
+}
 
 MAIN(osiSockTest)
 {
     int status;
-    testPlan(14);
+    testPlan(19);
 
     status = osiSockAttach();
     testOk(status, "osiSockAttach");
 
     udpSockTest();
+    udpBatchTest();
 
     osiSockRelease();
     return testDone();